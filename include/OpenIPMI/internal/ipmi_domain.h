@@ -53,6 +53,9 @@ os_handler_t *ipmi_domain_get_os_hnd(ipmi_domain_t *domain);
 /* Return the entity info for the given domain. */
 ipmi_entity_info_t *ipmi_domain_get_entities(ipmi_domain_t *domain);
 
+/* Return the lock shared by the lightweight op queues in the domain. */
+opq_sched_t *i_ipmi_domain_get_opq_sched(ipmi_domain_t *domain);
+
 /* Should the BMC do a full bus scan at startup?  This is so OEM
    code can turn this function off.  The value is a boolean. */
 int ipmi_domain_set_full_bus_scan(ipmi_domain_t *domain, int val);
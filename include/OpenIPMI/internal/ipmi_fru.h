@@ -161,7 +161,9 @@ void i_ipmi_fru_ref_nolock(ipmi_fru_t *fru);
  *
  * You can also override the function that sends the write message.
  * this function will get the data as formatted for a normal FRU
- * write.
+ * write.  It will only be given one write at a time, of at most 16
+ * bytes of data, and a successful completion is taken to mean all
+ * the data was written.
  */
 typedef void (*i_ipmi_fru_timestamp_cb)(ipmi_fru_t    *fru,
 					ipmi_domain_t *domain,
@@ -437,6 +437,7 @@ typedef struct ipmi_sensor_op_info_s
     ipmi_sensor_rsp_cb __rsp_handler;
     ipmi_msg_t         *__rsp;
     int                __err;
+    opq_lite_op_t      __opq_op;
 } ipmi_sensor_op_info_t;
 
 /* Add an operation to the sensor operation queue.  If nothing is in
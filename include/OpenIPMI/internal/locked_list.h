@@ -82,6 +82,16 @@ locked_list_t *locked_list_alloc(os_handler_t *os_hnd);
 IPMI_UTILS_DLL_PUBLIC
 void locked_list_destroy(locked_list_t *ll);
 
+/* Allocate a list for things that are iterated much more often than
+   they change, like handler lists.  Every add and remove makes a new
+   copy of the list, and locked_list_iterate() walks the current copy
+   without taking the lock.  A handler removed while an iteration is
+   in progress will not be called after the removal, but the removal
+   does not wait for iterations to finish.  Iterations with a prefunc
+   and the nolock calls still work as before. */
+IPMI_UTILS_DLL_PUBLIC
+locked_list_t *locked_list_alloc_snapshot(os_handler_t *os_hnd);
+
 /* Add an item to the locked list.  If the item is a duplicate, this
    operation will be ignored but a value of "2" will be returned.  It
    returns true if successful or false if memory could not be
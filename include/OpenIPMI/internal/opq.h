@@ -112,4 +112,55 @@ void opq_op_done(opq_t *opq);
 /* Returns true if the queue has current working stuff, false if not. */
 int opq_stuff_in_progress(opq_t *opq);
 
+/*
+ * Lightweight operation queues.  These are for objects that there
+ * are a lot of (like sensors) that need their operations serialized
+ * but are idle most of the time.  A full opq_t has its own lock and
+ * list and allocates an element for each operation.  Instead, the
+ * opq_lite_t is embedded in the object, all the queues in a domain
+ * share the lock in an opq_sched_t, and the caller provides the
+ * opq_lite_op_t (generally embedded in its operation data) that is
+ * used to link the operation into the queue.  So queuing an
+ * operation never allocates and cannot fail.
+ *
+ * Only the basic operations are supported, there are no done
+ * handlers, blocks, or priorities.  The handler semantics are the
+ * same as for opq_new_op().  The opq_lite_op_t must stay valid until
+ * its handler is called.
+ */
+typedef struct opq_sched_s opq_sched_t;
+
+typedef struct opq_lite_op_s
+{
+    opq_handler_cb       handler;
+    void                 *cb_data;
+    struct opq_lite_op_s *next;
+} opq_lite_op_t;
+
+typedef struct opq_lite_s
+{
+    opq_lite_op_t *head;
+    opq_lite_op_t *tail;
+    int           in_handler;
+} opq_lite_t;
+
+opq_sched_t *opq_sched_alloc(os_handler_t *os_hnd);
+void opq_sched_destroy(opq_sched_t *sched);
+
+void opq_lite_init(opq_lite_t *q);
+
+/* Call the handlers for everything still queued with shutdown set.
+   The queue may be reused after this. */
+void opq_lite_destroy(opq_sched_t *sched, opq_lite_t *q);
+
+void opq_lite_new_op(opq_sched_t    *sched,
+		     opq_lite_t     *q,
+		     opq_lite_op_t  *op,
+		     opq_handler_cb handler,
+		     void           *cb_data);
+
+void opq_lite_op_done(opq_sched_t *sched, opq_lite_t *q);
+
+int opq_lite_stuff_in_progress(opq_lite_t *q);
+
 #endif /* OPENIPMI_OPQ_H */
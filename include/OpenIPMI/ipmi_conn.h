@@ -521,6 +521,14 @@ IPMI_DLL_PUBLIC
 void *ipmi_alloc_msg_item_data(unsigned int size);
 IPMI_DLL_PUBLIC
 void ipmi_free_msg_item_data(void *data);
+/* Message items and data buffers are reused from a free list when
+   possible.  Get the number of allocations that were satisfied from
+   the free lists (hits) and the ones that had to allocate (misses). */
+IPMI_DLL_PUBLIC
+void ipmi_get_msg_pool_stats(unsigned long *item_hits,
+			     unsigned long *item_misses,
+			     unsigned long *data_hits,
+			     unsigned long *data_misses);
 /* Move the data from the old message item to the new one, NULL-ing
    out the old item's data.  This will free the new_item's original
    data if necessary.  This will *not* copy the data items, just the
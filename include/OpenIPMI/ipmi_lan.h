@@ -177,8 +177,10 @@ int ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
 /* Allow the maximum outstanding message count to be set.  Normally
    this is 2, but 2 may even be too much for some systems.  A larger
    number may improve performance for systems that can handle it.  The
-   maximum value is 63, but that's way bigger than anyone should need.
-   5-6 should be enough for anything.  The value is set in parm_val */
+   maximum value is 252.  Above 63, messages to the BMC are spread
+   over several sequence spaces (see IPMI_LAN_MAX_SEQ_SPACES below),
+   which the BMC must be able to handle.  The value is set in
+   parm_val */
 #define IPMI_LANP_MAX_OUTSTANDING_MSG_COUNT	12
 
 /* Address family, integer value, generally AF_INET or AF_INET6.  If
@@ -275,6 +277,19 @@ int ipmi_lan_handle_external_event(const struct sockaddr *src_addr,
 
 #define IPMI_RMCPP_ADDR_SOL (IPMI_RMCPP_ADDR_START + IPMI_RMCPP_PAYLOAD_TYPE_SOL)
 
+/* An IPMI message only has 6 bits of sequence number, so only 64
+   messages can be outstanding at a time.  To get more than that, the
+   LAN code also varies the remote console software ID (0x81, 0x83,
+   ...) the messages are sent from.  To the BMC each software ID is a
+   separate requester with its own sequence space.  This is only done
+   for messages sent directly to the BMC with the IPMI payload; for
+   those, the upper two bits of the sequence number passed to the
+   payload hold the sequence space. */
+#define IPMI_LAN_MAX_SEQ_SPACES		4
+#define IPMI_LAN_SEQ_SPACE(seq)		(((seq) >> 6) & 0x3)
+#define IPMI_LAN_SEQ_NUM(seq)		((seq) & 0x3f)
+#define IPMI_LAN_SEQ_SWID(space)	(0x81 + ((space) << 1))
+
 typedef struct ipmi_payload_s
 {
     /* Format a message for transmit on this payload.  The address and
@@ -282,8 +297,9 @@ typedef struct ipmi_payload_s
        pointer to where to store the output, out_data_len will point
        to the length of the buffer to store the output and should be
        updatated to be the actual length.  The seq is a 6-bit value
-       that should be store somewhere so the that response to this
-       message can be identified.  If the netfn is odd, the sequence
+       (8 bits for the IPMI payload, see above) that should be store
+       somewhere so the that response to this message can be
+       identified.  If the netfn is odd, the sequence
        number is not used.  The out_of_session variable is set to zero
        by default; if the message is meant to be sent out of session,
        then the formatter should set this value to 1. */
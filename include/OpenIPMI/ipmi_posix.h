@@ -53,6 +53,10 @@ extern "C" {
 /* Allocate and configure an OS handler. */
 SEL_DLL_PUBLIC
 os_handler_t *ipmi_posix_setup_os_handler(void);
+/* Like the above, but pass the SEL_OPT_xxx options in sel_opts to
+   the selector allocation. */
+SEL_DLL_PUBLIC
+os_handler_t *ipmi_posix_setup_os_handler_opts(unsigned int sel_opts);
 /* Gets the selector associated with the OS handler. */
 SEL_DLL_PUBLIC
 struct selector_s *ipmi_posix_os_handler_get_sel(os_handler_t *os_hnd);
@@ -100,10 +104,36 @@ void ipmi_posix_os_handler_set_sel(os_handler_t *os_hnd,
    it. */
 SEL_DLL_PUBLIC
 os_handler_t *ipmi_posix_thread_setup_os_handler(int wake_sig);
+/* Like the above, but pass the SEL_OPT_xxx options in sel_opts to
+   the selector allocation.  Shards get the same options. */
+SEL_DLL_PUBLIC
+os_handler_t *ipmi_posix_thread_setup_os_handler_opts(int wake_sig,
+						      unsigned int sel_opts);
 /* Gets the selector associated with the OS handler. */
 SEL_DLL_PUBLIC
 struct selector_s *ipmi_posix_thread_os_handler_get_sel(os_handler_t *os_hnd);
 
+/* Like ipmi_posix_thread_setup_os_handler(), but also create
+   num_shards more OS handlers, each with its own selector run by its
+   own worker thread (kept on one CPU where possible).  Use a shard's
+   OS handler when setting up a connection and the timers and file
+   descriptors of that connection and its domain stay on that shard.
+   The shards share the logging and database of the returned OS
+   handler and are freed with it; do not free them yourself. */
+SEL_DLL_PUBLIC
+os_handler_t *ipmi_posix_thread_setup_os_handler_sharded(int wake_sig,
+						unsigned int num_shards);
+SEL_DLL_PUBLIC
+unsigned int ipmi_posix_thread_os_handler_num_shards(os_handler_t *os_hnd);
+/* Returns NULL if num is out of range. */
+SEL_DLL_PUBLIC
+os_handler_t *ipmi_posix_thread_os_handler_get_shard(os_handler_t *os_hnd,
+						     unsigned int num);
+/* Hand out the shards round-robin.  Returns os_hnd if it has no
+   shards. */
+SEL_DLL_PUBLIC
+os_handler_t *ipmi_posix_thread_os_handler_next_shard(os_handler_t *os_hnd);
+
 /**********************************************************************
  * Special code, like the previous non-threaded ones.  Only needed
  * if you have special selector needs.  Don't use
@@ -101,6 +101,12 @@ typedef struct os_hnd_timer_id_s os_hnd_timer_id_t;
 typedef void (*os_data_ready_t)(int fd, void *cb_data, os_hnd_fd_id_t *id);
 typedef void (*os_timed_out_t)(void *cb_data, os_hnd_timer_id_t *id);
 
+/* Called with each datagram received by add_dgram_fd_to_wait_for.
+   The data and address are only good until this returns. */
+typedef void (*os_dgram_ready_t)(int fd, void *cb_data, os_hnd_fd_id_t *id,
+				 unsigned char *data, unsigned int len,
+				 void *addr, unsigned int addr_len);
+
 /* This can be registered with add_fd_to_wait_for, it will be called
    if the fd handler is freed or replaced.  This can be used to avoid
    free race conditions, handlers may be in callbacks when you remove
@@ -348,6 +354,42 @@ struct os_handler_s
 
     int (*get_monotonic_time)(os_handler_t *handler, struct timeval *tv);
     int (*get_real_time)(os_handler_t *handler, struct timeval *tv);
+
+    /* Mappable database entries.  These are like database_store and
+       database_find, but the data is kept so that database_map can
+       map it read-only straight into memory, and the same copy can be
+       shared by every process on the machine.  database_map_store
+       must replace an entry atomically, anyone with the old entry
+       mapped keeps the old data.  database_map returns the data and a
+       map id to pass to database_unmap when done with it.  The
+       mapped data must not be modified.  These are optional, and
+       like the other database routines, failures are not fatal to
+       OpenIPMI. */
+    int (*database_map_store)(os_handler_t  *handler,
+			      char          *key,
+			      unsigned char *data,
+			      unsigned int  data_len);
+    int (*database_map)(os_handler_t        *handler,
+			char                *key,
+			const unsigned char **data,
+			unsigned int        *data_len,
+			void                **map_id);
+    void (*database_unmap)(os_handler_t *handler,
+			   void         *map_id);
+
+    /* Like add_fd_to_wait_for, but for a datagram socket.  The OS
+       handler receives the datagrams itself and calls dgram_ready
+       with each one, which can be a lot cheaper than a wakeup and a
+       read per datagram.  The fd is removed with
+       remove_fd_to_wait_for.  This is optional, if it is NULL or
+       returns ENOSYS, use add_fd_to_wait_for and read the socket in
+       data_ready. */
+    int (*add_dgram_fd_to_wait_for)(os_handler_t       *handler,
+				    int                fd,
+				    os_dgram_ready_t   dgram_ready,
+				    void               *cb_data,
+				    os_fd_data_freed_t freed,
+				    os_hnd_fd_id_t     **id);
 };
 
 /* Only use these to allocate/free OS handlers. */
@@ -103,12 +103,40 @@ int sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
 			      void (*sel_unlock)(sel_lock_t *),
 			      void *cb_data);
 
+/*
+ * Like sel_alloc_selector_thread(), but with options.  With
+ * SEL_OPT_TIMER_WHEEL, timers expiring within about 10 seconds are
+ * kept in a timing wheel instead of the heap, making starting and
+ * stopping them O(1).  Useful with a very large number of short
+ * timers.
+ */
+#define SEL_OPT_TIMER_WHEEL	(1 << 0)
+/*
+ * Use io_uring instead of epoll to wait for file descriptors, if the
+ * kernel supports it.  If it does not, epoll is used as usual.  See
+ * sel_set_fd_dgram_handler() for what this buys datagram sockets.
+ */
+#define SEL_OPT_IO_URING	(1 << 1)
+SEL_DLL_PUBLIC
+int sel_alloc_selector_thread_opts(struct selector_s **new_selector,
+				   int wake_sig,
+				   sel_lock_t *(*sel_lock_alloc)(void *cb_data),
+				   void (*sel_lock_free)(sel_lock_t *),
+				   void (*sel_lock)(sel_lock_t *),
+				   void (*sel_unlock)(sel_lock_t *),
+				   void *cb_data,
+				   unsigned int opts);
+
   /* Create a selector for use in a single-threaded environment.  No
      need for locks or wakeups.  This just call the above call with
      NULL for all the values. */
 SEL_DLL_PUBLIC
 int sel_alloc_selector_nothread(struct selector_s **new_selector);
 
+/* Returns true if the selector is waiting on an io_uring. */
+SEL_DLL_PUBLIC
+int sel_uses_io_uring(struct selector_s *sel);
+
 /* Used to destroy a selector. */
 SEL_DLL_PUBLIC
 int sel_free_selector(struct selector_s *new_selector);
@@ -157,6 +185,31 @@ void sel_set_fd_write_handler(struct selector_s *sel, int fd, int state);
 SEL_DLL_PUBLIC
 void sel_set_fd_except_handler(struct selector_s *sel, int fd, int state);
 
+/*
+ * Have the selector receive the datagrams on a datagram socket and
+ * pass each one to the handler, instead of calling the read handler.
+ * The data and address are only good until the handler returns.
+ * Datagrams larger than SEL_DGRAM_MAX_LEN are truncated.  The fd must
+ * already have handlers set, and reading is enabled and disabled
+ * with sel_set_fd_read_handler() as usual.  Setting the handlers
+ * again with sel_set_fd_handlers() removes the datagram handler.
+ *
+ * This is only available on a selector using io_uring, where the
+ * socket gets a multishot receive into buffers registered with the
+ * kernel, so no system call is made per datagram.  Otherwise ENOSYS
+ * is returned and you should read the socket in the read handler.
+ * Datagrams received but not yet handled when reading is disabled
+ * are dropped.
+ */
+#define SEL_DGRAM_MAX_LEN	2048
+typedef void (*sel_dgram_handler_t)(int fd, void *data,
+				    unsigned char *buf, unsigned int len,
+				    void *addr, unsigned int addr_len);
+SEL_DLL_PUBLIC
+int sel_set_fd_dgram_handler(struct selector_s   *sel,
+			     int                 fd,
+			     sel_dgram_handler_t handler);
+
 struct sel_timer_s;
 typedef struct sel_timer_s sel_timer_t;
 
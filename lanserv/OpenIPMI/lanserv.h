@@ -77,10 +77,10 @@ extern "C" {
 #endif
 
 /*
- * Restrictions: <=64 sessions
+ * Restrictions: <=65535 sessions per channel
  */
-#define SESSION_BITS_REQ	6 /* Bits required to hold a session. */
-#define SESSION_MASK		0x3f
+#define SESSION_BITS_REQ	16 /* Bits required to hold a session. */
+#define SESSION_MASK		0xffff
 
 typedef struct lmc_data_s lmc_data_t;
 typedef struct ipmi_sol_s ipmi_sol_t;
@@ -141,6 +141,11 @@ typedef struct auth_data_s
     unsigned int  ckey_len;
     void          *cdata;
     const void    *ckey;
+
+    /* Keyed OpenSSL contexts, kept for the life of the session. */
+    void          *ictx;
+    void          *enc_ctx;
+    void          *dec_ctx;
 } auth_data_t;
 
 #define LANSERV_NUM_CLOSERS 3
@@ -159,6 +164,11 @@ struct session_s
 
     int           handle; /* My index in the table. */
 
+    /* Link in the free list, and in the remote address hash. */
+    session_t     *next_free;
+    session_t     *addr_next;
+    unsigned int  addr_hashed : 1;
+
     uint32_t        recv_seq;
     uint32_t        xmit_seq;
     uint32_t        sid;
@@ -300,8 +310,12 @@ struct channel_s
     unsigned int privilege_limit : 4;
     unsigned int privilege_limit_nonv : 4;
 
+    /*
+     * The IPMI commands report at most 63 sessions, that's the
+     * default limit.  LAN channels may be configured for more.
+     */
 #define MAX_SESSIONS 63
-    unsigned int active_sessions : 6;
+    unsigned int active_sessions;
 
     struct {
 	unsigned char allowed_auths;
@@ -444,9 +458,21 @@ struct lanserv_data_s
 
     /* Don't fill in the below in the user code. */
 
-    /* session 0 is not used. */
-    session_t sessions[MAX_SESSIONS+1];
-    unsigned int last_session; /* Last session picked, round robin them. */
+    /*
+     * The session table, indexed by the session handle (which is
+     * also in the session ID).  Session 0 is not used.  The table
+     * grows on demand up to max_sessions, closed sessions go on the
+     * free list and are reused in the order they were closed.
+     */
+    unsigned int max_sessions;
+    session_t **sessions;
+    unsigned int num_sessions;
+    session_t *free_head;
+    session_t *free_tail;
+
+    /* RMCP+ sessions hashed by remote address and remote session ID. */
+    session_t **addr_hash;
+    unsigned int addr_hash_size;
 
     /* Used to make the sid somewhat unique. */
     uint32_t sid_seq;
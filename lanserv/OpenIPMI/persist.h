@@ -107,6 +107,23 @@ int iterate_persist(persist_t *p,
 		    int (*int_func)(const char *name,
 				    long val, void *cb_data));
 
+/*
+ * Journals let small changes be recorded without rewriting the whole
+ * persist.  append_persist() appends the items in the persist, in the
+ * order they were added, to the journal for the persist's name.
+ * read_persist_journal() reads the journal back with iterate_persist()
+ * returning the items in the order they were appended.  When the full
+ * persist is rewritten, the journal should be removed with
+ * remove_persist_journal().  Since a crash between the two may leave
+ * an old journal around, replaying the journal must be idempotent.
+ */
+IPMI_LANSERV_DLL_PUBLIC
+int append_persist(persist_t *p);
+IPMI_LANSERV_DLL_PUBLIC
+persist_t *read_persist_journal(struct sys_data_s *sys, const char *name, ...);
+IPMI_LANSERV_DLL_PUBLIC
+int remove_persist_journal(persist_t *p);
+
 /* Free the values return by read_persist_data() and read_persist_str() */
 IPMI_LANSERV_DLL_PUBLIC
 void free_persist_data(persist_t *p, void *data);
@@ -192,6 +192,9 @@ struct sys_data_s {
     void (*set_chassis_control_prog)(struct lmc_data_s *mc, const char *prog);
 
     void (*register_tick_handler)(struct ipmi_tick_handler_s *handler);
+
+    /* The persistence namespace ("app/instance"), set by persist_init(). */
+    char *persist_app;
 };
 
 char *sys_strdup(struct sys_data_s *sys, const char *s);
@@ -106,16 +106,16 @@ handle_group_extension_netfn(lmc_data_t    *mc,
 	handle_invalid_cmd(mc, rdata, rdata_len);
 }
 
-static struct iana_handler_elem {
+struct iana_handler_elem {
     uint32_t iana;
     cmd_handler_f handler;
     void *cb_data;
     struct iana_handler_elem *next;
-} *iana_handlers;
+};
 
-static struct iana_handler_elem *find_iana(uint32_t iana)
+static struct iana_handler_elem *find_iana(emu_data_t *emu, uint32_t iana)
 {
-    struct iana_handler_elem *p = iana_handlers;
+    struct iana_handler_elem *p = emu->iana_handlers;
 
     while (p) {
 	if (p->iana == iana)
@@ -134,7 +134,7 @@ ipmi_emu_register_iana_handler(emu_data_t *emu,
 
     if (iana > 0xffffff)
 	return EINVAL;
-    if (find_iana(iana))
+    if (find_iana(emu, iana))
 	return EAGAIN;
     p = emu->sys->alloc(emu->sys, sizeof(*p));
     if (!p)
@@ -142,8 +142,8 @@ ipmi_emu_register_iana_handler(emu_data_t *emu,
     p->iana = iana;
     p->handler = handler;
     p->cb_data = cb_data;
-    p->next = iana_handlers;
-    iana_handlers = p;
+    p->next = emu->iana_handlers;
+    emu->iana_handlers = p;
     return 0;
 }
 
@@ -160,7 +160,7 @@ handle_iana_netfn(lmc_data_t    *mc,
 	return;
 
     msg->iana = msg->data[0] | (msg->data[1] << 8) | (msg->data[2] << 16);
-    p = find_iana(msg->iana);
+    p = find_iana(mc->emu, msg->iana);
     if (!p) {
 	handle_invalid_cmd(mc, rdata, rdata_len);
 	goto out;
@@ -181,16 +181,16 @@ handle_iana_netfn(lmc_data_t    *mc,
     *rdata_len += 3;
 }
 
-static struct oi_iana_cmd_elem {
+struct oi_iana_cmd_elem {
     uint8_t cmd;
     cmd_handler_f handler;
     void *cb_data;
     struct oi_iana_cmd_elem *next;
-} *oi_iana_cmds;
+};
 
-static struct oi_iana_cmd_elem *find_oi_iana(uint8_t cmd)
+static struct oi_iana_cmd_elem *find_oi_iana(emu_data_t *emu, uint8_t cmd)
 {
-    struct oi_iana_cmd_elem *p = oi_iana_cmds;
+    struct oi_iana_cmd_elem *p = emu->oi_iana_cmds;
 
     while (p) {
 	if (p->cmd == cmd)
@@ -208,7 +208,7 @@ static void handle_oi_iana_cmd(lmc_data_t    *mc,
 {
     struct oi_iana_cmd_elem *p;
 
-    p = find_oi_iana(msg->cmd);
+    p = find_oi_iana(mc->emu, msg->cmd);
     if (!p) {
 	handle_invalid_cmd(mc, rdata, rdata_len);
 	return;
@@ -225,7 +225,7 @@ ipmi_emu_register_oi_iana_handler(emu_data_t *emu,
     struct oi_iana_cmd_elem *p;
     int rv;
 
-    if (find_oi_iana(cmd))
+    if (find_oi_iana(emu, cmd))
 	return EAGAIN;
     rv = ipmi_emu_register_iana_handler(emu, OPENIPMI_IANA, handle_oi_iana_cmd,
 					NULL);
@@ -237,8 +237,8 @@ ipmi_emu_register_oi_iana_handler(emu_data_t *emu,
     p->cmd = cmd;
     p->handler = handler;
     p->cb_data = cb_data;
-    p->next = oi_iana_cmds;
-    oi_iana_cmds = p;
+    p->next = emu->oi_iana_cmds;
+    emu->oi_iana_cmds = p;
     return 0;
 }
 
@@ -248,15 +248,8 @@ check_chassis_capable(lmc_data_t *mc)
     return (mc->device_support & IPMI_DEVID_CHASSIS_DEVICE);
 }
 
-typedef struct netfn_handler_s {
-    cmd_handler_f *handlers;
-    void          **cb_data;
-    cmd_handler_f main_handler;
-    void          *main_handler_cb_data;
-    int (*check_capable)(lmc_data_t *mc);
-} netfn_handler_t;
-
-static netfn_handler_t netfn_handlers[32] = {
+/* The built-in handlers, each emulator starts with a copy of this. */
+static const netfn_handler_t default_netfn_handlers[32] = {
     [IPMI_APP_NETFN >> 1] = { .handlers = app_netfn_handlers },
     [IPMI_STORAGE_NETFN >> 1] = { .handlers = storage_netfn_handlers },
     [IPMI_CHASSIS_NETFN >> 1] = { .handlers = chassis_netfn_handlers,
@@ -274,25 +267,31 @@ ipmi_emu_register_cmd_handler(emu_data_t *emu,
 			      cmd_handler_f handler, void *cb_data)
 {
     unsigned int ni = netfn >> 1;
+    netfn_handler_t *nh;
+    cmd_handler_f *handlers;
 
     if (ni >= 32)
 	return EINVAL;
+    nh = &emu->netfn_handlers[ni];
 
-    if (!netfn_handlers[ni].handlers) {
-	netfn_handlers[ni].handlers = emu->sys->alloc(emu->sys,
-						256 * sizeof(cmd_handler_f));
-	if (!netfn_handlers[ni].handlers)
+    if (!nh->handlers_copied) {
+	/* The built-in tables are shared, copy before changing them. */
+	handlers = emu->sys->alloc(emu->sys, 256 * sizeof(cmd_handler_f));
+	if (!handlers)
 	    return ENOMEM;
+	if (nh->handlers)
+	    memcpy(handlers, nh->handlers, 256 * sizeof(cmd_handler_f));
+	nh->handlers = handlers;
+	nh->handlers_copied = 1;
     }
-    if (!netfn_handlers[ni].cb_data) {
-	netfn_handlers[ni].cb_data = emu->sys->alloc(emu->sys,
-						256 * sizeof(void *));
-	if (!netfn_handlers[ni].cb_data)
+    if (!nh->cb_data) {
+	nh->cb_data = emu->sys->alloc(emu->sys, 256 * sizeof(void *));
+	if (!nh->cb_data)
 	    return ENOMEM;
     }
 
-    netfn_handlers[ni].cb_data[cmd] = cb_data;
-    netfn_handlers[ni].handlers[cmd] = handler;
+    nh->cb_data[cmd] = cb_data;
+    nh->handlers[cmd] = handler;
     return 0;
 }
 
@@ -371,20 +370,19 @@ static int
 deliver_cmd_to_mc(lmc_data_t *mc, msg_t *msg,
 		  unsigned char *rdata, unsigned int *rdata_len)
 {
+    netfn_handler_t *nh = &mc->emu->netfn_handlers[msg->netfn >> 1];
+
     /* Now handle the message on the destination mc. */
-    if (netfn_handlers[msg->netfn >> 1].check_capable &&
-	!netfn_handlers[msg->netfn >> 1].check_capable(mc))
+    if (nh->check_capable && !nh->check_capable(mc))
 	handle_invalid_cmd(mc, rdata, rdata_len);
-    else if (netfn_handlers[msg->netfn >> 1].main_handler)
-	netfn_handlers[msg->netfn >> 1].main_handler(mc, msg, rdata, rdata_len,
-			 netfn_handlers[msg->netfn >> 1].main_handler_cb_data);
-    else if (netfn_handlers[msg->netfn >> 1].handlers &&
-	     netfn_handlers[msg->netfn >> 1].handlers[msg->cmd]) {
+    else if (nh->main_handler)
+	nh->main_handler(mc, msg, rdata, rdata_len,
+			 nh->main_handler_cb_data);
+    else if (nh->handlers && nh->handlers[msg->cmd]) {
 	void *cb_data = NULL;
-	if (netfn_handlers[msg->netfn >> 1].cb_data)
-	    cb_data = netfn_handlers[msg->netfn >> 1].cb_data[msg->cmd];
-	netfn_handlers[msg->netfn >> 1].handlers[msg->cmd](mc, msg, rdata,
-		 rdata_len, cb_data);
+	if (nh->cb_data)
+	    cb_data = nh->cb_data[msg->cmd];
+	nh->handlers[msg->cmd](mc, msg, rdata, rdata_len, cb_data);
     } else
 	handle_invalid_cmd(mc, rdata, rdata_len);
 
@@ -789,6 +787,8 @@ ipmi_emu_alloc(void *user_data, ipmi_emu_sleep_cb sleeper, sys_data_t *sys)
 	emu->user_data = user_data;
 	emu->sleeper = sleeper;
 	emu->sys = sys;
+	memcpy(emu->netfn_handlers, default_netfn_handlers,
+	       sizeof(emu->netfn_handlers));
     }
 	
     return emu;
@@ -846,6 +846,13 @@ ipmi_mc_destroy(lmc_data_t *mc)
 {
     sel_entry_t *entry, *n_entry;
 
+    /* Any pending compaction is lost, the journal is replayed instead. */
+    if (mc->sel.compact_timer) {
+	mc->sys->stop_timer(mc->sel.compact_timer);
+	mc->sys->free_timer(mc->sel.compact_timer);
+	mc->sel.compact_timer = NULL;
+    }
+
     entry = mc->sel.entries;
     while (entry) {
 	n_entry = entry->next;
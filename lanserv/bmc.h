@@ -85,6 +85,15 @@ typedef struct sel_s
     uint16_t      reservation;
     uint16_t      next_entry;
     long          time_offset;
+
+    /*
+     * Changes are appended to a journal, the journal is compacted
+     * into the main persist file from a timer once it gets large
+     * compared to the SEL.
+     */
+    unsigned int  journal_count;
+    int           compact_pending;
+    ipmi_timer_t  *compact_timer;
 } sel_t;
 
 #define MAX_SDR_LENGTH 261
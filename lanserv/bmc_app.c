@@ -412,7 +412,7 @@ handle_get_channel_info(lmc_data_t    *mc,
     unsigned char medium_type;
     unsigned char protocol_type;
     unsigned char session_support;
-    unsigned char active_sessions;
+    unsigned int  active_sessions;
 
     if (msg->len < 1) {
 	rdata[0] = IPMI_REQUEST_DATA_LENGTH_INVALID_CC;
@@ -446,6 +446,8 @@ handle_get_channel_info(lmc_data_t    *mc,
 	protocol_type = mc->channels[lchan]->protocol_type;
 	session_support = mc->channels[lchan]->session_support;
 	active_sessions = mc->channels[lchan]->active_sessions;
+	if (active_sessions > MAX_SESSIONS)
+	    active_sessions = MAX_SESSIONS;
     }
 
     rdata[0] = 0;
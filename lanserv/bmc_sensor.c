@@ -1259,8 +1259,140 @@ ipmi_mc_add_sensor(lmc_data_t    *mc,
     return 0;
 }
 
-struct file_data {
+/*
+ * Sensors that read the same file share one of these.  The file is
+ * kept open and read with pread(), and the data from a read is used
+ * by every sensor on the file that polls within FILE_SOURCE_CACHE_USEC
+ * of it, so a set of sensors on one file only costs one read.
+ */
+#define FILE_SOURCE_CACHE_USEC 100000
+
+struct file_source {
     char *filename;
+    int fd;
+
+    /* Number of bytes from the start of the file the sensors need. */
+    unsigned int readlen;
+    unsigned char *buf;
+
+    /* Result of the last read, valid until the cache time expires. */
+    int valid;
+    int datalen;
+    struct timeval read_time;
+
+    struct file_source *next;
+};
+
+static struct file_source *file_sources;
+
+static struct file_source *
+file_source_get(sys_data_t *sys, char *filename, unsigned int readlen)
+{
+    struct file_source *src;
+    unsigned char *buf;
+
+    for (src = file_sources; src; src = src->next) {
+	if (strcmp(src->filename, filename) == 0)
+	    break;
+    }
+
+    if (!src) {
+	src = sys->alloc(sys, sizeof(*src));
+	if (!src) {
+	    sys->free(sys, filename);
+	    return NULL;
+	}
+	memset(src, 0, sizeof(*src));
+	src->fd = -1;
+	src->filename = filename;
+	src->next = file_sources;
+	file_sources = src;
+    } else {
+	/* Already have one, the caller's name is not needed. */
+	sys->free(sys, filename);
+    }
+
+    if (readlen > src->readlen) {
+	buf = sys->alloc(sys, readlen);
+	if (!buf)
+	    return NULL;
+	if (src->buf)
+	    sys->free(sys, src->buf);
+	src->buf = buf;
+	src->readlen = readlen;
+	src->valid = 0;
+    }
+
+    return src;
+}
+
+static int
+file_source_open(struct file_source *src)
+{
+    if (src->fd == -1) {
+	src->fd = open(src->filename, O_RDONLY);
+	if (src->fd == -1)
+	    return errno;
+    }
+    return 0;
+}
+
+static void
+file_source_close(struct file_source *src)
+{
+    if (src->fd != -1) {
+	close(src->fd);
+	src->fd = -1;
+    }
+}
+
+static int
+file_source_read(sys_data_t *sys, struct file_source *src,
+		 const char **errstr)
+{
+    struct timeval now;
+    long diff;
+    int rv;
+    int retried = 0;
+
+    sys->get_monotonic_time(sys, &now);
+    if (src->valid) {
+	diff = ((now.tv_sec - src->read_time.tv_sec) * 1000000
+		+ (now.tv_usec - src->read_time.tv_usec));
+	if (diff >= 0 && diff < FILE_SOURCE_CACHE_USEC)
+	    return 0;
+	src->valid = 0;
+    }
+
+  retry:
+    rv = file_source_open(src);
+    if (rv) {
+	*errstr = "Unable to open sensor file";
+	return rv;
+    }
+
+    rv = pread(src->fd, src->buf, src->readlen, 0);
+    if (rv == -1) {
+	rv = errno;
+	/* The file may have been replaced, re-open it and try again. */
+	file_source_close(src);
+	if (!retried && (rv == ESTALE || rv == ENOENT || rv == ENODEV
+			 || rv == EBADF)) {
+	    retried = 1;
+	    goto retry;
+	}
+	*errstr = "No data read from file";
+	return rv;
+    }
+
+    src->datalen = rv;
+    src->read_time = now;
+    src->valid = 1;
+    return 0;
+}
+
+struct file_data {
+    struct file_source *src;
     unsigned int offset;
     unsigned int length;
     unsigned int mask;
@@ -1280,15 +1412,18 @@ struct file_data {
     unsigned char depends_sensor_bit;
 };
 
+#define FILE_ASCII_MAX 99
+
 static int
 file_poll(void *cb_data, unsigned int *rval, const char **errstr)
 {
     struct file_data *f = cb_data;
-    int fd;
+    struct file_source *src = f->src;
     int rv;
     int val;
     char *end;
     int errv;
+    int avail;
 
     if (f->depends_mc_addr) {
 	lmc_data_t *mc = f->sensor_mc;
@@ -1315,36 +1450,22 @@ file_poll(void *cb_data, unsigned int *rval, const char **errstr)
 	    return 0;
     }
 
-    fd = open(f->filename, O_RDONLY);
-    if (fd == -1) {
-	errv = errno;
-	*errstr = "Unable to open sensor file";
-	return errv;
-    }
+    rv = file_source_read(f->sensor_mc->sys, src, errstr);
+    if (rv)
+	return rv;
 
-    if (f->offset) {
-	if (lseek(fd, f->offset, SEEK_SET) == -1) {
-	    errv = errno;
-	    close(fd);
-	    *errstr = "Unable to seek file";
-	    return errv;
-	}
-    }
+    avail = src->datalen - (int) f->offset;
+    if (avail < 0)
+	avail = 0;
 
     if (f->is_raw) {
-	unsigned char data[4];
+	unsigned char *data = src->buf + f->offset;
 	int i;
 	int length = f->length;
 
 	if (length > 4)
 	    length = 4;
-	rv = read(fd, data, length);
-	errv = errno;
-	close(fd);
-	if (rv == -1) {
-	    *errstr = "No data read from file";
-	    return errv;
-	} else if (rv < length) {
+	if (avail < length) {
 	    *errstr = "Short data read from file";
 	    return -1;
 	}
@@ -1352,16 +1473,12 @@ file_poll(void *cb_data, unsigned int *rval, const char **errstr)
 	for (i = 0; i < length; i++)
 	    val |= data[i] << (i * 8);
     } else {
-	char data[100];
+	char data[FILE_ASCII_MAX + 1];
 
-	rv = read(fd, data, sizeof(data) - 1);
-	errv = errno;
-	close(fd);
-	if (rv == -1) {
-	    *errstr = "No data read from file";
-	    return errv;
-	}
-	data[rv] = '\0';
+	if (avail > FILE_ASCII_MAX)
+	    avail = FILE_ASCII_MAX;
+	memcpy(data, src->buf + f->offset, avail);
+	data[avail] = '\0';
 
 	val = strtol(data, &end, f->base);
 	if ((*end != '\0' && !isspace(*end)) || (end == data)) {
@@ -1521,7 +1638,14 @@ file_init(lmc_data_t *mc,
 	tok = mystrtok(NULL, " \t\n", toks);
     }
 
-    f->filename = fname;
+    if (f->is_raw)
+	f->src = file_source_get(mc->sys, fname, f->offset + 4);
+    else
+	f->src = file_source_get(mc->sys, fname, f->offset + FILE_ASCII_MAX);
+    if (!f->src) {
+	mc->sys->free(mc->sys, f);
+	return ENOMEM;
+    }
 
     *rcb_data = f;
     return 0;
@@ -90,6 +90,8 @@ find_sel_event_by_recid(lmc_data_t  *mc,
     return entry;
 }
 
+static void rewrite_sels(lmc_data_t *mc);
+
 static int
 handle_sel(const char *name, void *data, unsigned int len, void *cb_data)
 {
@@ -139,6 +141,65 @@ handle_sel_time(const char *name, long val, void *cb_data)
     return ITER_PERSIST_CONTINUE;
 }
 
+/*
+ * Journal replay.  The journal may have already been applied to the
+ * main file if we crashed while compacting, so adds of an existing
+ * record and deletes of a missing record are ignored.
+ */
+static int
+handle_sel_journal(const char *name, void *data, unsigned int len,
+		   void *cb_data)
+{
+    lmc_data_t *mc = cb_data;
+    sel_entry_t *e;
+    uint16_t record_id;
+
+    mc->sel.journal_count++;
+
+    if (len != 16)
+	return handle_sel(name, data, len, cb_data);
+
+    record_id = ipmi_get_uint16(data);
+    e = find_sel_event_by_recid(mc, record_id, NULL);
+    if (e) {
+	memcpy(e->data, data, 16);
+	return ITER_PERSIST_CONTINUE;
+    }
+    return handle_sel(name, data, len, cb_data);
+}
+
+static int
+handle_sel_journal_int(const char *name, long val, void *cb_data)
+{
+    lmc_data_t *mc = cb_data;
+    sel_entry_t *e, *p_e;
+
+    mc->sel.journal_count++;
+
+    if (strcmp(name, "del") != 0)
+	return handle_sel_time(name, val, cb_data);
+
+    e = find_sel_event_by_recid(mc, val, &p_e);
+    if (e) {
+	if (p_e)
+	    p_e->next = e->next;
+	else
+	    mc->sel.entries = e->next;
+	mc->sel.count--;
+	mc->sys->free(mc->sys, e);
+    }
+    return ITER_PERSIST_CONTINUE;
+}
+
+static void
+sel_compact_timeout(void *cb_data)
+{
+    lmc_data_t *mc = cb_data;
+
+    mc->sel.compact_pending = 0;
+    rewrite_sels(mc);
+}
+
 int
 ipmi_mc_enable_sel(lmc_data_t    *mc,
 		   int           max_entries,
@@ -154,13 +215,27 @@ ipmi_mc_enable_sel(lmc_data_t    *mc,
     mc->sel.flags = flags & 0xb;
     mc->sel.reservation = 0;
     mc->sel.next_entry = 1;
+    mc->sel.journal_count = 0;
+
+    if (!mc->sel.compact_timer) {
+	/* If this fails we just compact on every change. */
+	if (mc->sys->alloc_timer(mc->sys, sel_compact_timeout, mc,
+				 &mc->sel.compact_timer))
+	    mc->sel.compact_timer = NULL;
+    }
 
     p = read_persist(mc->sys, "sel.%2.2x", is_mc_get_ipmb(mc));
-    if (!p)
-	return 0;
+    if (p) {
+	iterate_persist(p, mc, handle_sel, handle_sel_time);
+	free_persist(p);
+    }
+
+    p = read_persist_journal(mc->sys, "sel.%2.2x", is_mc_get_ipmb(mc));
+    if (p) {
+	iterate_persist(p, mc, handle_sel_journal, handle_sel_journal_int);
+	free_persist(p);
+    }
 
-    iterate_persist(p, mc, handle_sel, handle_sel_time);
-    free_persist(p);
     return 0;
 }
 		    
@@ -198,6 +273,13 @@ rewrite_sels(lmc_data_t *mc)
     err = write_persist(p);
     if (err)
 	goto out_err;
+
+    /* Everything in the journal is in the main file now. */
+    err = remove_persist_journal(p);
+    if (err)
+	goto out_err;
+    mc->sel.journal_count = 0;
+
     free_persist(p);
     return;
 
@@ -209,6 +291,85 @@ rewrite_sels(lmc_data_t *mc)
 	free_persist(p);
 }
 
+#define SEL_JOURNAL_MIN_COMPACT 256
+
+/*
+ * Append the change to the SEL journal.  The journal is compacted once
+ * it gets larger than the SEL itself, so the cost of rewriting is
+ * spread over the changes.  If the append fails, fall back to
+ * rewriting everything.  The journal size is counted in items, the
+ * same way the replay counts it, so it stays right across a restart.
+ */
+static void
+journal_sel_change(lmc_data_t *mc, persist_t *p, unsigned int nitems)
+{
+    struct timeval timeout;
+    int err;
+
+    err = append_persist(p);
+    free_persist(p);
+    if (err) {
+	rewrite_sels(mc);
+	return;
+    }
+
+    mc->sel.journal_count += nitems;
+    if ((mc->sel.journal_count < SEL_JOURNAL_MIN_COMPACT)
+	|| (mc->sel.journal_count < (unsigned int) mc->sel.count)
+	|| mc->sel.compact_pending)
+	return;
+
+    if (!mc->sel.compact_timer) {
+	rewrite_sels(mc);
+	return;
+    }
+
+    mc->sel.compact_pending = 1;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    mc->sys->start_timer(mc->sel.compact_timer, &timeout);
+}
+
+static void
+journal_sel_add(lmc_data_t *mc, sel_entry_t *e)
+{
+    persist_t *p;
+
+    p = alloc_persist(mc->sys, "sel.%2.2x", is_mc_get_ipmb(mc));
+    if (!p)
+	goto out_err;
+    if (add_persist_data(p, e->data, 16, "%d", e->record_id))
+	goto out_err;
+    if (add_persist_int(p, mc->sel.last_add_time, "last_add_time"))
+	goto out_err;
+    journal_sel_change(mc, p, 2);
+    return;
+
+  out_err:
+    if (p)
+	free_persist(p);
+    rewrite_sels(mc);
+}
+
+static void
+journal_sel_int(lmc_data_t *mc, long val, const char *name)
+{
+    persist_t *p;
+
+    p = alloc_persist(mc->sys, "sel.%2.2x", is_mc_get_ipmb(mc));
+    if (!p)
+	goto out_err;
+    if (add_persist_int(p, val, "%s", name))
+	goto out_err;
+    journal_sel_change(mc, p, 1);
+    return;
+
+  out_err:
+    if (p)
+	free_persist(p);
+    rewrite_sels(mc);
+}
+
 int
 ipmi_mc_add_to_sel(lmc_data_t    *mc,
 		   unsigned char record_type,
@@ -274,7 +435,7 @@ ipmi_mc_add_to_sel(lmc_data_t    *mc,
     if (recid)
 	*recid = e->record_id;
 
-    rewrite_sels(mc);
+    journal_sel_add(mc, e);
 
     return 0;
 }
@@ -551,10 +712,10 @@ handle_delete_sel_entry(lmc_data_t    *mc,
     ipmi_set_uint16(rdata+1, entry->record_id);
     *rdata_len = 3;
 
+    journal_sel_int(mc, entry->record_id, "del");
+
     mc->sel.count--;
     mc->sys->free(mc->sys, entry);
-
-    rewrite_sels(mc);
 }
 
 static void
@@ -670,7 +831,7 @@ handle_set_sel_time(lmc_data_t    *mc,
     rdata[0] = 0;
     *rdata_len = 1;
 
-    rewrite_sels(mc);
+    journal_sel_int(mc, mc->sel.time_offset, "time_offset");
 }
 
 /*
@@ -801,7 +801,19 @@ read_config(sys_data_t *sys,
 		    dlib->file = library;
 		    dlib->init = initstr;
 		    dlib->next = NULL;
-		    if (!dlibs) {
+		    /*
+		     * Every BMC in a multi-BMC simulator reads the same
+		     * config, only keep one copy of each library.
+		     */
+		    for (dlibp = dlibs; dlibp; dlibp = dlibp->next) {
+			if ((strcmp(dlibp->file, library) == 0)
+			    && (strcmp(dlibp->init, initstr) == 0))
+			    break;
+		    }
+		    if (dlibp) {
+			sys->free(sys, dlib);
+			err = EEXIST;
+		    } else if (!dlibs) {
 			dlibs = dlib;
 		    } else {
 			dlibp = dlibs;
@@ -811,7 +823,11 @@ read_config(sys_data_t *sys,
 		    }
 		}
 	    }
-	    if (err) {
+	    if (err == EEXIST) {
+		sys->free(sys, library);
+		sys->free(sys, initstr);
+		err = 0;
+	    } else if (err) {
 		if (library)
 		    sys->free(sys, (char *) library);
 		if (initstr)
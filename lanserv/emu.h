@@ -70,6 +70,16 @@ typedef struct atca_site_s
 
 typedef void (*ipmi_emu_sleep_cb)(emu_data_t *emu, struct timeval *time);
 
+typedef struct netfn_handler_s {
+    cmd_handler_f *handlers;
+    void          **cb_data;
+    cmd_handler_f main_handler;
+    void          *main_handler_cb_data;
+    int (*check_capable)(lmc_data_t *mc);
+    /* Set when handlers is a copy owned by this emu. */
+    int           handlers_copied;
+} netfn_handler_t;
+
 #define MAX_EMU_ADDR		16
 #define MAX_EMU_ADDR_DATA	64
 typedef struct emu_addr_s
@@ -102,6 +112,14 @@ struct emu_data_s
 
     struct timeval last_addr_change_time;
     emu_addr_t addr[MAX_EMU_ADDR];
+
+    /*
+     * Command handlers.  These are per emulator because modules are
+     * initialized once for each BMC, with that BMC's data as cb_data.
+     */
+    netfn_handler_t netfn_handlers[32];
+    struct iana_handler_elem *iana_handlers;
+    struct oi_iana_cmd_elem *oi_iana_cmds;
 };
 
 void ipmi_emu_tick(emu_data_t *emu, unsigned int seconds);
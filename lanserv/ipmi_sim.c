@@ -68,12 +68,14 @@
 #include <string.h>
 #include <netdb.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <popt.h> /* Option parsing made easy */
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <pthread.h>
 
 #include <config.h>
 
@@ -85,6 +87,8 @@
 #include <OpenIPMI/ipmi_err.h>
 #include <OpenIPMI/ipmi_msgbits.h>
 #include <OpenIPMI/ipmi_mc.h>
+#include <OpenIPMI/ipmi_auth.h>
+#include <OpenIPMI/ipmi_lan.h>
 #include <OpenIPMI/os_handler.h>
 #include <OpenIPMI/ipmi_posix.h>
 
@@ -105,6 +109,10 @@ static char *command_string = NULL;
 static char *command_file = NULL;
 static int debug = 0;
 static int nostdio = 0;
+static int threaded = 0;
+static int num_bmcs = 1;
+static char *bmc_step = "port";
+static int bmc_step_ip = 0;
 
 /*
  * Keep track of open sockets so we can close them on exec().
@@ -171,8 +179,14 @@ struct misc_data
     os_handler_waiter_factory_t *waiter_factory;
     os_hnd_timer_id_t *timer;
     console_info_t *consoles;
+    unsigned int bmc_num;
 };
 
+/*
+ * All the simulated BMCs.  The first one owns the consoles and the
+ * shared OS handler, timer and waiter factory.
+ */
+static misc_data_t *bmcs;
 static misc_data_t *global_misc_data;
 
 static void *
@@ -197,10 +211,404 @@ typedef struct sim_addr_s
     /* struct sockaddr_storage addr; */
 } sim_addr_t;
 
+/*
+ * Threaded mode.  Each LAN, serial and IPMB channel gets its own OS
+ * handler and thread that does the socket I/O and the protocol
+ * handling for the channel (sessions, authentication, encryption,
+ * serial codecs).  The main thread does the MC command processing,
+ * timers and the console.  Messages from a channel to the MC and
+ * responses from the MC back to the channel go through queues.
+ *
+ * The emulator lock keeps the two sides apart.  Channel threads hold
+ * it shared while they work on a message, the main thread holds it
+ * exclusive while it runs any of its handlers.  So channel threads
+ * run in parallel with each other, and the channel hooks the MC code
+ * calls directly (LAN parms, session association, etc.) never run
+ * at the same time as the channel's own thread.
+ */
+typedef struct sim_qmsg_s
+{
+    channel_t *chan;
+    msg_t msg;
+    rsp_msg_t rsp;
+    struct sim_qmsg_s *next;
+} sim_qmsg_t;
+
+typedef struct sim_queue_s
+{
+    pthread_mutex_t lock;
+    sim_qmsg_t *head, *tail;
+    int wake_pending;
+    int wake_fd[2];
+    os_hnd_fd_id_t *wake_id;
+    void (*handler)(struct sim_queue_s *q, sim_qmsg_t *qmsg);
+} sim_queue_t;
+
+typedef struct sim_chan_thread_s
+{
+    channel_t *chan;
+    os_handler_t *os_hnd;
+    sim_queue_t rspq;
+    void (*return_rsp)(channel_t *chan, msg_t *msg, rsp_msg_t *rsp);
+    pthread_t thread;
+    struct sim_chan_thread_s *next;
+} sim_chan_thread_t;
+
+static sim_chan_thread_t *chan_threads;
+static sim_queue_t mc_queue;
+static pthread_t main_thread;
+
+/*
+ * RMCP+ payloads other than IPMI messages (SOL) use timers and I/O
+ * handlers on the main OS handler, so channel threads pass those
+ * packets to the main thread.  The raw packet is carried in the
+ * message data and its address in src_addr.
+ */
+static sim_queue_t payload_queue;
+
+/*
+ * A shared/exclusive lock that lets a waiting writer in ahead of new
+ * readers, so a stream of LAN traffic cannot starve the MC thread.
+ * Only the main thread takes it exclusive, and it may nest (the
+ * emulator sleep command runs the OS handler loop from a handler).
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned int readers;
+    unsigned int writer_waiting;
+    unsigned int writer_depth;
+} emu_lock = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0 };
+
+static void
+emu_lock_shared(void)
+{
+    if (!threaded)
+	return;
+    pthread_mutex_lock(&emu_lock.lock);
+    while (emu_lock.writer_depth || emu_lock.writer_waiting)
+	pthread_cond_wait(&emu_lock.cond, &emu_lock.lock);
+    emu_lock.readers++;
+    pthread_mutex_unlock(&emu_lock.lock);
+}
+
+static void
+emu_unlock_shared(void)
+{
+    if (!threaded)
+	return;
+    pthread_mutex_lock(&emu_lock.lock);
+    emu_lock.readers--;
+    if (emu_lock.readers == 0)
+	pthread_cond_broadcast(&emu_lock.cond);
+    pthread_mutex_unlock(&emu_lock.lock);
+}
+
+static void
+emu_lock_excl(void)
+{
+    if (!threaded)
+	return;
+    pthread_mutex_lock(&emu_lock.lock);
+    if (emu_lock.writer_depth == 0) {
+	emu_lock.writer_waiting = 1;
+	while (emu_lock.readers)
+	    pthread_cond_wait(&emu_lock.cond, &emu_lock.lock);
+	emu_lock.writer_waiting = 0;
+    }
+    emu_lock.writer_depth++;
+    pthread_mutex_unlock(&emu_lock.lock);
+}
+
+static void
+emu_unlock_excl(void)
+{
+    if (!threaded)
+	return;
+    pthread_mutex_lock(&emu_lock.lock);
+    emu_lock.writer_depth--;
+    if (emu_lock.writer_depth == 0)
+	pthread_cond_broadcast(&emu_lock.cond);
+    pthread_mutex_unlock(&emu_lock.lock);
+}
+
+/*
+ * Copy a message (and response) so it can be handled on another
+ * thread.  The message data and source address live in the same
+ * allocation.  The authentication pointers point into the receive
+ * buffer and are only used while receiving, so they are dropped.
+ */
+static sim_qmsg_t *
+sim_qmsg_alloc(channel_t *chan, msg_t *msg, rsp_msg_t *rsp)
+{
+    sim_qmsg_t *qmsg;
+    unsigned int src_len = msg->src_addr ? msg->src_len : 0;
+    unsigned int rsp_len = rsp ? rsp->data_len : 0;
+    unsigned char *pos;
+
+    qmsg = malloc(sizeof(*qmsg) + msg->len + src_len + rsp_len);
+    if (!qmsg)
+	return NULL;
+    pos = (unsigned char *) (qmsg + 1);
+
+    qmsg->chan = chan;
+    qmsg->next = NULL;
+    qmsg->msg = *msg;
+    qmsg->msg.data = pos;
+    if (msg->len)
+	memcpy(pos, msg->data, msg->len);
+    pos += msg->len;
+    if (src_len) {
+	memcpy(pos, msg->src_addr, src_len);
+	qmsg->msg.src_addr = pos;
+	pos += src_len;
+    }
+    qmsg->msg.src_allocated = 0;
+    if (msg->authtype == IPMI_AUTHTYPE_RMCP_PLUS) {
+	qmsg->msg.rmcpp.authdata = NULL;
+	qmsg->msg.rmcpp.authdata_len = 0;
+    } else if (msg->authtype == IPMI_AUTHTYPE_NONE) {
+	/* No auth code, and the union may hold RMCP+ payload info (the
+	   SOL send messages do this), so leave it alone. */
+    } else if (msg->rmcp.authcode == msg->rmcp.authcode_data) {
+	qmsg->msg.rmcp.authcode = qmsg->msg.rmcp.authcode_data;
+    } else {
+	qmsg->msg.rmcp.authcode = NULL;
+    }
+
+    if (rsp) {
+	qmsg->rsp = *rsp;
+	qmsg->rsp.data = pos;
+	if (rsp_len)
+	    memcpy(pos, rsp->data, rsp_len);
+    }
+
+    return qmsg;
+}
+
+static void
+sim_queue_put(sim_queue_t *q, sim_qmsg_t *qmsg)
+{
+    int wake;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail)
+	q->tail->next = qmsg;
+    else
+	q->head = qmsg;
+    q->tail = qmsg;
+    wake = !q->wake_pending;
+    q->wake_pending = 1;
+    pthread_mutex_unlock(&q->lock);
+
+    if (wake) {
+	unsigned char c = 1;
+
+	(void) write(q->wake_fd[1], &c, 1);
+    }
+}
+
+static void
+sim_queue_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
+{
+    sim_queue_t *q = cb_data;
+    sim_qmsg_t *qmsg, *next;
+    unsigned char buf[16];
+
+    (void) read(fd, buf, sizeof(buf));
+
+    pthread_mutex_lock(&q->lock);
+    qmsg = q->head;
+    q->head = NULL;
+    q->tail = NULL;
+    q->wake_pending = 0;
+    pthread_mutex_unlock(&q->lock);
+
+    while (qmsg) {
+	next = qmsg->next;
+	q->handler(q, qmsg);
+	free(qmsg);
+	qmsg = next;
+    }
+}
+
+static int
+sim_queue_init(sim_queue_t *q, os_handler_t *os_hnd,
+	       void (*handler)(sim_queue_t *q, sim_qmsg_t *qmsg))
+{
+    int err;
+
+    pthread_mutex_init(&q->lock, NULL);
+    q->head = NULL;
+    q->tail = NULL;
+    q->wake_pending = 0;
+    q->handler = handler;
+    if (pipe(q->wake_fd) == -1)
+	return errno;
+    fcntl(q->wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(q->wake_fd[1], F_SETFL, O_NONBLOCK);
+
+    err = os_hnd->add_fd_to_wait_for(os_hnd, q->wake_fd[0], sim_queue_ready,
+				     q, NULL, &q->wake_id);
+    if (err) {
+	close(q->wake_fd[0]);
+	close(q->wake_fd[1]);
+	return err;
+    }
+    isim_add_fd(q->wake_fd[0]);
+    isim_add_fd(q->wake_fd[1]);
+    return 0;
+}
+
+static void
+mc_queue_handler(sim_queue_t *q, sim_qmsg_t *qmsg)
+{
+    emu_lock_excl();
+    ipmi_mc_handle_msg(qmsg->chan->mc, &qmsg->msg);
+    emu_unlock_excl();
+}
+
+static void
+payload_queue_handler(sim_queue_t *q, sim_qmsg_t *qmsg)
+{
+    lanserv_data_t *lan = qmsg->chan->chan_info;
+
+    emu_lock_excl();
+    ipmi_handle_lan_msg(lan, qmsg->msg.data, qmsg->msg.len,
+			qmsg->msg.src_addr, qmsg->msg.src_len);
+    emu_unlock_excl();
+}
+
+static void
+rsp_queue_handler(sim_queue_t *q, sim_qmsg_t *qmsg)
+{
+    sim_chan_thread_t *ct = (sim_chan_thread_t *)
+	(((char *) q) - offsetof(sim_chan_thread_t, rspq));
+
+    emu_lock_shared();
+    ct->return_rsp(ct->chan, &qmsg->msg, &qmsg->rsp);
+    emu_unlock_shared();
+}
+
+static sim_chan_thread_t *
+find_chan_thread(channel_t *chan)
+{
+    sim_chan_thread_t *ct = chan_threads;
+
+    while (ct && ct->chan != chan)
+	ct = ct->next;
+    return ct;
+}
+
+/*
+ * Responses from the MC go back to the channel's thread, where the
+ * authentication and encryption for them is done.
+ */
+static void
+threaded_return_rsp(channel_t *chan, msg_t *msg, rsp_msg_t *rsp)
+{
+    sim_chan_thread_t *ct = find_chan_thread(chan);
+    sim_qmsg_t *qmsg;
+
+    if (pthread_equal(pthread_self(), ct->thread)) {
+	ct->return_rsp(chan, msg, rsp);
+	return;
+    }
+
+    qmsg = sim_qmsg_alloc(chan, msg, rsp);
+    if (!qmsg) {
+	chan->sys->log(chan->sys, OS_ERROR, msg,
+		       "Out of memory queueing response");
+	return;
+    }
+    sim_queue_put(&ct->rspq, qmsg);
+}
+
+/*
+ * In threaded mode, set up a thread and OS handler for the channel
+ * and route its responses through the channel's queue.  This must
+ * be called after the channel's return_rsp has been set.  Returns
+ * the OS handler the channel should use for its I/O.
+ */
+static os_handler_t *
+sim_chan_thread_setup(misc_data_t *data, channel_t *chan)
+{
+    sim_chan_thread_t *ct;
+    int err;
+
+    if (!threaded)
+	return data->os_hnd;
+
+    ct = malloc(sizeof(*ct));
+    if (!ct) {
+	fprintf(stderr, "Out of memory allocating channel thread\n");
+	exit(1);
+    }
+    memset(ct, 0, sizeof(*ct));
+    ct->chan = chan;
+    ct->os_hnd = ipmi_posix_setup_os_handler();
+    if (!ct->os_hnd) {
+	fprintf(stderr, "Unable to allocate channel OS handler\n");
+	exit(1);
+    }
+    err = sim_queue_init(&ct->rspq, ct->os_hnd, rsp_queue_handler);
+    if (err) {
+	fprintf(stderr, "Unable to set up channel queue: %s\n",
+		strerror(err));
+	exit(1);
+    }
+    ct->return_rsp = chan->return_rsp;
+    chan->return_rsp = threaded_return_rsp;
+
+    ct->next = chan_threads;
+    chan_threads = ct;
+    return ct->os_hnd;
+}
+
+static void *
+sim_chan_thread(void *cb_data)
+{
+    sim_chan_thread_t *ct = cb_data;
+
+    ct->os_hnd->operation_loop(ct->os_hnd);
+    return NULL;
+}
+
+static void
+sim_start_chan_threads(void)
+{
+    sim_chan_thread_t *ct;
+    sigset_t sigs, oldsigs;
+    int err;
+
+    /* Signals are handled by the main thread. */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+    for (ct = chan_threads; ct; ct = ct->next) {
+	err = pthread_create(&ct->thread, NULL, sim_chan_thread, ct);
+	if (err) {
+	    fprintf(stderr, "Unable to start channel thread: %s\n",
+		    strerror(err));
+	    exit(1);
+	}
+    }
+    pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+}
+
 static int
 smi_send(channel_t *chan, msg_t *msg)
 {
-    ipmi_mc_handle_msg(chan->mc, msg);
+    sim_qmsg_t *qmsg;
+
+    if (!threaded || pthread_equal(pthread_self(), main_thread)) {
+	ipmi_mc_handle_msg(chan->mc, msg);
+	return 0;
+    }
+
+    qmsg = sim_qmsg_alloc(chan, msg, NULL);
+    if (!qmsg)
+	return ENOMEM;
+    sim_queue_put(&mc_queue, qmsg);
     return 0;
 }
 
@@ -252,6 +660,7 @@ lan_data_ready(int lan_fd, void *cb_data, os_hnd_fd_id_t *id)
     sim_addr_t *l = (sim_addr_t *) addrdata;
     uint8_t msgd[256];
     struct sockaddr *addr = (struct sockaddr *) (((char *) l) + sizeof(*l));
+    int to_main = 0;
 
     l->addr_len = sizeof(struct sockaddr_storage);
     len = recvfrom(lan_fd, msgd, sizeof(msgd), 0, addr, &l->addr_len);
@@ -276,6 +685,36 @@ lan_data_ready(int lan_fd, void *cb_data, os_hnd_fd_id_t *id)
     if (msgd[0] != 6)
 	goto out; /* Invalid version */
 
+    if (threaded && (msgd[3] == 7) && (len > 5)
+	&& (msgd[4] == IPMI_AUTHTYPE_RMCP_PLUS))
+    {
+	unsigned int ptype = msgd[5] & 0x3f;
+
+	to_main = ((ptype != IPMI_RMCPP_PAYLOAD_TYPE_IPMI)
+		   && ((ptype < IPMI_RMCPP_PAYLOAD_TYPE_OPEN_SESSION_REQUEST)
+		       || (ptype > IPMI_RMCPP_PAYLOAD_TYPE_RAKP_4)));
+    }
+
+    if (to_main) {
+	msg_t msg;
+	sim_qmsg_t *qmsg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.data = msgd;
+	msg.len = len;
+	msg.src_addr = l;
+	msg.src_len = sizeof(*l) + l->addr_len;
+	qmsg = sim_qmsg_alloc(&lan->channel, &msg, NULL);
+	if (!qmsg) {
+	    lan->sys->log(lan->sys, OS_ERROR, NULL,
+			  "Out of memory queueing LAN payload");
+	    goto out;
+	}
+	sim_queue_put(&payload_queue, qmsg);
+	goto out;
+    }
+
+    emu_lock_shared();
     /* Check the message class. */
     switch (msgd[3]) {
 	case 6:
@@ -286,6 +725,7 @@ lan_data_ready(int lan_fd, void *cb_data, os_hnd_fd_id_t *id)
 	    ipmi_handle_lan_msg(lan, msgd, len, l, sizeof(*l) + l->addr_len);
 	    break;
     }
+    emu_unlock_shared();
  out:
     return;
 }
@@ -414,6 +854,61 @@ open_lan_fd(struct sockaddr *addr, socklen_t addr_len, unsigned short *rport)
     return fd;
 }
 
+/*
+ * Give each added BMC its own address by stepping the configured
+ * port or IP address by the BMC number.
+ */
+static void
+sim_step_addr(misc_data_t *data, sockaddr_ip_t *addr)
+{
+    unsigned int n = data->bmc_num;
+    in_port_t *portp;
+    unsigned int port;
+
+    if (n == 0)
+	return;
+
+    switch (addr->s_ipsock.s_addr0.sa_family) {
+    case AF_INET:
+	if (bmc_step_ip) {
+	    struct in_addr *a = &addr->s_ipsock.s_addr4.sin_addr;
+
+	    a->s_addr = htonl(ntohl(a->s_addr) + n);
+	    return;
+	}
+	portp = &addr->s_ipsock.s_addr4.sin_port;
+	break;
+
+#ifdef PF_INET6
+    case AF_INET6:
+	if (bmc_step_ip) {
+	    unsigned char *a = addr->s_ipsock.s_addr6.sin6_addr.s6_addr;
+	    uint32_t v;
+
+	    memcpy(&v, a + 12, 4);
+	    v = htonl(ntohl(v) + n);
+	    memcpy(a + 12, &v, 4);
+	    return;
+	}
+	portp = &addr->s_ipsock.s_addr6.sin6_port;
+	break;
+#endif
+
+    default:
+	return;
+    }
+
+    port = ntohs(*portp);
+    if (port == 0)
+	return;
+    port += n;
+    if (port > 65535) {
+	fprintf(stderr, "BMC %u: port is past 65535\n", n);
+	exit(1);
+    }
+    *portp = htons(port);
+}
+
 static int
 lan_channel_init(void *info, channel_t *chan)
 {
@@ -423,6 +918,7 @@ lan_channel_init(void *info, channel_t *chan)
     int lan_fd;
     os_hnd_fd_id_t *fd_id;
     unsigned char addr_data[6];
+    os_handler_t *os_hnd;
 
     lan->user_info = data;
     lan->send_out = lan_send;
@@ -433,6 +929,7 @@ lan_channel_init(void *info, channel_t *chan)
 	fprintf(stderr, "Unable to init lan: 0x%x\n", err);
 	exit(1);
     }
+    os_hnd = sim_chan_thread_setup(data, chan);
 
     if (lan->guid) {
 	lmc_data_t *sys = ipmi_emu_get_bmc_mc(data->emu);
@@ -441,6 +938,7 @@ lan_channel_init(void *info, channel_t *chan)
     }
 
     if (lan->lan_addr_set) {
+	sim_step_addr(data, &lan->lan_addr.addr);
 	lan_fd = open_lan_fd(&lan->lan_addr.addr.s_ipsock.s_addr0,
 			     lan->lan_addr.addr_len, &lan->port);
 	if (lan_fd == -1) {
@@ -455,9 +953,9 @@ lan_channel_init(void *info, channel_t *chan)
 	       &lan->lan_addr.addr.s_ipsock.s_addr4.sin_port, 2);
 	ipmi_emu_set_addr(data->emu, 0, 0, addr_data, 6);
 
-	err = data->os_hnd->add_fd_to_wait_for(data->os_hnd, lan_fd,
-					       lan_data_ready, lan,
-					       NULL, &fd_id);
+	err = os_hnd->add_fd_to_wait_for(os_hnd, lan_fd,
+					 lan_data_ready, lan,
+					 NULL, &fd_id);
 	if (err) {
 	    fprintf(stderr, "Unable to add socket wait: 0x%x\n", err);
 	    exit(1);
@@ -496,15 +994,19 @@ ser_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	if ((len < 0) && (errno == EINTR))
 	    return;
 
+	emu_lock_shared();
 	if (ser->codec->disconnected)
 	    ser->codec->disconnected(ser);
 	ser->os_hnd->remove_fd_to_wait_for(ser->os_hnd, id);
 	close_socket(fd);
 	ser->con_fd = -1;
+	emu_unlock_shared();
 	return;
     }
 
+    emu_lock_shared();
     serserv_handle_data(ser, msgd, len);
+    emu_unlock_shared();
 }
 
 static void
@@ -524,7 +1026,9 @@ ser_bind_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	exit(1);
     }
 
+    emu_lock_shared();
     if (ser->con_fd >= 0) {
+	emu_unlock_shared();
 	close_socket(rv);
 	return;
     }
@@ -545,6 +1049,7 @@ ser_bind_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	if (ser->codec->connected)
 	    ser->codec->connected(ser);
     }
+    emu_unlock_shared();
 }
 
 static int
@@ -558,7 +1063,6 @@ ser_channel_init(void *info, channel_t *chan)
     os_hnd_fd_id_t *fd_id;
     int val;
 
-    ser->os_hnd = data->os_hnd;
     ser->user_info = data;
     ser->send_out = ser_send;
 
@@ -567,7 +1071,9 @@ ser_channel_init(void *info, channel_t *chan)
 	fprintf(stderr, "Unable to init serial: 0x%x\n", err);
 	exit(1);
     }
+    ser->os_hnd = sim_chan_thread_setup(data, chan);
 
+    sim_step_addr(data, &ser->addr.addr);
     fd = socket(addr->sa_family, SOCK_STREAM, IPPROTO_TCP);
     if (fd == -1) {
 	perror("Unable to create socket");
@@ -584,9 +1090,9 @@ ser_channel_init(void *info, channel_t *chan)
 	ser->con_fd = fd;
 	ser->bind_fd = -1;
 
-	err = data->os_hnd->add_fd_to_wait_for(data->os_hnd, ser->con_fd,
-					       ser_data_ready, ser,
-					       NULL, &fd_id);
+	err = ser->os_hnd->add_fd_to_wait_for(ser->os_hnd, ser->con_fd,
+					      ser_data_ready, ser,
+					      NULL, &fd_id);
 	if (err) {
 	    fprintf(stderr, "Unable to add serial socket wait: 0x%x\n", err);
 	    exit(1);
@@ -627,9 +1133,9 @@ ser_channel_init(void *info, channel_t *chan)
 	}
 	
 
-	err = data->os_hnd->add_fd_to_wait_for(data->os_hnd, ser->bind_fd,
-					       ser_bind_ready, ser,
-					       NULL, &fd_id);
+	err = ser->os_hnd->add_fd_to_wait_for(ser->os_hnd, ser->bind_fd,
+					      ser_bind_ready, ser,
+					      NULL, &fd_id);
 	if (err) {
 	    fprintf(stderr, "Unable to add serial socket wait: 0x%x\n", err);
 	    exit(1);
@@ -680,7 +1186,9 @@ ipmb_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
         return;
     }
 
+    emu_lock_shared();
     ipmbserv_handle_data(ipmb, msgd, len);
+    emu_unlock_shared();
 }
 
 static void
@@ -706,7 +1214,11 @@ ipmb_channel_init(void *info, channel_t *chan)
     int err;
     os_hnd_fd_id_t *fd_id;
 
-    ipmb->os_hnd = data->os_hnd;
+    if (data->bmc_num > 0) {
+	fprintf(stderr, "IPMB channels are only supported on the first BMC\n");
+	exit(1);
+    }
+
     ipmb->user_info = data;
     ipmb->send_out = ipmb_send;
 
@@ -715,6 +1227,7 @@ ipmb_channel_init(void *info, channel_t *chan)
         fprintf(stderr, "Unable to init ipmb: 0x%x\n", err);
         exit(1);
     }
+    ipmb->os_hnd = sim_chan_thread_setup(data, chan);
 
     ipmb->fd = ipmb_open(ipmb->ipmbdev);
     if (ipmb->fd == -1){
@@ -722,7 +1235,7 @@ ipmb_channel_init(void *info, channel_t *chan)
         exit(1);
     }
 
-    err = data->os_hnd->add_fd_to_wait_for(data->os_hnd, ipmb->fd,
+    err = ipmb->os_hnd->add_fd_to_wait_for(ipmb->os_hnd, ipmb->fd,
                                             ipmb_data_ready, ipmb,
                                             NULL, &fd_id);
     if (err) {
@@ -740,7 +1253,7 @@ static void
 isim_log(sys_data_t *sys, int logtype, msg_t *msg, const char *format,
 	 va_list ap, int len)
 {
-    misc_data_t *data = sys->info;
+    misc_data_t *data = global_misc_data; /* Consoles are on the first BMC */
     char *str;
     console_info_t *con;
 
@@ -878,6 +1391,33 @@ static struct poptOption poptOpts[]=
 	"nopersist",
 	""
     },
+    {
+	"threaded",
+	't',
+	POPT_ARG_NONE,
+	NULL,
+	't',
+	"run each channel on its own thread",
+	""
+    },
+    {
+	"bmcs",
+	'b',
+	POPT_ARG_INT,
+	&num_bmcs,
+	'b',
+	"number of BMCs to simulate",
+	""
+    },
+    {
+	"bmc-step",
+	0,
+	POPT_ARG_STRING,
+	&bmc_step,
+	0,
+	"step the \"port\" or the \"ip\" address for each added BMC",
+	""
+    },
     POPT_AUTOHELP
     {
 	NULL,
@@ -1055,6 +1595,7 @@ user_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
     int         count;
 
     count = read(fd, rc, sizeof(rc));
+    emu_lock_excl();
     if (count == 0)
 	goto closeit;
     while (count > 0) {
@@ -1063,11 +1604,13 @@ user_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	c++;
 	count--;
     }
+    emu_unlock_excl();
     return;
 
  closeit:
     if (info->shutdown_on_close) {
 	ipmi_emu_shutdown(info->data->emu);
+	emu_unlock_excl();
 	return;
     }
 
@@ -1080,6 +1623,7 @@ user_data_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
     if (info->next)
 	info->next->prev = info->prev;
     free(info);
+    emu_unlock_excl();
 }
 
 static void
@@ -1136,11 +1680,13 @@ console_bind_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 	return;
     }
 
+    emu_lock_excl();
     newcon->next = misc->consoles;
     if (newcon->next)
 	newcon->next->prev = newcon;
     newcon->prev = NULL;
     misc->consoles = newcon;
+    emu_unlock_excl();
 
     err = write(rv, telnet_init_seq, sizeof(telnet_init_seq));
     err = write(rv, "> ", 2);
@@ -1170,6 +1716,7 @@ ipmi_emu_shutdown(emu_data_t *emu)
     misc_data_t *data = ipmi_emu_get_user_data(emu);
     console_info_t *con;
     
+    data = global_misc_data;
     if (data->sys->console_fd != -1)
 	close(data->sys->console_fd);
     con = data->consoles;
@@ -1219,21 +1766,27 @@ static void
 io_read_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 {
     ipmi_io_t *io = cb_data;
+    emu_lock_excl();
     io->read_cb(fd, io->cb_data);
+    emu_unlock_excl();
 }
 
 static void
 io_write_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 {
     ipmi_io_t *io = cb_data;
+    emu_lock_excl();
     io->write_cb(fd, io->cb_data);
+    emu_unlock_excl();
 }
 
 static void
 io_except_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
 {
     ipmi_io_t *io = cb_data;
+    emu_lock_excl();
     io->except_cb(fd, io->cb_data);
+    emu_unlock_excl();
 }
 
 static void
@@ -1326,7 +1879,9 @@ timer_cb(void *cb_data, os_hnd_timer_id_t *id)
 {
     ipmi_timer_t *timer = cb_data;
 
+    emu_lock_excl();
     timer->cb(timer->cb_data);
+    emu_unlock_excl();
 }
 
 static int
@@ -1362,16 +1917,19 @@ tick(void *cb_data, os_hnd_timer_id_t *id)
 {
     misc_data_t *data = cb_data;
     struct timeval tv;
-    int err;
+    int err, i;
     ipmi_tick_handler_t *h;
 
+    emu_lock_excl();
     h = tick_handlers;
     while(h) {
 	h->handler(h->info, 1);
 	h = h->next;
     }
 
-    ipmi_emu_tick(data->emu, 1);
+    for (i = 0; i < num_bmcs; i++)
+	ipmi_emu_tick(bmcs[i].emu, 1);
+    emu_unlock_excl();
 
     tv.tv_sec = 1;
     tv.tv_usec = 0;
@@ -1414,11 +1972,13 @@ sigchld_ready(int fd, void *cb_data, os_hnd_fd_id_t *id)
     if (rv == -1)
 	return;
 
+    emu_lock_excl();
     h = child_quit_handlers;
     while (h) {
 	h->handler(h->info, rv);
 	h = h->next;
     }
+    emu_unlock_excl();
 }
 
 static ipmi_shutdown_t *shutdown_handlers;
@@ -1500,11 +2060,160 @@ static int ipmi_get_real_time(sys_data_t *sys, struct timeval *tv)
     return os_hnd->get_real_time(os_hnd, tv);
 }
 
+/*
+ * Set up one simulated BMC: its system data, emulator and MCs, read
+ * the config and run the command file for it.  The first BMC is
+ * number zero; the others get their own persistence namespace and
+ * have their addresses stepped by their number.
+ */
+static int
+setup_bmc(misc_data_t *data, unsigned int num, emu_out_t *out,
+	  int print_version)
+{
+    sys_data_t *sys = data->sys;
+    lmc_data_t *mc;
+    char *base_name;
+    int err;
+
+    sysinfo_init(sys);
+    sys->info = data;
+    sys->alloc = balloc;
+    sys->free = bfree;
+    sys->get_monotonic_time = ipmi_get_monotonic_time;
+    sys->get_real_time = ipmi_get_real_time;
+    sys->alloc_timer = ipmi_alloc_timer;
+    sys->start_timer = ipmi_start_timer;
+    sys->stop_timer = ipmi_stop_timer;
+    sys->free_timer = ipmi_free_timer;
+    sys->add_io_hnd = ipmi_add_io_hnd;
+    sys->io_set_hnds = ipmi_io_set_hnds;
+    sys->io_set_enables = ipmi_io_set_enables;
+    sys->remove_io_hnd = ipmi_remove_io_hnd;
+    sys->gen_rand = sys_gen_rand;
+    sys->debug = debug;
+    sys->log = sim_log;
+    sys->csmi_send = smi_send;
+    sys->lan_channel_init = lan_channel_init;
+    sys->ser_channel_init = ser_channel_init;
+    sys->ipmb_channel_init = ipmb_channel_init;
+    sys->mc_alloc_unconfigured = is_mc_alloc_unconfigured;
+    sys->resend_atn = is_resend_atn;
+    sys->mc_get_ipmb = is_mc_get_ipmb;
+    sys->mc_get_channelset = is_mc_get_channelset;
+    sys->mc_get_sol = is_mc_get_sol;
+    sys->mc_get_startcmdinfo = is_mc_get_startcmdinfo;
+    sys->mc_get_users = is_mc_get_users;
+    sys->mc_users_changed = is_mc_users_changed;
+    sys->mc_get_pef = is_mc_get_pef;
+    sys->sol_read_config = is_sol_read_config;
+    sys->set_chassis_control_prog = is_set_chassis_control_prog;
+    sys->register_tick_handler = is_register_tick_handler;
+    sys->console_fd = -1;
+
+    data->bmc_num = num;
+    data->emu = ipmi_emu_alloc(data, sleeper, sys);
+
+    err = is_mc_alloc_unconfigured(sys, 0x20, &mc);
+    if (err) {
+	if (err == ENOMEM)
+	    fprintf(stderr, "Out of memory allocation BMC MC\n");
+	exit(1);
+    }
+    sys->mc = mc;
+    sys->chan_set = is_mc_get_channelset(mc);
+    sys->startcmd = is_mc_get_startcmdinfo(mc);
+    sys->cpef = is_mc_get_pef(mc);
+    sys->cusers = is_mc_get_users(mc);
+    sys->sol = is_mc_get_sol(mc);
+
+    if (read_config(sys, config_file, print_version))
+	exit(1);
+
+    if (print_version)
+	exit(0);
+
+    if (!sys->name) {
+	fprintf(stderr, "name not set in config file\n");
+	exit(1);
+    }
+
+    base_name = sys->name;
+    if (num > 0) {
+	sys->name = malloc(strlen(base_name) + 12);
+	if (!sys->name) {
+	    fprintf(stderr, "Out of memory\n");
+	    exit(1);
+	}
+	sprintf(sys->name, "%s-%u", base_name, num);
+    }
+
+    err = persist_init(sys, "ipmi_sim", sys->name, statedir);
+    if (err) {
+	fprintf(stderr, "Unable to initialize persistence: %s\n",
+		strerror(err));
+	exit(1);
+    }
+
+    read_persist_users(sys);
+
+    err = sol_init(data->emu);
+    if (err) {
+	fprintf(stderr, "Unable to initialize SOL: %s\n",
+		strerror(err));
+	return err;
+    }
+
+    err = read_sol_config(sys);
+    if (err) {
+	fprintf(stderr, "Unable to read SOL configs: %s\n",
+		strerror(err));
+	return err;
+    }
+
+    err = load_dynamic_libs(sys, 0);
+    if (err)
+	return err;
+
+    if (!command_file && (num == 0)) {
+	FILE *tf;
+	command_file = malloc(strlen(BASE_CONF_STR) + 6 + strlen(base_name));
+	if (!command_file) {
+	    fprintf(stderr, "Out of memory\n");
+	    return ENOMEM;
+	}
+	strcpy(command_file, BASE_CONF_STR);
+	strcat(command_file, "/");
+	strcat(command_file, base_name);
+	strcat(command_file, ".emu");
+	tf = fopen(command_file, "r");
+	if (!tf) {
+	    free(command_file);
+	    command_file = NULL;
+	} else {
+	    fclose(tf);
+	}
+    }
+
+    if (command_file)
+	read_command_file(out, data->emu, command_file);
+
+    if (command_string)
+	ipmi_emu_cmd(out, data->emu, command_string);
+
+    if (!sys->bmc_ipmb || !sys->ipmb_addrs[sys->bmc_ipmb]) {
+	sys->log(sys, SETUP_ERROR, NULL,
+		 "No bmc_ipmb specified or configured.");
+	return EINVAL;
+    }
+
+    return 0;
+}
+
 int
 main(int argc, const char *argv[])
 {
-    sys_data_t  sysinfo;
-    misc_data_t data;
+    sys_data_t  *sysinfo;
+    misc_data_t *data;
     int err, rv = 1;
     int i;
     poptContext poptCtx;
@@ -1512,7 +2221,6 @@ main(int argc, const char *argv[])
     console_info_t stdio_console;
     struct sigaction act;
     os_hnd_fd_id_t *conid;
-    lmc_data_t *mc;
     int print_version = 0;
 
     poptCtx = poptGetContext(argv[0], argc, argv, poptOpts, 0);
@@ -1530,69 +2238,70 @@ main(int argc, const char *argv[])
 	    case 'p':
 		persist_enable = 0;
 		break;
+	    case 't':
+		threaded = 1;
+		break;
 	}
     }
     poptFreeContext(poptCtx);
 
+    if (num_bmcs < 1) {
+	fprintf(stderr, "The number of BMCs must be at least 1\n");
+	exit(1);
+    }
+    if (strcmp(bmc_step, "ip") == 0) {
+	bmc_step_ip = 1;
+    } else if (strcmp(bmc_step, "port") != 0) {
+	fprintf(stderr, "The BMC step must be \"port\" or \"ip\"\n");
+	exit(1);
+    }
+
     printf("IPMI Simulator version %s\n\r", PVERSION);
     fflush(stdout);
 
-    global_misc_data = &data;
+    bmcs = calloc(num_bmcs, sizeof(*bmcs));
+    sysinfo = calloc(num_bmcs, sizeof(*sysinfo));
+    if (!bmcs || !sysinfo) {
+	fprintf(stderr, "Out of memory allocating BMCs\n");
+	exit(1);
+    }
+    data = bmcs;
+    global_misc_data = data;
 
-    data.os_hnd = ipmi_posix_setup_os_handler();
-    if (!data.os_hnd) {
+    data->os_hnd = ipmi_posix_setup_os_handler();
+    if (!data->os_hnd) {
 	fprintf(stderr, "Unable to allocate OS handler\n");
 	exit(1);
     }
 
-    err = os_handler_alloc_waiter_factory(data.os_hnd, 0, 0,
-					  &data.waiter_factory);
+    err = os_handler_alloc_waiter_factory(data->os_hnd, 0, 0,
+					  &data->waiter_factory);
     if (err) {
 	fprintf(stderr, "Unable to allocate waiter factory: 0x%x\n", err);
 	exit(1);
     }
 
-    err = data.os_hnd->alloc_timer(data.os_hnd, &data.timer);
+    err = data->os_hnd->alloc_timer(data->os_hnd, &data->timer);
     if (err) {
 	fprintf(stderr, "Unable to allocate timer: 0x%x\n", err);
 	exit(1);
     }
 
-    sysinfo_init(&sysinfo);
-    sysinfo.info = &data;
-    sysinfo.alloc = balloc;
-    sysinfo.free = bfree;
-    sysinfo.get_monotonic_time = ipmi_get_monotonic_time;
-    sysinfo.get_real_time = ipmi_get_real_time;
-    sysinfo.alloc_timer = ipmi_alloc_timer;
-    sysinfo.start_timer = ipmi_start_timer;
-    sysinfo.stop_timer = ipmi_stop_timer;
-    sysinfo.free_timer = ipmi_free_timer;
-    sysinfo.add_io_hnd = ipmi_add_io_hnd;
-    sysinfo.io_set_hnds = ipmi_io_set_hnds;
-    sysinfo.io_set_enables = ipmi_io_set_enables;
-    sysinfo.remove_io_hnd = ipmi_remove_io_hnd;
-    sysinfo.gen_rand = sys_gen_rand;
-    sysinfo.debug = debug;
-    sysinfo.log = sim_log;
-    sysinfo.csmi_send = smi_send;
-    sysinfo.lan_channel_init = lan_channel_init;
-    sysinfo.ser_channel_init = ser_channel_init;
-    sysinfo.ipmb_channel_init = ipmb_channel_init;
-    sysinfo.mc_alloc_unconfigured = is_mc_alloc_unconfigured;
-    sysinfo.resend_atn = is_resend_atn;
-    sysinfo.mc_get_ipmb = is_mc_get_ipmb;
-    sysinfo.mc_get_channelset = is_mc_get_channelset;
-    sysinfo.mc_get_sol = is_mc_get_sol;
-    sysinfo.mc_get_startcmdinfo = is_mc_get_startcmdinfo;
-    sysinfo.mc_get_users = is_mc_get_users;
-    sysinfo.mc_users_changed = is_mc_users_changed;
-    sysinfo.mc_get_pef = is_mc_get_pef;
-    sysinfo.sol_read_config = is_sol_read_config;
-    sysinfo.set_chassis_control_prog = is_set_chassis_control_prog;
-    sysinfo.register_tick_handler = is_register_tick_handler;
-
-    data.sys = &sysinfo;
+    if (threaded) {
+	main_thread = pthread_self();
+	err = sim_queue_init(&mc_queue, data->os_hnd, mc_queue_handler);
+	if (err) {
+	    fprintf(stderr, "Unable to set up MC queue: %s\n", strerror(err));
+	    exit(1);
+	}
+	err = sim_queue_init(&payload_queue, data->os_hnd,
+			     payload_queue_handler);
+	if (err) {
+	    fprintf(stderr, "Unable to set up payload queue: %s\n",
+		    strerror(err));
+	    exit(1);
+	}
+    }
 
     err = pipe(sigpipeh);
     if (err) {
@@ -1610,18 +2319,16 @@ main(int argc, const char *argv[])
 	exit(1);
     }
 
-    err = data.os_hnd->add_fd_to_wait_for(data.os_hnd, sigpipeh[0],
-					  sigchld_ready, &data,
+    err = data->os_hnd->add_fd_to_wait_for(data->os_hnd, sigpipeh[0],
+					  sigchld_ready, data,
 					  NULL, &conid);
     if (err) {
 	fprintf(stderr, "Unable to sigchld pipe wait: 0x%x\n", err);
 	exit(1);
     }
 
-    data.emu = ipmi_emu_alloc(&data, sleeper, &sysinfo);
-
     /* Set this up for console I/O, even if we don't use it. */
-    stdio_console.data = &data;
+    stdio_console.data = data;
     stdio_console.outfd = 1;
     stdio_console.pos = 0;
     stdio_console.echo = 1;
@@ -1637,104 +2344,28 @@ main(int argc, const char *argv[])
     }
     stdio_console.next = NULL;
     stdio_console.prev = NULL;
-    data.consoles = &stdio_console;
-
-    err = is_mc_alloc_unconfigured(&sysinfo, 0x20, &mc);
-    if (err) {
-	if (err == ENOMEM)
-	    fprintf(stderr, "Out of memory allocation BMC MC\n");
-	exit(1);
-    }
-    sysinfo.mc = mc;
-    sysinfo.chan_set = is_mc_get_channelset(mc);
-    sysinfo.startcmd = is_mc_get_startcmdinfo(mc);
-    sysinfo.cpef = is_mc_get_pef(mc);
-    sysinfo.cusers = is_mc_get_users(mc);
-    sysinfo.sol = is_mc_get_sol(mc);
-
-    if (read_config(&sysinfo, config_file, print_version))
-	exit(1);
-
-    if (print_version)
-	exit(0);
-
-    if (!sysinfo.name) {
-	fprintf(stderr, "name not set in config file\n");
-	exit(1);
-    }
-
-    err = persist_init(&sysinfo, "ipmi_sim", sysinfo.name, statedir);
-    if (err) {
-	fprintf(stderr, "Unable to initialize persistence: %s\n",
-		strerror(err));
-	exit(1);
-    }
-
-    read_persist_users(&sysinfo);
-
-    err = sol_init(data.emu);
-    if (err) {
-	fprintf(stderr, "Unable to initialize SOL: %s\n",
-		strerror(err));
-	goto out;
-    }
+    data->consoles = &stdio_console;
 
-    err = read_sol_config(&sysinfo);
-    if (err) {
-	fprintf(stderr, "Unable to read SOL configs: %s\n",
-		strerror(err));
-	goto out;
-    }
-
-    err = load_dynamic_libs(&sysinfo, 0);
-    if (err)
-	goto out;
-
-    if (!command_file) {
-	FILE *tf;
-	command_file = malloc(strlen(BASE_CONF_STR) + 6 + strlen(sysinfo.name));
-	if (!command_file) {
-	    fprintf(stderr, "Out of memory\n");
+    for (i = 0; i < num_bmcs; i++) {
+	bmcs[i].os_hnd = data->os_hnd;
+	bmcs[i].waiter_factory = data->waiter_factory;
+	bmcs[i].sys = &sysinfo[i];
+	if (setup_bmc(&bmcs[i], i, &stdio_console.out, print_version))
 	    goto out;
-	}
-	strcpy(command_file, BASE_CONF_STR);
-	strcat(command_file, "/");
-	strcat(command_file, sysinfo.name);
-	strcat(command_file, ".emu");
-	tf = fopen(command_file, "r");
-	if (!tf) {
-	    free(command_file);
-	    command_file = NULL;
-	} else {
-	    fclose(tf);
-	}
-    }
-
-    if (command_file)
-	read_command_file(&stdio_console.out, data.emu, command_file);
-
-    if (command_string)
-	ipmi_emu_cmd(&stdio_console.out, data.emu, command_string);
-
-    if (!sysinfo.bmc_ipmb || !sysinfo.ipmb_addrs[sysinfo.bmc_ipmb]) {
-	sysinfo.log(&sysinfo, SETUP_ERROR, NULL,
-		    "No bmc_ipmb specified or configured.");
-	goto out;
     }
 
-    sysinfo.console_fd = -1;
-    if (sysinfo.console_addr_len) {
+    if (sysinfo->console_addr_len) {
 	int nfd;
 	int val;
 
-	nfd = socket(sysinfo.console_addr.s_ipsock.s_addr0.sa_family,
+	nfd = socket(sysinfo->console_addr.s_ipsock.s_addr0.sa_family,
 		     SOCK_STREAM, IPPROTO_TCP);
 	if (nfd == -1) {
 	    perror("Console socket open");
 	    goto out;
 	}
-	err = bind(nfd, (struct sockaddr *) &sysinfo.console_addr,
-		   sysinfo.console_addr_len);
+	err = bind(nfd, (struct sockaddr *) &sysinfo->console_addr,
+		   sysinfo->console_addr_len);
 	if (err) {
 	    perror("bind to console socket");
 	    goto out;
@@ -1751,10 +2382,10 @@ main(int argc, const char *argv[])
 	    perror("console setsockopt reuseaddr");
 	    goto out;
 	}
-	sysinfo.console_fd = nfd;
+	sysinfo->console_fd = nfd;
 
-	err = data.os_hnd->add_fd_to_wait_for(data.os_hnd, nfd,
-					      console_bind_ready, &data,
+	err = data->os_hnd->add_fd_to_wait_for(data->os_hnd, nfd,
+					      console_bind_ready, data,
 					      NULL, &conid);
 	if (err) {
 	    fprintf(stderr, "Unable to add console wait: 0x%x\n", err);
@@ -1768,7 +2399,7 @@ main(int argc, const char *argv[])
 	init_term();
 
 	err = write(1, "> ", 2);
-	err = data.os_hnd->add_fd_to_wait_for(data.os_hnd, 0,
+	err = data->os_hnd->add_fd_to_wait_for(data->os_hnd, 0,
 					      user_data_ready, &stdio_console,
 					      NULL, &stdio_console.conid);
 	if (err) {
@@ -1777,7 +2408,8 @@ main(int argc, const char *argv[])
 	}
     }
 
-    post_init_dynamic_libs(&sysinfo);
+    for (i = 0; i < num_bmcs; i++)
+	post_init_dynamic_libs(&sysinfo[i]);
 
     act.sa_handler = shutdown_handler;
     act.sa_flags = SA_RESETHAND;
@@ -1791,13 +2423,16 @@ main(int argc, const char *argv[])
 
     tv.tv_sec = 1;
     tv.tv_usec = 0;
-    err = data.os_hnd->start_timer(data.os_hnd, data.timer, &tv, tick, &data);
+    err = data->os_hnd->start_timer(data->os_hnd, data->timer, &tv, tick, data);
     if (err) {
 	fprintf(stderr, "Unable to start timer: 0x%x\n", err);
 	goto out;
     }
 
-    data.os_hnd->operation_loop(data.os_hnd);
+    if (threaded)
+	sim_start_chan_threads();
+
+    data->os_hnd->operation_loop(data->os_hnd);
     rv = 0;
   out:
     shutdown_handler(0);
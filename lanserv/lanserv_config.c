@@ -155,6 +155,13 @@ lanserv_read_config(sys_data_t    *sys,
 		    lan->port = 0;
 		lan->port = htons(lan->port);
 	    }
+	} else if (strcmp(tok, "max_sessions") == 0) {
+	    err = get_uint(&tokptr, &val, &errstr);
+	    if (!err && (val < 1 || val > SESSION_MASK)) {
+		errstr = "max_sessions must be 1 to 65535";
+		err = -1;
+	    }
+	    lan->max_sessions = val;
 	} else if (strcmp(tok, "guid") == 0) {
 	    if (!lan->guid)
 		lan->guid = sys->alloc(sys, 16);
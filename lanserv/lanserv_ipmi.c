@@ -61,6 +61,12 @@
 
 #ifdef HAVE_OPENSSL
 #include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#define HMAC_USE_EVP_MAC
+#elif OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define HMAC_USE_HMAC_CTX
+#endif
 #endif
 
 #include <OpenIPMI/ipmi_msgbits.h>
@@ -106,25 +112,211 @@ find_user(lanserv_data_t *lan, uint8_t *user, int name_only_lookup, int priv)
     return rv;
 }
 
+static session_t *
+handle_to_session(lanserv_data_t *lan, unsigned int handle)
+{
+    session_t *session;
+
+    if (handle == 0 || handle >= lan->num_sessions)
+	return NULL;
+    session = lan->sessions[handle];
+    if (!session->active)
+	return NULL;
+    return session;
+}
+
+/*
+ * The session handle in IPMI messages is a byte, sessions past 255
+ * don't have one and can only be found by their session ID.
+ */
+static unsigned char
+session_handle_byte(unsigned int handle)
+{
+    if (handle > 0xff)
+	return 0;
+    return handle;
+}
+
 static session_t *
 sid_to_session(lanserv_data_t *lan, unsigned int sid)
 {
-    int       idx;
     session_t *session;
 
     if (sid & 1)
 	return NULL;
-    idx = (sid >> 1) & SESSION_MASK;
-    if (idx > MAX_SESSIONS)
-	return NULL;
-    session = lan->sessions + idx;
-    if (!session->active)
+    session = handle_to_session(lan, (sid >> 1) & SESSION_MASK);
+    if (!session)
 	return NULL;
     if (session->sid != sid)
 	return NULL;
     return session;
 }
 
+static unsigned int
+addr_hash(const void *addr, int addr_len, uint32_t rem_sid)
+{
+    const unsigned char *d = addr;
+    uint32_t h = 2166136261U;
+    int i;
+
+    for (i = 0; i < addr_len; i++)
+	h = (h ^ d[i]) * 16777619U;
+    for (i = 0; i < 4; i++, rem_sid >>= 8)
+	h = (h ^ (rem_sid & 0xff)) * 16777619U;
+    return h;
+}
+
+static void
+addr_hash_add(lanserv_data_t *lan, session_t *session)
+{
+    unsigned int h = addr_hash(session->src_addr, session->src_len,
+			       session->rem_sid) & (lan->addr_hash_size - 1);
+
+    session->addr_next = lan->addr_hash[h];
+    lan->addr_hash[h] = session;
+    session->addr_hashed = 1;
+}
+
+static void
+addr_hash_del(lanserv_data_t *lan, session_t *session)
+{
+    unsigned int h = addr_hash(session->src_addr, session->src_len,
+			       session->rem_sid) & (lan->addr_hash_size - 1);
+    session_t **p = &lan->addr_hash[h];
+
+    while (*p) {
+	if (*p == session) {
+	    *p = session->addr_next;
+	    break;
+	}
+	p = &(*p)->addr_next;
+    }
+    session->addr_hashed = 0;
+}
+
+/* Find the RMCP+ session a remote console opened with rem_sid. */
+static session_t *
+find_addr_session(lanserv_data_t *lan, msg_t *msg, uint32_t rem_sid)
+{
+    session_t *session;
+    unsigned int h;
+
+    if (!lan->addr_hash)
+	return NULL;
+    h = addr_hash(msg->src_addr, msg->src_len, rem_sid);
+    session = lan->addr_hash[h & (lan->addr_hash_size - 1)];
+    while (session) {
+	if (session->rem_sid == rem_sid
+	    && session->src_len == (int) msg->src_len
+	    && memcmp(session->src_addr, msg->src_addr, msg->src_len) == 0)
+	    return session;
+	session = session->addr_next;
+    }
+    return NULL;
+}
+
+static void
+free_session_put(lanserv_data_t *lan, session_t *session)
+{
+    session->next_free = NULL;
+    if (lan->free_tail)
+	lan->free_tail->next_free = session;
+    else
+	lan->free_head = session;
+    lan->free_tail = session;
+}
+
+/*
+ * Grow the session table (and the address hash with it) by doubling
+ * it, up to the session limit.
+ */
+static int
+grow_sessions(lanserv_data_t *lan)
+{
+    sys_data_t *sys = lan->sys;
+    unsigned int i, start, new_num, hash_size;
+    session_t **new_sessions, **new_hash;
+
+    if (lan->num_sessions > lan->max_sessions)
+	return ENOSPC;
+    new_num = lan->num_sessions * 2;
+    if (new_num < 16)
+	new_num = 16;
+    if (new_num > lan->max_sessions + 1)
+	new_num = lan->max_sessions + 1;
+
+    hash_size = 16;
+    while (hash_size < new_num)
+	hash_size <<= 1;
+
+    new_sessions = sys->alloc(sys, new_num * sizeof(session_t *));
+    if (!new_sessions)
+	return ENOMEM;
+    new_hash = sys->alloc(sys, hash_size * sizeof(session_t *));
+    if (!new_hash) {
+	sys->free(sys, new_sessions);
+	return ENOMEM;
+    }
+    start = lan->num_sessions ? lan->num_sessions : 1;
+    for (i = start; i < new_num; i++) {
+	new_sessions[i] = sys->alloc(sys, sizeof(session_t));
+	if (!new_sessions[i]) {
+	    while (i > start)
+		sys->free(sys, new_sessions[--i]);
+	    sys->free(sys, new_hash);
+	    sys->free(sys, new_sessions);
+	    return ENOMEM;
+	}
+	new_sessions[i]->handle = i;
+    }
+
+    if (lan->sessions) {
+	memcpy(new_sessions, lan->sessions,
+	       lan->num_sessions * sizeof(session_t *));
+	sys->free(sys, lan->sessions);
+    }
+    if (lan->addr_hash)
+	sys->free(sys, lan->addr_hash);
+    lan->addr_hash = new_hash;
+    lan->addr_hash_size = hash_size;
+    for (i = 1; i < lan->num_sessions; i++) {
+	if (new_sessions[i]->addr_hashed)
+	    addr_hash_add(lan, new_sessions[i]);
+    }
+
+    lan->sessions = new_sessions;
+    lan->num_sessions = new_num;
+    for (i = start; i < new_num; i++)
+	free_session_put(lan, new_sessions[i]);
+
+    return 0;
+}
+
+/*
+ * Allocate a session from the free list, least recently used first.
+ * The session is returned active and counted, close_session() gives
+ * it back.
+ */
+static session_t *
+find_free_session(lanserv_data_t *lan)
+{
+    session_t *session;
+
+    if (lan->channel.active_sessions >= lan->max_sessions)
+	return NULL;
+    if (!lan->free_head && grow_sessions(lan))
+	return NULL;
+
+    session = lan->free_head;
+    lan->free_head = session->next_free;
+    if (!lan->free_head)
+	lan->free_tail = NULL;
+    session->next_free = NULL;
+    session->active = 1;
+    lan->channel.active_sessions++;
+    return session;
+}
+
 static void
 close_session(lanserv_data_t *lan, session_t *session)
 {
@@ -142,17 +334,19 @@ close_session(lanserv_data_t *lan, session_t *session)
     }
 
     session->active = 0;
+    if (session->integh)
+	session->integh->cleanup(lan, session);
+    if (session->confh)
+	session->confh->cleanup(lan, session);
     if (session->authdata) {
 	if (session->authtype <= 4)
 	    ipmi_auths[session->authtype].authcode_cleanup(session->authdata);
 	else
 	    memset(&session->auth_data, 0, sizeof(auth_data_t));
     }
-    if (session->integh)
-	session->integh->cleanup(lan, session);
-    if (session->confh)
-	session->confh->cleanup(lan, session);
     lan->channel.active_sessions--;
+    if (session->addr_hashed)
+	addr_hash_del(lan, session);
     if (session->src_addr) {
 	lan->channel.sys->free(lan->channel.sys, session->src_addr);
 	session->src_addr = NULL;
@@ -161,6 +355,7 @@ close_session(lanserv_data_t *lan, session_t *session)
     old_handle = session->handle;
     memset(session, 0, sizeof(session_t));
     session->handle = old_handle;
+    free_session_put(lan, session);
 }
 
 static int
@@ -567,12 +762,12 @@ lan_handle_send_msg(channel_t *chan, msg_t *imsg,
     /* First byte of the message is the channel handle field. */
 
     handle = imsg->data[1];
-    if (handle > MAX_SESSIONS + 1 || !lan->sessions[handle].active) {
+    session = handle_to_session(lan, handle);
+    if (!session) {
 	rdata[0] = IPMI_NOT_PRESENT_CC;
 	*rdata_len = 1;
 	return;
     }
-    session = &lan->sessions[handle];
 
     msg.daddr = imsg->data[2];
     msg.dlun = imsg->data[3] & 0x3;
@@ -609,7 +804,8 @@ static int
 lan_format_lun_2(channel_t *chan, msg_t *qmsg,
 		 unsigned char *rdata, unsigned int *rdata_len)
 {
-    qmsg->data[0] = (qmsg->sid >> 1) & MAX_SESSIONS; /* Extract handle. */
+    /* Extract handle. */
+    qmsg->data[0] = session_handle_byte((qmsg->sid >> 1) & SESSION_MASK);
     qmsg->data[1] = qmsg->daddr;
     qmsg->data[2] = (qmsg->netfn << 2) | qmsg->dlun;
     qmsg->data[3] = -ipmb_checksum(qmsg->data, 3, 0);
@@ -748,7 +944,7 @@ handle_get_session_challenge(lanserv_data_t *lan, msg_t *msg)
 	return;
     }
 
-    if (lan->channel.active_sessions >= MAX_SESSIONS) {
+    if (lan->channel.active_sessions >= lan->max_sessions) {
 	lan->sys->log(lan->sys, SESSION_CHALLENGE_FAILED, msg,
 		      "Session challenge failed: To many open sessions");
 	return_err(lan, msg, NULL, IPMI_OUT_OF_SPACE_CC);
@@ -912,27 +1108,6 @@ ifree(void *info, void *data)
     lan->channel.sys->free(lan->channel.sys, data);
 }
 
-static session_t *
-find_free_session(lanserv_data_t *lan)
-{
-    unsigned int i, j = lan->last_session + 1;
-
-    /* Find a free session.  Session 0 is invalid.  Round-robin them. */
-    for (i = 0; i <= MAX_SESSIONS; i++, j++) {
-	if (j == 0)
-	    continue;
-	if (j > MAX_SESSIONS + 1) {
-	    j = 0;
-	    continue;
-	}
-	if (! lan->sessions[j].active) {
-	    lan->last_session = j;
-	    return &(lan->sessions[j]);
-	}
-    }
-    return NULL;
-}
-
 static void
 handle_temp_session(lanserv_data_t *lan, msg_t *msg)
 {
@@ -989,7 +1164,7 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
 	return;
     }
 
-    if (lan->channel.active_sessions >= MAX_SESSIONS) {
+    if (lan->channel.active_sessions >= lan->max_sessions) {
 	lan->sys->log(lan->sys, NEW_SESSION_FAILED, msg,
 		      "Session challenge failed: To many open sessions");
 	return;
@@ -1071,21 +1246,20 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
 	lan->sys->log(lan->sys, NEW_SESSION_FAILED, msg,
 		      "Activate session failed: out of memory");
 	return_err(lan, msg, &dummy_session, IPMI_UNKNOWN_ERR_CC);
-	goto out_free;
+	goto out_close;
     }
     memcpy(session->src_addr, msg->src_addr, msg->src_len);
     session->src_len = msg->src_len;
 
-    session->active = 1;
-    session->authtype = auth;
-    session->authdata = dummy_session.authdata;
     rv = lan->gen_rand(lan, seq_data, 4);
     if (rv) {
 	lan->sys->log(lan->sys, NEW_SESSION_FAILED, msg,
 		 "Activate session failed: Could not generate random number");
 	return_err(lan, msg, &dummy_session, IPMI_UNKNOWN_ERR_CC);
-	goto out_free;
+	goto out_close;
     }
+    session->authtype = auth;
+    session->authdata = dummy_session.authdata;
     session->recv_seq = ipmi_get_uint32(seq_data) & ~1;
     if (!session->recv_seq)
 	session->recv_seq = 2;
@@ -1095,7 +1269,6 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
     session->userid = user->idx;
     session->time_left = lan->default_session_timeout;
 
-    lan->channel.active_sessions++;
     lan->sys->log(lan->sys, NEW_SESSION, msg,
 	     "Activate session: Session opened for user 0x%x, max priv %d",
 	     user_idx, priv);
@@ -1117,6 +1290,8 @@ handle_temp_session(lanserv_data_t *lan, msg_t *msg)
     return_rsp_data(lan, msg, &dummy_session, data, 11);
     return;
 
+ out_close:
+    close_session(lan, session);
  out_free:
     ipmi_auths[msg->authtype].authcode_cleanup(dummy_session.authdata);
 }
@@ -1276,23 +1451,22 @@ handle_get_session_info(lanserv_data_t *lan, session_t *session, msg_t *msg)
 	}
 	
 	handle = msg->data[1];
-	if (handle >= MAX_SESSIONS) {
+	if (handle == 0) {
 	    return_err(lan, msg, session, IPMI_INVALID_DATA_FIELD_CC);
 	    return;
 	}
-	if (lan->sessions[handle].active)
-	    nses = &lan->sessions[handle];
+	nses = handle_to_session(lan, handle);
     } else if (idx == 0) {
 	nses = session;
     } else {
-	int i;
+	unsigned int i;
 
 	if (idx <= lan->channel.active_sessions) {
-	    for (i=0; i<=MAX_SESSIONS; i++) {
-		if (lan->sessions[i].active) {
+	    for (i = 1; i < lan->num_sessions; i++) {
+		if (lan->sessions[i]->active) {
 		    idx--;
 		    if (idx == 0) {
-			nses = &lan->sessions[i];
+			nses = lan->sessions[i];
 			break;
 		    }
 		}
@@ -1300,11 +1474,14 @@ handle_get_session_info(lanserv_data_t *lan, session_t *session, msg_t *msg)
 	}
     }
 
+    /* The session counts are 6-bit fields. */
     data[0] = 0;
-    data[2] = MAX_SESSIONS;
-    data[3] = lan->channel.active_sessions;
+    data[2] = (lan->max_sessions > MAX_SESSIONS ? MAX_SESSIONS
+	       : lan->max_sessions);
+    data[3] = (lan->channel.active_sessions > MAX_SESSIONS ? MAX_SESSIONS
+	       : lan->channel.active_sessions);
     if (nses) {
-	data[1] = nses->handle;
+	data[1] = session_handle_byte(nses->handle);
 	data[4] = nses->userid;
 	data[5] = nses->priv;
 	data[6] = lan->channel.channel_num;
@@ -2138,9 +2315,22 @@ static auth_handlers_t rakp_hmac_md5 =
 };
 #define RAKP_INIT , &rakp_hmac_sha1, &rakp_hmac_md5
 
+static void
+hmac_cleanup(lanserv_data_t *lan, session_t *session)
+{
+#if defined(HMAC_USE_EVP_MAC)
+    EVP_MAC_CTX_free(session->auth_data.ictx);
+#elif defined(HMAC_USE_HMAC_CTX)
+    HMAC_CTX_free(session->auth_data.ictx);
+#endif
+    session->auth_data.ictx = NULL;
+}
+
 static int
 hmac_sha1_init(lanserv_data_t *lan, session_t *session)
 {
+    /* RAKP may have been redone, drop any old key. */
+    hmac_cleanup(lan, session);
     session->auth_data.ikey2 = EVP_sha1();
     session->auth_data.ikey = session->auth_data.k1;
     session->auth_data.ikey_len = 20;
@@ -2152,6 +2342,8 @@ static int
 hmac_md5_init(lanserv_data_t *lan, session_t *session)
 {
     user_t *user = &(lan->users[session->userid]);
+
+    hmac_cleanup(lan, session);
     session->auth_data.ikey2 = EVP_md5();
     session->auth_data.ikey = user->pw;
     session->auth_data.ikey_len = 16;
@@ -2159,9 +2351,67 @@ hmac_md5_init(lanserv_data_t *lan, session_t *session)
     return 0;
 }
 
-static void
-hmac_cleanup(lanserv_data_t *lan, session_t *session)
+/*
+ * The integrity key is only known once RAKP is done, so the HMAC
+ * context is keyed on first use.  After that it is just reset for
+ * each message, which keeps the key schedule.
+ */
+static int
+hmac_calc(auth_data_t *a, const unsigned char *data, unsigned int len,
+	  unsigned char *integ)
 {
+#if defined(HMAC_USE_EVP_MAC)
+    EVP_MAC_CTX *ctx = a->ictx;
+    size_t      ilen;
+
+    if (!ctx) {
+	EVP_MAC    *mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+	OSSL_PARAM params[2];
+
+	if (!mac)
+	    return ENOSYS;
+	ctx = EVP_MAC_CTX_new(mac);
+	EVP_MAC_free(mac);
+	if (!ctx)
+	    return ENOMEM;
+	params[0] = OSSL_PARAM_construct_utf8_string
+	    (OSSL_MAC_PARAM_DIGEST, (char *) EVP_MD_get0_name(a->ikey2), 0);
+	params[1] = OSSL_PARAM_construct_end();
+	if (!EVP_MAC_init(ctx, a->ikey, a->ikey_len, params)) {
+	    EVP_MAC_CTX_free(ctx);
+	    return EINVAL;
+	}
+	a->ictx = ctx;
+    } else if (!EVP_MAC_init(ctx, NULL, 0, NULL)) {
+	return EINVAL;
+    }
+    if (!EVP_MAC_update(ctx, data, len)
+	|| !EVP_MAC_final(ctx, integ, &ilen, 20))
+	return EINVAL;
+#elif defined(HMAC_USE_HMAC_CTX)
+    HMAC_CTX     *ctx = a->ictx;
+    unsigned int ilen;
+
+    if (!ctx) {
+	ctx = HMAC_CTX_new();
+	if (!ctx)
+	    return ENOMEM;
+	if (!HMAC_Init_ex(ctx, a->ikey, a->ikey_len, a->ikey2, NULL)) {
+	    HMAC_CTX_free(ctx);
+	    return EINVAL;
+	}
+	a->ictx = ctx;
+    } else if (!HMAC_Init_ex(ctx, NULL, 0, NULL, NULL)) {
+	return EINVAL;
+    }
+    if (!HMAC_Update(ctx, data, len) || !HMAC_Final(ctx, integ, &ilen))
+	return EINVAL;
+#else
+    unsigned int ilen;
+
+    HMAC(a->ikey2, a->ikey, a->ikey_len, data, len, integ, &ilen);
+#endif
+    return 0;
 }
 
 static int 
@@ -2170,13 +2420,15 @@ hmac_add(lanserv_data_t *lan, session_t *session,
 	 unsigned int *data_len, unsigned int data_size)
 {
     auth_data_t   *a = &session->auth_data;
-    unsigned int  ilen;
     unsigned char integ[20];
+    int           rv;
 
     if (((*data_len) + a->ikey_len) > data_size)
 	return E2BIG;
 
-    HMAC(a->ikey2, a->ikey, a->ikey_len, pos+4, (*data_len)-4, integ, &ilen);
+    rv = hmac_calc(a, pos+4, (*data_len)-4, integ);
+    if (rv)
+	return rv;
     memcpy(pos+(*data_len), integ, a->integ_len);
     *data_len += a->integ_len;
     return 0;
@@ -2187,13 +2439,12 @@ hmac_check(lanserv_data_t *lan, session_t *session, msg_t *msg)
 {
     unsigned char integ[20];
     auth_data_t   *a = &session->auth_data;
-    unsigned int  ilen;
 
     if ((msg->len-5) < a->integ_len)
 	return E2BIG;
 
-    HMAC(a->ikey2, a->ikey, a->ikey_len, msg->data, msg->len-a->integ_len,
-	 integ, &ilen);
+    if (hmac_calc(a, msg->data, msg->len-a->integ_len, integ))
+	return EINVAL;
     if (memcmp(msg->data+msg->len-a->integ_len, integ, a->integ_len) != 0)
 	return EINVAL;
     return 0;
@@ -2287,17 +2538,52 @@ static integ_handlers_t md5_integ =
 #define HMAC_INIT , &hmac_sha1_integ, &hmac_md5_integ
 #define MD5_INIT , &md5_integ
 
+static void
+aes_cbc_cleanup(lanserv_data_t *lan, session_t *session)
+{
+    if (session->auth_data.enc_ctx)
+	EVP_CIPHER_CTX_free(session->auth_data.enc_ctx);
+    if (session->auth_data.dec_ctx)
+	EVP_CIPHER_CTX_free(session->auth_data.dec_ctx);
+    session->auth_data.enc_ctx = NULL;
+    session->auth_data.dec_ctx = NULL;
+}
+
 static int
 aes_cbc_init(lanserv_data_t *lan, session_t *session)
 {
+    /* RAKP may have been redone, drop any old key. */
+    aes_cbc_cleanup(lan, session);
     session->auth_data.ckey = session->auth_data.k2;
     session->auth_data.ckey_len = 16;
     return 0;
 }
 
-static void
-aes_cbc_cleanup(lanserv_data_t *lan, session_t *session)
+/*
+ * K2 is only known once RAKP is done, so the cipher contexts are
+ * keyed on first use.  After that only the IV is set per message,
+ * the AES key schedule is kept.
+ */
+static EVP_CIPHER_CTX *
+aes_cbc_ctx(auth_data_t *a, void **ctxp, int enc, unsigned char *iv)
 {
+    EVP_CIPHER_CTX *ctx = *ctxp;
+
+    if (!ctx) {
+	ctx = EVP_CIPHER_CTX_new();
+	if (!ctx)
+	    return NULL;
+	if (!EVP_CipherInit_ex(ctx, EVP_aes_128_cbc(), NULL, a->ckey, NULL,
+			       enc)) {
+	    EVP_CIPHER_CTX_free(ctx);
+	    return NULL;
+	}
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	*ctxp = ctx;
+    }
+    if (!EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, enc))
+	return NULL;
+    return ctx;
 }
 
 static int
@@ -2307,11 +2593,10 @@ aes_cbc_encrypt(lanserv_data_t *lan, session_t *session,
 {
     auth_data_t    *a = &session->auth_data;
     unsigned int   l = *data_len;
-    unsigned char  *d;
     unsigned char  *iv;
     unsigned int   i;
     EVP_CIPHER_CTX *ctx;
-    int            rv;
+    int            rv = 0;
     int            outlen;
     int            tmplen;
     unsigned char  *padpos;
@@ -2331,16 +2616,8 @@ aes_cbc_encrypt(lanserv_data_t *lan, session_t *session,
     if (l > *data_size)
 	return E2BIG;
 
-    /* We store the unencrypted data here, then crypt into the real
-       data. */
-    d = lan->sys->alloc(lan->sys, l);
-    if (!d)
-	return ENOMEM;
-
-    memcpy(d, *pos, *data_len);
-
-    /* Now add the padding. */
-    padpos = d + *data_len;
+    /* Now add the padding, the data is encrypted in place. */
+    padpos = (*pos) + *data_len;
     padval = 1;
     for (i=0; i<padlen; i++, padpos++, padval++)
 	*padpos = padval;
@@ -2349,38 +2626,24 @@ aes_cbc_encrypt(lanserv_data_t *lan, session_t *session,
     /* Now create the initialization vector, including making room for it. */
     iv = (*pos) - 16;
     rv = lan->gen_rand(lan, iv, 16);
-    if (rv) {
-	lan->sys->free(lan->sys, d);
+    if (rv)
 	return rv;
-    }
     *hdr_left -= 16;
     *data_size += 16;
 
     /* Ok, we're set to do the crypt operation. */
-    ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-	    rv = ENOMEM;
-	    goto out_cleanup;
-    }
-    EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, a->ckey, iv);
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-    if (!EVP_EncryptUpdate(ctx, *pos, &outlen, d, l)) {
-	rv = ENOMEM;
-	goto out_cleanup;
-    }
-    if (!EVP_EncryptFinal_ex(ctx, (*pos) + outlen, &tmplen)) {
-	rv = ENOMEM; /* right? */
-	goto out_cleanup;
-    }
+    ctx = aes_cbc_ctx(a, &a->enc_ctx, 1, iv);
+    if (!ctx)
+	return ENOMEM;
+    if (!EVP_EncryptUpdate(ctx, *pos, &outlen, *pos, l))
+	return ENOMEM;
+    if (!EVP_EncryptFinal_ex(ctx, (*pos) + outlen, &tmplen))
+	return ENOMEM; /* right? */
     outlen += tmplen;
 
     *pos = iv;
     *data_len = outlen + 16;
-
- out_cleanup:
-    EVP_CIPHER_CTX_free(ctx);
-    lan->sys->free(lan->sys, d);
-    return rv;
+    return 0;
 }
 
 static int
@@ -2388,58 +2651,36 @@ aes_cbc_decrypt(lanserv_data_t *lan, session_t *session, msg_t *msg)
 {
     auth_data_t    *a = &session->auth_data;
     unsigned int   l = msg->len;
-    unsigned char  *d;
     EVP_CIPHER_CTX *ctx;
     int            outlen;
     unsigned char  *pad;
     int            padlen;
-    int            rv = 0;
 
     if (l < 32)
 	/* Not possible with this algorithm. */
 	return EINVAL;
     l -= 16;
 
-    /* We store the encrypted data here, then decrypt into the real
-       data. */
-    d = lan->sys->alloc(lan->sys, l);
-    if (!d)
+    /* Ok, we're set to do the decrypt operation, in place. */
+    ctx = aes_cbc_ctx(a, &a->dec_ctx, 0, msg->data);
+    if (!ctx)
 	return ENOMEM;
+    if (!EVP_DecryptUpdate(ctx, msg->data+16, &outlen, msg->data+16, l))
+	return EINVAL;
 
-    memcpy(d, msg->data+16, l);
-
-    /* Ok, we're set to do the decrypt operation. */
-    ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-	    rv = ENOMEM;
-	    goto out_cleanup;
-    }
-    EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, a->k2, msg->data);
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-    if (!EVP_DecryptUpdate(ctx, msg->data+16, &outlen, d, l)) {
-	rv = EINVAL;
-	goto out_cleanup;
-    }
-
-    if (outlen < 16) {
-	rv = EINVAL;
-	goto out_cleanup;
-    }
+    if (outlen < 16)
+	return EINVAL;
 
     /* Now remove the padding */
     pad = msg->data + 16 + outlen - 1;
     padlen = *pad;
-    if (padlen >= 16) {
-	rv = EINVAL;
-	goto out_cleanup;
-    }
+    if (padlen >= 16)
+	return EINVAL;
     outlen--;
     pad--;
     while (padlen) {
-	if (*pad != padlen) {
-	    rv = EINVAL;
-	    goto out_cleanup;
-	}
+	if (*pad != padlen)
+	    return EINVAL;
 	outlen--;
 	pad--;
 	padlen--;
@@ -2447,11 +2688,7 @@ aes_cbc_decrypt(lanserv_data_t *lan, session_t *session, msg_t *msg)
     
     msg->data += 16; /* Remove the init vector */
     msg->len = outlen;
-
- out_cleanup:
-    EVP_CIPHER_CTX_free(ctx);
-    lan->sys->free(lan->sys, d);
-    return rv;
+    return 0;
 }
 
 static conf_handlers_t aes_cbc_conf =
@@ -2611,6 +2848,15 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
 	goto out_err;
     }
 
+    /*
+     * A console that retransmits its open session request (because
+     * it didn't see the response) would otherwise leave a half open
+     * session behind for each retry.  Replace the old one instead.
+     */
+    session = find_addr_session(lan, msg, rem_sid);
+    if (session && session->state == SESSION_STATE_OPENED)
+	close_session(lan, session);
+
     session = find_free_session(lan);
     if (!session) {
 	lan->sys->log(lan->sys, NEW_SESSION_FAILED, msg,
@@ -2629,7 +2875,6 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
     memcpy(session->src_addr, msg->src_addr, msg->src_len);
     session->src_len = msg->src_len;
 
-    session->active = 1;
     session->in_startup = 1;
     session->authtype = IPMI_AUTHTYPE_RMCP_PLUS;
     rv = lan->gen_rand(lan, session->auth_data.rand, 16);
@@ -2644,6 +2889,7 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
     session->unauth_recv_seq = 1;
     session->unauth_xmit_seq = 1;
     session->rem_sid = rem_sid;
+    addr_hash_add(lan, session);
 
     session->auth = auth;
     session->authh = auths[auth];
@@ -2680,8 +2926,6 @@ handle_open_session_payload(lanserv_data_t *lan, msg_t *msg)
     data[31] = 8;
     data[32] = conf;
 
-    lan->channel.active_sessions++;
-
     // progress session state
     session->state = SESSION_STATE_OPENED;
 
@@ -2897,6 +3141,8 @@ ipmi_register_payload(unsigned int payload_id, ipmi_payload_handler_cb handler)
 {
     if (payload_id >= 64)
 	return EINVAL;
+    if (payload_handlers[payload_id] == handler)
+	return 0;
     if (payload_handlers[payload_id])
 	return EBUSY;
     payload_handlers[payload_id] = handler;
@@ -3207,20 +3453,22 @@ static void
 ipmi_lan_tick(void *info, unsigned int time_since_last)
 {
     lanserv_data_t *lan = info;
-    int i;
+    unsigned int i;
+    session_t *session;
 
-    for (i=1; i<=MAX_SESSIONS; i++) {
-	if (lan->sessions[i].active) {
-	    if (lan->sessions[i].time_left <= time_since_last) {
+    for (i = 1; i < lan->num_sessions; i++) {
+	session = lan->sessions[i];
+	if (session->active) {
+	    if (session->time_left <= time_since_last) {
 		msg_t msg = { 0 }; /* A fake message to hold the address. */
 
-		msg.src_addr = lan->sessions[i].src_addr;
-		msg.src_len = lan->sessions[i].src_len;
+		msg.src_addr = session->src_addr;
+		msg.src_len = session->src_len;
 		lan->sys->log(lan->sys, SESSION_CLOSED, &msg,
 			      "Session closed: Closed due to timeout");
-		close_session(lan, &(lan->sessions[i]));
+		close_session(lan, session);
 	    } else {
-		lan->sessions[i].time_left -= time_since_last;
+		session->time_left -= time_since_last;
 	    }
 	}
     }
@@ -3312,9 +3560,10 @@ ipmi_lan_init(lanserv_data_t *lan)
     int rv;
     uint8_t challenge_data[16];
 
-    for (i=0; i<=MAX_SESSIONS; i++) {
-	lan->sessions[i].handle = i;
-    }
+    if (lan->max_sessions == 0)
+	lan->max_sessions = MAX_SESSIONS;
+    if (lan->max_sessions > SESSION_MASK)
+	lan->max_sessions = SESSION_MASK;
 
     rv = read_lan_config(lan);
     if (rv)
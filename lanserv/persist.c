@@ -58,6 +58,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <stdarg.h>
@@ -86,7 +87,6 @@ struct persist_s {
 
 int persist_enable = 1;
 
-static char *app = NULL;
 static const char *basedir;
 
 int
@@ -97,12 +97,13 @@ persist_init(struct sys_data_s *sys,
     char *dname;
     struct stat st;
     char *n;
+    char *app;
     int rv = 0;
 
     if (!persist_enable)
 	return 0;
 
-    if (app)
+    if (sys->persist_app)
 	return EBUSY;
     
     basedir = ibasedir;
@@ -121,6 +122,7 @@ persist_init(struct sys_data_s *sys,
 	sys->free(sys, app);
 	return ENOMEM;
     }
+    sys->persist_app = app;
     strcpy(dname, basedir);
     strcat(dname, "/");
     strcat(dname, app);
@@ -198,6 +200,7 @@ alloc_persist(struct sys_data_s *sys, const char *name, ...)
 static char *
 get_fname(persist_t *p, char *sfx)
 {
+    const char *app = p->sys->persist_app;
     int len = (strlen(basedir) + strlen(app) + strlen(p->name)
 	       + strlen(sfx) + 3);
     char *fname = p->sys->alloc(p->sys, len);
@@ -274,31 +277,22 @@ write_data(void *idata, unsigned int len, FILE *f)
     }
 }
 
-persist_t *
-read_persist(struct sys_data_s *sys, const char *name, ...)
+/*
+ * Parse the lines from the file into items in the persist.  If
+ * in_order is set, the items are kept in the order they appear in the
+ * file, otherwise they are added to the front like alloc_pi() does.
+ */
+static int
+read_persist_lines(persist_t *p, FILE *f, int in_order)
 {
-    char *fname;
-    va_list ap;
-    persist_t *p = NULL;
-    FILE *f;
+    struct sys_data_s *sys = p->sys;
+    struct pitem **tail = &p->items;
     char *line;
     char *end;
     size_t n;
 
-    if (!persist_enable)
-	return NULL;
-
-    va_start(ap, name);
-    p = alloc_vpersist(sys, name, ap);
-    if (!p)
-	goto out_err;
-    fname = get_fname(p, "");
-    if (!fname)
-	goto out_err;
-    f = fopen(fname, "r");
-    sys->free(sys, fname);
-    if (!f)
-	goto out_err;
+    while (*tail)
+	tail = &(*tail)->next;
 
     for (line = NULL; getline(&line, &n, f) != -1;
 	 sys->free(sys, line), line = NULL) {
@@ -318,14 +312,14 @@ read_persist(struct sys_data_s *sys, const char *name, ...)
 	pi = sys->alloc(sys, sizeof(*pi));
 	if (!pi) {
 	    sys->free(sys, line);
-	    goto out_err;
+	    return ENOMEM;
 	}
 
 	pi->iname = sys_strdup(sys, name);
 	if (!pi->iname) {
 	    sys->free(sys, pi);
 	    sys->free(sys, line);
-	    goto out_err;
+	    return ENOMEM;
 	}
 	pi->type = type[0];
 
@@ -353,36 +347,99 @@ read_persist(struct sys_data_s *sys, const char *name, ...)
 	    continue;
 	}
 
-	pi->next = p->items;
-	p->items = pi;
+	if (in_order) {
+	    pi->next = NULL;
+	    *tail = pi;
+	    tail = &pi->next;
+	} else {
+	    pi->next = p->items;
+	    p->items = pi;
+	}
     }
 
-    va_end(ap);
+    return 0;
+}
+
+static persist_t *
+read_vpersist(struct sys_data_s *sys, char *sfx, int in_order,
+	      const char *name, va_list ap)
+{
+    char *fname;
+    persist_t *p = NULL;
+    FILE *f;
+    int rv;
+
+    if (!persist_enable)
+	return NULL;
+
+    p = alloc_vpersist(sys, name, ap);
+    if (!p)
+	return NULL;
+    fname = get_fname(p, sfx);
+    if (!fname)
+	goto out_err;
+    f = fopen(fname, "r");
+    sys->free(sys, fname);
+    if (!f)
+	goto out_err;
+
+    rv = read_persist_lines(p, f, in_order);
+    fclose(f);
+    if (rv)
+	goto out_err;
+
     return p;
  out_err:
-    if (p)
-	free_persist(p);
-    va_end(ap);
+    free_persist(p);
     return NULL;
 }
 
+persist_t *
+read_persist(struct sys_data_s *sys, const char *name, ...)
+{
+    va_list ap;
+    persist_t *p;
+
+    va_start(ap, name);
+    p = read_vpersist(sys, "", 0, name, ap);
+    va_end(ap);
+    return p;
+}
+
+persist_t *
+read_persist_journal(struct sys_data_s *sys, const char *name, ...)
+{
+    va_list ap;
+    persist_t *p;
+
+    va_start(ap, name);
+    p = read_vpersist(sys, ".jnl", 1, name, ap);
+    va_end(ap);
+    return p;
+}
+
+static void
+write_pitem(struct pitem *pi, FILE *f)
+{
+    fprintf(f, "%s:%c:", pi->iname, pi->type);
+    switch (pi->type) {
+    case PITEM_DATA:
+    case PITEM_STR:
+	write_data(pi->data, pi->dval, f);
+	break;
+    case PITEM_INT:
+	fprintf(f, "%ld", pi->dval);
+    }
+    fputc('\n', f);
+}
+
 int
 write_persist_file(persist_t *p, FILE *f)
 {
     struct pitem *pi;
 
-    for (pi = p->items; pi; pi = pi->next) {
-	fprintf(f, "%s:%c:", pi->iname, pi->type);
-	switch (pi->type) {
-	case PITEM_DATA:
-	case PITEM_STR:
-	    write_data(pi->data, pi->dval, f);
-	    break;
-	case PITEM_INT:
-	    fprintf(f, "%ld", pi->dval);
-	}
-	fputc('\n', f);
-    }
+    for (pi = p->items; pi; pi = pi->next)
+	write_pitem(pi, f);
     return 0;
 }
 
@@ -426,6 +483,65 @@ write_persist(persist_t *p)
     return rv;
 }
 
+/*
+ * Items are kept newest first, write them out oldest first so the
+ * journal replays in the order they were added.
+ */
+static void
+write_pitems_in_order(struct pitem *pi, FILE *f)
+{
+    if (!pi)
+	return;
+    write_pitems_in_order(pi->next, f);
+    write_pitem(pi, f);
+}
+
+int
+append_persist(persist_t *p)
+{
+    char *fname;
+    int rv = 0;
+    FILE *f;
+
+    if (!persist_enable)
+	return 0;
+
+    fname = get_fname(p, ".jnl");
+    if (!fname)
+	return ENOMEM;
+
+    f = fopen(fname, "a");
+    p->sys->free(p->sys, fname);
+    if (!f)
+	return errno;
+
+    write_pitems_in_order(p->items, f);
+    if (fclose(f) != 0)
+	rv = errno;
+
+    return rv;
+}
+
+int
+remove_persist_journal(persist_t *p)
+{
+    char *fname;
+    int rv = 0;
+
+    if (!persist_enable)
+	return 0;
+
+    fname = get_fname(p, ".jnl");
+    if (!fname)
+	return ENOMEM;
+
+    if ((unlink(fname) != 0) && (errno != ENOENT))
+	rv = errno;
+    p->sys->free(p->sys, fname);
+
+    return rv;
+}
+
 int
 iterate_persist(persist_t *p,
 		void *cb_data,
@@ -44,33 +44,65 @@
 typedef struct aes_cbc_info_s
 {
     unsigned char k2[16];
+
+    /*
+     * Contexts keyed with K2 when the session starts.  Each message
+     * copies one and only sets the IV, so the AES key schedule is
+     * not redone per message and a send and a receive can run at the
+     * same time.
+     */
+    EVP_CIPHER_CTX *enc_ctx;
+    EVP_CIPHER_CTX *dec_ctx;
 } aes_cbc_info_t;
 
+static void
+aes_cbc_free(ipmi_con_t *ipmi, void *conf_data)
+{
+    aes_cbc_info_t *info = conf_data;
+
+    if (info->enc_ctx)
+	EVP_CIPHER_CTX_free(info->enc_ctx);
+    if (info->dec_ctx)
+	EVP_CIPHER_CTX_free(info->dec_ctx);
+    memset(info->k2, 0, 16);
+    ipmi_mem_free(info);
+}
+
 static int
 aes_cbc_init(ipmi_con_t *ipmi, ipmi_rmcpp_auth_t *ainfo, void **conf_data)
 {
     aes_cbc_info_t *info;
     unsigned int   k2len;
 
+    if (ipmi_rmcpp_auth_get_k2_len(ainfo) < 16)
+	return EINVAL;
+
     info = ipmi_mem_alloc(sizeof(*info));
     if (!info)
 	return ENOMEM;
+    memset(info, 0, sizeof(*info));
 
-    if (ipmi_rmcpp_auth_get_k2_len(ainfo) < 16)
-	return EINVAL;
-    
     memcpy(info->k2, ipmi_rmcpp_auth_get_k2(ainfo, &k2len), 16);
+
+    info->enc_ctx = EVP_CIPHER_CTX_new();
+    info->dec_ctx = EVP_CIPHER_CTX_new();
+    if (!info->enc_ctx || !info->dec_ctx)
+	goto out_err;
+    if (!EVP_EncryptInit_ex(info->enc_ctx, EVP_aes_128_cbc(), NULL,
+			    info->k2, NULL))
+	goto out_err;
+    EVP_CIPHER_CTX_set_padding(info->enc_ctx, 0);
+    if (!EVP_DecryptInit_ex(info->dec_ctx, EVP_aes_128_cbc(), NULL,
+			    info->k2, NULL))
+	goto out_err;
+    EVP_CIPHER_CTX_set_padding(info->dec_ctx, 0);
+
     *conf_data = info;
     return 0;
-}
 
-static void
-aes_cbc_free(ipmi_con_t *ipmi, void *conf_data)
-{
-    aes_cbc_info_t *info = conf_data;
-
-    memset(info->k2, 0, 16);
-    ipmi_mem_free(info);
+ out_err:
+    aes_cbc_free(ipmi, info);
+    return ENOMEM;
 }
 
 static int
@@ -85,7 +117,6 @@ aes_cbc_encrypt(ipmi_con_t    *ipmi,
     unsigned char  *iv;
     unsigned int   l = *payload_len;
     unsigned int   i;
-    unsigned char  *d;
     EVP_CIPHER_CTX *ctx;
     int            rv;
     int            outlen;
@@ -108,16 +139,8 @@ aes_cbc_encrypt(ipmi_con_t    *ipmi,
     if (l > *max_payload_len)
 	return E2BIG;
 
-    /* We store the unencrypted data here, then crypt into the real
-       data. */
-    d = ipmi_mem_alloc(l);
-    if (!d)
-	return ENOMEM;
-
-    memcpy(d, *payload, *payload_len);
-
-    /* Now add the padding. */
-    padpos = d + *payload_len;
+    /* Now add the padding, the data is encrypted in place. */
+    padpos = (*payload) + *payload_len;
     padval = 1;
     for (i=0; i<padlen; i++, padpos++, padval++)
 	*padpos = padval;
@@ -126,22 +149,23 @@ aes_cbc_encrypt(ipmi_con_t    *ipmi,
     /* Now create the initialization vector, including making room for it. */
     iv = (*payload)-16;
     rv = ipmi->os_hnd->get_random(ipmi->os_hnd, iv, 16);
-    if (rv) {
-	ipmi_mem_free(d);
+    if (rv)
 	return rv;
+
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx)
+	return ENOMEM;
+    if (!EVP_CIPHER_CTX_copy(ctx, info->enc_ctx)
+	|| !EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv))
+    {
+	rv = ENOMEM;
+	goto out_cleanup;
     }
     *header_len -= 16;
     *max_payload_len += 16;
 
-    ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-	    rv = ENOMEM;
-	    goto out_cleanup;
-    }
     /* Ok, we're set to do the crypt operation. */
-    EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, info->k2, iv);
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-    if (!EVP_EncryptUpdate(ctx, *payload, &outlen, d, l)) {
+    if (!EVP_EncryptUpdate(ctx, *payload, &outlen, *payload, l)) {
 	rv = ENOMEM; /* right? */
 	goto out_cleanup;
     }
@@ -159,7 +183,6 @@ aes_cbc_encrypt(ipmi_con_t    *ipmi,
 
  out_cleanup:
     EVP_CIPHER_CTX_free(ctx);
-    ipmi_mem_free(d);
 
     return rv;
 }
@@ -172,7 +195,6 @@ aes_cbc_decrypt(ipmi_con_t    *ipmi,
 {
     aes_cbc_info_t *info = conf_data;
     unsigned int   l = *payload_len;
-    unsigned char  *d;
     unsigned char  *p;
     EVP_CIPHER_CTX *ctx;
     int            outlen;
@@ -188,25 +210,19 @@ aes_cbc_decrypt(ipmi_con_t    *ipmi,
 	return EINVAL;
 
     l -= 16;
-    /* We store the encrypted data here, then decrypt into the real
-       data. */
-    d = ipmi_mem_alloc(l);
-    if (!d)
-	return ENOMEM;
-
     p = (*payload)+16;
 
-    memcpy(d, p, l);
-
-    /* Ok, we're set to do the decrypt operation. */
+    /* Ok, we're set to do the decrypt operation, in place. */
     ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-	    rv = ENOMEM;
-	    goto out_cleanup;
+    if (!ctx)
+	return ENOMEM;
+    if (!EVP_CIPHER_CTX_copy(ctx, info->dec_ctx)
+	|| !EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, *payload))
+    {
+	rv = ENOMEM;
+	goto out_cleanup;
     }
-    EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, info->k2, *payload);
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-    if (!EVP_DecryptUpdate(ctx, p, &outlen, d, l)) {
+    if (!EVP_DecryptUpdate(ctx, p, &outlen, p, l)) {
 	rv = EINVAL;
 	goto out_cleanup;
     }
@@ -250,7 +266,6 @@ aes_cbc_decrypt(ipmi_con_t    *ipmi,
 
  out_cleanup:
     EVP_CIPHER_CTX_free(ctx);
-    ipmi_mem_free(d);
     return rv;
 }
 
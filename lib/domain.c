@@ -86,24 +86,39 @@ typedef struct audit_domain_info_s
     ipmi_domain_t *domain;
 } audit_domain_info_t;
 
-/* Used to keep a record of a bus scan. */
+/* Used to keep a record of a bus scan.  A scan keeps a window of
+   addresses being probed at the same time, each slot tracks one
+   address in flight. */
 typedef struct mc_ipmb_scan_info_s mc_ipmb_scan_info_t;
+typedef struct mc_ipmb_scan_slot_s
+{
+    mc_ipmb_scan_info_t *info;
+    ipmi_addr_t         addr;
+    unsigned int        missed_responses;
+    int                 timer_running;
+    os_hnd_timer_id_t   *timer;
+} mc_ipmb_scan_slot_t;
+
 struct mc_ipmb_scan_info_s
 {
     ipmi_addr_t         addr;
     unsigned int        addr_len;
     ipmi_domain_t       *domain;
     ipmi_msg_t          msg;
+    unsigned int        next_addr;
     unsigned int        end_addr;
     ipmi_domain_cb      done_handler;
     void                *cb_data;
     mc_ipmb_scan_info_t *next;
-    unsigned int        missed_responses;
     int                 cancelled;
-    int                 timer_running;
+    unsigned int        timers_pending;
     os_handler_t        *os_hnd;
-    os_hnd_timer_id_t   *timer;
     ipmi_lock_t         *lock;
+
+    /* Number of slots that currently have an address in flight. */
+    unsigned int        in_flight;
+    unsigned int        num_slots;
+    mc_ipmb_scan_slot_t *slots;
 };
 
 /* This structure tracks messages sent to the domain, it is primarily
@@ -266,6 +281,21 @@ struct ipmi_domain_s
        they can be properly freed. */
     mc_ipmb_scan_info_t *bus_scans_running;
 
+    /* The number of addresses an IPMB bus scan will probe at the same
+       time. */
+    unsigned int        ipmb_scan_window;
+
+    /* Number of Get SDR requests to keep outstanding, 0 for the
+       normal sequential fetch. */
+    unsigned int        sdr_fetch_window;
+
+    /* Number of Get SEL Entry requests to send ahead, 0 for the
+       normal sequential fetch. */
+    unsigned int        sel_fetch_window;
+
+    /* Shared lock for the lightweight sensor operation queues. */
+    opq_sched_t         *opq_sched;
+
     ipmi_chan_info_t chan[MAX_IPMI_USED_CHANNELS];
     char             chan_set[MAX_IPMI_USED_CHANNELS];
     unsigned char    msg_int_type;
@@ -366,6 +396,8 @@ static void real_close_connection(ipmi_domain_t *domain);
 
 static void free_domain_cruft(ipmi_domain_t *domain);
 
+static void cancel_scan_info(mc_ipmb_scan_info_t *info);
+
 static void ll_con_changed(ipmi_con_t   *ipmi,
 			   int          err,
 			   unsigned int port_num,
@@ -778,20 +810,7 @@ cleanup_domain(ipmi_domain_t *domain)
 	while (domain->bus_scans_running) {
 	    item = domain->bus_scans_running;
 	    domain->bus_scans_running = item->next;
-	    ipmi_lock(item->lock);
-	    if (item->timer_running) {
-		if (item->os_hnd->stop_timer(item->os_hnd, item->timer)) {
-		    item->cancelled = 1;
-		    ipmi_unlock(item->lock);
-		    item = NULL;
-		}
-	    }
-	    if (item) {
-		ipmi_unlock(item->lock);
-		item->os_hnd->free_timer(item->os_hnd, item->timer);
-		ipmi_destroy_lock(item->lock);
-		ipmi_mem_free(item);
-	    }
+	    cancel_scan_info(item);
 	}
     }
 
@@ -828,6 +847,8 @@ cleanup_domain(ipmi_domain_t *domain)
 	ipmi_ll_con_free_stat_info(domain->con_stat_info);
 
     /* Locks must be last, because they can be used by many things. */
+    if (domain->opq_sched)
+	opq_sched_destroy(domain->opq_sched);
     if (domain->ipmb_ignores_lock)
 	ipmi_destroy_lock(domain->ipmb_ignores_lock);
     if (domain->mc_lock)
@@ -915,6 +936,24 @@ process_options(ipmi_domain_t      *domain,
 	    domain->option_local_only = options[i].ival != 0;
 	    domain->option_local_only_set = 1;
 	    break;
+	case IPMI_OPEN_OPTION_IPMB_SCAN_WINDOW:
+	    if ((options[i].ival < 1)
+		|| (options[i].ival > IPMI_MAX_IPMB_SCAN_WINDOW))
+		return EINVAL;
+	    domain->ipmb_scan_window = options[i].ival;
+	    break;
+	case IPMI_OPEN_OPTION_SDR_FETCH_WINDOW:
+	    if ((options[i].ival < 0)
+		|| (options[i].ival > IPMI_MAX_SDR_FETCH_WINDOW))
+		return EINVAL;
+	    domain->sdr_fetch_window = options[i].ival;
+	    break;
+	case IPMI_OPEN_OPTION_SEL_FETCH_WINDOW:
+	    if ((options[i].ival < 0)
+		|| (options[i].ival > IPMI_MAX_SEL_FETCH_WINDOW))
+		return EINVAL;
+	    domain->sel_fetch_window = options[i].ival;
+	    break;
 	default:
 	    return EINVAL;
 	}
@@ -956,6 +995,9 @@ setup_domain(const char         *name,
     domain->option_local_only = 0;
     domain->option_local_only_set = 0;
     domain->option_use_cache = 1;
+    domain->ipmb_scan_window = 1;
+    domain->sdr_fetch_window = 0;
+    domain->sel_fetch_window = 0;
 
     priv = IPMI_PRIVILEGE_ADMIN;
     for (i=0; i<num_con; i++) {
@@ -1049,6 +1091,12 @@ setup_domain(const char         *name,
     if (rv)
 	goto out_err;
 
+    domain->opq_sched = opq_sched_alloc(domain->os_hnd);
+    if (!domain->opq_sched) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+
     domain->activate_timer_info = ipmi_mem_alloc(sizeof(activate_timer_info_t));
     if (!domain->activate_timer_info) {
 	rv = ENOMEM;
@@ -1076,7 +1124,7 @@ setup_domain(const char         *name,
 	goto out_err;
     }
 
-    domain->event_handlers = locked_list_alloc(domain->os_hnd);
+    domain->event_handlers = locked_list_alloc_snapshot(domain->os_hnd);
     if (!domain->event_handlers) {
 	rv = ENOMEM;
 	goto out_err;
@@ -1125,7 +1173,7 @@ setup_domain(const char         *name,
 	goto out_err;
     }
 
-    domain->con_change_handlers = locked_list_alloc(domain->os_hnd);
+    domain->con_change_handlers = locked_list_alloc_snapshot(domain->os_hnd);
     if (! domain->con_change_handlers) {
 	rv = ENOMEM;
 	goto out_err;
@@ -2460,6 +2508,63 @@ ipmi_domain_set_full_bus_scan(ipmi_domain_t *domain, int val)
     return 0;
 }
 
+int
+ipmi_domain_set_ipmb_scan_window(ipmi_domain_t *domain, unsigned int val)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    if ((val < 1) || (val > IPMI_MAX_IPMB_SCAN_WINDOW))
+	return EINVAL;
+    domain->ipmb_scan_window = val;
+    return 0;
+}
+
+unsigned int
+ipmi_domain_get_ipmb_scan_window(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->ipmb_scan_window;
+}
+
+int
+ipmi_domain_set_sdr_fetch_window(ipmi_domain_t *domain, unsigned int val)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (val > IPMI_MAX_SDR_FETCH_WINDOW)
+	return EINVAL;
+    domain->sdr_fetch_window = val;
+    return 0;
+}
+
+unsigned int
+ipmi_domain_get_sdr_fetch_window(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->sdr_fetch_window;
+}
+
+int
+ipmi_domain_set_sel_fetch_window(ipmi_domain_t *domain, unsigned int val)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    if (val > IPMI_MAX_SEL_FETCH_WINDOW)
+	return EINVAL;
+    domain->sel_fetch_window = val;
+    return 0;
+}
+
+unsigned int
+ipmi_domain_get_sel_fetch_window(ipmi_domain_t *domain)
+{
+    CHECK_DOMAIN_LOCK(domain);
+
+    return domain->sel_fetch_window;
+}
+
 static void
 add_bus_scans_running(ipmi_domain_t *domain, mc_ipmb_scan_info_t *info)
 {
@@ -2487,23 +2592,218 @@ remove_bus_scans_running(ipmi_domain_t *domain, mc_ipmb_scan_info_t *info)
 
 static int devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi);
 
+static mc_ipmb_scan_info_t *
+alloc_scan_info(ipmi_domain_t *domain, unsigned int num_slots)
+{
+    mc_ipmb_scan_info_t *info;
+    unsigned int        i;
+    int                 rv;
+
+    info = ipmi_mem_alloc(sizeof(*info));
+    if (!info)
+	return NULL;
+    memset(info, 0, sizeof(*info));
+
+    info->slots = ipmi_mem_alloc(sizeof(mc_ipmb_scan_slot_t) * num_slots);
+    if (!info->slots) {
+	ipmi_mem_free(info);
+	return NULL;
+    }
+    memset(info->slots, 0, sizeof(mc_ipmb_scan_slot_t) * num_slots);
+    info->num_slots = num_slots;
+
+    info->domain = domain;
+    info->os_hnd = domain->os_hnd;
+    info->msg.netfn = IPMI_APP_NETFN;
+    info->msg.cmd = IPMI_GET_DEVICE_ID_CMD;
+    info->msg.data = NULL;
+    info->msg.data_len = 0;
+
+    for (i=0; i<num_slots; i++) {
+	info->slots[i].info = info;
+	rv = info->os_hnd->alloc_timer(info->os_hnd, &info->slots[i].timer);
+	if (rv)
+	    goto out_err;
+    }
+
+    rv = ipmi_create_lock(domain, &info->lock);
+    if (rv)
+	goto out_err;
+
+    return info;
+
+ out_err:
+    for (i=0; i<num_slots; i++) {
+	if (info->slots[i].timer)
+	    info->os_hnd->free_timer(info->os_hnd, info->slots[i].timer);
+    }
+    ipmi_mem_free(info->slots);
+    ipmi_mem_free(info);
+    return NULL;
+}
+
+static void
+free_scan_info(mc_ipmb_scan_info_t *info)
+{
+    unsigned int i;
+
+    for (i=0; i<info->num_slots; i++)
+	info->os_hnd->free_timer(info->os_hnd, info->slots[i].timer);
+    ipmi_destroy_lock(info->lock);
+    ipmi_mem_free(info->slots);
+    ipmi_mem_free(info);
+}
+
+/* Stop a bus scan in progress when the domain is destroyed.  If a
+   retry timer could not be stopped, the timer handler will do the
+   free. */
+static void
+cancel_scan_info(mc_ipmb_scan_info_t *info)
+{
+    unsigned int i;
+
+    ipmi_lock(info->lock);
+    for (i=0; i<info->num_slots; i++) {
+	mc_ipmb_scan_slot_t *slot = &info->slots[i];
+
+	if (slot->timer_running) {
+	    if (info->os_hnd->stop_timer(info->os_hnd, slot->timer))
+		info->timers_pending++;
+	    else
+		slot->timer_running = 0;
+	}
+    }
+    if (info->timers_pending) {
+	info->cancelled = 1;
+	ipmi_unlock(info->lock);
+	return;
+    }
+    ipmi_unlock(info->lock);
+    free_scan_info(info);
+}
+
+/* Pick the next address to scan for the slot.  Must be called with
+   the scan lock held.  Returns 1 if the slot got an address, 0 if
+   the range is exhausted. */
+static int
+scan_assign_addr(mc_ipmb_scan_info_t *info, mc_ipmb_scan_slot_t *slot)
+{
+    ipmi_ipmb_addr_t *ipmb;
+    unsigned int     addr;
+
+    while (info->next_addr <= info->end_addr) {
+	addr = info->next_addr;
+	info->next_addr += 2;
+	slot->addr = info->addr;
+	slot->missed_responses = 0;
+	if (info->addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+	    return 1;
+	ipmb = (ipmi_ipmb_addr_t *) &slot->addr;
+	ipmb->slave_addr = addr;
+	if (!in_ipmb_ignores(info->domain, ipmb->channel, addr))
+	    return 1;
+    }
+    return 0;
+}
+
+static int
+scan_slot_send(ipmi_domain_t *domain, mc_ipmb_scan_slot_t *slot)
+{
+    mc_ipmb_scan_info_t *info = slot->info;
+
+    return ipmi_send_command_addr(domain,
+				  &slot->addr,
+				  info->addr_len,
+				  &info->msg,
+				  devid_bc_rsp_handler,
+				  slot, NULL);
+}
+
+/* The slot is done with its current address, move it to the next
+   unscanned address.  If there is nothing left to scan the slot is
+   retired, and when the last slot is retired the scan is complete. */
+static void
+scan_slot_next(ipmi_domain_t *domain, mc_ipmb_scan_slot_t *slot)
+{
+    mc_ipmb_scan_info_t *info = slot->info;
+    int                 done;
+
+    for (;;) {
+	ipmi_lock(info->lock);
+	if (!scan_assign_addr(info, slot)) {
+	    info->in_flight--;
+	    done = (info->in_flight == 0);
+	    ipmi_unlock(info->lock);
+	    if (done) {
+		/* We've hit the end, we can quit now. */
+		if (info->done_handler)
+		    info->done_handler(domain, 0, info->cb_data);
+		remove_bus_scans_running(domain, info);
+		free_scan_info(info);
+	    }
+	    return;
+	}
+	ipmi_unlock(info->lock);
+
+	if (!scan_slot_send(domain, slot))
+	    return;
+    }
+}
+
+/* Start as many slots as the scan window allows.  Returns the number
+   of slots that were started. */
+static unsigned int
+start_scan_slots(ipmi_domain_t *domain, mc_ipmb_scan_info_t *info)
+{
+    unsigned int i;
+    unsigned int started = 0;
+
+    for (i=0; i<info->num_slots; i++) {
+	mc_ipmb_scan_slot_t *slot = &info->slots[i];
+
+	for (;;) {
+	    ipmi_lock(info->lock);
+	    if (!scan_assign_addr(info, slot)) {
+		ipmi_unlock(info->lock);
+		return started;
+	    }
+	    info->in_flight++;
+	    ipmi_unlock(info->lock);
+
+	    if (!scan_slot_send(domain, slot)) {
+		started++;
+		break;
+	    }
+
+	    ipmi_lock(info->lock);
+	    info->in_flight--;
+	    ipmi_unlock(info->lock);
+	}
+    }
+
+    return started;
+}
+
 static void
 rescan_timeout_handler(void *cb_data, os_hnd_timer_id_t *id)
 {
-    mc_ipmb_scan_info_t *info = cb_data;
+    mc_ipmb_scan_slot_t *slot = cb_data;
+    mc_ipmb_scan_info_t *info = slot->info;
     int                 rv;
-    ipmi_ipmb_addr_t    *ipmb;
     ipmi_domain_t       *domain;
 
     ipmi_lock(info->lock);
     if (info->cancelled) {
+	info->timers_pending--;
+	if (info->timers_pending == 0) {
+	    ipmi_unlock(info->lock);
+	    free_scan_info(info);
+	    return;
+	}
 	ipmi_unlock(info->lock);
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_destroy_lock(info->lock);
-	ipmi_mem_free(info);
 	return;
     }
-    info->timer_running = 0;
+    slot->timer_running = 0;
     ipmi_unlock(info->lock);
 
     domain = info->domain;
@@ -2516,37 +2816,10 @@ rescan_timeout_handler(void *cb_data, os_hnd_timer_id_t *id)
 	return;
     }
 
-    goto retry_addr;
-
- next_addr_nolock:
-    ipmb = (ipmi_ipmb_addr_t *) &info->addr;
-    ipmb->slave_addr += 2;
-    if ((info->addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
-	|| (ipmb->slave_addr > info->end_addr)) {
-	/* We've hit the end, we can quit now. */
-	if (info->done_handler)
-	    info->done_handler(domain, 0, info->cb_data);
-	remove_bus_scans_running(domain, info);
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_destroy_lock(info->lock);
-	ipmi_mem_free(info);
-	goto out;
-    }
-    info->missed_responses = 0;
-    if (in_ipmb_ignores(domain, ipmb->channel, ipmb->slave_addr))
-	goto next_addr_nolock;
-
- retry_addr:
-    rv = ipmi_send_command_addr(domain,
-				&(info->addr),
-				info->addr_len,
-				&(info->msg),
-				devid_bc_rsp_handler,
-				info, NULL);
+    rv = scan_slot_send(domain, slot);
     if (rv)
-	goto next_addr_nolock;
+	scan_slot_next(domain, slot);
 
- out:
     i_ipmi_domain_put(domain);
 }
 
@@ -2556,10 +2829,10 @@ devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
     ipmi_msg_t          *msg = &rspi->msg;
     ipmi_addr_t         *addr = &rspi->addr;
     unsigned int        addr_len = rspi->addr_len;
-    mc_ipmb_scan_info_t *info = rspi->data1;
+    mc_ipmb_scan_slot_t *slot = rspi->data1;
+    mc_ipmb_scan_info_t *info = slot->info;
     int                 rv;
     ipmi_mc_t           *mc = NULL;
-    ipmi_ipmb_addr_t    *ipmb;
     int                 mc_added = 0;
     int                 mc_changed = 0;
 
@@ -2592,14 +2865,13 @@ devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
                    active, reuse the same data. */
 		rv = i_ipmi_create_mc(domain, addr, addr_len, &mc);
 		if (rv) {
-		    /* Out of memory, just give up for now. */
-		    if (info->done_handler)
-			info->done_handler(domain, 0, info->cb_data);
-		    remove_bus_scans_running(domain, info);
-		    info->os_hnd->free_timer(info->os_hnd, info->timer);
-		    ipmi_destroy_lock(info->lock);
-		    ipmi_mem_free(info);
-		    goto out;
+		    /* Out of memory, just give up for now.  Stop
+		       handing out addresses, the scan completes when
+		       the other slots in flight finish. */
+		    ipmi_lock(info->lock);
+		    info->next_addr = info->end_addr + 1;
+		    ipmi_unlock(info->lock);
+		    goto next_addr_nolock;
 		}
 
 		rv = add_mc_to_domain(domain, mc);
@@ -2613,7 +2885,7 @@ devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 		    /* If we couldn't handle the device data, just clean
 		       it up */
 		    i_ipmi_cleanup_mc(mc);
-		    goto out;
+		    goto next_addr_nolock;
 		}
 
 		/* In this case, the use count is defined to be 1, so
@@ -2646,17 +2918,18 @@ devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 	}
     } else if (mc && ipmi_mc_is_active(mc)) {
 	/* Didn't get a response.  Maybe the MC has gone away? */
-	info->missed_responses++;
+	slot->missed_responses++;
 
 	/* We fail system interface addresses immediately, since they
            shouldn't be a timeout problem. */
 	if ((info->addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
-	    || (info->missed_responses >= MAX_MC_MISSED_RESPONSES))
+	    || (slot->missed_responses >= MAX_MC_MISSED_RESPONSES))
 	{
 	    i_ipmi_cleanup_mc(mc);
 	    goto next_addr;
 	} else {
-	    /* Try again after a second. */
+	    /* Try again after a second.  Only this slot waits, the
+	       rest of the window keeps scanning. */
 	    struct timeval timeout;
 
 	    if (msg->data[0] == IPMI_TIMEOUT_CC)
@@ -2667,12 +2940,12 @@ devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 	    ipmi_lock(info->lock);
 	    timeout.tv_sec = 1;
 	    timeout.tv_usec = 0;
-	    info->timer_running = 1;
+	    slot->timer_running = 1;
 	    info->os_hnd->start_timer(info->os_hnd,
-				      info->timer,
+				      slot->timer,
 				      &timeout,
 				      rescan_timeout_handler,
-				      info);
+				      slot);
 	    ipmi_unlock(info->lock);
 	    goto out;
 	}
@@ -2685,30 +2958,11 @@ devid_bc_rsp_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 	call_mc_upd_handlers(domain, mc, IPMI_CHANGED);
 
  next_addr_nolock:
-    ipmb = (ipmi_ipmb_addr_t *) &info->addr;
-    ipmb->slave_addr += 2;
-    if ((info->addr.addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
-	|| (ipmb->slave_addr > info->end_addr)) {
-	/* We've hit the end, we can quit now. */
-	if (info->done_handler)
-	    info->done_handler(domain, 0, info->cb_data);
-	remove_bus_scans_running(domain, info);
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-	ipmi_destroy_lock(info->lock);
-	ipmi_mem_free(info);
-	goto out;
-    }
-    info->missed_responses = 0;
-    if (in_ipmb_ignores(domain, ipmb->channel, ipmb->slave_addr))
-	goto next_addr_nolock;
+    scan_slot_next(domain, slot);
+    goto out;
 
  retry_addr:
-    rv = ipmi_send_command_addr(domain,
-				&(info->addr),
-				info->addr_len,
-				&(info->msg),
-				devid_bc_rsp_handler,
-				info, NULL);
+    rv = scan_slot_send(domain, slot);
     if (rv)
 	goto next_addr_nolock;
 
@@ -2728,8 +2982,10 @@ ipmi_start_ipmb_mc_scan(ipmi_domain_t  *domain,
 			void           *cb_data)
 {
     mc_ipmb_scan_info_t *info;
-    int                 rv;
     ipmi_ipmb_addr_t    *ipmb;
+    unsigned int        window;
+    unsigned int        started;
+    int                 done;
 
     CHECK_DOMAIN_LOCK(domain);
 
@@ -2741,68 +2997,44 @@ ipmi_start_ipmb_mc_scan(ipmi_domain_t  *domain,
 	/* Make sure it is IPMB, or the BMC address. */
 	return ENOSYS;
 
-    info = ipmi_mem_alloc(sizeof(*info));
+    /* No point in having more slots than addresses to scan. */
+    window = domain->ipmb_scan_window;
+    if (end_addr < start_addr)
+	window = 1;
+    else if (window > ((end_addr - start_addr) / 2) + 1)
+	window = ((end_addr - start_addr) / 2) + 1;
+
+    info = alloc_scan_info(domain, window);
     if (!info)
 	return ENOMEM;
-    memset(info, 0, sizeof(*info));
 
-    info->domain = domain;
     ipmb = (ipmi_ipmb_addr_t *) &info->addr;
     ipmb->addr_type = IPMI_IPMB_BROADCAST_ADDR_TYPE;
     ipmb->channel = channel;
     ipmb->slave_addr = start_addr;
     ipmb->lun = 0;
     info->addr_len = sizeof(*ipmb);
-    info->msg.netfn = IPMI_APP_NETFN;
-    info->msg.cmd = IPMI_GET_DEVICE_ID_CMD;
-    info->msg.data = NULL;
-    info->msg.data_len = 0;
+    info->next_addr = start_addr;
     info->end_addr = end_addr;
     info->done_handler = done_handler;
     info->cb_data = cb_data;
-    info->missed_responses = 0;
-    info->os_hnd = domain->os_hnd;
-    rv = info->os_hnd->alloc_timer(info->os_hnd, &info->timer);
-    if (rv)
-	goto out_err;
-
-    rv = ipmi_create_lock(domain, &info->lock);
-    if (rv)
-	goto out_err;
-
-    rv = ENOSYS; /* Return err if no scans done */
-
-    /* Skip addresses we must ignore. */
-    while (in_ipmb_ignores(domain, ipmb->channel, ipmb->slave_addr)) {
-	/* ipmb->slave_addr is 8 bits, so we can't do a <= comparison as it
-	   will overflow after 254. */
-	if (ipmb->slave_addr == end_addr)
-	    goto out_err;
-	ipmb->slave_addr += 2;
-    }
-    while (rv) {
-	rv = ipmi_send_command_addr(domain,
-				    &info->addr,
-				    info->addr_len,
-				    &(info->msg),
-				    devid_bc_rsp_handler,
-				    info, NULL);
-	if (rv) {
-	    if (ipmb->slave_addr == end_addr)
-		goto out_err;
-	    ipmb->slave_addr += 2;
-	}
-    }
 
+    /* Hold the scan open while the slots are started, responses
+       may come in on other threads before we are done here. */
+    info->in_flight = 1;
     add_bus_scans_running(domain, info);
-    return 0;
+    started = start_scan_slots(domain, info);
+    ipmi_lock(info->lock);
+    info->in_flight--;
+    done = (info->in_flight == 0);
+    ipmi_unlock(info->lock);
+    if (done) {
+	remove_bus_scans_running(domain, info);
+	if (started && info->done_handler)
+	    info->done_handler(domain, 0, info->cb_data);
+	free_scan_info(info);
+    }
 
- out_err:
-    if (info->timer)
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-    if (info->lock)
-	ipmi_destroy_lock(info->lock);
-    ipmi_mem_free(info);
     return 0; /* Since the done handler is always called, always
 		 return true.  Bus scans always succeed. */
 }
@@ -2817,52 +3049,34 @@ ipmi_start_si_scan(ipmi_domain_t  *domain,
     ipmi_system_interface_addr_t *si;
     int                          rv;
 
-    info = ipmi_mem_alloc(sizeof(mc_ipmb_scan_info_t));
+    info = alloc_scan_info(domain, 1);
     if (!info) 
 	return ENOMEM;
-    memset(info, 0, sizeof(*info));
 
-    info->domain = domain;
     si = (void *) &info->addr;
     si->addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
     si->channel = si_num;
     si->lun = 0;
     info->addr_len = sizeof(*si);
-    info->msg.netfn = IPMI_APP_NETFN;
-    info->msg.cmd = IPMI_GET_DEVICE_ID_CMD;
-    info->msg.data = NULL;
-    info->msg.data_len = 0;
+    info->next_addr = 0;
+    info->end_addr = 0;
     info->done_handler = done_handler;
     info->cb_data = cb_data;
-    info->missed_responses = 0;
-    info->os_hnd = domain->os_hnd;
-    rv = info->os_hnd->alloc_timer(info->os_hnd, &info->timer);
-    if (rv)
-	goto out_err;
 
-    rv = ipmi_create_lock(domain, &info->lock);
-    if (rv)
-	goto out_err;
+    ipmi_lock(info->lock);
+    scan_assign_addr(info, &info->slots[0]);
+    info->in_flight = 1;
+    ipmi_unlock(info->lock);
 
-    rv = ipmi_send_command_addr(domain,
-				&info->addr,
-				info->addr_len,
-				&(info->msg),
-				devid_bc_rsp_handler,
-				info, NULL);
-    if (rv)
-	goto out_err;
-    else
-	add_bus_scans_running(domain, info);
-    return 0;
+    add_bus_scans_running(domain, info);
+    rv = scan_slot_send(domain, &info->slots[0]);
+    if (rv) {
+	remove_bus_scans_running(domain, info);
+	free_scan_info(info);
+	return rv;
+    }
 
- out_err:
-    if (info->timer)
-	info->os_hnd->free_timer(info->os_hnd, info->timer);
-    if (info->lock)
-	ipmi_destroy_lock(info->lock);
-    ipmi_mem_free(info);
-    return rv;
+    return 0;
 }
 
 static void
@@ -3724,6 +3938,12 @@ ipmi_domain_get_os_hnd(ipmi_domain_t *domain)
     return domain->os_hnd;
 }
 
+opq_sched_t *
+i_ipmi_domain_get_opq_sched(ipmi_domain_t *domain)
+{
+    return domain->opq_sched;
+}
+
 ipmi_entity_info_t *
 ipmi_domain_get_entities(ipmi_domain_t *domain)
 {
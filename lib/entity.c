@@ -147,6 +147,10 @@ struct ipmi_entity_s
 
     dlr_ref_t key;
 
+    /* Chain in the entity info's hash table, protected by the domain
+       entity lock. */
+    ipmi_entity_t *hash_next;
+
     /* Lock used for protecting misc data. */
     ipmi_lock_t *elock;
 
@@ -317,6 +321,9 @@ struct ipmi_entity_s
     void               *cruft_fru_cb_data;
 };
 
+/* Must be a power of 2. */
+#define ENTITY_HASH_SIZE 256
+
 struct ipmi_entity_info_s
 {
     locked_list_t         *update_handlers;
@@ -324,12 +331,18 @@ struct ipmi_entity_info_s
     ipmi_domain_t         *domain;
     ipmi_domain_id_t      domain_id;
     locked_list_t         *entities;
+
+    /* Index of the entities list by key, so entities can be found
+       without walking the list.  The list is still used for
+       iteration so the order doesn't change. */
+    ipmi_entity_t         *hash[ENTITY_HASH_SIZE];
 };
 
 #define ent_lock(e) ipmi_lock(e->elock)
 #define ent_unlock(e) ipmi_unlock(e->elock)
 
 static void entity_mc_active(ipmi_mc_t *mc, int active, void *cb_data);
+static void entity_hash_remove(ipmi_entity_info_t *ents, ipmi_entity_t *ent);
 static void call_presence_handlers(ipmi_entity_t *ent, int present);
 static void call_fully_up_handlers(ipmi_entity_t *ent);
 
@@ -439,6 +452,7 @@ ipmi_entity_info_alloc(ipmi_domain_t *domain, ipmi_entity_info_t **new_info)
     ents = ipmi_mem_alloc(sizeof(*ents));
     if (!ents)
 	return ENOMEM;
+    memset(ents, 0, sizeof(*ents));
 
     ents->domain = domain;
     ents->domain_id = ipmi_domain_convert_to_id(domain);
@@ -909,6 +923,7 @@ cleanup_entity(ipmi_entity_t *ent)
 
 	/* Remove it from the entities list. */
 	locked_list_remove_nolock(ent->ents->entities, ent, NULL);
+	entity_hash_remove(ent->ents, ent);
 
 	/* The sensor, control, parent, and child lists should be empty
 	   now, we can just destroy it. */
@@ -1244,29 +1259,51 @@ ipmi_entity_info_remove_update_handler_cl(ipmi_entity_info_t       *ents,
 	return EINVAL;
 }
 
-typedef struct search_info_s {
-    dlr_ref_t         key;
-    ipmi_entity_t     *ent;
-} search_info_t;
+static unsigned int
+entity_hash_key(ipmi_device_num_t device_num,
+		int               entity_id,
+		int               entity_instance)
+{
+    unsigned int h;
 
-static int
-search_entity(void *cb_data, void *item1, void *item2)
+    h = device_num.channel;
+    h = (h * 31) + device_num.address;
+    h = (h * 31) + (entity_id & 0xff);
+    h = (h * 31) + (entity_instance & 0xff);
+    return h & (ENTITY_HASH_SIZE - 1);
+}
+
+/* Must be called with the domain entity lock held. */
+static void
+entity_hash_add(ipmi_entity_info_t *ents, ipmi_entity_t *ent)
 {
-    ipmi_entity_t *ent = (ipmi_entity_t *) item1;
-    search_info_t *info = (search_info_t *) cb_data;
-    int           same;
+    unsigned int idx = entity_hash_key(ent->key.device_num,
+				       ent->key.entity_id,
+				       ent->key.entity_instance);
+
+    ent->hash_next = ents->hash[idx];
+    ents->hash[idx] = ent;
+}
+
+/* Must be called with the domain entity lock held. */
+static void
+entity_hash_remove(ipmi_entity_info_t *ents, ipmi_entity_t *ent)
+{
+    unsigned int  idx = entity_hash_key(ent->key.device_num,
+					ent->key.entity_id,
+					ent->key.entity_instance);
+    ipmi_entity_t **e;
 
-    same = ((ent->key.device_num.channel == info->key.device_num.channel)
-	    && (ent->key.device_num.address == info->key.device_num.address)
-	    && (ent->key.entity_id == info->key.entity_id)
-	    && (ent->key.entity_instance == info->key.entity_instance));
-    if (same) {
-	info->ent = ent;
-	return LOCKED_LIST_ITER_STOP;
+    for (e = &ents->hash[idx]; *e; e = &(*e)->hash_next) {
+	if (*e == ent) {
+	    *e = ent->hash_next;
+	    break;
+	}
     }
-    return LOCKED_LIST_ITER_CONTINUE;
+    ent->hash_next = NULL;
 }
 
+/* Must be called with the domain entity lock held. */
 static int
 entity_find(ipmi_entity_info_t *ents,
 	    ipmi_device_num_t  device_num,
@@ -1274,19 +1311,25 @@ entity_find(ipmi_entity_info_t *ents,
 	    int                entity_instance,
 	    ipmi_entity_t      **found_ent)
 {
-    search_info_t info = { {device_num, entity_id, entity_instance}, NULL};
-    int           rv = 0;
-
-    locked_list_iterate_nolock(ents->entities, search_entity, &info);
-    if (info.ent == NULL) {
-	rv = ENOENT;
-    } else {
-	info.ent->usecount++;
-	if (found_ent)
-	    *found_ent = info.ent;
+    ipmi_entity_t *ent;
+    unsigned int  idx;
+
+    idx = entity_hash_key(device_num, entity_id, entity_instance);
+    for (ent = ents->hash[idx]; ent; ent = ent->hash_next) {
+	if ((ent->key.device_num.channel == device_num.channel)
+	    && (ent->key.device_num.address == device_num.address)
+	    && (ent->key.entity_id == (uint8_t) entity_id)
+	    && (ent->key.entity_instance == (uint8_t) entity_instance))
+	    break;
     }
 
-    return rv;
+    if (ent == NULL)
+	return ENOENT;
+
+    ent->usecount++;
+    if (found_ent)
+	*found_ent = ent;
+    return 0;
 }
 
 int
@@ -1401,7 +1444,7 @@ entity_add(ipmi_entity_info_t *ents,
     ent->presence_handlers_cl = locked_list_alloc(ent->os_hnd);
     if (!ent->presence_handlers_cl)
 	goto out_err;
-    ent->presence_handlers = locked_list_alloc(ent->os_hnd);
+    ent->presence_handlers = locked_list_alloc_snapshot(ent->os_hnd);
     if (!ent->presence_handlers)
 	goto out_err;
 
@@ -1433,7 +1476,7 @@ entity_add(ipmi_entity_info_t *ents,
     ent->sensor_handlers_cl = locked_list_alloc(ent->os_hnd);
     if (!ent->sensor_handlers_cl)
 	goto out_err;
-    ent->sensor_handlers = locked_list_alloc(ent->os_hnd);
+    ent->sensor_handlers = locked_list_alloc_snapshot(ent->os_hnd);
     if (!ent->sensor_handlers)
 	goto out_err;
 
@@ -1480,6 +1523,7 @@ entity_add(ipmi_entity_info_t *ents,
 
     if (! locked_list_add_nolock(ents->entities, ent, NULL))
 	goto out_err;
+    entity_hash_add(ents, ent);
 
     i_ipmi_domain_entity_unlock(ent->domain);
 
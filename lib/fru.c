@@ -53,13 +53,34 @@
 #include <OpenIPMI/internal/ipmi_oem.h>
 #include <OpenIPMI/internal/ipmi_fru.h>
 
-#define MAX_FRU_DATA_FETCH 32
+/*
+ * Reads start at FRU_DATA_FETCH_START bytes and grow by
+ * FRU_DATA_FETCH_INCR after each full one, up to MAX_FRU_DATA_FETCH.
+ * If the MC can't handle a size, it goes back to the last size that
+ * worked (or drops by FRU_DATA_FETCH_DECR) and stops growing.
+ */
+#define FRU_DATA_FETCH_START 32
+#define FRU_DATA_FETCH_INCR 16
+#define MAX_FRU_DATA_FETCH 128
 #define FRU_DATA_FETCH_DECR 8
 #define MIN_FRU_DATA_FETCH 16
 
-#define MAX_FRU_DATA_WRITE 16
+/* The most Read FRU Data commands to have outstanding at once. */
+#define FRU_FETCH_WINDOW 4
+
+/*
+ * Writes start at MIN_FRU_DATA_WRITE bytes and grow by
+ * FRU_DATA_WRITE_INCR after each one the MC takes whole, until it
+ * refuses one or MAX_FRU_DATA_WRITE is reached.
+ */
+#define MIN_FRU_DATA_WRITE 16
+#define FRU_DATA_WRITE_INCR 8
+#define MAX_FRU_DATA_WRITE 64
 #define MAX_FRU_WRITE_RETRIES 30
 
+/* The most Write FRU Data commands to have outstanding at once. */
+#define FRU_WRITE_WINDOW 4
+
 #define MAX_FRU_FETCH_RETRIES 5
 
 #define IPMI_FRU_ATTR_NAME "ipmi_fru"
@@ -82,6 +103,7 @@ struct fru_update_s
 {
     unsigned short offset;
     unsigned short length;
+    unsigned int   retry_count; /* Busy retries, when being written */
     fru_update_t   *next;
 };
 
@@ -147,11 +169,20 @@ struct ipmi_fru_s
     unsigned char *data;
     unsigned int  data_len;
     unsigned int  curr_pos;
-    unsigned int  curr_write_len;
     int           write_prepared;
     int           saved_err;
 
     int           fetch_size;
+    int           fetch_size_fixed;
+    unsigned int  fetch_size_ok; /* Biggest read that has worked */
+
+    /* Reads sent but not answered, and ranges that have to be read
+       again.  The window drops to one if the MC says it is busy. */
+    fru_update_t *fetch_ops;
+    fru_update_t *fetch_redo;
+    unsigned int  fetches_outstanding;
+    unsigned int  fetch_window;
+    int           fetch_err;
 
     /* Is this in the list of FRUs? */
     int in_frulist;
@@ -160,9 +191,19 @@ struct ipmi_fru_s
     fru_update_t *update_recs;
     fru_update_t *update_recs_tail;
 
-    /* The last send command for writing */
-    unsigned int  last_cmd_len;
-    unsigned int  retry_count;
+    /* Writes sent but not answered, and the first error seen. */
+    fru_update_t *write_ops;
+    unsigned int  writes_outstanding;
+    int           write_err;
+
+    /* The size of the next write.  Fixed once the MC refuses one. */
+    unsigned int  write_size;
+    int           write_size_fixed;
+
+    /* The FRU contents as last read and written, so a write only
+       sends the bytes that differ. */
+    unsigned char *last_image;
+    unsigned int  last_image_len;
 
     os_handler_t *os_hnd;
 
@@ -389,68 +430,6 @@ i_ipmi_fru_get_setup_data(ipmi_fru_t *fru)
     return fru->setup_data;
 }
 
-static int
-fru_normal_write_done(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
-{
-    ipmi_msg_t      *msg = &rspi->msg;
-    ipmi_fru_t      *fru = rspi->data1;
-    unsigned char   *data = msg->data;
-    i_ipmi_fru_op_cb cb = rspi->data2;
-    int             err = 0;
-
-    if (data[0]) {
-	err = IPMI_IPMI_ERR_VAL(data[0]);
-	goto out;
-    }
-
-    if (msg->data_len < 2) {
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "%sfru.c(fru_normal_write_done): "
-		 "FRU write response too small",
-		 FRU_DOMAIN_NAME(fru));
-	err = EINVAL;
-	goto out;
-    }
-
-    if ((unsigned int) (data[1] << fru->access_by_words)
-	!= (fru->last_cmd_len - 3))
-    {
-	/* Write was incomplete for some reason.  Just go on but issue
-	   a warning. */
-	ipmi_log(IPMI_LOG_WARNING,
-		 "%sfru.c(fru_normal_write_done): "
-		 "Incomplete writing FRU data, write %d, expected %d",
-		 FRU_DOMAIN_NAME(fru),
-		 data[1] << fru->access_by_words, fru->last_cmd_len-3);
-    }
-
- out:
-    cb(fru, domain, err);
-    return IPMI_MSG_ITEM_NOT_USED;
-}
-
-static int
-fru_normal_write(ipmi_fru_t      *fru,
-		 ipmi_domain_t   *domain,
-		 unsigned char   *data,
-		 unsigned int    data_len,
-		 i_ipmi_fru_op_cb done)
-{
-    ipmi_msg_t msg;
-
-    msg.netfn = IPMI_STORAGE_NETFN;
-    msg.cmd = IPMI_WRITE_FRU_DATA_CMD;
-    msg.data = data;
-    msg.data_len = data_len;
-
-    return ipmi_send_command_addr(domain,
-				  &fru->addr, fru->addr_len,
-				  &msg,
-				  fru_normal_write_done,
-				  fru,
-				  done);
-}
-
 void
 ipmi_fru_set_options(ipmi_fru_t *fru, unsigned int options)
 {
@@ -514,6 +493,8 @@ final_fru_destroy(ipmi_fru_t *fru)
 	fru->update_recs = to_free->next;
 	ipmi_mem_free(to_free);
     }
+    if (fru->last_image)
+	ipmi_mem_free(fru->last_image);
     if (fru->setup_data_cleanup)
 	fru->setup_data_cleanup(fru, fru->setup_data);
     ipmi_destroy_lock(fru->lock);
@@ -620,6 +601,8 @@ start_fru_fetch(ipmi_fru_t *fru, ipmi_domain_t *domain)
     int rv;
 
     fru->curr_pos = 0;
+    fru->fetch_err = 0;
+    fru->fetch_window = FRU_FETCH_WINDOW;
 
     if (fru->is_logical)
 	rv = start_logical_fru_fetch(domain, fru);
@@ -699,9 +682,9 @@ ipmi_fru_alloc_internal(ipmi_domain_t       *domain,
     fru->private_bus = private_bus;
     fru->channel = channel;
     fru->fetch_mask = fetch_mask;
-    fru->fetch_size = MAX_FRU_DATA_FETCH;
+    fru->fetch_size = FRU_DATA_FETCH_START;
+    fru->write_size = MIN_FRU_DATA_WRITE;
     fru->os_hnd = ipmi_domain_get_os_hnd(domain);
-    fru->write_cb = fru_normal_write;
 
     len = sizeof(fru->name);
     p = ipmi_domain_get_name(domain, fru->name, len);
@@ -918,7 +901,21 @@ fetch_complete(ipmi_domain_t *domain, ipmi_fru_t *fru, int err)
 	i_ipmi_fru_lock(fru);
     }
 
-    if (fru->data)
+    while (fru->fetch_redo) {
+	fru_update_t *to_free = fru->fetch_redo;
+	fru->fetch_redo = to_free->next;
+	ipmi_mem_free(to_free);
+    }
+
+    if (fru->last_image) {
+	ipmi_mem_free(fru->last_image);
+	fru->last_image = NULL;
+    }
+    if (!err && fru->data) {
+	/* Keep what was read to compare against on a write. */
+	fru->last_image = fru->data;
+	fru->last_image_len = fru->data_len;
+    } else if (fru->data)
 	ipmi_mem_free(fru->data);
     fru->data = NULL;
     fru->in_use = 0;
@@ -976,6 +973,40 @@ end_fru_fetch(ipmi_fru_t    *fru,
     return;
 }
 
+/*
+ * Add a range to read again, keeping the list sorted and merging it
+ * with its neighbors so it can be read in as few pieces as possible.
+ */
+static void
+fru_fetch_redo(ipmi_fru_t *fru, fru_update_t *op)
+{
+    fru_update_t **prev = &fru->fetch_redo;
+    fru_update_t *next;
+
+    while (*prev && ((*prev)->offset + (*prev)->length < op->offset))
+	prev = &(*prev)->next;
+
+    if (*prev && ((*prev)->offset + (*prev)->length == op->offset)) {
+	(*prev)->length += op->length;
+	ipmi_mem_free(op);
+	op = *prev;
+    } else {
+	op->next = *prev;
+	*prev = op;
+    }
+
+    next = op->next;
+    if (next && (op->offset + op->length == next->offset)) {
+	op->length += next->length;
+	op->next = next->next;
+	ipmi_mem_free(next);
+    }
+}
+
+/*
+ * Handle the result of one read, requeueing what is left of it if
+ * necessary, and send more or finish the fetch.
+ */
 static int
 fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 {
@@ -983,15 +1014,30 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
     unsigned int  addr_len = rspi->addr_len;
     ipmi_msg_t    *msg = &rspi->msg;
     ipmi_fru_t    *fru = rspi->data1;
+    fru_update_t  *op = rspi->data2;
     unsigned char *data = msg->data;
-    int           count;
+    fru_update_t  **prev;
+    unsigned int  count;
     int           err;
 
     i_ipmi_fru_lock(fru);
 
-    if (fru->deleted) {
-	fetch_complete(domain, fru, ECANCELED);
-	goto out;
+    for (prev = &fru->fetch_ops; *prev; prev = &(*prev)->next) {
+	if (*prev == op) {
+	    *prev = op->next;
+	    break;
+	}
+    }
+    fru->fetches_outstanding--;
+
+    /* Everything outstanding has to come back before the fetch can
+       be completed, so errors are saved until then. */
+    if (fru->deleted)
+	fru->fetch_err = ECANCELED;
+
+    if (fru->fetch_err || (op->offset >= fru->data_len)) {
+	ipmi_mem_free(op);
+	goto check_done;
     }
 
     /* The timeout and unknown errors should not be necessary, but
@@ -1002,49 +1048,52 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 	 || (data[0] == IPMI_REQUEST_DATA_LENGTH_INVALID_CC)
 	 || (data[0] == IPMI_TIMEOUT_CC)
 	 || (data[0] == IPMI_UNKNOWN_ERR_CC))
-	&& (fru->fetch_size > MIN_FRU_DATA_FETCH))
+	&& (op->length > MIN_FRU_DATA_FETCH))
     {
-	/* System couldn't support the given size, try decreasing and
-	   starting again. */
-	fru->fetch_size -= FRU_DATA_FETCH_DECR;
-	err = request_next_data(domain, fru, addr, addr_len);
-	if (err) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "%sfru.c(fru_data_handler): "
-		     "Error requesting next FRU data (2)",
-		     FRU_DOMAIN_NAME(fru));
-	    fetch_complete(domain, fru, err);
-	    goto out;
-	}
-	goto out_unlock;
+	/* System couldn't support the given size, go back to the last
+	   size that worked or try decreasing, and read that part
+	   again. */
+	unsigned int size;
+
+	if (fru->fetch_size_ok && (op->length > fru->fetch_size_ok))
+	    size = fru->fetch_size_ok;
+	else
+	    size = op->length - FRU_DATA_FETCH_DECR;
+	if (size < MIN_FRU_DATA_FETCH)
+	    size = MIN_FRU_DATA_FETCH;
+	if (size < (unsigned int) fru->fetch_size)
+	    fru->fetch_size = size;
+	fru->fetch_size_fixed = 1;
+	fru_fetch_redo(fru, op);
+	goto check_done;
+    }
+
+    if ((data[0] == IPMI_NODE_BUSY_CC) && (fru->fetch_window > 1)) {
+	/* Probably can't take more than one at a time, go back to
+	   reading serially. */
+	fru->fetch_window = 1;
+	fru_fetch_redo(fru, op);
+	goto check_done;
     }
 
     if (data[0] != 0) {
-	if (fru->curr_pos >= 8) {
+	if (op->offset >= 8) {
 	    /* Some screwy cards give more size in the info than they
 	       really have, if we have enough, try to process it. */
 	    ipmi_log(IPMI_LOG_WARNING,
 		     "%sfru.c(fru_data_handler): "
 		     "IPMI error getting FRU data: %x",
 		     FRU_DOMAIN_NAME(fru), data[0]);
-	    fru->data_len = fru->curr_pos;
-	    if (fru->timestamp_cb) {
-		err = fru->timestamp_cb(fru, domain, end_fru_fetch);
-		if (err)
-		    fetch_complete(domain, fru, err);
-		else
-		    goto out_unlock;
-	    } else {
-		fetch_complete(domain, fru, 0);
-	    }
+	    fru->data_len = op->offset;
 	} else {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "%sfru.c(fru_data_handler): "
 		     "IPMI error getting FRU data: %x",
 		     FRU_DOMAIN_NAME(fru), data[0]);
-	    fetch_complete(domain, fru, IPMI_IPMI_ERR_VAL(data[0]));
+	    fru->fetch_err = IPMI_IPMI_ERR_VAL(data[0]);
 	}
-	goto out;
+	ipmi_mem_free(op);
+	goto check_done;
     }
 
     if (msg->data_len < 2) {
@@ -1052,8 +1101,9 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 		 "%sfru.c(fru_data_handler): "
 		 "FRU data response too small",
 		 FRU_DOMAIN_NAME(fru));
-	fetch_complete(domain, fru, EINVAL);
-	goto out;
+	fru->fetch_err = EINVAL;
+	ipmi_mem_free(op);
+	goto check_done;
     }
 
     count = data[1] << fru->access_by_words;
@@ -1063,44 +1113,76 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 		 "%sfru.c(fru_data_handler): "
 		 "FRU got zero-sized data, must make progress!",
 		 FRU_DOMAIN_NAME(fru));
-	fetch_complete(domain, fru, EINVAL);
-	goto out;
+	fru->fetch_err = EINVAL;
+	ipmi_mem_free(op);
+	goto check_done;
     }
 
-    if (count > msg->data_len-2) {
+    if (count > (unsigned int) msg->data_len-2) {
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "%sfru.c(fru_data_handler): "
 		 "FRU data count mismatch",
 		 FRU_DOMAIN_NAME(fru));
-	fetch_complete(domain, fru, EINVAL);
-	goto out;
+	fru->fetch_err = EINVAL;
+	ipmi_mem_free(op);
+	goto check_done;
     }
 
-    memcpy(fru->data+fru->curr_pos, data+2, count);
-    fru->curr_pos += count;
+    if (count > op->length)
+	count = op->length;
+    if (op->offset + count > fru->data_len)
+	count = fru->data_len - op->offset;
+    memcpy(fru->data+op->offset, data+2, count);
+
+    if (count < op->length) {
+	/* Short read, get the rest later. */
+	op->offset += count;
+	op->length -= count;
+	fru_fetch_redo(fru, op);
+	goto check_done;
+    }
 
-    if (fru->curr_pos < fru->data_len) {
-	/* More to fetch. */
+    if (op->length > fru->fetch_size_ok)
+	fru->fetch_size_ok = op->length;
+    if (!fru->fetch_size_fixed && (op->length == fru->fetch_size)
+	&& (fru->fetch_size < MAX_FRU_DATA_FETCH))
+    {
+	fru->fetch_size += FRU_DATA_FETCH_INCR;
+	if (fru->fetch_size > MAX_FRU_DATA_FETCH)
+	    fru->fetch_size = MAX_FRU_DATA_FETCH;
+    }
+    ipmi_mem_free(op);
+
+ check_done:
+    if (!fru->fetch_err) {
 	err = request_next_data(domain, fru, addr, addr_len);
 	if (err) {
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "%sfru.c(fru_data_handler): "
 		     "Error requesting next FRU data",
 		     FRU_DOMAIN_NAME(fru));
+	    fru->fetch_err = err;
+	}
+    }
+
+    if (fru->fetches_outstanding)
+	goto out_unlock;
+
+    if (fru->fetch_err) {
+	fetch_complete(domain, fru, fru->fetch_err);
+	goto out;
+    }
+
+    /* Nothing left outstanding or to send, we have it all. */
+    if (fru->timestamp_cb) {
+	err = fru->timestamp_cb(fru, domain, end_fru_fetch);
+	if (err) {
 	    fetch_complete(domain, fru, err);
 	    goto out;
 	}
     } else {
-	if (fru->timestamp_cb) {
-	    err = fru->timestamp_cb(fru, domain, end_fru_fetch);
-	    if (err) {
-		fetch_complete(domain, fru, err);
-		goto out;
-	    }
-	} else {
-	    fetch_complete(domain, fru, 0);
-	    goto out;
-	}
+	fetch_complete(domain, fru, 0);
+	goto out;
     }
 
  out_unlock:
@@ -1109,6 +1191,11 @@ fru_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
     return IPMI_MSG_ITEM_NOT_USED;
 }
 
+/*
+ * Send reads until the window is full, taking ranges that have to be
+ * read again first.  If something is already outstanding, a send
+ * error is saved for when it finishes.
+ */
 static int
 request_next_data(ipmi_domain_t *domain,
 		  ipmi_fru_t    *fru,
@@ -1117,28 +1204,92 @@ request_next_data(ipmi_domain_t *domain,
 {
     unsigned char cmd_data[4];
     ipmi_msg_t    msg;
-    int           to_read;
+    fru_update_t  *op;
+    unsigned int  to_read;
+    int           rv;
+
+    while (fru->fetches_outstanding < fru->fetch_window) {
+	op = fru->fetch_redo;
+	if (op && (op->offset >= fru->data_len)) {
+	    /* The data was cut short, this isn't needed any more. */
+	    fru->fetch_redo = op->next;
+	    ipmi_mem_free(op);
+	    continue;
+	}
 
-    /* We only request as much as we have to.  Don't always reqeust
-       the maximum amount, some machines don't like this. */
-    to_read = fru->data_len - fru->curr_pos;
-    if (to_read > fru->fetch_size)
-	to_read = fru->fetch_size;
+	if (op) {
+	    to_read = op->length;
+	    if (op->offset + to_read > fru->data_len)
+		to_read = fru->data_len - op->offset;
+	    if (to_read > (unsigned int) fru->fetch_size) {
+		/* Split off what we can read now. */
+		fru_update_t *rest = ipmi_mem_alloc(sizeof(*rest));
+		if (!rest) {
+		    rv = ENOMEM;
+		    goto out_err;
+		}
+		rest->offset = op->offset + fru->fetch_size;
+		rest->length = to_read - fru->fetch_size;
+		rest->next = op->next;
+		op->next = rest;
+		to_read = fru->fetch_size;
+	    }
+	    op->length = to_read;
+	    fru->fetch_redo = op->next;
+	} else {
+	    if (fru->curr_pos >= fru->data_len)
+		break;
+
+	    /* We only request as much as we have to.  Don't always
+	       reqeust the maximum amount, some machines don't like
+	       this. */
+	    to_read = fru->data_len - fru->curr_pos;
+	    if (to_read > (unsigned int) fru->fetch_size)
+		to_read = fru->fetch_size;
+
+	    op = ipmi_mem_alloc(sizeof(*op));
+	    if (!op) {
+		rv = ENOMEM;
+		goto out_err;
+	    }
+	    op->offset = fru->curr_pos;
+	    op->length = to_read;
+	    fru->curr_pos += to_read;
+	}
 
-    cmd_data[0] = fru->device_id;
-    ipmi_set_uint16(cmd_data+1, fru->curr_pos >> fru->access_by_words);
-    cmd_data[3] = to_read >> fru->access_by_words;
-    msg.netfn = IPMI_STORAGE_NETFN;
-    msg.cmd = IPMI_READ_FRU_DATA_CMD;
-    msg.data = cmd_data;
-    msg.data_len = 4;
+	op->next = fru->fetch_ops;
+	fru->fetch_ops = op;
+	fru->fetches_outstanding++;
+
+	cmd_data[0] = fru->device_id;
+	ipmi_set_uint16(cmd_data+1, op->offset >> fru->access_by_words);
+	cmd_data[3] = to_read >> fru->access_by_words;
+	msg.netfn = IPMI_STORAGE_NETFN;
+	msg.cmd = IPMI_READ_FRU_DATA_CMD;
+	msg.data = cmd_data;
+	msg.data_len = 4;
+
+	rv = ipmi_send_command_addr(domain,
+				    addr, addr_len,
+				    &msg,
+				    fru_data_handler,
+				    fru,
+				    op);
+	if (rv) {
+	    fru->fetch_ops = op->next;
+	    fru->fetches_outstanding--;
+	    fru_fetch_redo(fru, op);
+	    goto out_err;
+	}
+    }
 
-    return ipmi_send_command_addr(domain,
-				  addr, addr_len,
-				  &msg,
-				  fru_data_handler,
-				  fru,
-				  NULL);
+    return 0;
+
+ out_err:
+    if (!fru->fetches_outstanding)
+	return rv;
+    fru->fetch_err = rv;
+    return 0;
 }
 
 static int
@@ -1290,6 +1441,10 @@ i_ipmi_fru_new_update_record(ipmi_fru_t   *fru,
 
 static int next_fru_write(ipmi_domain_t *domain, ipmi_fru_t *fru);
 void write_complete(ipmi_domain_t *domain, ipmi_fru_t *fru, int err);
+static int fru_write_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi);
+static void fru_write_handler(ipmi_fru_t    *fru,
+			      ipmi_domain_t *domain,
+			      int           err);
 
 void
 write_complete2(ipmi_fru_t *fru, ipmi_domain_t *domain, int err)
@@ -1321,7 +1476,12 @@ write_complete(ipmi_domain_t *domain, ipmi_fru_t *fru, int err)
 	/* If we succeed, set everything unchanged. */
 	if (fru->ops.write_complete)
 	    fru->ops.write_complete(fru);
+    } else if (fru->last_image) {
+	/* We don't know what made it to the device now. */
+	ipmi_mem_free(fru->last_image);
+	fru->last_image = NULL;
     }
+    fru->write_err = 0;
     if (fru->data)
 	ipmi_mem_free(fru->data);
     fru->data = NULL;
@@ -1335,90 +1495,278 @@ write_complete(ipmi_domain_t *domain, ipmi_fru_t *fru, int err)
     fru_put(fru);
 }
 
+/* Put a write back on the front of the queue to be sent again. */
 static void
-fru_write_handler(ipmi_fru_t    *fru,
-		  ipmi_domain_t *domain,
-		  int           err)
+fru_write_requeue(ipmi_fru_t *fru, fru_update_t *op)
 {
-    int rv;
+    op->next = fru->update_recs;
+    if (!fru->update_recs)
+	fru->update_recs_tail = op;
+    fru->update_recs = op;
+}
 
-    i_ipmi_fru_lock(fru);
+static void
+fru_write_size_failed(ipmi_fru_t *fru, fru_update_t *op)
+{
+    unsigned int size = op->length - FRU_DATA_WRITE_INCR;
+
+    if (size < MIN_FRU_DATA_WRITE)
+	size = MIN_FRU_DATA_WRITE;
+    if (size < fru->write_size)
+	fru->write_size = size;
+    fru->write_size_fixed = 1;
+    op->retry_count = 0;
+}
+
+static int
+fru_send_write(ipmi_domain_t *domain, ipmi_fru_t *fru, fru_update_t *op)
+{
+    unsigned char data[MAX_FRU_DATA_WRITE+3];
+    ipmi_msg_t    msg;
+
+    data[0] = fru->device_id;
+    ipmi_set_uint16(data+1, op->offset >> fru->access_by_words);
+    memcpy(data+3, fru->data+op->offset, op->length);
+
+    if (fru->write_cb)
+	return fru->write_cb(fru, domain, data, op->length+3,
+			     fru_write_handler);
+
+    msg.netfn = IPMI_STORAGE_NETFN;
+    msg.cmd = IPMI_WRITE_FRU_DATA_CMD;
+    msg.data = data;
+    msg.data_len = op->length + 3;
+
+    return ipmi_send_command_addr(domain,
+				  &fru->addr, fru->addr_len,
+				  &msg,
+				  fru_write_data_handler,
+				  fru,
+				  op);
+}
+
+/*
+ * Send writes from the front of the update records until the window
+ * is full.  A custom write handler only gets one write at a time,
+ * since its completion does not say which write finished.
+ */
+static int
+next_fru_write(ipmi_domain_t *domain, ipmi_fru_t *fru)
+{
+    unsigned int window = fru->write_cb ? 1 : FRU_WRITE_WINDOW;
+    fru_update_t *rec, *op;
+    int          rv;
+
+    while (fru->update_recs && (fru->writes_outstanding < window)) {
+	rec = fru->update_recs;
+	if (rec->length > fru->write_size) {
+	    op = ipmi_mem_alloc(sizeof(*op));
+	    if (!op) {
+		rv = ENOMEM;
+		goto out_err;
+	    }
+	    op->offset = rec->offset;
+	    op->length = fru->write_size;
+	    op->retry_count = 0;
+	    rec->offset += fru->write_size;
+	    rec->length -= fru->write_size;
+	} else {
+	    op = rec;
+	    fru->update_recs = rec->next;
+	}
+
+	op->next = fru->write_ops;
+	fru->write_ops = op;
+	fru->writes_outstanding++;
+
+	rv = fru_send_write(domain, fru, op);
+	if (rv) {
+	    fru->write_ops = op->next;
+	    fru->writes_outstanding--;
+	    fru_write_requeue(fru, op);
+	    if ((rv == E2BIG) && (op->length > MIN_FRU_DATA_WRITE)) {
+		/* Too big for the connection, go smaller. */
+		fru_write_size_failed(fru, op);
+		continue;
+	    }
+	    goto out_err;
+	}
+    }
+
+    return 0;
+
+ out_err:
+    if (!fru->writes_outstanding)
+	return rv;
+    /* Let the outstanding writes finish and report the error then. */
+    fru->write_err = rv;
+    return 0;
+}
+
+/*
+ * Handle the result of one write, requeueing what is left of it if
+ * necessary, and send more or finish the write.  Called with the FRU
+ * locked, returns with it unlocked.
+ */
+static void
+fru_write_op_done(ipmi_domain_t *domain,
+		  ipmi_fru_t    *fru,
+		  fru_update_t  *op,
+		  int           err,
+		  unsigned int  count)
+{
+    fru_update_t **prev;
+    int          rv;
+
+    for (prev = &fru->write_ops; *prev; prev = &(*prev)->next) {
+	if (*prev == op) {
+	    *prev = op->next;
+	    break;
+	}
+    }
+    fru->writes_outstanding--;
 
     /* Note that for safety, we do not stop a fru write on deletion. */
 
+    if (fru->write_err) {
+	/* Already failed, just wait for the rest to come back. */
+	ipmi_mem_free(op);
+	goto check_done;
+    }
+
     if (err == IPMI_IPMI_ERR_VAL(0x81)) {
 	/* Got a busy response.  Try again if we haven't run out of
 	   retries. */
-	if (fru->retry_count >= MAX_FRU_WRITE_RETRIES) {
-	    write_complete(domain, fru, err);
-	    goto out;
+	if (op->retry_count >= MAX_FRU_WRITE_RETRIES) {
+	    fru->write_err = err;
+	    ipmi_mem_free(op);
+	    goto check_done;
 	}
-	fru->retry_count++;
-	goto retry_write;
-    } else if (err) {
+	op->retry_count++;
+	fru_write_requeue(fru, op);
+	goto check_done;
+    }
+
+    /* As with reading, some systems just time out if the message is
+       too big. */
+    if (((err == IPMI_IPMI_ERR_VAL(IPMI_CANNOT_RETURN_REQ_LENGTH_CC))
+	 || (err == IPMI_IPMI_ERR_VAL(IPMI_REQUESTED_DATA_LENGTH_EXCEEDED_CC))
+	 || (err == IPMI_IPMI_ERR_VAL(IPMI_REQUEST_DATA_LENGTH_INVALID_CC))
+	 || (err == IPMI_IPMI_ERR_VAL(IPMI_TIMEOUT_CC))
+	 || (err == IPMI_IPMI_ERR_VAL(IPMI_UNKNOWN_ERR_CC)))
+	&& (op->length > MIN_FRU_DATA_WRITE))
+    {
+	fru_write_size_failed(fru, op);
+	fru_write_requeue(fru, op);
+	goto check_done;
+    }
+
+    if (err) {
 	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "%sfru.c(fru_write_handler): "
+		 "%sfru.c(fru_write_op_done): "
 		 "IPMI error writing FRU data: %x",
 		 FRU_DOMAIN_NAME(fru), err);
-	write_complete(domain, fru, err);
-	goto out;
+	fru->write_err = err;
+	ipmi_mem_free(op);
+	goto check_done;
     }
 
-    fru->update_recs->length -= fru->curr_write_len;
-    if (fru->update_recs->length > 0) {
-	fru->update_recs->offset += fru->curr_write_len;
-    } else {
-	fru_update_t *to_free = fru->update_recs;
-	fru->update_recs = to_free->next;
-	ipmi_mem_free(to_free);
+    if (count == 0) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%sfru.c(fru_write_op_done): "
+		 "FRU write at %d wrote nothing",
+		 FRU_DOMAIN_NAME(fru), op->offset);
+	fru->write_err = EIO;
+	ipmi_mem_free(op);
+	goto check_done;
+    }
+
+    if (count > op->length)
+	count = op->length;
+
+    if (fru->last_image && (fru->last_image_len == fru->data_len))
+	memcpy(fru->last_image + op->offset, fru->data + op->offset, count);
+
+    if (count < op->length) {
+	/* The MC took only part of it, write the rest and don't send
+	   anything bigger than it took. */
+	ipmi_log(IPMI_LOG_WARNING,
+		 "%sfru.c(fru_write_op_done): "
+		 "Incomplete writing FRU data, write %d, expected %d",
+		 FRU_DOMAIN_NAME(fru), count, op->length);
+	op->offset += count;
+	op->length -= count;
+	op->retry_count = 0;
+	fru->write_size = count;
+	fru->write_size_fixed = 1;
+	fru_write_requeue(fru, op);
+	goto check_done;
     }
 
- retry_write:
-    if (fru->update_recs) {
-	/* More to do. */
+    if (!fru->write_size_fixed && (op->length == fru->write_size)
+	&& (fru->write_size < MAX_FRU_DATA_WRITE))
+    {
+	fru->write_size += FRU_DATA_WRITE_INCR;
+	if (fru->write_size > MAX_FRU_DATA_WRITE)
+	    fru->write_size = MAX_FRU_DATA_WRITE;
+    }
+    ipmi_mem_free(op);
+
+ check_done:
+    if (!fru->write_err) {
 	rv = next_fru_write(domain, fru);
-	if (rv) {
-	    write_complete(domain, fru, rv);
-	    goto out;
-	}
-    } else {
-	write_complete(domain, fru, 0);
-	goto out;
+	if (rv)
+	    fru->write_err = rv;
+    }
+
+    if (!fru->writes_outstanding && (fru->write_err || !fru->update_recs)) {
+	write_complete(domain, fru, fru->write_err);
+	return;
     }
 
     i_ipmi_fru_unlock(fru);
- out:
-    return;
 }
 
 static int
-next_fru_write(ipmi_domain_t *domain, ipmi_fru_t *fru)
+fru_write_data_handler(ipmi_domain_t *domain, ipmi_msgi_t *rspi)
 {
-    unsigned char data[MAX_FRU_DATA_WRITE+4];
-    int           offset, length = 0, left, noff, tlen;
+    ipmi_msg_t    *msg = &rspi->msg;
+    ipmi_fru_t    *fru = rspi->data1;
+    fru_update_t  *op = rspi->data2;
+    unsigned char *data = msg->data;
+    unsigned int  count = 0;
+    int           err = 0;
 
-    noff = fru->update_recs->offset;
-    offset = noff;
-    left = MAX_FRU_DATA_WRITE;
-    while ((left > 0) && (noff == fru->update_recs->offset))
-    {
-	if (left < fru->update_recs->length)
-	    tlen = left;
-	else
-	    tlen = fru->update_recs->length;
+    if (!domain)
+	err = ECANCELED;
+    else if (data[0])
+	err = IPMI_IPMI_ERR_VAL(data[0]);
+    else if (msg->data_len < 2) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%sfru.c(fru_write_data_handler): "
+		 "FRU write response too small",
+		 FRU_DOMAIN_NAME(fru));
+	err = EINVAL;
+    } else
+	count = data[1] << fru->access_by_words;
 
-	noff += tlen;
-	length += tlen;
-	left -= tlen;
-	fru->curr_write_len = tlen;
-    }
+    i_ipmi_fru_lock(fru);
+    fru_write_op_done(domain, fru, op, err, count);
+    return IPMI_MSG_ITEM_NOT_USED;
+}
 
-    fru->retry_count = 0;
-    data[0] = fru->device_id;
-    ipmi_set_uint16(data+1, offset >> fru->access_by_words);
-    memcpy(data+3, fru->data+offset, length);
-    fru->last_cmd_len = length + 3;
-    return fru->write_cb(fru, domain, data, length+3, fru_write_handler);
+static void
+fru_write_handler(ipmi_fru_t    *fru,
+		  ipmi_domain_t *domain,
+		  int           err)
+{
+    fru_update_t *op;
+
+    /* Custom write handlers only have one write outstanding and
+       don't report a count, so assume it all went. */
+    i_ipmi_fru_lock(fru);
+    op = fru->write_ops;
+    fru_write_op_done(domain, fru, op, err, err ? 0 : op->length);
 }
 
 static void
@@ -1487,6 +1835,89 @@ fru_write_start_timestamp_check(ipmi_fru_t    *fru,
     return;
 }
 
+/*
+ * Cut the update records down to the bytes that actually differ from
+ * what was last read or written.  Without a good copy of the device
+ * contents, everything the records cover is written.
+ */
+static int
+fru_write_trim_unchanged(ipmi_fru_t *fru)
+{
+    unsigned char *dirty;
+    fru_update_t  *rec, *recs;
+    unsigned int  i, start, end;
+    int           have_image;
+    int           rv = 0;
+
+    dirty = ipmi_mem_alloc(fru->data_len);
+    if (!dirty)
+	return ENOMEM;
+    memset(dirty, 0, fru->data_len);
+
+    have_image = fru->last_image && (fru->last_image_len == fru->data_len);
+    for (rec = fru->update_recs; rec; rec = rec->next) {
+	end = rec->offset + rec->length;
+	if (end > fru->data_len)
+	    end = fru->data_len;
+	for (i = rec->offset; i < end; i++) {
+	    if (!have_image || (fru->data[i] != fru->last_image[i]))
+		dirty[i] = 1;
+	}
+    }
+
+    recs = fru->update_recs;
+    fru->update_recs = NULL;
+    fru->update_recs_tail = NULL;
+
+    i = 0;
+    while (i < fru->data_len) {
+	if (!dirty[i]) {
+	    i++;
+	    continue;
+	}
+	start = i;
+	while ((i < fru->data_len) && dirty[i])
+	    i++;
+	end = i;
+	if (fru->access_by_words) {
+	    start &= ~1U;
+	    if ((end & 1) && (end < fru->data_len))
+		end++;
+	}
+	rec = fru->update_recs_tail;
+	if (fru->update_recs && ((rec->offset + rec->length) >= start)) {
+	    /* Touches the previous run, just extend it. */
+	    rec->length = end - rec->offset;
+	    continue;
+	}
+	rv = i_ipmi_fru_new_update_record(fru, start, end - start);
+	if (rv)
+	    break;
+    }
+
+    ipmi_mem_free(dirty);
+
+    if (rv) {
+	/* Put the original records back. */
+	while (fru->update_recs) {
+	    rec = fru->update_recs;
+	    fru->update_recs = rec->next;
+	    ipmi_mem_free(rec);
+	}
+	fru->update_recs = recs;
+	for (rec = recs; rec; rec = rec->next)
+	    fru->update_recs_tail = rec;
+	return rv;
+    }
+
+    while (recs) {
+	rec = recs;
+	recs = rec->next;
+	ipmi_mem_free(rec);
+    }
+    return 0;
+}
+
 typedef struct start_domain_fru_write_s
 {
     ipmi_fru_t *fru;
@@ -1498,6 +1929,7 @@ start_domain_fru_write(ipmi_domain_t *domain, void *cb_data)
 {
     start_domain_fru_write_t *info = cb_data;
     ipmi_fru_t               *fru = info->fru;
+    int                      had_updates;
 
 
     /* We allocate and format the entire FRU data.  We do this because
@@ -1516,8 +1948,17 @@ start_domain_fru_write(ipmi_domain_t *domain, void *cb_data)
     if (info->rv)
 	goto out_unlock;
 
+    had_updates = fru->update_recs != NULL;
+    info->rv = fru_write_trim_unchanged(fru);
+    if (info->rv)
+	goto out_unlock;
+
     if (!fru->update_recs) {
-	/* No data changed, no write is needed. */
+	/* No data changed, no write is needed.  If the device already
+	   matched the changes, they are written as far as the FRU
+	   code is concerned. */
+	if (had_updates && fru->ops.write_complete)
+	    fru->ops.write_complete(fru);
 	ipmi_mem_free(fru->data);
 	fru->data = NULL;
 	fru->in_use = 0;
@@ -1530,6 +1971,12 @@ start_domain_fru_write(ipmi_domain_t *domain, void *cb_data)
 
     fru_get(fru);
     fru->write_prepared = 0;
+    fru->write_err = 0;
+    if (fru->write_cb) {
+	/* A custom handler may not take anything bigger. */
+	fru->write_size = MIN_FRU_DATA_WRITE;
+	fru->write_size_fixed = 1;
+    }
 
     if (fru->prepare_write_cb)
 	info->rv = fru->prepare_write_cb(fru, domain, fru->last_timestamp,
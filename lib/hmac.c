@@ -41,14 +41,102 @@
 #include <OpenIPMI/ipmi_lan.h>
 #include <OpenIPMI/internal/ipmi_malloc.h>
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#define HMAC_USE_EVP_MAC
+#elif OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define HMAC_USE_HMAC_CTX
+#endif
+
 typedef struct hmac_info_s
 {
     const EVP_MD *evp_md;
     unsigned int  klen;
     unsigned int  ilen;
     unsigned char k[20];
+
+    /*
+     * Keyed once when the session starts.  Each message works on a
+     * copy, so the key schedule isn't redone per message and a send
+     * and a receive can run at the same time.
+     */
+#if defined(HMAC_USE_EVP_MAC)
+    EVP_MAC_CTX   *ctx;
+#elif defined(HMAC_USE_HMAC_CTX)
+    HMAC_CTX      *ctx;
+#endif
 } hmac_info_t;
 
+static int
+hmac_key(hmac_info_t *info)
+{
+#if defined(HMAC_USE_EVP_MAC)
+    EVP_MAC    *mac;
+    OSSL_PARAM params[2];
+
+    mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    if (!mac)
+	return ENOSYS;
+    info->ctx = EVP_MAC_CTX_new(mac);
+    EVP_MAC_free(mac);
+    if (!info->ctx)
+	return ENOMEM;
+    params[0] = OSSL_PARAM_construct_utf8_string
+	(OSSL_MAC_PARAM_DIGEST, (char *) EVP_MD_get0_name(info->evp_md), 0);
+    params[1] = OSSL_PARAM_construct_end();
+    if (!EVP_MAC_init(info->ctx, info->k, info->klen, params)) {
+	EVP_MAC_CTX_free(info->ctx);
+	info->ctx = NULL;
+	return EINVAL;
+    }
+#elif defined(HMAC_USE_HMAC_CTX)
+    info->ctx = HMAC_CTX_new();
+    if (!info->ctx)
+	return ENOMEM;
+    if (!HMAC_Init_ex(info->ctx, info->k, info->klen, info->evp_md, NULL)) {
+	HMAC_CTX_free(info->ctx);
+	info->ctx = NULL;
+	return EINVAL;
+    }
+#endif
+    return 0;
+}
+
+static int
+hmac_calc(hmac_info_t *info, const unsigned char *data, unsigned int len,
+	  unsigned char *integ)
+{
+#if defined(HMAC_USE_EVP_MAC)
+    EVP_MAC_CTX *ctx = EVP_MAC_CTX_dup(info->ctx);
+    size_t      ilen;
+    int         ok;
+
+    if (!ctx)
+	return ENOMEM;
+    ok = (EVP_MAC_update(ctx, data, len)
+	  && EVP_MAC_final(ctx, integ, &ilen, 20));
+    EVP_MAC_CTX_free(ctx);
+    return ok ? 0 : EINVAL;
+#elif defined(HMAC_USE_HMAC_CTX)
+    HMAC_CTX     *ctx = HMAC_CTX_new();
+    unsigned int ilen;
+    int          ok;
+
+    if (!ctx)
+	return ENOMEM;
+    ok = (HMAC_CTX_copy(ctx, info->ctx)
+	  && HMAC_Update(ctx, data, len)
+	  && HMAC_Final(ctx, integ, &ilen));
+    HMAC_CTX_free(ctx);
+    return ok ? 0 : EINVAL;
+#else
+    unsigned int ilen;
+
+    HMAC(info->evp_md, info->k, info->klen, data, len, integ, &ilen);
+    return 0;
+#endif
+}
+
 static int
 hmac_sha1_init(ipmi_con_t       *ipmi,
 	       ipmi_rmcpp_auth_t *ainfo,
@@ -57,10 +145,7 @@ hmac_sha1_init(ipmi_con_t       *ipmi,
     hmac_info_t         *info;
     const unsigned char *k;
     unsigned int        klen;
-
-    info = ipmi_mem_alloc(sizeof(*info));
-    if (!info)
-	return ENOMEM;
+    int                 rv;
 
     if (ipmi_rmcpp_auth_get_sik_len(ainfo) < 20)
 	return EINVAL;
@@ -72,11 +157,21 @@ hmac_sha1_init(ipmi_con_t       *ipmi,
     if (klen < 20)
 	return EINVAL;
 
+    info = ipmi_mem_alloc(sizeof(*info));
+    if (!info)
+	return ENOMEM;
+    memset(info, 0, sizeof(*info));
+
     memcpy(info->k, k, 20);
     info->klen = 20;
     info->ilen = 12;
 
     info->evp_md = EVP_sha1();
+    rv = hmac_key(info);
+    if (rv) {
+	ipmi_mem_free(info);
+	return rv;
+    }
     *integ_data = info;
     return 0;
 }
@@ -89,10 +184,7 @@ hmac_md5_init(ipmi_con_t       *ipmi,
     hmac_info_t         *info;
     const unsigned char *k;
     unsigned int        klen;
-
-    info = ipmi_mem_alloc(sizeof(*info));
-    if (!info)
-	return ENOMEM;
+    int                 rv;
 
     if (ipmi_rmcpp_auth_get_sik_len(ainfo) < 16)
 	return EINVAL;
@@ -101,11 +193,21 @@ hmac_md5_init(ipmi_con_t       *ipmi,
     if (klen < 16)
 	return EINVAL;
 
+    info = ipmi_mem_alloc(sizeof(*info));
+    if (!info)
+	return ENOMEM;
+    memset(info, 0, sizeof(*info));
+
     memcpy(info->k, k, 16);
     info->klen = 16;
     info->ilen = 16;
 
     info->evp_md = EVP_md5();
+    rv = hmac_key(info);
+    if (rv) {
+	ipmi_mem_free(info);
+	return rv;
+    }
     *integ_data = info;
     return 0;
 }
@@ -116,6 +218,11 @@ hmac_free(ipmi_con_t *ipmi,
 {
     hmac_info_t *info = integ_data;
 
+#if defined(HMAC_USE_EVP_MAC)
+    EVP_MAC_CTX_free(info->ctx);
+#elif defined(HMAC_USE_HMAC_CTX)
+    HMAC_CTX_free(info->ctx);
+#endif
     memset(info->k, 0, sizeof(info->k));
     ipmi_mem_free(integ_data);
 }
@@ -161,8 +268,8 @@ hmac_add(ipmi_con_t    *ipmi,
     hmac_info_t   *info = integ_data;
     unsigned char *p = payload;
     unsigned int  l = *payload_len;
-    unsigned int  ilen;
     unsigned char integ[20];
+    int           rv;
 
     if (l+info->ilen+1 > max_payload_len)
 	return E2BIG;
@@ -173,8 +280,10 @@ hmac_add(ipmi_con_t    *ipmi,
     p[l] = 0x07; /* Add the next header */
     l++;
 
-    HMAC(info->evp_md, info->k, info->klen, p+4, l-4, integ, &ilen);
-    memcpy(p+l, integ, ilen);
+    rv = hmac_calc(info, p+4, l-4, integ);
+    if (rv)
+	return rv;
+    memcpy(p+l, integ, info->ilen);
     l += info->ilen;
 
     *payload_len = l;
@@ -191,7 +300,6 @@ hmac_check(ipmi_con_t    *ipmi,
     hmac_info_t   *info = integ_data;
     unsigned char *p = payload;
     unsigned int  l = payload_len;
-    unsigned int  ilen;
     unsigned char new_integ[20];
 
     /* We don't authenticate this part of the header. */
@@ -203,7 +311,8 @@ hmac_check(ipmi_con_t    *ipmi,
 
     /* We add 1 to the length because we also check the next header
        field. */
-    HMAC(info->evp_md, info->k, info->klen, p, l+1, new_integ, &ilen);
+    if (hmac_calc(info, p, l+1, new_integ))
+	return EINVAL;
     if (memcmp(new_integ, p+l+1, info->ilen) != 0)
 	return EINVAL;
 
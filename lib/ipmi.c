@@ -126,6 +126,100 @@ ipmi_get_seq(void)
     return rv;
 }
 
+/* Message items and data buffers are kept on free lists so the
+   normal message path does not have to go to malloc.  The lists are
+   bounded, anything beyond that is really freed. */
+#define MSG_ITEM_POOL_MAX	256
+#define MSG_DATA_POOL_MAX	64
+#define MSG_DATA_POOL_SIZE	1024
+
+/* Data buffers have this in front so we know where they go when they
+   are freed.  A union to keep the data aligned. */
+typedef union msg_data_hdr_u
+{
+    union msg_data_hdr_u *next;
+    unsigned int         size;
+    double               align;
+} msg_data_hdr_t;
+
+static int           msg_pool_initialized;
+static os_hnd_lock_t *msg_pool_lock;
+static ipmi_msgi_t   *msg_item_pool;
+static unsigned int  msg_item_pool_count;
+static msg_data_hdr_t *msg_data_pool;
+static unsigned int  msg_data_pool_count;
+static unsigned long msg_item_hits, msg_item_misses;
+static unsigned long msg_data_hits, msg_data_misses;
+
+static void
+msg_pool_lock_get(void)
+{
+    if (msg_pool_lock)
+	ipmi_os_handler->lock(ipmi_os_handler, msg_pool_lock);
+}
+
+static void
+msg_pool_lock_put(void)
+{
+    if (msg_pool_lock)
+	ipmi_os_handler->unlock(ipmi_os_handler, msg_pool_lock);
+}
+
+static int
+msg_pool_init(os_handler_t *handler)
+{
+    int rv;
+
+    if (handler->create_lock) {
+	rv = handler->create_lock(handler, &msg_pool_lock);
+	if (rv)
+	    return rv;
+    } else {
+	msg_pool_lock = NULL;
+    }
+    msg_pool_initialized = 1;
+    return 0;
+}
+
+static void
+msg_pool_shutdown(void)
+{
+    if (!msg_pool_initialized)
+	return;
+    msg_pool_initialized = 0;
+
+    while (msg_item_pool) {
+	ipmi_msgi_t *item = msg_item_pool;
+	msg_item_pool = item->next;
+	ipmi_mem_free(item);
+    }
+    msg_item_pool_count = 0;
+    while (msg_data_pool) {
+	msg_data_hdr_t *hdr = msg_data_pool;
+	msg_data_pool = hdr->next;
+	ipmi_mem_free(hdr);
+    }
+    msg_data_pool_count = 0;
+    if (msg_pool_lock) {
+	ipmi_os_handler->destroy_lock(ipmi_os_handler, msg_pool_lock);
+	msg_pool_lock = NULL;
+    }
+}
+
+void
+ipmi_get_msg_pool_stats(unsigned long *item_hits,
+			unsigned long *item_misses,
+			unsigned long *data_hits,
+			unsigned long *data_misses)
+{
+    msg_pool_lock_get();
+    *item_hits = msg_item_hits;
+    *item_misses = msg_item_misses;
+    *data_hits = msg_data_hits;
+    *data_misses = msg_data_misses;
+    msg_pool_lock_put();
+}
+
 void
 ipmi_event_state_init(ipmi_event_state_t *events)
 {
@@ -495,6 +589,10 @@ ipmi_init(os_handler_t *handler)
 	seq_lock = NULL;
     }
 
+    rv = msg_pool_init(handler);
+    if (rv)
+	goto out_err;
+
 #ifdef HAVE_OPENIPMI_SMI
     rv = i_ipmi_smi_init(handler);
     if (rv)
@@ -605,6 +703,7 @@ ipmi_shutdown(void)
     i_ipmi_conn_shutdown();
     if (seq_lock)
 	ipmi_os_handler->destroy_lock(ipmi_os_handler, seq_lock);
+    msg_pool_shutdown();
     if (con_type_list)
 	locked_list_destroy(con_type_list);
     ipmi_debug_malloc_cleanup();
@@ -1003,6 +1102,25 @@ i_ipmi_unregister_con_type(const char *name, ipmi_con_setup_t *setup)
     return data.err;
 }
 
+/* Parse the number in a "-xxxwindow=n" option and check it is in the
+   range the domain will take. */
+static int
+parse_window_option(ipmi_open_option_t *option, int optnum,
+		    const char *val, unsigned long min, unsigned long max)
+{
+    unsigned long v;
+    char          *end;
+
+    if ((*val < '0') || (*val > '9'))
+	return EINVAL;
+    v = strtoul(val, &end, 0);
+    if ((*end != '\0') || (v < min) || (v > max))
+	return EINVAL;
+    option->option = optnum;
+    option->ival = v;
+    return 0;
+}
+
 int
 ipmi_parse_options(ipmi_open_option_t *option,
 		   char               *arg)
@@ -1073,6 +1191,15 @@ ipmi_parse_options(ipmi_open_option_t *option,
     } else if (strcmp(arg, "-cache") == 0) {
 	option->option = IPMI_OPEN_OPTION_USE_CACHE;
 	option->ival = 1;
+    } else if (strncmp(arg, "-ipmbscanwindow=", 16) == 0) {
+	return parse_window_option(option, IPMI_OPEN_OPTION_IPMB_SCAN_WINDOW,
+				   arg + 16, 1, IPMI_MAX_IPMB_SCAN_WINDOW);
+    } else if (strncmp(arg, "-sdrfetchwindow=", 16) == 0) {
+	return parse_window_option(option, IPMI_OPEN_OPTION_SDR_FETCH_WINDOW,
+				   arg + 16, 0, IPMI_MAX_SDR_FETCH_WINDOW);
+    } else if (strncmp(arg, "-selfetchwindow=", 16) == 0) {
+	return parse_window_option(option, IPMI_OPEN_OPTION_SEL_FETCH_WINDOW,
+				   arg + 16, 0, IPMI_MAX_SEL_FETCH_WINDOW);
     } else
 	return EINVAL;
 
@@ -1093,7 +1220,12 @@ ipmi_parse_options_help(void)
 	"-[no]setseltime - setting the SEL clock\n"
 	"-[no]activate - connection activation\n"
 	"-[no]localonly - Just talk to the local BMC, (ATCA-only, for blades)\n"
-        "-[no]cache - use the local cache for SDRs.  On by default."
+        "-[no]cache - use the local cache for SDRs.  On by default.\n"
+	"-ipmbscanwindow=<n> - probe n IPMB addresses at a time when scanning\n"
+	"-sdrfetchwindow=<n> - keep n Get SDR requests outstanding, 0 for\n"
+	"    the normal sequential fetch\n"
+	"-selfetchwindow=<n> - send n Get SEL Entry requests ahead, 0 for\n"
+	"    the normal sequential fetch\n"
 	"-wait_til_up - wait until the domain is up before returning";
 }
 
@@ -1219,13 +1351,37 @@ ipmi_openipmi_version(void)
 ipmi_msgi_t *
 ipmi_alloc_msg_item(void)
 {
-    ipmi_msgi_t *rv;
+    ipmi_msgi_t *rv = NULL;
+
+    if (msg_pool_initialized) {
+	msg_pool_lock_get();
+	rv = msg_item_pool;
+	if (rv) {
+	    msg_item_pool = rv->next;
+	    msg_item_pool_count--;
+	    msg_item_hits++;
+	} else
+	    msg_item_misses++;
+	msg_pool_lock_put();
+    }
+    if (!rv) {
+	rv = ipmi_mem_alloc(sizeof(ipmi_msgi_t));
+	if (!rv)
+	    return NULL;
+    }
 
-    rv = ipmi_mem_alloc(sizeof(ipmi_msgi_t));
-    if (!rv)
-	return NULL;
-    memset(rv, 0, sizeof(*rv));
+    /* The data buffer is not cleared, the user sets the length. */
+    memset(&rv->addr, 0, sizeof(rv->addr));
+    rv->addr_len = 0;
+    rv->msg.netfn = 0;
+    rv->msg.cmd = 0;
+    rv->msg.data_len = 0;
     rv->msg.data = rv->data;
+    rv->next = NULL;
+    rv->data1 = NULL;
+    rv->data2 = NULL;
+    rv->data3 = NULL;
+    rv->data4 = NULL;
     return rv;
 }
 
@@ -1234,19 +1390,67 @@ ipmi_free_msg_item(ipmi_msgi_t *item)
 {
     if (item->msg.data && (item->msg.data != item->data))
 	ipmi_free_msg_item_data(item->msg.data);
-    ipmi_mem_free(item);
+
+    if (msg_pool_initialized) {
+	msg_pool_lock_get();
+	if (msg_item_pool_count < MSG_ITEM_POOL_MAX) {
+	    item->next = msg_item_pool;
+	    msg_item_pool = item;
+	    msg_item_pool_count++;
+	    item = NULL;
+	}
+	msg_pool_lock_put();
+    }
+    if (item)
+	ipmi_mem_free(item);
 }
 
 void *
 ipmi_alloc_msg_item_data(unsigned int size)
 {
-    return ipmi_mem_alloc(size);
+    msg_data_hdr_t *hdr = NULL;
+
+    if (msg_pool_initialized && (size <= MSG_DATA_POOL_SIZE)) {
+	msg_pool_lock_get();
+	hdr = msg_data_pool;
+	if (hdr) {
+	    msg_data_pool = hdr->next;
+	    msg_data_pool_count--;
+	    msg_data_hits++;
+	} else
+	    msg_data_misses++;
+	msg_pool_lock_put();
+    }
+    if (!hdr) {
+	/* Small buffers are always allocated full size so they can go
+	   into the pool when freed. */
+	if (size <= MSG_DATA_POOL_SIZE)
+	    size = MSG_DATA_POOL_SIZE;
+	hdr = ipmi_mem_alloc(sizeof(*hdr) + size);
+	if (!hdr)
+	    return NULL;
+    }
+    hdr->size = size;
+    return hdr + 1;
 }
 
 void
 ipmi_free_msg_item_data(void *data)
 {
-    ipmi_mem_free(data);
+    msg_data_hdr_t *hdr = ((msg_data_hdr_t *) data) - 1;
+
+    if (msg_pool_initialized && (hdr->size <= MSG_DATA_POOL_SIZE)) {
+	msg_pool_lock_get();
+	if (msg_data_pool_count < MSG_DATA_POOL_MAX) {
+	    hdr->next = msg_data_pool;
+	    msg_data_pool = hdr;
+	    msg_data_pool_count++;
+	    hdr = NULL;
+	}
+	msg_pool_lock_put();
+    }
+    if (hdr)
+	ipmi_mem_free(hdr);
 }
 
 void
@@ -33,6 +33,9 @@
 
 #include <config.h>
 
+/* Get recvmmsg/sendmmsg for GNU. */
+#define _GNU_SOURCE
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -90,9 +93,10 @@ dump_hex(void *vdata, int len)
 #define IP_FAIL_COUNT 4
 
 /* The default for the maximum number of messages that are allowed to be
-   outstanding.  This is a pretty conservative number. */
+   outstanding.  This is a pretty conservative number.  Each sequence
+   space has 64 sequence numbers, minus our reserved sequence zero. */
 #define DEFAULT_MAX_OUTSTANDING_MSG_COUNT 2
-#define MAX_POSSIBLE_OUTSTANDING_MSG_COUNT 63
+#define MAX_POSSIBLE_OUTSTANDING_MSG_COUNT (IPMI_LAN_MAX_SEQ_SPACES * 63)
 
 typedef struct lan_data_s lan_data_t;
 
@@ -216,7 +220,9 @@ typedef struct lan_stat_info_s
 #define STAT_INVALID_PAYLOAD	16
 #define STAT_SEQ_ERR		17
 #define STAT_RSP_NO_CMD		18
-#define NUM_STATS 19
+#define STAT_RECV_BATCHED	19
+#define STAT_XMIT_BATCHED	20
+#define NUM_STATS 21
     /* Statistics */
     void *stats[NUM_STATS];
 } lan_stat_info_t;
@@ -241,7 +247,9 @@ static const char *lan_stat_names[NUM_STATS] =
     "lan_decrypt_fail",
     "lan_invalid_payload",
     "lan_seq_err",
-    "lan_rsp_no_cmd"
+    "lan_rsp_no_cmd",
+    "lan_recv_batched",
+    "lan_xmit_batched"
 };
 
 
@@ -290,6 +298,33 @@ typedef struct lan_ip_data_s
 #else
 # define LAN_MAX_RAW_MSG 80 /* Enough to hold the rmcp+ session messages */
 #endif
+
+typedef struct lan_seq_s
+{
+    unsigned int          inuse : 1;
+    ipmi_addr_t           addr;
+    unsigned int          addr_len;
+
+    ipmi_msg_t            msg;
+    unsigned char         data[LAN_MAX_RAW_MSG];
+    ipmi_ll_rsp_handler_t rsp_handler;
+    ipmi_msgi_t           *rsp_item;
+    int                   use_orig_addr;
+    ipmi_addr_t           orig_addr;
+    unsigned int          orig_addr_len;
+    os_hnd_timer_id_t     *timer;
+    lan_timer_info_t      *timer_info;
+    int                   retries_left;
+    int                   side_effects;
+
+    /* If -1, just use the normal algorithm.  If not -1, force to
+       this address. */
+    int                   addr_num;
+
+    /* The number of the last IP address sent on. */
+    int                   last_ip_num;
+} lan_seq_t;
+
 struct lan_data_s
 {
     unsigned int	       refcount;
@@ -352,34 +387,15 @@ struct lan_data_s
     /* RMCP+ specific info */
     unsigned int               use_two_keys : 1;
 
-    struct {
-	unsigned int          inuse : 1;
-	ipmi_addr_t           addr;
-	unsigned int          addr_len;
-	
-	ipmi_msg_t            msg;
-	unsigned char         data[LAN_MAX_RAW_MSG];
-	ipmi_ll_rsp_handler_t rsp_handler;
-	ipmi_msgi_t           *rsp_item;
-	int                   use_orig_addr;
-	ipmi_addr_t           orig_addr;
-	unsigned int          orig_addr_len;
-	os_hnd_timer_id_t     *timer;
-	lan_timer_info_t      *timer_info;
-	int                   retries_left;
-	int                   side_effects;
-
-	/* If -1, just use the normal algorithm.  If not -1, force to
-           this address. */
-	int                   addr_num;
-
-	/* The number of the last IP address sent on. */
-	int                   last_ip_num;
-    } seq_table[64];
+    /* Outstanding messages, indexed by sequence number.  There are
+       64 entries for each sequence space in use. */
+    lan_seq_t                 *seq_table;
+    unsigned int              num_seq_spaces;
     ipmi_lock_t               *seq_num_lock;
 
     /* The current sequence number.  Note that we reserve sequence
-       number 0 for our own neferous purposes. */
+       number 0 (in each sequence space) for our own neferous
+       purposes. */
     unsigned int              last_seq;
 
     /* The number of messages that are outstanding with the remote
@@ -387,8 +403,8 @@ struct lan_data_s
     unsigned int outstanding_msg_count;
 
     /* The maximum number of outstanding messages.  This must NEVER be
-       larger than 63 (64 sequence numbers minus 1 for our reserved
-       sequence zero. */
+       larger than 63 times the number of sequence spaces (64 sequence
+       numbers minus 1 for our reserved sequence zero). */
     unsigned int max_outstanding_msg_count;
 
     /* Timeouts for normal messages and messages with side effects. */
@@ -1076,18 +1092,44 @@ static void check_command_queue(ipmi_con_t *ipmi, lan_data_t *lan);
 static int send_auth_cap(ipmi_con_t *ipmi, lan_data_t *lan, int addr_num,
 			 int force_ipmiv15);
 
-static os_handler_t *lan_os_hnd;
+#define IPMI_MAX_LAN_LEN    (IPMI_MAX_MSG_LENGTH + 128)
+#define IPMI_LAN_MAX_HEADER 128
+
+/* If the platform can do it, datagrams on the shared sockets are
+   received in batches, and anything sent while a batch is being
+   handled is queued and sent in one call at the end. */
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define LAN_USE_MMSG
+#define LAN_RECV_BATCH	16
+#define LAN_XMIT_BATCH	16
+
+typedef struct lan_xmit_s
+{
+    unsigned int  len;
+    sockaddr_ip_t addr;
+    unsigned char data[IPMI_MAX_LAN_LEN+IPMI_LAN_MAX_HEADER];
+} lan_xmit_t;
+#endif
 
 #define MAX_CONS_PER_FD	32
 struct lan_fd_s
 {
     int            fd;
+    os_handler_t   *os_hnd;
     os_hnd_fd_id_t *fd_wait_id;
     unsigned int   cons_in_use;
     lan_data_t     *lan[MAX_CONS_PER_FD];
     lan_fd_t       *next, *prev;
     ipmi_lock_t    *con_lock;
 
+#ifdef LAN_USE_MMSG
+    /* Transmit queue, only used while xmit_batching is non-zero. */
+    ipmi_lock_t    *xmit_lock;
+    unsigned int   xmit_batching;
+    unsigned int   num_xmit;
+    lan_xmit_t     xmit[LAN_XMIT_BATCH];
+#endif
+
     /* Main list info. */
     ipmi_lock_t    *lock;
     lan_fd_t       **free_list;
@@ -1111,6 +1153,13 @@ static lan_fd_t *fd6_free_list;
 static void data_handler(int            fd,
 			 void           *cb_data,
 			 os_hnd_fd_id_t *id);
+static void dgram_handler(int            fd,
+			  void           *cb_data,
+			  os_hnd_fd_id_t *id,
+			  unsigned char  *data,
+			  unsigned int   len,
+			  void           *addr,
+			  unsigned int   addr_len);
 
 static int
 lan_addr_same(sockaddr_ip_t *a1, sockaddr_ip_t *a2)
@@ -1214,6 +1263,15 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
     ipmi_lock(lock);
     item = list->next;
  retry:
+    if ((item->cons_in_use < MAX_CONS_PER_FD)
+	&& (item->os_hnd != lan->ipmi->os_hnd))
+    {
+	/* Only share an fd between connections on the same OS
+	   handler, so everything for a connection is handled by the
+	   same selector. */
+	item = item->next;
+	goto retry;
+    }
     if (item->cons_in_use < MAX_CONS_PER_FD) {
 	int tslot = -1;
 	/* Got an entry with a slot, just reuse it. */
@@ -1273,6 +1331,15 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
 		    item = NULL;
 		    goto out_unlock;
 		}
+#ifdef LAN_USE_MMSG
+		rv = ipmi_create_global_lock(&item->xmit_lock);
+		if (rv) {
+		    ipmi_destroy_lock(item->con_lock);
+		    ipmi_mem_free(item);
+		    item = NULL;
+		    goto out_unlock;
+		}
+#endif
 		item->lock = lock;
 		item->free_list = free_list;
 		item->list = list;
@@ -1304,12 +1371,24 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
 	    goto out_unlock;
 	}
 
-	rv = lan_os_hnd->add_fd_to_wait_for(lan_os_hnd,
-					    item->fd,
-					    data_handler, 
-					    item,
-					    NULL,
-					    &(item->fd_wait_id));
+	item->os_hnd = lan->ipmi->os_hnd;
+	/* Let the OS handler receive the packets for us if it can, it
+	   may be able to do that without a system call per packet. */
+	rv = ENOSYS;
+	if (item->os_hnd->add_dgram_fd_to_wait_for)
+	    rv = item->os_hnd->add_dgram_fd_to_wait_for(item->os_hnd,
+							item->fd,
+							dgram_handler,
+							item,
+							NULL,
+							&(item->fd_wait_id));
+	if (rv)
+	    rv = item->os_hnd->add_fd_to_wait_for(item->os_hnd,
+						  item->fd,
+						  data_handler,
+						  item,
+						  NULL,
+						  &(item->fd_wait_id));
 	if (rv) {
 	    close_socket(item->fd);
 	    item->next = *free_list;
@@ -1330,6 +1409,16 @@ find_free_lan_fd(int family, lan_data_t *lan, int *slot)
     return item;
 }
 
+static void
+free_lan_fd(lan_fd_t *item)
+{
+    ipmi_destroy_lock(item->con_lock);
+#ifdef LAN_USE_MMSG
+    ipmi_destroy_lock(item->xmit_lock);
+#endif
+    ipmi_mem_free(item);
+}
+
 static void
 release_lan_fd(lan_fd_t *item, int slot)
 {
@@ -1337,7 +1426,7 @@ release_lan_fd(lan_fd_t *item, int slot)
     item->lan[slot] = NULL;
     item->cons_in_use--;
     if (item->cons_in_use == 0) {
-	lan_os_hnd->remove_fd_to_wait_for(lan_os_hnd, item->fd_wait_id);
+	item->os_hnd->remove_fd_to_wait_for(item->os_hnd, item->fd_wait_id);
 	close_socket(item->fd);
 	item->next->prev = item->prev;
 	item->prev->next = item->next;
@@ -1590,8 +1679,6 @@ auth_check(lan_data_t    *lan,
     return rv;
 }
 
-#define IPMI_MAX_LAN_LEN    (IPMI_MAX_MSG_LENGTH + 128)
-#define IPMI_LAN_MAX_HEADER 128
 
 static int
 rmcpp_format_msg(lan_data_t *lan, int addr_num,
@@ -1782,6 +1869,68 @@ lan15_format_msg(lan_data_t *lan, int addr_num,
     return 0;
 }
 
+#ifdef LAN_USE_MMSG
+/* Send everything in the transmit queue, must be called with the
+   xmit_lock held. */
+static void
+lan_flush_xmit(lan_fd_t *item)
+{
+    struct mmsghdr msgs[LAN_XMIT_BATCH];
+    struct iovec   iov[LAN_XMIT_BATCH];
+    unsigned int   i, sent = 0;
+    int            rv;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i=0; i<item->num_xmit; i++) {
+	iov[i].iov_base = item->xmit[i].data;
+	iov[i].iov_len = item->xmit[i].len;
+	msgs[i].msg_hdr.msg_name = &item->xmit[i].addr.s_ipsock;
+	msgs[i].msg_hdr.msg_namelen = item->xmit[i].addr.ip_addr_len;
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (sent < item->num_xmit) {
+	rv = sendmmsg(item->fd, msgs + sent, item->num_xmit - sent, 0);
+	if (rv > 0)
+	    sent += rv;
+	else if ((rv == -1) && (errno == EINTR))
+	    continue;
+	else
+	    /* Drop the packet that failed, just like a failed sendto
+	       the retransmit will take care of it. */
+	    sent++;
+    }
+    item->num_xmit = 0;
+}
+
+/* Queue the packet if the fd is handling a receive batch.  Returns
+   true if the packet was queued. */
+static int
+lan_queue_xmit(lan_data_t *lan, unsigned char *data, unsigned int len,
+	       int addr_num)
+{
+    lan_fd_t   *item = lan->fd;
+    lan_xmit_t *x;
+
+    ipmi_lock(item->xmit_lock);
+    if (!item->xmit_batching) {
+	ipmi_unlock(item->xmit_lock);
+	return 0;
+    }
+    if (item->num_xmit >= LAN_XMIT_BATCH)
+	lan_flush_xmit(item);
+    x = &item->xmit[item->num_xmit++];
+    memcpy(x->data, data, len);
+    x->len = len;
+    x->addr = lan->cparm.ip_addr[addr_num];
+    ipmi_unlock(item->xmit_lock);
+
+    add_stat(lan->ipmi, STAT_XMIT_BATCHED, 1);
+    return 1;
+}
+#endif
+
 static int
 lan_send_addr(lan_data_t              *lan,
 	      const ipmi_addr_t       *addr,
@@ -1905,6 +2054,11 @@ lan_send_addr(lan_data_t              *lan,
 
     add_stat(lan->ipmi, STAT_XMIT_PACKETS, 1);
 
+#ifdef LAN_USE_MMSG
+    if (lan_queue_xmit(lan, tmsg, pos, addr_num))
+	return 0;
+#endif
+
     rv = sendto(lan->fd->fd, (void*) tmsg, pos, 0,
 		(struct sockaddr *) &(lan->cparm.ip_addr[addr_num].s_ipsock),
 		lan->cparm.ip_addr[addr_num].ip_addr_len);
@@ -2620,6 +2774,46 @@ handle_async_event(ipmi_con_t        *ipmi,
 }
 
 /* Must be called with the message sequence lock held. */
+/* Messages directly to the BMC may use any of the sequence spaces.
+   Everything else (bridged messages, RMCP+ session setup, etc.) only
+   uses the first one, since the software ID is fixed for those. */
+static unsigned int
+lan_seq_limit(lan_data_t *lan, const ipmi_addr_t *addr)
+{
+    if (addr->addr_type == IPMI_SYSTEM_INTERFACE_ADDR_TYPE)
+	return lan->num_seq_spaces * 64;
+    return 64;
+}
+
+/* Find a free sequence number for a message to the given address.
+   Must be called with the seq_num_lock held. */
+static int
+lan_alloc_seq(lan_data_t *lan, const ipmi_addr_t *addr, unsigned int *rseq)
+{
+    unsigned int limit = lan_seq_limit(lan, addr);
+    unsigned int seq = lan->last_seq;
+    unsigned int i;
+
+    for (i=0; i<limit; i++) {
+	seq = (seq + 1) % limit;
+	if (IPMI_LAN_SEQ_NUM(seq) == 0)
+	    continue;
+	if (!lan->seq_table[seq].inuse) {
+	    *rseq = seq;
+	    return 0;
+	}
+    }
+    return EAGAIN;
+}
+
+static int
+lan_seq_available(lan_data_t *lan, const ipmi_addr_t *addr)
+{
+    unsigned int seq;
+
+    return lan_alloc_seq(lan, addr, &seq) == 0;
+}
+
 static int
 handle_msg_send(lan_timer_info_t      *info,
 		int                   addr_num,
@@ -2643,22 +2837,16 @@ handle_msg_send(lan_timer_info_t      *info,
 
     *addr = *iaddr;
 
-    seq = (lan->last_seq + 1) % 64;
-    if (seq == 0)
-	seq++;
-    while (lan->seq_table[seq].inuse) {
-	if (seq == lan->last_seq) {
-	    /* This cannot really happen if max_outstanding_msg_count <= 63. */
-	    ipmi_log(IPMI_LOG_FATAL,
-		     "%sipmi_lan.c(handle_msg_send): "
-		     "ipmi_lan: Attempted to start too many messages",
-		     IPMI_CONN_NAME(ipmi));
-	    abort();
-	}
-
-	seq = (seq + 1) % 64;
-	if (seq == 0)
-	    seq++;
+    rv = lan_alloc_seq(lan, iaddr, &seq);
+    if (rv) {
+	/* The callers check for this, so it shouldn't happen. */
+	ipmi_log(IPMI_LOG_SEVERE,
+		 "%sipmi_lan.c(handle_msg_send): "
+		 "ipmi_lan: Attempted to start too many messages",
+		 IPMI_CONN_NAME(ipmi));
+	ipmi->os_hnd->free_timer(ipmi->os_hnd, info->timer);
+	ipmi_mem_free(info);
+	goto out;
     }
 
     if (DEBUG_MSG) {
@@ -2787,14 +2975,22 @@ handle_msg_send(lan_timer_info_t      *info,
     return rv;
 }
 
+/* Called when a message has completed.  Start waiting messages while
+   there is room for them.  A message that needs a sequence number from
+   a space that is full stays at the head of the queue, so the
+   messages are still started in order. */
 static void
 check_command_queue(ipmi_con_t *ipmi, lan_data_t *lan)
 {
     int              rv;
     lan_wait_queue_t *q_item;
-    int              started = 0;
 
-    while (!started && (lan->wait_q != NULL)) {
+    lan->outstanding_msg_count--;
+
+    while ((lan->wait_q != NULL)
+	   && (lan->outstanding_msg_count < lan->max_outstanding_msg_count)
+	   && lan_seq_available(lan, &lan->wait_q->addr))
+    {
 	/* Commands are waiting to be started, remove the queue item
            and start it. */
 	q_item = lan->wait_q;
@@ -2823,14 +3019,10 @@ check_command_queue(ipmi_con_t *ipmi, lan_data_t *lan)
 					 &q_item->msg, q_item->rsp_handler);
 	    ipmi_lock(lan->seq_num_lock);
 	} else {
-	    /* We successfully sent a message, break out of the loop. */
-	    started = 1;
+	    lan->outstanding_msg_count++;
 	}
 	ipmi_mem_free(q_item);
     }
-
-    if (!started)
-	lan->outstanding_msg_count--;
 }
 
 /* Per the spec, RMCP and RMCP+ have different allowed sequence number
@@ -2844,7 +3036,10 @@ check_session_seq_num(lan_data_t *lan, uint32_t seq,
     if ((int) (seq - *in_seq) >= 0 && (int) (seq - *in_seq) <= gt_allowed) {
 	/* It's after the current sequence number, but within gt_allowed.
 	   We move the sequence number forward. */
-	*map <<= seq - *in_seq;
+	if ((seq - *in_seq) >= 32)
+	    *map = 0;
+	else
+	    *map <<= seq - *in_seq;
 	*map |= 1;
 	*in_seq = seq;
     } else if ((int) (*in_seq - seq) >= 0 && (int) (*in_seq - seq) <= lt_allowed) {
@@ -2873,18 +3068,32 @@ check_session_seq_num(lan_data_t *lan, uint32_t seq,
     return 0;
 }
 
+/* If a lot of messages are outstanding, a burst of lost responses
+   can skip further ahead than the normal window, and we would never
+   get back in sync.  So allow skipping ahead as far as the number of
+   messages that can be outstanding. */
+static int
+session_seq_gt_allowed(lan_data_t *lan, int gt_allowed)
+{
+    if ((int) lan->max_outstanding_msg_count > gt_allowed)
+	return lan->max_outstanding_msg_count;
+    return gt_allowed;
+}
+
 static int
 check_15_session_seq_num(lan_data_t *lan, uint32_t seq,
 			 uint32_t *in_seq, uint32_t *map)
 {
-    return check_session_seq_num(lan, seq, in_seq, map, 8, 8);
+    return check_session_seq_num(lan, seq, in_seq, map,
+				 session_seq_gt_allowed(lan, 8), 8);
 }
 
 static int
 check_20_session_seq_num(lan_data_t *lan, uint32_t seq,
 			 uint32_t *in_seq, uint32_t *map)
 {
-    return check_session_seq_num(lan, seq, in_seq, map, 15, 16);
+    return check_session_seq_num(lan, seq, in_seq, map,
+				 session_seq_gt_allowed(lan, 15), 16);
 }
 
 static void
@@ -2944,7 +3153,7 @@ handle_payload(ipmi_con_t    *ipmi,
     }
 
     ipmi_lock(lan->seq_num_lock);
-    if (! lan->seq_table[seq].inuse) {
+    if ((seq >= lan->num_seq_spaces * 64) || (! lan->seq_table[seq].inuse)) {
 	add_stat(ipmi, STAT_RSP_NO_CMD, 1);
 	if (DEBUG_RAWMSG || DEBUG_MSG_ERR)
 	    ipmi_log(IPMI_LOG_DEBUG,
@@ -3459,31 +3668,19 @@ rmcp_find_ipmi(lan_fd_t      *item,
 }
 
 static void
-data_handler(int            fd,
-	     void           *cb_data,
-	     os_hnd_fd_id_t *id)
+handle_lan_packet(lan_fd_t      *item,
+		  unsigned char *data,
+		  int           len,
+		  sockaddr_ip_t *ipaddrd,
+		  int           batched)
 {
-    lan_fd_t           *item = cb_data;
     ipmi_con_t         *ipmi;
     lan_data_t         *lan;
-    unsigned char      data[IPMI_MAX_LAN_LEN];
-    sockaddr_ip_t      ipaddrd;
-    socklen_t          from_len;
-    int                len;
     int                addr_num = 0; /* Keep gcc happy and initialize */
 
-    from_len = sizeof(ipaddrd.s_ipsock);
-    len = recvfrom(fd, (void*) data, sizeof(data), 0, (struct sockaddr *)&ipaddrd,
-		   &from_len);
-
-    if (len < 0)
-	/* Got an error, probably no data, just return. */
-	return;
-
-    ipaddrd.ip_addr_len = from_len;
     if (DEBUG_RAWMSG) {
 	ipmi_log(IPMI_LOG_DEBUG_START, "incoming\n addr = ");
-	dump_hex((unsigned char *) &ipaddrd, from_len);
+	dump_hex((unsigned char *) ipaddrd, ipaddrd->ip_addr_len);
 	if (len) {
 	    ipmi_log(IPMI_LOG_DEBUG_CONT, "\n data =\n  ");
 	    dump_hex(data, len);
@@ -3508,9 +3705,9 @@ data_handler(int            fd,
     }
 
     if ((data[4] & 0x0f) == IPMI_AUTHTYPE_RMCP_PLUS) {
-	ipmi = rmcpp_find_ipmi(item, data, len, &ipaddrd, &addr_num);
+	ipmi = rmcpp_find_ipmi(item, data, len, ipaddrd, &addr_num);
     } else {
-	ipmi = rmcp_find_ipmi(item, data, len, &ipaddrd, &addr_num);
+	ipmi = rmcp_find_ipmi(item, data, len, ipaddrd, &addr_num);
     }
 
     if (!lan_valid_ipmi(ipmi))
@@ -3521,6 +3718,8 @@ data_handler(int            fd,
     lan = ipmi->con_data;
 
     add_stat(ipmi, STAT_RECV_PACKETS, 1);
+    if (batched)
+	add_stat(ipmi, STAT_RECV_BATCHED, 1);
 
     if ((data[4] & 0x0f) == IPMI_AUTHTYPE_RMCP_PLUS) {
 	handle_rmcpp_recv(ipmi, lan, addr_num, data, len);
@@ -3532,6 +3731,97 @@ data_handler(int            fd,
     return;
 }
 
+#ifdef LAN_USE_MMSG
+static void
+data_handler(int            fd,
+	     void           *cb_data,
+	     os_hnd_fd_id_t *id)
+{
+    lan_fd_t       *item = cb_data;
+    unsigned char  data[LAN_RECV_BATCH][IPMI_MAX_LAN_LEN];
+    sockaddr_ip_t  ipaddrd[LAN_RECV_BATCH];
+    struct mmsghdr msgs[LAN_RECV_BATCH];
+    struct iovec   iov[LAN_RECV_BATCH];
+    int            i, count;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i=0; i<LAN_RECV_BATCH; i++) {
+	iov[i].iov_base = data[i];
+	iov[i].iov_len = sizeof(data[i]);
+	msgs[i].msg_hdr.msg_name = &ipaddrd[i].s_ipsock;
+	msgs[i].msg_hdr.msg_namelen = sizeof(ipaddrd[i].s_ipsock);
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    count = recvmmsg(fd, msgs, LAN_RECV_BATCH, MSG_DONTWAIT, NULL);
+    if (count <= 0)
+	/* Got an error, probably no data, just return. */
+	return;
+
+    /* Hold transmits generated by the responses and send them all
+       together at the end. */
+    ipmi_lock(item->xmit_lock);
+    item->xmit_batching++;
+    ipmi_unlock(item->xmit_lock);
+
+    for (i=0; i<count; i++) {
+	ipaddrd[i].ip_addr_len = msgs[i].msg_hdr.msg_namelen;
+	handle_lan_packet(item, data[i], msgs[i].msg_len, &ipaddrd[i],
+			  count > 1);
+    }
+
+    ipmi_lock(item->xmit_lock);
+    item->xmit_batching--;
+    if (item->xmit_batching == 0)
+	lan_flush_xmit(item);
+    ipmi_unlock(item->xmit_lock);
+}
+#else
+static void
+data_handler(int            fd,
+	     void           *cb_data,
+	     os_hnd_fd_id_t *id)
+{
+    lan_fd_t           *item = cb_data;
+    unsigned char      data[IPMI_MAX_LAN_LEN];
+    sockaddr_ip_t      ipaddrd;
+    socklen_t          from_len;
+    int                len;
+
+    from_len = sizeof(ipaddrd.s_ipsock);
+    len = recvfrom(fd, (void*) data, sizeof(data), 0, (struct sockaddr *)&ipaddrd,
+		   &from_len);
+
+    if (len < 0)
+	/* Got an error, probably no data, just return. */
+	return;
+
+    ipaddrd.ip_addr_len = from_len;
+    handle_lan_packet(item, data, len, &ipaddrd, 0);
+}
+#endif
+
+/* Packets the OS handler received for us. */
+static void
+dgram_handler(int            fd,
+	      void           *cb_data,
+	      os_hnd_fd_id_t *id,
+	      unsigned char  *data,
+	      unsigned int   len,
+	      void           *addr,
+	      unsigned int   addr_len)
+{
+    lan_fd_t      *item = cb_data;
+    sockaddr_ip_t ipaddrd;
+
+    if (addr_len > sizeof(ipaddrd.s_ipsock))
+	addr_len = sizeof(ipaddrd.s_ipsock);
+    memcpy(&ipaddrd.s_ipsock, addr, addr_len);
+    ipaddrd.ip_addr_len = addr_len;
+    handle_lan_packet(item, data, len, &ipaddrd, 0);
+}
+
 /* Note that this puts the address number in data4 of the rspi. */
 int
 ipmi_lan_send_command_forceip(ipmi_con_t            *ipmi,
@@ -3583,7 +3873,7 @@ ipmi_lan_send_command_forceip(ipmi_con_t            *ipmi,
 
     ipmi_lock(lan->seq_num_lock);
 
-    if (lan->outstanding_msg_count >= 60) {
+    if (!lan_seq_available(lan, addr)) {
 	rv = EAGAIN;
 	goto out_unlock;
     }
@@ -3650,7 +3940,7 @@ lan_send_command_option(ipmi_con_t              *ipmi,
     }
 
     if (!rspi) {
-	rspi = ipmi_mem_alloc(sizeof(*rspi));
+	rspi = ipmi_alloc_msg_item();
 	if (!rspi)
 	    return ENOMEM;
     }
@@ -3672,7 +3962,11 @@ lan_send_command_option(ipmi_con_t              *ipmi,
 
     ipmi_lock(lan->seq_num_lock);
 
-    if (lan->outstanding_msg_count >= lan->max_outstanding_msg_count) {
+    /* Anything already waiting goes first, to keep things in order. */
+    if ((lan->wait_q != NULL)
+	|| (lan->outstanding_msg_count >= lan->max_outstanding_msg_count)
+	|| !lan_seq_available(lan, addr))
+    {
 	lan_wait_queue_t *q_item;
 
 	q_item = ipmi_mem_alloc(sizeof(*q_item));
@@ -3712,7 +4006,7 @@ lan_send_command_option(ipmi_con_t              *ipmi,
 	lan->outstanding_msg_count++;
     else if (!trspi && rspi)
 	/* If we allocated an rspi, free it on error. */
-	ipmi_mem_free(rspi);
+	ipmi_free_msg_item(rspi);
     ipmi_unlock(lan->seq_num_lock);
     return rv;
 
@@ -3729,7 +4023,7 @@ lan_send_command_option(ipmi_con_t              *ipmi,
     if (rv) {
 	/* If we allocated an rspi, free it. */
 	if (!trspi && rspi)
-	    ipmi_mem_free(rspi);
+	    ipmi_free_msg_item(rspi);
     }
     return rv;
 }
@@ -3948,6 +4242,8 @@ cleanup_con(ipmi_con_t *ipmi)
 	    locked_list_destroy(lan->ipmb_change_handlers);
 	if (lan->seq_num_lock)
 	    ipmi_destroy_lock(lan->seq_num_lock);
+	if (lan->seq_table)
+	    ipmi_mem_free(lan->seq_table);
 	if (lan->fd)
 	    release_lan_fd(lan->fd, lan->fd_slot);
 	if (lan->authdata)
@@ -3983,7 +4279,7 @@ lan_cleanup(ipmi_con_t *ipmi)
     lan->in_cleanup = 1;
 
     ipmi_lock(lan->seq_num_lock);
-    for (i=0; i<64; i++) {
+    for (i=0; i<lan->num_seq_spaces*64; i++) {
 	if (lan->seq_table[i].inuse) {
 	    ipmi_ll_rsp_handler_t handler;
 	    ipmi_msgi_t           *rspi;
@@ -5740,6 +6036,17 @@ ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
 
     lan->outstanding_msg_count = 0;
     lan->max_outstanding_msg_count = max_outstanding_msg_count;
+
+    /* Only use as many sequence spaces as we need. */
+    lan->num_seq_spaces = (max_outstanding_msg_count + 62) / 63;
+    lan->seq_table = ipmi_mem_alloc(sizeof(lan_seq_t)
+				    * lan->num_seq_spaces * 64);
+    if (!lan->seq_table) {
+	rv = ENOMEM;
+	goto out_err;
+    }
+    memset(lan->seq_table, 0,
+	   sizeof(lan_seq_t) * lan->num_seq_spaces * 64);
     lan->msg_timeout = msg_timeout;
     lan->msg_timeout_sideeff = msg_timeout_sideeff;
     lan->addr_family = set_addr_family;
@@ -5762,13 +6069,13 @@ ipmi_lanp_setup_con(ipmi_lanp_parm_t *parms,
     if (rv)
 	goto out_err;
 
-    lan->con_change_handlers = locked_list_alloc(handlers);
+    lan->con_change_handlers = locked_list_alloc_snapshot(handlers);
     if (!lan->con_change_handlers) {
 	rv = ENOMEM;
 	goto out_err;
     }
 
-    lan->event_handlers = locked_list_alloc(handlers);
+    lan->event_handlers = locked_list_alloc_snapshot(handlers);
     if (!lan->event_handlers) {
 	rv = ENOMEM;
 	goto out_err;
@@ -6080,7 +6387,7 @@ static struct lan_argnum_info_s
       "The IPMI 2.0 Spec was unclear which integrity key to use",
       NULL, NULL },
     { "Max_Outstanding_Msgs",	"int",
-      "How many outstanding messages on the connection, range 1-63",
+      "How many outstanding messages on the connection, range 1-252",
       NULL, NULL },
     { "Address_Family",	"enum",
       "Specified address family (AF_INET or AF_INET6) or AF_UNSPEC",
@@ -6940,7 +7247,8 @@ lan_parse_help(void)
 	"different privileges and different passwords), the default is straight\n"
 	"name lookup.  -Rk sets the BMC key, needed if the system does two-key\n"
 	"lookups.  The -M option sets the maximum outstanding messages.\n"
-	"The default is 2, ranges 1-63.\n"
+	"The default is 2, ranges 1-252.  Above 63 the BMC must handle\n"
+	"requests from several remote console software IDs.\n"
 	"-4 and -6 force IPv4 and IPv6.  The default is unspecified.\n"
 	"The -H option enables certain hacks for broken platforms.  This may\n"
 	"be listed multiple times to enable multiple hacks.  The currently\n"
@@ -7044,8 +7352,6 @@ i_ipmi_lan_init(os_handler_t *os_hnd)
     if (rv)
 	return rv;
 
-    lan_os_hnd = os_hnd;
-
     return 0;
 }
 
@@ -7099,18 +7405,16 @@ i_ipmi_lan_shutdown(void)
 	    lan_fd_t *e = fd_list.next;
 	    e->next->prev = e->prev;
 	    e->prev->next = e->next;
-	    lan_os_hnd->remove_fd_to_wait_for(lan_os_hnd, e->fd_wait_id);
+	    e->os_hnd->remove_fd_to_wait_for(e->os_hnd, e->fd_wait_id);
 	    close_socket(e->fd);
-	    ipmi_destroy_lock(e->con_lock);
-	    ipmi_mem_free(e);
+	    free_lan_fd(e);
 	}
 	memset(&fd_list, 0, sizeof(fd_list));
     }
     while (fd_free_list) {
 	lan_fd_t *e = fd_free_list;
 	fd_free_list = e->next;
-	ipmi_destroy_lock(e->con_lock);
-	ipmi_mem_free(e);
+	free_lan_fd(e);
     }
 #ifdef PF_INET6
     if (fd6_list_lock) {
@@ -7122,19 +7426,16 @@ i_ipmi_lan_shutdown(void)
 	    lan_fd_t *e = fd6_list.next;
 	    e->next->prev = e->prev;
 	    e->prev->next = e->next;
-	    lan_os_hnd->remove_fd_to_wait_for(lan_os_hnd, e->fd_wait_id);
+	    e->os_hnd->remove_fd_to_wait_for(e->os_hnd, e->fd_wait_id);
 	    close_socket(e->fd);
-	    ipmi_destroy_lock(e->con_lock);
-	    ipmi_mem_free(e);
+	    free_lan_fd(e);
 	}
 	memset(&fd6_list, 0, sizeof(fd6_list));
     }
     while (fd6_free_list) {
 	lan_fd_t *e = fd6_free_list;
 	fd6_free_list = e->next;
-	ipmi_destroy_lock(e->con_lock);
-	ipmi_mem_free(e);
+	free_lan_fd(e);
     }
 #endif
-    lan_os_hnd = NULL;
 }
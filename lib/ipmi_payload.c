@@ -67,6 +67,20 @@ ipmb_checksum(unsigned char *data, int size)
 	return -csum;
 }
 
+/* Is the value one of the software IDs used by the LAN sequence
+   spaces?  Return the space number or -1 if not. */
+static int
+swid_seq_space(unsigned char swid)
+{
+    int space;
+
+    for (space=0; space<IPMI_LAN_MAX_SEQ_SPACES; space++) {
+	if (swid == IPMI_LAN_SEQ_SWID(space))
+	    return space;
+    }
+    return -1;
+}
+
 static int
 ipmi_format_msg(ipmi_con_t        *ipmi,
 		const ipmi_addr_t *addr,
@@ -94,8 +108,9 @@ ipmi_format_msg(ipmi_con_t        *ipmi,
 	    tmsg[0] = ipmi->ipmb_addr[0]; /* To the BMC. */
 	tmsg[1] = (msg->netfn << 2) | si_addr->lun;
 	tmsg[2] = ipmb_checksum(tmsg, 2);
-	tmsg[3] = 0x81; /* Remote console IPMI Software ID */
-	tmsg[4] = seq << 2;
+	/* Remote console IPMI Software ID, picks the sequence space. */
+	tmsg[3] = IPMI_LAN_SEQ_SWID(IPMI_LAN_SEQ_SPACE(seq));
+	tmsg[4] = IPMI_LAN_SEQ_NUM(seq) << 2;
 	tmsg[5] = msg->cmd;
 	memcpy(tmsg+6, msg->data, msg->data_len);
 	pos = msg->data_len + 6;
@@ -159,6 +174,8 @@ ipmi_get_recv_seq(ipmi_con_t    *ipmi,
 		  unsigned int  data_len,
 		  unsigned char *seq)
 {
+    int space;
+
     if (data_len < 8) { /* Minimum size of an IPMI msg. */
 	if (DEBUG_RAWMSG || DEBUG_MSG_ERR)
 	    ipmi_log(IPMI_LOG_DEBUG,
@@ -173,7 +190,15 @@ ipmi_get_recv_seq(ipmi_con_t    *ipmi,
 	return ENOSYS;
     }
 
-    *seq = data[4] >> 2;
+    /* The software ID we sent from tells us the sequence space.  Some
+       systems don't swap rq and rs addresses, so check both. */
+    space = swid_seq_space(data[0]);
+    if (space < 0)
+	space = swid_seq_space(data[3]);
+    if (space < 0)
+	space = 0;
+
+    *seq = (space << 6) | (data[4] >> 2);
     return 0;
 }
 
@@ -287,7 +312,7 @@ ipmi_handle_recv(ipmi_con_t    *ipmi,
 		|| ((! (ipmi->hacks & IPMI_CONN_HACK_20_AS_MAIN_ADDR))
 		    && ((tmsg[3] == ipmi->ipmb_addr[chan])
 			/* Some systems don't swap rq and rs addresses :( */
-			|| ((tmsg[3] == 0x81)
+			|| ((swid_seq_space(tmsg[3]) >= 0)
 			    && (tmsg[0] == ipmi->ipmb_addr[chan]))))))
 	{
 	    /* In some cases, a message from the IPMB looks like it came
@@ -314,7 +339,7 @@ ipmi_handle_recv(ipmi_con_t    *ipmi,
 		|| ((!(ipmi->hacks & IPMI_CONN_HACK_20_AS_MAIN_ADDR))
 		    && ((tmsg[3] == ipmi->ipmb_addr[chan])
 			/* Some systems don't swap rq and rs addresses :( */
-			|| ((tmsg[3] == 0x81)
+			|| ((swid_seq_space(tmsg[3]) >= 0)
 			    && (tmsg[0] == ipmi->ipmb_addr[chan])))))
 	    {
 		ipmi_system_interface_addr_t *si_addr
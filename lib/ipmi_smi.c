@@ -66,6 +66,18 @@ static ipmi_args_t *smi_con_alloc_args(void);
 #define SMI_TIMEOUT 60000
 
 #define SMI_AUDIT_TIMEOUT 10000000
+
+/*
+ * The most messages to take from the driver per wakeup.  If there
+ * are more, the fd is still readable and we get called again.
+ */
+#define SMI_MAX_RECV_BATCH 16
+
+/*
+ * The most commands to hold while the driver has no room for more
+ * outstanding commands.
+ */
+#define SMI_MAX_SEND_QUEUE 256
 #if !defined(MIN)
 #define MIN(x,y) ((x)<(y)?(x):(y))
 #endif
@@ -102,6 +114,14 @@ typedef struct pending_cmd_s
     ipmi_addr_t           orig_addr;
     unsigned int          orig_addr_len;
     struct pending_cmd_s  *next, *prev;
+
+    /* A copy of the data while waiting in the send queue, when it
+       was queued so it can be timed out, and the completion code to
+       report if it never gets sent. */
+    unsigned char         *send_data;
+    struct timeval        send_q_time;
+    unsigned char         send_fail_cc;
+    struct pending_cmd_s  *send_next;
 } pending_cmd_t;
 
 typedef struct cmd_handler_s
@@ -125,6 +145,14 @@ typedef struct smi_data_s
     int			       disabled;
     pending_cmd_t              *pending_cmds;
     ipmi_lock_t                *cmd_lock;
+
+    /*
+     * Commands the driver had no room for, sent in order as
+     * responses come back.  Protected by cmd_lock.
+     */
+    pending_cmd_t              *send_q_head, *send_q_tail;
+    unsigned int               send_q_len;
+
     cmd_handler_t              *cmd_handlers;
     ipmi_lock_t                *cmd_handlers_lock;
     os_hnd_fd_id_t             *fd_wait_id;
@@ -166,6 +194,8 @@ static int smi_valid_ipmi(ipmi_con_t *ipmi)
     return (elem != NULL);
 }
 
+static void fail_cmd(ipmi_con_t *ipmi, pending_cmd_t *cmd, unsigned char cc);
+
 static void
 smi_cleanup(ipmi_con_t *ipmi)
 {
@@ -192,30 +222,16 @@ smi_cleanup(ipmi_con_t *ipmi)
     cmd = smi->pending_cmds;
     smi->pending_cmds = NULL;
     while (cmd) {
-	ipmi_addr_t   *addr;
-	unsigned int  addr_len;
-	unsigned char data[1];
 	next_cmd = cmd->next;
-	if (!smi->disabled && cmd->rsp_handler) {
-	    if (cmd->use_orig_addr) {
-		addr = &cmd->orig_addr;
-		addr_len = cmd->orig_addr_len;
-	    } else {
-		addr = &cmd->addr;
-		addr_len = cmd->addr_len;
-	    }
-	    data[0] = IPMI_UNKNOWN_ERR_CC;
-	    
-	    cmd->msg.netfn |= 1;
-	    cmd->msg.data = data;
-	    cmd->msg.data_len = 1;
-	    ipmi_handle_rsp_item_copyall(ipmi, cmd->rsp_item,
-					 addr, addr_len, &cmd->msg,
-					 cmd->rsp_handler);
-	}
+	if (!smi->disabled && cmd->rsp_handler)
+	    fail_cmd(ipmi, cmd, IPMI_UNKNOWN_ERR_CC);
+	if (cmd->send_data)
+	    ipmi_mem_free(cmd->send_data);
 	ipmi_mem_free(cmd);
 	cmd = next_cmd;
     }
+    smi->send_q_head = NULL;
+    smi->send_q_tail = NULL;
 
     hnd_to_free = smi->cmd_handlers;
     smi->cmd_handlers = NULL;
@@ -472,6 +488,124 @@ smi_send(smi_data_t        *smi,
     return 0;
 }
 
+/* The driver is out of sequence numbers or message slots. */
+#define SMI_SEND_FULL(err) (((err) == EAGAIN) || ((err) == EBUSY))
+
+/* Must be called with cmd_lock held. */
+static int
+send_q_add(smi_data_t *smi, pending_cmd_t *cmd, const ipmi_msg_t *msg)
+{
+    if (smi->send_q_len >= SMI_MAX_SEND_QUEUE)
+	return EAGAIN;
+
+    if (msg->data_len) {
+	cmd->send_data = ipmi_mem_alloc(msg->data_len);
+	if (!cmd->send_data)
+	    return ENOMEM;
+	memcpy(cmd->send_data, msg->data, msg->data_len);
+    }
+    smi->ipmi->os_hnd->get_monotonic_time(smi->ipmi->os_hnd,
+					  &cmd->send_q_time);
+    cmd->send_next = NULL;
+    if (smi->send_q_tail)
+	smi->send_q_tail->send_next = cmd;
+    else
+	smi->send_q_head = cmd;
+    smi->send_q_tail = cmd;
+    smi->send_q_len++;
+    return 0;
+}
+
+static void
+fail_cmd(ipmi_con_t *ipmi, pending_cmd_t *cmd, unsigned char cc)
+{
+    ipmi_addr_t   *addr;
+    unsigned int  addr_len;
+    unsigned char data[1];
+
+    if (cmd->use_orig_addr) {
+	addr = &cmd->orig_addr;
+	addr_len = cmd->orig_addr_len;
+    } else {
+	addr = &cmd->addr;
+	addr_len = cmd->addr_len;
+    }
+    data[0] = cc;
+    cmd->msg.netfn |= 1;
+    cmd->msg.data = data;
+    cmd->msg.data_len = 1;
+    ipmi_handle_rsp_item_copyall(ipmi, cmd->rsp_item, addr, addr_len,
+				 &cmd->msg, cmd->rsp_handler);
+}
+
+/*
+ * Send the queued commands back to back until the driver is full
+ * again.  Commands the driver rejects for other reasons get an error
+ * response, and ones that have waited longer than SMI_TIMEOUT get a
+ * timeout.
+ */
+static void
+send_q_flush(ipmi_con_t *ipmi, smi_data_t *smi)
+{
+    pending_cmd_t  *cmd, *failed = NULL, **failed_tail = &failed;
+    ipmi_msg_t     msg;
+    struct timeval now, expire;
+    int            rv;
+
+    ipmi->os_hnd->get_monotonic_time(ipmi->os_hnd, &now);
+
+    ipmi_lock(smi->cmd_lock);
+    while ((cmd = smi->send_q_head)) {
+	/* The queue is in order, so only the head can have expired. */
+	expire = cmd->send_q_time;
+	expire.tv_sec += SMI_TIMEOUT / 1000;
+	expire.tv_usec += (SMI_TIMEOUT % 1000) * 1000;
+	if (expire.tv_usec >= 1000000) {
+	    expire.tv_sec++;
+	    expire.tv_usec -= 1000000;
+	}
+	if ((now.tv_sec > expire.tv_sec)
+	    || ((now.tv_sec == expire.tv_sec)
+		&& (now.tv_usec >= expire.tv_usec)))
+	{
+	    rv = ETIMEDOUT;
+	} else {
+	    msg = cmd->msg;
+	    msg.data = cmd->send_data;
+	    rv = smi_send(smi, smi->fd, &cmd->addr, cmd->addr_len, &msg,
+			  (long) cmd);
+	    if (SMI_SEND_FULL(rv))
+		break;
+	}
+
+	smi->send_q_head = cmd->send_next;
+	if (!smi->send_q_head)
+	    smi->send_q_tail = NULL;
+	smi->send_q_len--;
+	if (cmd->send_data) {
+	    ipmi_mem_free(cmd->send_data);
+	    cmd->send_data = NULL;
+	}
+	if (rv) {
+	    remove_cmd(ipmi, smi, cmd);
+	    if (rv == ETIMEDOUT)
+		cmd->send_fail_cc = IPMI_TIMEOUT_CC;
+	    else
+		cmd->send_fail_cc = IPMI_UNKNOWN_ERR_CC;
+	    cmd->send_next = NULL;
+	    *failed_tail = cmd;
+	    failed_tail = &cmd->send_next;
+	}
+    }
+    ipmi_unlock(smi->cmd_lock);
+
+    while ((cmd = failed)) {
+	failed = cmd->send_next;
+	fail_cmd(ipmi, cmd, cmd->send_fail_cc);
+	ipmi_mem_free(cmd);
+    }
+}
+
 static void
 set_ipmb_in_dev(smi_data_t          *smi,
 		const unsigned char ipmb_addr[],
@@ -620,6 +754,9 @@ audit_timeout_handler(void              *cb_data,
 	goto out_done;
     }
 
+    /* In case nothing came back to kick the send queue. */
+    send_q_flush(ipmi, (smi_data_t *) ipmi->con_data);
+
     msg.netfn = IPMI_APP_NETFN;
     msg.cmd = IPMI_GET_DEVICE_ID_CMD;
     msg.data = NULL;
@@ -902,34 +1039,47 @@ ipmi_dev_data_handler(int            fd,
 		      os_hnd_fd_id_t *id)
 {
     ipmi_con_t       *ipmi = (ipmi_con_t *) cb_data;
+    smi_data_t       *smi;
     unsigned char    data[IPMI_MAX_MSG_LENGTH];
     ipmi_addr_t      addr;
     struct ipmi_recv recv;
     int              rv;
+    int              count;
 
     if (!smi_valid_ipmi(ipmi)) {
 	/* We can have due to a race condition, just return and
            everything should be fine. */
 	return;
     }
+    smi = (smi_data_t *) ipmi->con_data;
 
-    recv.msg.data = data;
-    recv.msg.data_len = sizeof(data);
-    recv.addr = (unsigned char *) &addr;
-    recv.addr_len = sizeof(addr);
-    rv = ioctl(fd, IPMICTL_RECEIVE_MSG_TRUNC, &recv);
-    if (rv == -1) {
-	if (errno == EMSGSIZE) {
-	    /* The message was truncated, handle it as such. */
-	    data[0] = IPMI_REQUESTED_DATA_LENGTH_EXCEEDED_CC;
-	    rv = 0;
-	} else
-	    goto out;
+    /*
+     * Take everything the driver has queued (the receive ioctl
+     * doesn't block, it returns EAGAIN when empty), not just one
+     * message per trip through the selector.
+     */
+    for (count = 0; count < SMI_MAX_RECV_BATCH; count++) {
+	recv.msg.data = data;
+	recv.msg.data_len = sizeof(data);
+	recv.addr = (unsigned char *) &addr;
+	recv.addr_len = sizeof(addr);
+	rv = ioctl(fd, IPMICTL_RECEIVE_MSG_TRUNC, &recv);
+	if (rv == -1) {
+	    if (errno == EMSGSIZE) {
+		/* The message was truncated, handle it as such. */
+		data[0] = IPMI_REQUESTED_DATA_LENGTH_EXCEEDED_CC;
+		rv = 0;
+	    } else
+		break;
+	}
+
+	gen_recv_msg(ipmi, &recv);
     }
 
-    gen_recv_msg(ipmi, &recv);
+    /* Responses free up room in the driver, send what was waiting. */
+    if (smi->send_q_head)
+	send_q_flush(ipmi, smi);
 
- out:
     smi_put(ipmi);
 }
 
@@ -1006,12 +1156,25 @@ smi_send_command(ipmi_con_t            *ipmi,
     cmd->rsp_handler = rsp_handler;
     cmd->rsp_item = rspi;
 
+    cmd->send_data = NULL;
+
     ipmi_lock(smi->cmd_lock);
     add_cmd(ipmi, addr, addr_len, msg, smi, cmd);
 
-    rv = smi_send(smi, smi->fd, addr, addr_len, msg, (long) cmd);
+    /*
+     * Keep commands in order behind any that are waiting for room
+     * in the driver, and queue this one if the driver is full.
+     */
+    if (smi->send_q_head)
+	rv = EAGAIN;
+    else
+	rv = smi_send(smi, smi->fd, addr, addr_len, msg, (long) cmd);
+    if (SMI_SEND_FULL(rv))
+	rv = send_q_add(smi, cmd, msg);
     if (rv) {
 	remove_cmd(ipmi, smi, cmd);
+	if (cmd->send_data)
+	    ipmi_mem_free(cmd->send_data);
 	ipmi_mem_free(cmd);
 	goto out_unlock;
     }
@@ -1484,13 +1647,13 @@ setup(int          if_num,
 	goto out_err;
     }
 
-    smi->con_change_handlers = locked_list_alloc(handlers);
+    smi->con_change_handlers = locked_list_alloc_snapshot(handlers);
     if (!smi->con_change_handlers) {
 	rv = ENOMEM;
 	goto out_err;
     }
 
-    smi->event_handlers = locked_list_alloc(handlers);
+    smi->event_handlers = locked_list_alloc_snapshot(handlers);
     if (!smi->event_handlers) {
 	rv = ENOMEM;
 	goto out_err;
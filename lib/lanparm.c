@@ -466,6 +466,7 @@ typedef struct lanparm_fetch_handler_s
     unsigned char       *data;
     unsigned int        data_len;
     int                 rv;
+    int                 queued; /* Went through the opq */
 } lanparm_fetch_handler_t;
 
 /* This should be called with the lanparm locked.  It will unlock the lanparm
@@ -473,6 +474,8 @@ typedef struct lanparm_fetch_handler_s
 static void
 fetch_complete(ipmi_lanparm_t *lanparm, int err, lanparm_fetch_handler_t *elem)
 {
+    int queued = elem->queued;
+
     if (lanparm->in_destroy)
 	goto out;
 
@@ -483,7 +486,7 @@ fetch_complete(ipmi_lanparm_t *lanparm, int err, lanparm_fetch_handler_t *elem)
 
     ipmi_mem_free(elem);
 
-    if (!lanparm->destroyed)
+    if (queued && !lanparm->destroyed)
 	opq_op_done(lanparm->opq);
 
     lanparm_put(lanparm);
@@ -586,13 +589,19 @@ start_config_fetch(void *cb_data, int shutdown)
     return OPQ_HANDLER_STARTED;
 }
 
-int
-ipmi_lanparm_get_parm(ipmi_lanparm_t      *lanparm,
-		      unsigned int	  parm,
-		      unsigned int	  set,
-		      unsigned int	  block,
-		      ipmi_lanparm_get_cb done,
-		      void                *cb_data)
+/*
+ * If queued is false, the fetch is started right away instead of
+ * waiting its turn in the opq, so more than one can be outstanding.
+ * That is only for the reads done by ipmi_lan_get_config().
+ */
+static int
+lanparm_get_parm(ipmi_lanparm_t      *lanparm,
+		 unsigned int	     parm,
+		 unsigned int	     set,
+		 unsigned int	     block,
+		 ipmi_lanparm_get_cb done,
+		 void                *cb_data,
+		 int                 queued)
 {
     lanparm_fetch_handler_t *elem;
     int                 rv = 0;
@@ -615,6 +624,13 @@ ipmi_lanparm_get_parm(ipmi_lanparm_t      *lanparm,
     elem->set = set;
     elem->block = block;
     elem->rv = 0;
+    elem->queued = queued;
+
+    if (!queued) {
+	lanparm_get(lanparm);
+	start_config_fetch(elem, 0);
+	return 0;
+    }
 
     if (!opq_new_op(lanparm->opq, start_config_fetch, elem, 0))
 	rv = ENOMEM;
@@ -627,6 +643,17 @@ ipmi_lanparm_get_parm(ipmi_lanparm_t      *lanparm,
     return rv;
 }
 
+int
+ipmi_lanparm_get_parm(ipmi_lanparm_t      *lanparm,
+		      unsigned int	  parm,
+		      unsigned int	  set,
+		      unsigned int	  block,
+		      ipmi_lanparm_get_cb done,
+		      void                *cb_data)
+{
+    return lanparm_get_parm(lanparm, parm, set, block, done, cb_data, 1);
+}
+
 typedef struct lanparm_set_handler_s
 {
     ipmi_lanparm_t 	 *lanparm;
@@ -823,12 +850,35 @@ typedef struct alert_dest_addr_s
     unsigned short dest_vlan_tag;
 } alert_dest_addr_t;
 
+/*
+ * A parameter to fetch for ipmi_lan_get_config().  These are sent
+ * LANPARM_FETCH_WINDOW at a time, entries whose selectors depend on
+ * an earlier parameter are added when that parameter comes back.
+ */
+#define LANPARM_FETCH_WINDOW 8
+typedef struct lan_fetch_s
+{
+    ipmi_lan_config_t  *lanc;
+    unsigned char      parm;
+    unsigned char      sel;
+    struct lan_fetch_s *next;
+} lan_fetch_t;
+
 struct ipmi_lan_config_s
 {
     /* Stuff for getting/setting the values. */
     int curr_parm;
     int curr_sel;
 
+    /* Fetches not yet sent, and the number sent but not answered.
+       Protected by the lanparm lock. */
+    lan_fetch_t *fetch_head, *fetch_tail;
+    int         fetch_outstanding;
+    int         fetch_running;
+    /* Set by whoever decides the fetch is over, only that caller may
+       touch the config after dropping the lock. */
+    int         fetch_done;
+
     /* Not used for access, just for checking validity. */
     ipmi_lanparm_t *my_lan;
 
@@ -1493,6 +1543,145 @@ err_lock_cleared(ipmi_lanparm_t *lanparm,
     lanparm_put(lanparm);
 }
 
+static int
+lanc_fetch_add(ipmi_lan_config_t *lanc, unsigned int parm, unsigned int sel)
+{
+    lan_fetch_t *ent;
+
+    ent = ipmi_mem_alloc(sizeof(*ent));
+    if (!ent)
+	return ENOMEM;
+    ent->lanc = lanc;
+    ent->parm = parm;
+    ent->sel = sel;
+    ent->next = NULL;
+    if (lanc->fetch_tail)
+	lanc->fetch_tail->next = ent;
+    else
+	lanc->fetch_head = ent;
+    lanc->fetch_tail = ent;
+    return 0;
+}
+
+/* Called when nothing is outstanding any more. */
+static void
+lanc_fetch_done(ipmi_lanparm_t *lanparm, ipmi_lan_config_t *lanc)
+{
+    lan_fetch_t *ent;
+    int         err;
+
+    while ((ent = lanc->fetch_head)) {
+	lanc->fetch_head = ent->next;
+	ipmi_mem_free(ent);
+    }
+    lanc->fetch_tail = NULL;
+
+    if (lanc->err) {
+	unsigned char data[1];
+
+	/* Clear the lock */
+	data[0] = 0;
+	err = ipmi_lanparm_set_parm(lanparm, 0, data, 1,
+				    err_lock_cleared, lanc);
+	if (err) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "lanparm.c(lanc_fetch_done): Error trying to clear lock:"
+		     " %x",
+		     err);
+	    lanc->done(lanparm, lanc->err, NULL, lanc->cb_data);
+	    ipmi_lan_free_config(lanc);
+	    lanparm->locked = 0;
+	    lanparm_put(lanparm);
+	}
+    } else {
+	lanc->done(lanparm, 0, lanc, lanc->cb_data);
+	lanparm_put(lanparm);
+    }
+}
+
+static void got_parm(ipmi_lanparm_t *lanparm, int err, unsigned char *data,
+		     unsigned int data_len, void *cb_data);
+
+/*
+ * Send fetches until the window is full.  Only one caller runs the
+ * loop at a time, a response that comes in while it is sending just
+ * updates the state and the loop picks that up.  Must be called with
+ * the lanparm lock held, it is released.  Completion is decided once,
+ * under the lock, and the config must not be touched after this
+ * returns since whoever completed it may have freed it.
+ */
+static void
+lanc_fetch_next(ipmi_lanparm_t *lanparm, ipmi_lan_config_t *lanc)
+{
+    lan_fetch_t *ent;
+    int         rv;
+    int         finished;
+
+    if (lanc->fetch_running || lanc->fetch_done) {
+	lanparm_unlock(lanparm);
+	return;
+    }
+    lanc->fetch_running = 1;
+    while (!lanc->err && lanc->fetch_head
+	   && (lanc->fetch_outstanding < LANPARM_FETCH_WINDOW))
+    {
+	ent = lanc->fetch_head;
+	lanc->fetch_head = ent->next;
+	if (!lanc->fetch_head)
+	    lanc->fetch_tail = NULL;
+	lanc->fetch_outstanding++;
+	lanparm_unlock(lanparm);
+	rv = lanparm_get_parm(lanparm, ent->parm, ent->sel, 0, got_parm, ent,
+			      0);
+	lanparm_lock(lanparm);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "lanparm.c(lanc_fetch_next): Error trying to get parm"
+		     " %d: %x",
+		     ent->parm, rv);
+	    ipmi_mem_free(ent);
+	    lanc->fetch_outstanding--;
+	    if (!lanc->err)
+		lanc->err = rv;
+	}
+    }
+    lanc->fetch_running = 0;
+    finished = ((lanc->fetch_outstanding == 0)
+		&& (lanc->err || !lanc->fetch_head));
+    if (finished)
+	lanc->fetch_done = 1;
+    lanparm_unlock(lanparm);
+
+    if (finished)
+	lanc_fetch_done(lanparm, lanc);
+}
+
+/* Errors are reported through the done handler. */
+static void
+lanc_fetch_start(ipmi_lanparm_t *lanparm, ipmi_lan_config_t *lanc)
+{
+    int i;
+
+    for (i=1; i<NUM_LANPARMS; i++) {
+	if (!lanparms[i].valid)
+	    continue;
+	switch (i) {
+	case IPMI_LANPARM_DEST_TYPE:
+	case IPMI_LANPARM_DEST_ADDR:
+	case IPMI_LANPARM_DEST_VLAN_TAG:
+	case IPMI_LANPARM_CIPHER_SUITE_ENTRY_SUPPORT:
+	case IPMI_LANPARM_CIPHER_SUITE_ENTRY_PRIV:
+	    /* Added when the count they depend on comes back. */
+	    continue;
+	}
+	lanc->err = lanc_fetch_add(lanc, i, 0);
+	if (lanc->err)
+	    break;
+    }
+    lanparm_lock(lanparm);
+    lanc_fetch_next(lanparm, lanc);
+}
+
 static void
 got_parm(ipmi_lanparm_t    *lanparm,
 	 int               err,
@@ -1500,8 +1689,20 @@ got_parm(ipmi_lanparm_t    *lanparm,
 	 unsigned int      data_len,
 	 void              *cb_data)
 {
-    ipmi_lan_config_t *lanc = cb_data;
-    lanparms_t        *lp = &(lanparms[lanc->curr_parm]);
+    lan_fetch_t       *ent = cb_data;
+    ipmi_lan_config_t *lanc = ent->lanc;
+    lanparms_t        *lp = &(lanparms[ent->parm]);
+    unsigned int      i;
+
+    lanparm_lock(lanparm);
+    lanc->fetch_outstanding--;
+    if (lanc->err)
+	/* Already failed, just waiting for the rest to come back. */
+	goto out;
+
+    /* The get handlers and error logs use these. */
+    lanc->curr_parm = ent->parm;
+    lanc->curr_sel = ent->sel;
 
     /* Check the length, and don't forget the revision byte must be added. */
     if ((!err) && (data_len < (unsigned int) (lp->length+1))) {
@@ -1509,14 +1710,14 @@ got_parm(ipmi_lanparm_t    *lanparm,
 	    /* Some systems return zero-length data for optional parms. */
 	    unsigned char *opt = ((unsigned char *)lanc) + lp->optional_offset;
 	    *opt = 0;
-	    goto next_parm;
+	    goto out;
 	}
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "lanparm.c(got_parm): "
 		 " Invalid data length on parm %d was %d, should have been %d",
 		 lanc->curr_parm, data_len, lp->length+1);
 	err = EINVAL;
-	goto done;
+	goto out_err;
     }
 
     err = lp->get_handler(lanc, lp, err, data);
@@ -1525,59 +1726,35 @@ got_parm(ipmi_lanparm_t    *lanparm,
 		 "lanparm.c(got_parm): "
 		 "Error fetching parm %d: %x",
 		 lanc->curr_parm, err);
-	goto done;
+	goto out_err;
     }
 
- next_parm:
-    switch (lanc->curr_parm) {
+    switch (ent->parm) {
     case IPMI_LANPARM_NUM_DESTINATIONS:
-	if (lanc->num_alert_destinations == 0)
-	    lanc->curr_parm = IPMI_LANPARM_VLAN_ID;
-	else {
-	    lanc->curr_parm++;
-	    lanc->curr_sel = 0;
-	}
-	break;
-
-    case IPMI_LANPARM_DEST_TYPE:
-	lanc->curr_sel++;
-	if (lanc->curr_sel >= lanc->num_alert_destinations) {
-	    lanc->curr_parm++;
-	    lanc->curr_sel = 0;
-	}
-	break;
-
-    case IPMI_LANPARM_DEST_ADDR:
-	lanc->curr_sel++;
-	if (lanc->curr_sel >= lanc->num_alert_destinations) {
-	    lanc->curr_parm = IPMI_LANPARM_VLAN_ID;
-	    lanc->curr_sel = 0;
+	for (i=0; !err && (i<lanc->num_alert_destinations); i++) {
+	    err = lanc_fetch_add(lanc, IPMI_LANPARM_DEST_TYPE, i);
+	    if (!err)
+		err = lanc_fetch_add(lanc, IPMI_LANPARM_DEST_ADDR, i);
 	}
+	/* VLAN tags are optional, see if the first one is there. */
+	if (!err && lanc->num_alert_destinations)
+	    err = lanc_fetch_add(lanc, IPMI_LANPARM_DEST_VLAN_TAG, 0);
 	break;
 
     case IPMI_LANPARM_NUM_CIPHER_SUITE_ENTRIES:
-	lanc->curr_parm++;
-	if (lanc->num_cipher_suites == 0) {
-	    if (lanc->num_alert_destinations == 0)
-		goto done;
-	    lanc->curr_parm = IPMI_LANPARM_DEST_VLAN_TAG;
-	    lanc->curr_sel = 0;
-	}
-	break;
-
-    case IPMI_LANPARM_CIPHER_SUITE_ENTRY_PRIV:
-	if (lanc->num_alert_destinations == 0)
-	    goto done;
-	else {
-	    lanc->curr_parm++;
-	    lanc->curr_sel = 0;
+	if (lanc->num_cipher_suites) {
+	    err = lanc_fetch_add(lanc, IPMI_LANPARM_CIPHER_SUITE_ENTRY_SUPPORT,
+				 0);
+	    if (!err)
+		err = lanc_fetch_add(lanc,
+				     IPMI_LANPARM_CIPHER_SUITE_ENTRY_PRIV, 0);
 	}
 	break;
 
     case IPMI_LANPARM_DEST_VLAN_TAG:
 	if (!lanc->vlan_tag_supported)
-	    goto done;
-	if ((data[1] & 0xf) != lanc->curr_sel) {
+	    break;
+	if ((data[1] & 0xf) != ent->sel) {
 	    /* Yikes, wrong selector came back! */
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "lanparm.c(got_parm): "
@@ -1585,54 +1762,30 @@ got_parm(ipmi_lanparm_t    *lanparm,
 		     " wrong selector came back, expecting %d, was %d",
 		     lanc->curr_parm, lanc->curr_sel, data[1] & 0xf);
 	    err = EINVAL;
-	    goto done;
+	    break;
+	}
+	if (ent->sel == 0) {
+	    for (i=1; !err && (i<lanc->num_alert_destinations); i++)
+		err = lanc_fetch_add(lanc, IPMI_LANPARM_DEST_VLAN_TAG, i);
 	}
-	lanc->curr_sel++;
-	if (lanc->curr_sel >= lanc->num_alert_destinations)
-	    goto done;
 	break;
-
-    default:
-	lanc->curr_parm++;
     }
-
-    lp = &(lanparms[lanc->curr_parm]);
-    if (!lp->valid)
-	goto next_parm;
-
-    err = ipmi_lanparm_get_parm(lanparm, lanc->curr_parm, lanc->curr_sel, 0,
-				got_parm, lanc);
     if (err)
-	goto done;
+	goto out_err;
 
+ out:
+    /* Keep the lock, the outstanding count must not reach zero where
+       another thread can complete the fetch before we look at it. */
+    ipmi_mem_free(ent);
+    lanc_fetch_next(lanparm, lanc);
     return;
 
- done:
-    if (err) {
-	unsigned char data[1];
-
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "lanparm.c(got_parm): Error trying to get parm %d: %x",
-		 lanc->curr_parm, err);
-	lanc->err = err;
-	/* Clear the lock */
-	data[0] = 0;
-	err = ipmi_lanparm_set_parm(lanparm, 0, data, 1,
-				    err_lock_cleared, lanc);
-	if (err) {
-	    ipmi_lan_free_config(lanc);
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "lanparm.c(got_parm): Error trying to clear lock: %x",
-		     err);
-	    lanc->done(lanparm, lanc->err, NULL, lanc->cb_data);
-	    ipmi_lan_free_config(lanc);
-	    lanparm->locked = 0;
-	    lanparm_put(lanparm);
-	}
-    } else {
-	lanc->done(lanparm, 0, lanc, lanc->cb_data);
-	lanparm_put(lanparm);
-    }
+ out_err:
+    ipmi_log(IPMI_LOG_ERR_INFO,
+	     "lanparm.c(got_parm): Error trying to get parm %d: %x",
+	     lanc->curr_parm, err);
+    lanc->err = err;
+    goto out;
 }
 
 static void 
@@ -1641,7 +1794,6 @@ lock_done(ipmi_lanparm_t *lanparm,
 	  void           *cb_data)
 {
     ipmi_lan_config_t *lanc = cb_data;
-    int               rv;
 
     if (err == IPMI_IPMI_ERR_VAL(0x80)) {
 	/* Lock is not supported, just mark it and go on. */
@@ -1666,29 +1818,7 @@ lock_done(ipmi_lanparm_t *lanparm,
 	lanparm->locked = 1;
     }
 
-    rv = ipmi_lanparm_get_parm(lanparm, lanc->curr_parm, lanc->curr_sel, 0,
-			       got_parm, lanc);
-    if (rv) {
-	unsigned char data[1];
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "lanparm.c(lock_done): Error trying to get parms: %x",
-		 err);
-
-	lanc->err = rv;
-	/* Clear the lock */
-	data[0] = 0;
-	rv = ipmi_lanparm_set_parm(lanparm, 0, data, 1,
-				   err_lock_cleared, lanc);
-	if (rv) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "lanparm.c(lock_done): Error trying to clear lock: %x",
-		     err);
-	    lanc->done(lanparm, lanc->err, NULL, lanc->cb_data);
-	    ipmi_lan_free_config(lanc);
-	    lanparm->locked = 0;
-	    lanparm_put(lanparm);
-	}
-    }
+    lanc_fetch_start(lanparm, lanc);
 }
 
 int ipmi_lan_get_config(ipmi_lanparm_t         *lanparm,
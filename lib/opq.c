@@ -346,3 +346,156 @@ opq_stuff_in_progress(opq_t *opq)
 {
     return opq->in_handler;
 }
+
+/***********************************************************************
+ *
+ * Lightweight op queues.
+ *
+ **********************************************************************/
+
+struct opq_sched_s
+{
+    os_handler_t  *os_hnd;
+    os_hnd_lock_t *lock;
+};
+
+static void
+sched_lock(opq_sched_t *sched)
+{
+    if (sched->lock)
+	sched->os_hnd->lock(sched->os_hnd, sched->lock);
+}
+
+static void
+sched_unlock(opq_sched_t *sched)
+{
+    if (sched->lock)
+	sched->os_hnd->unlock(sched->os_hnd, sched->lock);
+}
+
+opq_sched_t *
+opq_sched_alloc(os_handler_t *os_hnd)
+{
+    int         rv;
+    opq_sched_t *sched;
+
+    sched = ipmi_mem_alloc(sizeof(*sched));
+    if (!sched)
+	return NULL;
+    memset(sched, 0, sizeof(*sched));
+
+    sched->os_hnd = os_hnd;
+    if (os_hnd->create_lock) {
+	rv = os_hnd->create_lock(os_hnd, &(sched->lock));
+	if (rv) {
+	    ipmi_mem_free(sched);
+	    return NULL;
+	}
+    }
+
+    return sched;
+}
+
+void
+opq_sched_destroy(opq_sched_t *sched)
+{
+    if (sched->lock)
+	sched->os_hnd->destroy_lock(sched->os_hnd, sched->lock);
+    ipmi_mem_free(sched);
+}
+
+void
+opq_lite_init(opq_lite_t *q)
+{
+    q->head = NULL;
+    q->tail = NULL;
+    q->in_handler = 0;
+}
+
+void
+opq_lite_destroy(opq_sched_t *sched, opq_lite_t *q)
+{
+    opq_lite_op_t *op, *next;
+
+    sched_lock(sched);
+    op = q->head;
+    q->head = NULL;
+    q->tail = NULL;
+    q->in_handler = 0;
+    sched_unlock(sched);
+
+    while (op) {
+	next = op->next;
+	op->handler(op->cb_data, 1);
+	op = next;
+    }
+}
+
+/* Must be called with the sched lock held. */
+static void
+lite_start_next_op(opq_sched_t *sched, opq_lite_t *q)
+{
+    opq_lite_op_t *op;
+    int           success;
+
+    while ((op = q->head)) {
+	q->head = op->next;
+	if (!q->head)
+	    q->tail = NULL;
+	sched_unlock(sched);
+	/* The op may be freed by the handler, don't touch it after. */
+	success = op->handler(op->cb_data, 0);
+	sched_lock(sched);
+	if (success == OPQ_HANDLER_STARTED)
+	    return;
+    }
+    q->in_handler = 0;
+}
+
+void
+opq_lite_new_op(opq_sched_t    *sched,
+		opq_lite_t     *q,
+		opq_lite_op_t  *op,
+		opq_handler_cb handler,
+		void           *cb_data)
+{
+    int success;
+
+    sched_lock(sched);
+    if (q->in_handler) {
+	op->handler = handler;
+	op->cb_data = cb_data;
+	op->next = NULL;
+	if (q->tail)
+	    q->tail->next = op;
+	else
+	    q->head = op;
+	q->tail = op;
+	sched_unlock(sched);
+	return;
+    }
+
+    q->in_handler = 1;
+    sched_unlock(sched);
+    success = handler(cb_data, 0);
+    if (success == OPQ_HANDLER_ABORTED) {
+	/* In case any were added while I was unlocked. */
+	sched_lock(sched);
+	lite_start_next_op(sched, q);
+	sched_unlock(sched);
+    }
+}
+
+void
+opq_lite_op_done(opq_sched_t *sched, opq_lite_t *q)
+{
+    sched_lock(sched);
+    lite_start_next_op(sched, q);
+    sched_unlock(sched);
+}
+
+int
+opq_lite_stuff_in_progress(opq_lite_t *q)
+{
+    return q->in_handler;
+}
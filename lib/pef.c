@@ -541,6 +541,7 @@ typedef struct pef_fetch_handler_s
     unsigned char       *data;
     unsigned int        data_len;
     int                 rv;
+    int                 queued; /* Went through the opq */
 } pef_fetch_handler_t;
 
 /* This should be called with the pef locked.  It will unlock the pef
@@ -548,6 +549,8 @@ typedef struct pef_fetch_handler_s
 static void
 fetch_complete(ipmi_pef_t *pef, int err, pef_fetch_handler_t *elem)
 {
+    int queued = elem->queued;
+
     if (pef->in_destroy)
 	goto out;
 
@@ -558,7 +561,7 @@ fetch_complete(ipmi_pef_t *pef, int err, pef_fetch_handler_t *elem)
 
     ipmi_mem_free(elem);
 
-    if (!pef->destroyed)
+    if (queued && !pef->destroyed)
 	opq_op_done(pef->opq);
 
     pef_put(pef);
@@ -655,13 +658,19 @@ start_config_fetch(void *cb_data, int shutdown)
     return OPQ_HANDLER_STARTED;
 }
 
-int
-ipmi_pef_get_parm(ipmi_pef_t      *pef,
-		  unsigned int    parm,
-		  unsigned int    set,
-		  unsigned int    block,
-		  ipmi_pef_get_cb done,
-		  void            *cb_data)
+/*
+ * If queued is false, the fetch is started right away instead of
+ * waiting its turn in the opq, so more than one can be outstanding.
+ * That is only for the reads done by ipmi_pef_get_config().
+ */
+static int
+pef_get_parm(ipmi_pef_t      *pef,
+	     unsigned int    parm,
+	     unsigned int    set,
+	     unsigned int    block,
+	     ipmi_pef_get_cb done,
+	     void            *cb_data,
+	     int             queued)
 {
     pef_fetch_handler_t *elem;
     int                 rv = 0;
@@ -686,8 +695,14 @@ ipmi_pef_get_parm(ipmi_pef_t      *pef,
     elem->set = set;
     elem->block = block;
     elem->rv = 0;
+    elem->queued = queued;
 
     pef_get(pef);
+    if (!queued) {
+	start_config_fetch(elem, 0);
+	return 0;
+    }
+
     if (!opq_new_op(pef->opq, start_config_fetch, elem, 0)) {
 	pef_put(pef);
 	rv = ENOMEM;
@@ -699,6 +714,17 @@ ipmi_pef_get_parm(ipmi_pef_t      *pef,
     return rv;
 }
 
+int
+ipmi_pef_get_parm(ipmi_pef_t      *pef,
+		  unsigned int    parm,
+		  unsigned int    set,
+		  unsigned int    block,
+		  ipmi_pef_get_cb done,
+		  void            *cb_data)
+{
+    return pef_get_parm(pef, parm, set, block, done, cb_data, 1);
+}
+
 typedef struct pef_set_handler_s
 {
     ipmi_pef_t 		*pef;
@@ -995,12 +1021,37 @@ typedef struct ipmi_ask_s
     unsigned int alert_string_set : 4;
 } ipmi_ask_t;
 
+/*
+ * A parameter to fetch for ipmi_pef_get_config().  These are sent
+ * PEF_FETCH_WINDOW at a time, table entries are added when the
+ * count for the table comes back and each alert string block is
+ * added when the one before it comes back.
+ */
+#define PEF_FETCH_WINDOW 8
+typedef struct pef_fetch_s
+{
+    ipmi_pef_config_t  *pefc;
+    unsigned char      parm;
+    unsigned char      sel;
+    unsigned char      block;
+    struct pef_fetch_s *next;
+} pef_fetch_t;
+
 struct ipmi_pef_config_s
 {
     int curr_parm;
     int curr_sel;
     int curr_block;
 
+    /* Fetches not yet sent, and the number sent but not answered.
+       Protected by the pef lock. */
+    pef_fetch_t *fetch_head, *fetch_tail;
+    int         fetch_outstanding;
+    int         fetch_running;
+    /* Set by whoever decides the fetch is over, only that caller may
+       touch the config after dropping the lock. */
+    int         fetch_done;
+
     /* Not used for access, just for checking validity. */
     ipmi_pef_t *my_pef;
 
@@ -1581,6 +1632,142 @@ err_lock_cleared(ipmi_pef_t *pef,
     pef_put(pef);
 }
 
+static int
+pefc_fetch_add(ipmi_pef_config_t *pefc, unsigned int parm, unsigned int sel,
+	       unsigned int block)
+{
+    pef_fetch_t *ent;
+
+    ent = ipmi_mem_alloc(sizeof(*ent));
+    if (!ent)
+	return ENOMEM;
+    ent->pefc = pefc;
+    ent->parm = parm;
+    ent->sel = sel;
+    ent->block = block;
+    ent->next = NULL;
+    if (pefc->fetch_tail)
+	pefc->fetch_tail->next = ent;
+    else
+	pefc->fetch_head = ent;
+    pefc->fetch_tail = ent;
+    return 0;
+}
+
+/* Called when nothing is outstanding any more. */
+static void
+pefc_fetch_done(ipmi_pef_t *pef, ipmi_pef_config_t *pefc)
+{
+    pef_fetch_t *ent;
+    int         err;
+
+    while ((ent = pefc->fetch_head)) {
+	pefc->fetch_head = ent->next;
+	ipmi_mem_free(ent);
+    }
+    pefc->fetch_tail = NULL;
+
+    if (pefc->err) {
+	unsigned char data[1];
+
+	/* Clear the lock */
+	data[0] = 0;
+	err = ipmi_pef_set_parm(pef, 0, data, 1, err_lock_cleared, pefc);
+	if (err) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "pef.c(pefc_fetch_done): Error trying to clear lock: %x",
+		     err);
+	    pefc->done(pef, pefc->err, NULL, pefc->cb_data);
+	    ipmi_pef_free_config(pefc);
+	    pef_put(pef);
+	}
+    } else {
+	pefc->done(pef, 0, pefc, pefc->cb_data);
+	pef_put(pef);
+    }
+}
+
+static void got_parm(ipmi_pef_t *pef, int err, unsigned char *data,
+		     unsigned int data_len, void *cb_data);
+
+/*
+ * Send fetches until the window is full.  Only one caller runs the
+ * loop at a time, a response that comes in while it is sending just
+ * updates the state and the loop picks that up.  Must be called with
+ * the pef lock held, it is released.  Completion is decided once,
+ * under the lock, and the config must not be touched after this
+ * returns since whoever completed it may have freed it.
+ */
+static void
+pefc_fetch_next(ipmi_pef_t *pef, ipmi_pef_config_t *pefc)
+{
+    pef_fetch_t *ent;
+    int         rv;
+    int         finished;
+
+    if (pefc->fetch_running || pefc->fetch_done) {
+	pef_unlock(pef);
+	return;
+    }
+    pefc->fetch_running = 1;
+    while (!pefc->err && pefc->fetch_head
+	   && (pefc->fetch_outstanding < PEF_FETCH_WINDOW))
+    {
+	ent = pefc->fetch_head;
+	pefc->fetch_head = ent->next;
+	if (!pefc->fetch_head)
+	    pefc->fetch_tail = NULL;
+	pefc->fetch_outstanding++;
+	pef_unlock(pef);
+	rv = pef_get_parm(pef, ent->parm, ent->sel, ent->block, got_parm, ent,
+			  0);
+	pef_lock(pef);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "pef.c(pefc_fetch_next): Error trying to get parm %d: %x",
+		     ent->parm, rv);
+	    ipmi_mem_free(ent);
+	    pefc->fetch_outstanding--;
+	    if (!pefc->err)
+		pefc->err = rv;
+	}
+    }
+    pefc->fetch_running = 0;
+    finished = ((pefc->fetch_outstanding == 0)
+		&& (pefc->err || !pefc->fetch_head));
+    if (finished)
+	pefc->fetch_done = 1;
+    pef_unlock(pef);
+
+    if (finished)
+	pefc_fetch_done(pef, pefc);
+}
+
+/* Errors are reported through the done handler. */
+static void
+pefc_fetch_start(ipmi_pef_t *pef, ipmi_pef_config_t *pefc)
+{
+    int i;
+
+    for (i=1; i<NUM_PEFPARMS; i++) {
+	if (!pefparms[i].valid)
+	    continue;
+	switch (i) {
+	case IPMI_PEFPARM_EVENT_FILTER_TABLE:
+	case IPMI_PEFPARM_ALERT_POLICY_TABLE:
+	case IPMI_PEFPARM_ALERT_STRING_KEY:
+	case IPMI_PEFPARM_ALERT_STRING:
+	    /* Added when the count they depend on comes back. */
+	    continue;
+	}
+	pefc->err = pefc_fetch_add(pefc, i, 0, 0);
+	if (pefc->err)
+	    break;
+    }
+    pef_lock(pef);
+    pefc_fetch_next(pef, pefc);
+}
+
 static void
 got_parm(ipmi_pef_t     *pef,
 	 int            err,
@@ -1588,8 +1775,21 @@ got_parm(ipmi_pef_t     *pef,
 	 unsigned int   data_len,
 	 void           *cb_data)
 {
-    ipmi_pef_config_t *pefc = cb_data;
-    pefparms_t        *lp = &(pefparms[pefc->curr_parm]);
+    pef_fetch_t       *ent = cb_data;
+    ipmi_pef_config_t *pefc = ent->pefc;
+    pefparms_t        *lp = &(pefparms[ent->parm]);
+    unsigned int      i;
+
+    pef_lock(pef);
+    pefc->fetch_outstanding--;
+    if (pefc->err)
+	/* Already failed, just waiting for the rest to come back. */
+	goto out;
+
+    /* The error logs use these. */
+    pefc->curr_parm = ent->parm;
+    pefc->curr_sel = ent->sel;
+    pefc->curr_block = ent->block;
 
     /* Check the length, and don't forget the revision byte must be added. */
     if ((!err) && (data_len < (unsigned int) (lp->length+1))) {
@@ -1598,7 +1798,7 @@ got_parm(ipmi_pef_t     *pef,
 		 " Invalid data length on parm %d was %d, should have been %d",
 		 pefc->curr_parm, data_len, lp->length+1);
 	err = EINVAL;
-	goto done;
+	goto out_err;
     }
 
     err = lp->get_handler(pefc, lp, err, data, data_len);
@@ -1606,158 +1806,104 @@ got_parm(ipmi_pef_t     *pef,
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "ipmi_pefparm_got_parm: Error fetching parm %d: %x",
 		 pefc->curr_parm, err);
-	goto done;
+	goto out_err;
     }
 
- next_parm:
-    switch (pefc->curr_parm) {
+    switch (ent->parm) {
     case IPMI_PEFPARM_NUM_EVENT_FILTERS:
-	pefc->curr_parm++;
-	if (pefc->num_event_filters == 0)
-	    pefc->curr_parm = IPMI_PEFPARM_NUM_ALERT_POLICIES;
-	else
-	    pefc->curr_sel = 1;
+	for (i=1; !err && (i<=pefc->num_event_filters); i++)
+	    err = pefc_fetch_add(pefc, IPMI_PEFPARM_EVENT_FILTER_TABLE, i, 0);
 	break;
 
     case IPMI_PEFPARM_EVENT_FILTER_TABLE:
-	if ((data[1] & 0x7f) != pefc->curr_sel) {
+	if ((data[1] & 0x7f) != ent->sel) {
 	    /* Yikes, wrong selector came back! */
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "ipmi_pefparm_got_parm: Error fetching eft %d,"
 		     " wrong selector came back, expecting %d, was %d",
 		     pefc->curr_parm, pefc->curr_sel, data[1] & 0x7f);
 	    err = EINVAL;
-	    goto done;
-	}
-	pefc->curr_sel++;
-	if (pefc->curr_sel > pefc->num_event_filters) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 0;
 	}
 	break;
 
     case IPMI_PEFPARM_NUM_ALERT_POLICIES:
-	pefc->curr_parm++;
-	if (pefc->num_alert_policies == 0)
-	    pefc->curr_parm = IPMI_PEFPARM_NUM_ALERT_STRINGS;
-	else
-	    pefc->curr_sel = 1;
+	for (i=1; !err && (i<=pefc->num_alert_policies); i++)
+	    err = pefc_fetch_add(pefc, IPMI_PEFPARM_ALERT_POLICY_TABLE, i, 0);
 	break;
 
     case IPMI_PEFPARM_ALERT_POLICY_TABLE:
-	if ((data[1] & 0x7f) != pefc->curr_sel) {
+	if ((data[1] & 0x7f) != ent->sel) {
 	    /* Yikes, wrong selector came back! */
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "ipmi_pefparm_got_parm: Error fetching apt %d,"
 		     " wrong selector came back, expecting %d, was %d",
 		     pefc->curr_parm, pefc->curr_sel, data[1] & 0x7f);
 	    err = EINVAL;
-	    goto done;
-	}
-	pefc->curr_sel++;
-	if (pefc->curr_sel > pefc->num_alert_policies) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 0;
 	}
 	break;
 
     case IPMI_PEFPARM_NUM_ALERT_STRINGS:
-	pefc->curr_parm++;
-	if (pefc->num_alert_strings == 0)
-	    goto done;
-	pefc->curr_sel = 0;
+	for (i=0; !err && (i<pefc->num_alert_strings); i++) {
+	    err = pefc_fetch_add(pefc, IPMI_PEFPARM_ALERT_STRING_KEY, i, 0);
+	    /* The blocks of a string are appended in order, so each
+	       string fetches one block at a time. */
+	    if (!err)
+		err = pefc_fetch_add(pefc, IPMI_PEFPARM_ALERT_STRING, i, 1);
+	}
 	break;
 
     case IPMI_PEFPARM_ALERT_STRING_KEY:
-	if ((data[1] & 0x7f) != pefc->curr_sel) {
+	if ((data[1] & 0x7f) != ent->sel) {
 	    /* Yikes, wrong selector came back! */
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "ipmi_pefparm_got_parm: Error fetching ask %d,"
 		     " wrong selector came back, expecting %d, was %d",
 		     pefc->curr_parm, pefc->curr_sel, data[1] & 0x7f);
 	    err = EINVAL;
-	    goto done;
-	}
-	pefc->curr_sel++;
-	if (pefc->curr_sel >= pefc->num_alert_strings) {
-	    pefc->curr_parm++;
-	    pefc->curr_sel = 0;
-	    pefc->curr_block = 1;
 	}
 	break;
 
     case IPMI_PEFPARM_ALERT_STRING:
-	if ((data[1] & 0x7f) != pefc->curr_sel) {
+	if ((data[1] & 0x7f) != ent->sel) {
 	    /* Yikes, wrong selector came back! */
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "ipmi_pefparm_got_parm: Error fetching ask %d,"
 		     " wrong selector came back, expecting %d, was %d",
 		     pefc->curr_parm, pefc->curr_sel, data[1] & 0x7f);
 	    err = EINVAL;
-	    goto done;
+	    break;
 	}
-	if (data[2] != pefc->curr_block) {
+	if (data[2] != ent->block) {
 	    /* Yikes, wrong block came back! */
 	    ipmi_log(IPMI_LOG_ERR_INFO,
 		     "ipmi_pefparm_got_parm: Error fetching ask %d,"
 		     " wrong block came back, expecting %d, was %d",
 		     pefc->curr_parm, pefc->curr_block, data[2]);
 	    err = EINVAL;
-	    goto done;
-	}
-	if ((data_len < 19) ||
-	    (memchr(data+3, '\0', data_len-3)))
-	{
-	    /* End of string, either a subsize-block or a nil
-	       character in the data. */
-	    pefc->curr_sel++;
-	    pefc->curr_block = 1;
-	    if (pefc->curr_sel >= pefc->num_alert_strings)
-		goto done;
-	} else {
-	    /* Not at the end yet. */
-	    pefc->curr_block++;
+	    break;
 	}
+	/* The string ends with a short block or a nil character. */
+	if ((data_len >= 19) && !memchr(data+3, '\0', data_len-3))
+	    err = pefc_fetch_add(pefc, IPMI_PEFPARM_ALERT_STRING, ent->sel,
+				 ent->block + 1);
 	break;
-
-    default:
-	pefc->curr_parm++;
     }
-
-    lp = &(pefparms[pefc->curr_parm]);
-    if (!lp->valid)
-	goto next_parm;
-
-    err = ipmi_pef_get_parm(pef, pefc->curr_parm, pefc->curr_sel, 
-			    pefc->curr_block, got_parm, pefc);
     if (err)
-	goto done;
+	goto out_err;
 
+ out:
+    /* Keep the lock, the outstanding count must not reach zero where
+       another thread can complete the fetch before we look at it. */
+    ipmi_mem_free(ent);
+    pefc_fetch_next(pef, pefc);
     return;
 
- done:
-    if (err) {
-	unsigned char data[1];
-
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "pef.c(got_parm): Error trying to get parm %d: %x",
-		 pefc->curr_parm, err);
-	pefc->err = err;
-	/* Clear the lock */
-	data[0] = 0;
-	err = ipmi_pef_set_parm(pef, 0, data, 1, err_lock_cleared, pefc);
-	if (err) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "pef.c(got_parm): Error trying to clear lock: %x",
-		     err);
-	    pefc->done(pef, pefc->err, NULL, pefc->cb_data);
-	    ipmi_pef_free_config(pefc);
-	    pef_put(pef);
-	}
-    } else {
-	pefc->done(pef, 0, pefc, pefc->cb_data);
-	pef_put(pef);
-    }
+ out_err:
+    ipmi_log(IPMI_LOG_ERR_INFO,
+	     "pef.c(got_parm): Error trying to get parm %d: %x",
+	     pefc->curr_parm, err);
+    pefc->err = err;
+    goto out;
 }
 
 static void 
@@ -1766,7 +1912,6 @@ lock_done(ipmi_pef_t *pef,
 	  void       *cb_data)
 {
     ipmi_pef_config_t *pefc = cb_data;
-    int               rv;
 
     if (err == IPMI_IPMI_ERR_VAL(0x80)) {
 	/* Lock is not supported, just mark it and go on. */
@@ -1790,27 +1935,7 @@ lock_done(ipmi_pef_t *pef,
 
     pefc->pef_locked = 1;
 
-    rv = ipmi_pef_get_parm(pef, pefc->curr_parm, pefc->curr_sel, 0,
-			    got_parm, pefc);
-    if (rv) {
-	unsigned char data[1];
-
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "pef.c(lock_done): Error trying to get parm %d: %x",
-		 pefc->curr_parm, rv);
-	pefc->err = rv;
-	/* Clear the lock */
-	data[0] = 0;
-	rv = ipmi_pef_set_parm(pef, 0, data, 1, err_lock_cleared, pefc);
-	if (rv) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "pef.c(lock_done): Error trying to clear lock: %x",
-		     err);
-	    pefc->done(pef, pefc->err, NULL, pefc->cb_data);
-	    ipmi_pef_free_config(pefc);
-	    pef_put(pef);
-	}
-    }
+    pefc_fetch_start(pef, pefc);
 }
 
 int ipmi_pef_get_config(ipmi_pef_t             *pef,
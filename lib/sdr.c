@@ -33,6 +33,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <OpenIPMI/ipmiif.h>
 #include <OpenIPMI/ipmi_sdr.h>
@@ -82,6 +83,49 @@ typedef struct fetch_info_s
     ilist_item_t link;
 } fetch_info_t;
 
+/* Per-record state for a parallel fetch, see the "Parallel fetch"
+   section below. */
+typedef struct sdr_par_rec_s
+{
+    uint16_t     rec_id;      /* Record ID the header was requested with. */
+    uint16_t     next_rec_id; /* From the header, valid in PAR_REC_HDR. */
+    unsigned int state;
+} sdr_par_rec_t;
+
+#define PAR_REC_SENT	0 /* Header read is outstanding. */
+#define PAR_REC_FAILED	1 /* A guessed header read failed. */
+#define PAR_REC_HDR	2 /* Have the header. */
+
+/* Layout of the SDR cache when the OS handler can map database
+   entries.  Everything is in host byte order, it is only meant to be
+   shared on one machine.  The SDR array is stored exactly as it is
+   kept in memory so it can be used in place, followed by an index of
+   the records sorted by record ID. */
+#define SDR_CACHE_MAGIC		0x4f495344
+#define SDR_CACHE_VERSION	1
+#define SDR_CACHE_ALIGN(v)	(((v) + 7) & ~7)
+
+typedef struct sdr_cache_hdr_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t hdr_size;
+    uint32_t sdr_size;
+    uint32_t num_sdrs;
+    uint32_t sdr_offset;
+    uint32_t index_offset;
+    uint32_t last_addition_timestamp;
+    uint32_t last_erase_timestamp;
+    uint32_t reserved;
+} sdr_cache_hdr_t;
+
+typedef struct sdr_cache_idx_s
+{
+    uint16_t record_id;
+    uint16_t reserved;
+    uint32_t idx;
+} sdr_cache_idx_t;
+
 #undef DEBUG_INFO_TRACKING
 
 struct ipmi_sdr_info_s
@@ -176,6 +220,24 @@ struct ipmi_sdr_info_s
     ilist_t *free_fetch;
     ilist_t *outstanding_fetch;
     ilist_t *process_fetch;
+    unsigned int num_fetch_infos;
+    unsigned int num_outstanding_fetch;
+
+    /* Parallel fetch state, par_recs is NULL when doing a normal
+       sequential fetch.  par_hdr_next is the next record index to
+       read the header for, par_hdrs is the number of records at the
+       start of the chain whose headers are read and whose IDs are
+       verified.  par_body_idx/par_body_offset is the next body read
+       to send.  In this mode process_fetch holds body reads that
+       must be redone with a smaller size. */
+    sdr_par_rec_t *par_recs;
+    unsigned int  par_window;
+    unsigned int  par_hdr_next;
+    unsigned int  par_hdrs;
+    unsigned int  par_body_idx;
+    unsigned int  par_body_offset;
+    unsigned int  par_bad_guesses;
+    int           par_chain_done;
 
     /* This is used so that start_fetch will only start when nothing
        is outstanding from other fetches.  This avoids getting
@@ -194,6 +256,11 @@ struct ipmi_sdr_info_s
     unsigned int sdr_array_size;
     ipmi_sdr_t *sdrs;
 
+    /* If map_id is set, sdrs points into a read-only mapping of the
+       cache and must be copied before it is modified. */
+    void                  *map_id;
+    const sdr_cache_idx_t *map_index;
+
     char db_key[32+5];
     int  db_key_set;
 
@@ -254,6 +321,158 @@ cleanup_fetch_items(ipmi_sdr_info_t *sdrs)
     ilist_iter(sdrs->free_fetch, free_fetch, NULL);
     ilist_iter(sdrs->process_fetch, free_fetch, NULL);
     ilist_iter(sdrs->outstanding_fetch, cancel_fetch, NULL);
+    sdrs->num_outstanding_fetch = 0;
+}
+
+/* Free fetch buffers beyond the normal number that a parallel fetch
+   allocated.  Only free ones are released, any that are in use are
+   trimmed by a later call. */
+static void
+trim_fetch_items(ipmi_sdr_info_t *sdrs)
+{
+    fetch_info_t *info;
+
+    while (sdrs->num_fetch_infos > MAX_SDR_FETCH_OUTSTANDING) {
+	info = ilist_remove_first(sdrs->free_fetch);
+	if (!info)
+	    break;
+	ipmi_mem_free(info);
+	sdrs->num_fetch_infos--;
+    }
+}
+
+/* Get rid of the current SDR array, which may be mapped from the
+   cache. */
+static void
+sdrs_free_array(ipmi_sdr_info_t *sdrs)
+{
+    if (sdrs->map_id) {
+	sdrs->os_hnd->database_unmap(sdrs->os_hnd, sdrs->map_id);
+	sdrs->map_id = NULL;
+	sdrs->map_index = NULL;
+    } else if (sdrs->sdrs)
+	ipmi_mem_free(sdrs->sdrs);
+    sdrs->sdrs = NULL;
+}
+
+/* Make sure the SDR array is not the read-only cache mapping, call
+   before modifying it. */
+static int
+sdrs_unshare(ipmi_sdr_info_t *sdrs)
+{
+    ipmi_sdr_t *new_sdrs;
+
+    if (!sdrs->map_id)
+	return 0;
+
+    /* Allocate 9 extra bytes for the db info. */
+    new_sdrs = ipmi_mem_alloc((sizeof(ipmi_sdr_t) * sdrs->num_sdrs) + 9);
+    if (!new_sdrs)
+	return ENOMEM;
+    memcpy(new_sdrs, sdrs->sdrs, sizeof(ipmi_sdr_t) * sdrs->num_sdrs);
+    sdrs_free_array(sdrs);
+    sdrs->sdrs = new_sdrs;
+    sdrs->sdr_array_size = sdrs->num_sdrs;
+    return 0;
+}
+
+static int
+cmp_cache_idx(const void *a, const void *b)
+{
+    const sdr_cache_idx_t *i1 = a, *i2 = b;
+
+    if (i1->record_id != i2->record_id)
+	return i1->record_id < i2->record_id ? -1 : 1;
+    if (i1->idx != i2->idx)
+	return i1->idx < i2->idx ? -1 : 1;
+    return 0;
+}
+
+static void
+sdr_cache_store(ipmi_sdr_info_t *sdrs)
+{
+    unsigned int    num = sdrs->num_sdrs;
+    unsigned int    sdr_offset, index_offset, len, i;
+    unsigned char   *data;
+    sdr_cache_hdr_t *hdr;
+    sdr_cache_idx_t *idx;
+
+    sdr_offset = SDR_CACHE_ALIGN(sizeof(*hdr));
+    index_offset = SDR_CACHE_ALIGN(sdr_offset + (sizeof(ipmi_sdr_t) * num));
+    len = index_offset + (sizeof(*idx) * num);
+    data = ipmi_mem_alloc(len);
+    if (!data)
+	return;
+    memset(data, 0, len);
+
+    hdr = (sdr_cache_hdr_t *) data;
+    hdr->magic = SDR_CACHE_MAGIC;
+    hdr->version = SDR_CACHE_VERSION;
+    hdr->hdr_size = sizeof(*hdr);
+    hdr->sdr_size = sizeof(ipmi_sdr_t);
+    hdr->num_sdrs = num;
+    hdr->sdr_offset = sdr_offset;
+    hdr->index_offset = index_offset;
+    hdr->last_addition_timestamp = sdrs->last_addition_timestamp;
+    hdr->last_erase_timestamp = sdrs->last_erase_timestamp;
+    memcpy(data + sdr_offset, sdrs->sdrs, sizeof(ipmi_sdr_t) * num);
+    idx = (sdr_cache_idx_t *) (data + index_offset);
+    for (i=0; i<num; i++) {
+	idx[i].record_id = sdrs->sdrs[i].record_id;
+	idx[i].idx = i;
+    }
+    qsort(idx, num, sizeof(*idx), cmp_cache_idx);
+
+    sdrs->os_hnd->database_map_store(sdrs->os_hnd, sdrs->db_key, data, len);
+    ipmi_mem_free(data);
+}
+
+/* Use the cache in place if the OS handler can map it.  Called with
+   the SDR lock held. */
+static int
+sdr_cache_map(ipmi_sdr_info_t *sdrs)
+{
+    const unsigned char   *data;
+    unsigned int          len;
+    void                  *map_id;
+    const sdr_cache_hdr_t *hdr;
+    int                   rv;
+
+    rv = sdrs->os_hnd->database_map(sdrs->os_hnd, sdrs->db_key,
+				    &data, &len, &map_id);
+    if (rv)
+	return rv;
+
+    hdr = (const sdr_cache_hdr_t *) data;
+    if ((len < sizeof(*hdr))
+	|| (hdr->magic != SDR_CACHE_MAGIC)
+	|| (hdr->version != SDR_CACHE_VERSION)
+	|| (hdr->hdr_size != sizeof(*hdr))
+	|| (hdr->sdr_size != sizeof(ipmi_sdr_t))
+	|| (hdr->sdr_offset % 8) || (hdr->index_offset % 8)
+	|| (hdr->sdr_offset > len) || (hdr->index_offset > len)
+	|| (hdr->num_sdrs > ((len - hdr->sdr_offset) / sizeof(ipmi_sdr_t)))
+	|| (hdr->num_sdrs > ((len - hdr->index_offset)
+			     / sizeof(sdr_cache_idx_t))))
+    {
+	sdrs->os_hnd->database_unmap(sdrs->os_hnd, map_id);
+	return EINVAL;
+    }
+
+    sdrs_free_array(sdrs);
+    sdrs->last_addition_timestamp = hdr->last_addition_timestamp;
+    sdrs->last_erase_timestamp = hdr->last_erase_timestamp;
+    sdrs->num_sdrs = hdr->num_sdrs;
+    sdrs->sdr_array_size = hdr->num_sdrs;
+    sdrs->fetched = 1;
+    if (hdr->num_sdrs == 0) {
+	sdrs->os_hnd->database_unmap(sdrs->os_hnd, map_id);
+	return 0;
+    }
+    sdrs->sdrs = (ipmi_sdr_t *) (data + hdr->sdr_offset);
+    sdrs->map_index = (const sdr_cache_idx_t *) (data + hdr->index_offset);
+    sdrs->map_id = map_id;
+    return 0;
 }
 
 static void
@@ -263,7 +482,7 @@ process_db_data(ipmi_sdr_info_t *sdrs,
 {
     int           num;
     unsigned char *d;
-    ipmi_sdr_t    *to_free;
+    ipmi_sdr_t    *new_sdrs;
 
     if (len < 9)
 	goto no_db;
@@ -283,16 +502,15 @@ process_db_data(ipmi_sdr_info_t *sdrs,
     num = len / sizeof(ipmi_sdr_t);
     /* Allocate 9 extra bytes for storing the timestamps and
      * format#. */
-    to_free = sdrs->sdrs;
-    sdrs->sdrs = ipmi_mem_alloc((sizeof(ipmi_sdr_t) * num) + 9);
-    if (!sdrs->sdrs)
+    new_sdrs = ipmi_mem_alloc((sizeof(ipmi_sdr_t) * num) + 9);
+    if (!new_sdrs)
 	goto no_db;
-    memcpy(sdrs->sdrs, db_data, sizeof(ipmi_sdr_t) * num);
+    memcpy(new_sdrs, db_data, sizeof(ipmi_sdr_t) * num);
+    sdrs_free_array(sdrs);
+    sdrs->sdrs = new_sdrs;
     sdrs->num_sdrs = num;
     sdrs->sdr_array_size = num;
     sdrs->fetched = 1;
-    if (to_free)
-	ipmi_mem_free(to_free);
 
  no_db:
     sdrs->os_hnd->database_free(sdrs->os_hnd, db_data);
@@ -340,8 +558,14 @@ start_db_fetch(void *cb_data, int shutdown)
 	return OPQ_HANDLER_ABORTED;
     }
 
-    /* Go ahead and do the database fetch here if we have support. */
-    if (sdrs->os_hnd->database_find && sdrs->db_key_set)
+    /* Go ahead and do the database fetch here if we have support.
+       A mappable cache is preferred, since it does not need to be
+       copied. */
+    if (sdrs->os_hnd->database_map && sdrs->db_key_set
+	&& (sdr_cache_map(sdrs) == 0))
+    {
+	rv = -1; /* Just mark it as done */
+    } else if (sdrs->os_hnd->database_find && sdrs->db_key_set)
     {
 	unsigned char *db_data;
 	unsigned int  db_data_len;
@@ -453,6 +677,7 @@ ipmi_sdr_info_alloc(ipmi_domain_t   *domain,
 	}
 	info->sdrs = sdrs;
 	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	sdrs->num_fetch_infos++;
     }
 
     sdrs->process_fetch = alloc_ilist();
@@ -523,17 +748,14 @@ internal_destroy_sdr_info(ipmi_sdr_info_t *sdrs)
     if (sdrs->destroy_handler)
 	sdrs->destroy_handler(sdrs, sdrs->destroy_cb_data);
 
-    if (sdrs->sdrs)
-	ipmi_mem_free(sdrs->sdrs);
+    sdrs_free_array(sdrs);
     ipmi_mem_free(sdrs);
 }
 
 void
 ipmi_sdr_clean_out_sdrs(ipmi_sdr_info_t *sdrs)
 {
-    if (sdrs->sdrs)
-	ipmi_mem_free(sdrs->sdrs);
-    sdrs->sdrs = NULL;
+    sdrs_free_array(sdrs);
     sdrs->dynamic_population = 1;
     sdrs->fetched = 0;
 }
@@ -614,6 +836,7 @@ fetch_complete(ipmi_sdr_info_t *sdrs, int err)
 {
     DEBUG_INFO(sdrs);
     sdrs->wait_err = err;
+    trim_fetch_items(sdrs);
     if (err) {
 	DEBUG_INFO(sdrs);
 	if (sdrs->working_sdrs) {
@@ -621,23 +844,23 @@ fetch_complete(ipmi_sdr_info_t *sdrs, int err)
 	    sdrs->working_sdrs = NULL;
 	}
     } else {
-	/* The wierd to_free business is because at some points we put
-	   the sdrs into the working_sdrs so they will be restored
-	   properly. */
-	ipmi_sdr_t *to_free = NULL;
-
+	/* At some points we put the sdrs into the working_sdrs so
+	   they will be restored properly, don't free them then. */
 	DEBUG_INFO(sdrs);
 	sdrs->fetched = 1;
 	sdrs->num_sdrs = sdrs->curr_read_idx+1;
 	sdrs->sdr_array_size = sdrs->num_sdrs;
 	if (sdrs->sdrs != sdrs->working_sdrs)
-	    to_free = sdrs->sdrs;
+	    sdrs_free_array(sdrs);
 	sdrs->sdrs = sdrs->working_sdrs;
 	sdrs->working_sdrs = NULL;
-	if (to_free)
-	    ipmi_mem_free(to_free);
 
-	if (sdrs->sdrs && sdrs->db_key_set && sdrs->os_hnd->database_store) {
+	if (!sdrs->sdrs || !sdrs->db_key_set || sdrs->map_id) {
+	    /* Nothing to store, or the SDRs are already the ones in the
+	       cache. */
+	} else if (sdrs->os_hnd->database_map_store) {
+	    sdr_cache_store(sdrs);
+	} else if (sdrs->os_hnd->database_store) {
 	    unsigned int  len = sdrs->num_sdrs * sizeof(ipmi_sdr_t);
 	    unsigned char *d = ((unsigned char *) sdrs->sdrs) + len;
 
@@ -892,7 +1115,7 @@ static void handle_sdr_data(ipmi_mc_t  *mc,
 			    void       *rsp_data);
 
 static int
-info_send(ipmi_sdr_info_t *sdrs, fetch_info_t *info, ipmi_mc_t *mc)
+sdr_send_fetch(ipmi_sdr_info_t *sdrs, fetch_info_t *info, ipmi_mc_t *mc)
 {
     unsigned char   cmd_data[MAX_IPMI_DATA_SIZE];
     ipmi_msg_t      cmd_msg;
@@ -916,6 +1139,19 @@ info_send(ipmi_sdr_info_t *sdrs, fetch_info_t *info, ipmi_mc_t *mc)
 
     rv = ipmi_mc_send_command(mc, sdrs->lun, &cmd_msg,
 			      handle_sdr_data, info);
+    if (!rv) {
+	ilist_add_tail(sdrs->outstanding_fetch, info, &info->link);
+	sdrs->num_outstanding_fetch++;
+    }
+    return rv;
+}
+
+static int
+info_send(ipmi_sdr_info_t *sdrs, fetch_info_t *info, ipmi_mc_t *mc)
+{
+    int rv;
+
+    rv = sdr_send_fetch(sdrs, info, mc);
     if (rv) {
 	DEBUG_INFO(sdrs);
 	ilist_add_tail(sdrs->free_fetch, info, &info->link);
@@ -927,12 +1163,479 @@ info_send(ipmi_sdr_info_t *sdrs, fetch_info_t *info, ipmi_mc_t *mc)
 	fetch_complete(sdrs, rv);
     } else {
 	DEBUG_INFO(sdrs);
-	ilist_add_tail(sdrs->outstanding_fetch, info, &info->link);
     }
 
     return rv;
 }
 
+/***********************************************************************
+ *
+ * Parallel fetch.  When the domain has an SDR fetch window set, the
+ * record ID chain is walked by reading just the record headers.
+ * Since the next record ID is usually predictable (from the previous
+ * copy of the repository, or just the next number), several headers
+ * are read at once on a guess.  A bad guess is thrown away and the
+ * chain is continued from the real next ID.  Once a record's place in
+ * the chain is verified, its body is read, with up to the window's
+ * worth of requests in flight.  All of this is done under the one
+ * reservation, and losing it restarts the fetch just like the normal
+ * mode.
+ *
+ **********************************************************************/
+
+/* Set up the parallel fetch state for a new fetch, called with the
+   SDR lock held once the working SDRs are allocated. */
+static int
+par_fetch_init(ipmi_sdr_info_t *sdrs, unsigned int window)
+{
+    fetch_info_t *info;
+
+    if (sdrs->par_recs) {
+	ipmi_mem_free(sdrs->par_recs);
+	sdrs->par_recs = NULL;
+    }
+    if (window == 0) {
+	/* A sequential fetch uses every buffer it has, so don't let it
+	   have the ones from a bigger window. */
+	trim_fetch_items(sdrs);
+	return 0;
+    }
+
+    sdrs->par_recs = ipmi_mem_alloc(sizeof(sdr_par_rec_t)
+				    * sdrs->working_num_sdrs);
+    if (!sdrs->par_recs)
+	return ENOMEM;
+
+    /* Anything left over in the redo list from a previous fetch is
+       stale. */
+    while ((info = ilist_remove_first(sdrs->process_fetch)))
+	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+
+    /* Make sure we have enough fetch buffers for the window.  If we
+       can't get them all, just work with what we have. */
+    while (sdrs->num_fetch_infos < window) {
+	info = ipmi_mem_alloc(sizeof(*info));
+	if (!info)
+	    break;
+	info->sdrs = sdrs;
+	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	sdrs->num_fetch_infos++;
+    }
+
+    sdrs->par_window = window;
+    sdrs->par_hdr_next = 0;
+    sdrs->par_hdrs = 0;
+    sdrs->par_body_idx = 0;
+    sdrs->par_body_offset = SDR_HEADER_SIZE;
+    sdrs->par_bad_guesses = 0;
+    sdrs->par_chain_done = 0;
+    return 0;
+}
+
+/* Guess the record ID that comes after the record at idx.  Returns 0
+   if there is no reasonable guess. */
+static int
+par_guess_next(ipmi_sdr_info_t *sdrs, unsigned int idx, unsigned int *rec_id)
+{
+    unsigned int cur;
+
+    if (sdrs->par_recs[idx].state == PAR_REC_HDR)
+	cur = sdrs->working_sdrs[idx].record_id;
+    else if (idx == 0)
+	/* Record 0 is read as "the first record", we don't know its
+	   real ID until the header comes back. */
+	return 0;
+    else
+	cur = sdrs->par_recs[idx].rec_id;
+
+    /* Follow the previous copy of the repository if it matches. */
+    if (sdrs->sdrs && (idx < sdrs->num_sdrs)
+	&& (sdrs->sdrs[idx].record_id == cur))
+    {
+	if (idx+1 >= sdrs->num_sdrs)
+	    return 0;
+	*rec_id = sdrs->sdrs[idx+1].record_id;
+	return 1;
+    }
+
+    /* Most repositories number their records sequentially, but stop
+       guessing that if it keeps being wrong. */
+    if ((sdrs->par_bad_guesses > 4) || (cur >= 0xfffe))
+	return 0;
+    *rec_id = cur + 1;
+    return 1;
+}
+
+/* Extend the verified part of the chain as far as the headers we
+   have allow.  Throw away any guesses found to be wrong. */
+static void
+par_advance_chain(ipmi_sdr_info_t *sdrs)
+{
+    sdr_par_rec_t *recs = sdrs->par_recs;
+    unsigned int  k;
+
+    while (sdrs->par_hdrs < sdrs->par_hdr_next) {
+	k = sdrs->par_hdrs;
+	if ((k > 0) && (recs[k].rec_id != recs[k-1].next_rec_id)) {
+	    /* Guessed wrong, everything sent after this is bogus. */
+	    sdrs->par_bad_guesses++;
+	    sdrs->par_hdr_next = k;
+	    break;
+	}
+	if (recs[k].state == PAR_REC_FAILED) {
+	    /* The guess was right but the read failed, send it again
+	       now that we know it's real. */
+	    sdrs->par_hdr_next = k;
+	    break;
+	}
+	if (recs[k].state != PAR_REC_HDR)
+	    break;
+	sdrs->par_hdrs++;
+	if (recs[k].next_rec_id == 0xffff) {
+	    sdrs->par_chain_done = 1;
+	    sdrs->par_hdr_next = sdrs->par_hdrs;
+	    break;
+	}
+    }
+}
+
+/* Make room for more SDRs than the repository info said there
+   were. */
+static int
+par_expand(ipmi_sdr_info_t *sdrs)
+{
+    unsigned int  new_num_sdrs;
+    ipmi_sdr_t    *new_sdrs;
+    sdr_par_rec_t *new_recs;
+
+    /* The get device SDR command (stupidly) only reports the number
+       of sensors, not the number of SDRs, so allow some expansion
+       there, within reason. */
+    if (!sdrs->sensor || (sdrs->working_num_sdrs >= 512)) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssdr.c(par_expand): "
+		 "Fetched more SDRs than the info said there were",
+		 sdrs->name);
+	return EINVAL;
+    }
+
+    new_num_sdrs = sdrs->working_num_sdrs + 10;
+    /* Allocate 9 extra bytes for the db info. */
+    new_sdrs = ipmi_mem_alloc((sizeof(ipmi_sdr_t) * new_num_sdrs) + 9);
+    if (!new_sdrs)
+	return ENOMEM;
+    new_recs = ipmi_mem_alloc(sizeof(sdr_par_rec_t) * new_num_sdrs);
+    if (!new_recs) {
+	ipmi_mem_free(new_sdrs);
+	return ENOMEM;
+    }
+    memcpy(new_sdrs, sdrs->working_sdrs,
+	   sdrs->working_num_sdrs * sizeof(ipmi_sdr_t));
+    memcpy(new_recs, sdrs->par_recs,
+	   sdrs->working_num_sdrs * sizeof(sdr_par_rec_t));
+    ipmi_mem_free(sdrs->working_sdrs);
+    ipmi_mem_free(sdrs->par_recs);
+    sdrs->working_sdrs = new_sdrs;
+    sdrs->par_recs = new_recs;
+    sdrs->working_num_sdrs = new_num_sdrs;
+    return 0;
+}
+
+/* Send everything we can.  Must be called with the SDR lock held,
+   the lock is still held on return. */
+static int
+par_fetch_send(ipmi_sdr_info_t *sdrs, ipmi_mc_t *mc)
+{
+    sdr_par_rec_t *recs;
+    fetch_info_t  *info;
+    unsigned int  k, rec_id, hdr_limit, len;
+    int           rv;
+
+    hdr_limit = (sdrs->par_window + 1) / 2;
+    while (!ilist_empty(sdrs->free_fetch)
+	   && (sdrs->num_outstanding_fetch < sdrs->par_window))
+    {
+	recs = sdrs->par_recs;
+
+	/* Body reads that got too big for the target go first. */
+	info = ilist_remove_first(sdrs->process_fetch);
+	if (info) {
+	    if (info->read_len > sdrs->fetch_size) {
+		fetch_info_t *rest = ilist_remove_first(sdrs->free_fetch);
+
+		rest->idx = info->idx;
+		rest->sdr_rec = info->sdr_rec;
+		rest->offset = info->offset + sdrs->fetch_size;
+		rest->read_len = info->read_len - sdrs->fetch_size;
+		ilist_add_tail(sdrs->process_fetch, rest, &rest->link);
+		info->read_len = sdrs->fetch_size;
+	    }
+	    info->fetch_retry_num = sdrs->fetch_retry_count;
+	    goto send;
+	}
+
+	/* Walk the header chain, it gates everything else. */
+	k = sdrs->par_hdr_next;
+	if (!sdrs->par_chain_done
+	    && ((k - sdrs->par_hdrs) < hdr_limit))
+	{
+	    int have_rec = 1;
+
+	    if (k == 0)
+		rec_id = 0;
+	    else if (k == sdrs->par_hdrs)
+		/* The previous one is verified, so this is not a guess. */
+		rec_id = recs[k-1].next_rec_id;
+	    else
+		have_rec = par_guess_next(sdrs, k-1, &rec_id);
+
+	    if (have_rec && (k >= sdrs->working_num_sdrs)) {
+		if (k != sdrs->par_hdrs)
+		    /* Don't guess past the end. */
+		    have_rec = 0;
+		else {
+		    rv = par_expand(sdrs);
+		    if (rv)
+			return rv;
+		    recs = sdrs->par_recs;
+		}
+	    }
+
+	    if (have_rec) {
+		info = ilist_remove_first(sdrs->free_fetch);
+		recs[k].rec_id = rec_id;
+		recs[k].state = PAR_REC_SENT;
+		sdrs->par_hdr_next++;
+		info->sdr_rec = rec_id;
+		info->idx = k;
+		info->offset = 0;
+		info->read_len = SDR_HEADER_SIZE;
+		info->fetch_retry_num = sdrs->fetch_retry_count;
+		goto send;
+	    }
+	}
+
+	/* Now the bodies of the records we know are real. */
+	while ((sdrs->par_body_idx < sdrs->par_hdrs)
+	       && (sdrs->par_body_offset
+		   >= ((unsigned int) sdrs->working_sdrs[sdrs->par_body_idx].length
+		       + SDR_HEADER_SIZE)))
+	{
+	    sdrs->par_body_idx++;
+	    sdrs->par_body_offset = SDR_HEADER_SIZE;
+	}
+	if (sdrs->par_body_idx >= sdrs->par_hdrs)
+	    break;
+
+	k = sdrs->par_body_idx;
+	len = (sdrs->working_sdrs[k].length + SDR_HEADER_SIZE
+	       - sdrs->par_body_offset);
+	if (len > sdrs->fetch_size)
+	    len = sdrs->fetch_size;
+	info = ilist_remove_first(sdrs->free_fetch);
+	info->sdr_rec = recs[k].rec_id;
+	info->idx = k;
+	info->offset = sdrs->par_body_offset;
+	info->read_len = len;
+	info->fetch_retry_num = sdrs->fetch_retry_count;
+	sdrs->par_body_offset += len;
+
+    send:
+	rv = sdr_send_fetch(sdrs, info, mc);
+	if (rv) {
+	    ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%ssdr.c(par_fetch_send): "
+		     "Could not send SDR fetch: %x", sdrs->name, rv);
+	    return rv;
+	}
+    }
+
+    return 0;
+}
+
+/* Abort the fetch, completing it if nothing is outstanding.  Must be
+   called with the SDR lock held, returns with it released. */
+static void
+par_fetch_fail(ipmi_sdr_info_t *sdrs, int err)
+{
+    sdrs->fetch_retry_count = MAX_SDR_FETCH_RETRIES+1;
+    sdrs->fetch_err = err;
+    if (!ilist_empty(sdrs->outstanding_fetch)) {
+	sdr_unlock(sdrs);
+	return;
+    }
+    fetch_complete(sdrs, err);
+}
+
+/* Send what we can and check for completion.  Must be called with
+   the SDR lock held, returns with it released. */
+static void
+par_fetch_next(ipmi_sdr_info_t *sdrs, ipmi_mc_t *mc)
+{
+    int rv;
+
+    rv = par_fetch_send(sdrs, mc);
+    if (rv) {
+	par_fetch_fail(sdrs, rv);
+	return;
+    }
+
+    if (sdrs->par_chain_done
+	&& (sdrs->par_body_idx >= sdrs->par_hdrs)
+	&& ilist_empty(sdrs->process_fetch)
+	&& ilist_empty(sdrs->outstanding_fetch))
+    {
+	sdrs->curr_read_idx = sdrs->par_hdrs - 1;
+	start_reservation_check(sdrs, mc);
+	return;
+    }
+
+    sdr_unlock(sdrs);
+}
+
+/* Throw away everything from record idx on and read it again,
+   starting with that record's header.  Must be called with the SDR
+   lock held. */
+static void
+par_refetch_from(ipmi_sdr_info_t *sdrs, unsigned int idx)
+{
+    /* Reads already sent for these are ignored when they come back,
+       and ones waiting to be redone are dropped. */
+    cancel_same_or_newer(sdrs, idx);
+
+    if (sdrs->par_hdrs > idx)
+	sdrs->par_hdrs = idx;
+    sdrs->par_hdr_next = idx;
+    sdrs->par_chain_done = 0;
+    if (sdrs->par_body_idx >= idx) {
+	sdrs->par_body_idx = idx;
+	sdrs->par_body_offset = SDR_HEADER_SIZE;
+    }
+}
+
+/* Handle a Get SDR response in parallel mode.  Called with the SDR
+   lock held and info removed from the outstanding list, returns with
+   the lock released.  Lost reservations are handled by the caller. */
+static void
+handle_par_sdr_data(ipmi_sdr_info_t *sdrs, fetch_info_t *info,
+		    ipmi_mc_t *mc, ipmi_msg_t *rsp)
+{
+    sdr_par_rec_t *recs = sdrs->par_recs;
+    unsigned int  k = info->idx;
+
+    if (info->offset == 0) {
+	int verified;
+
+	if ((k >= sdrs->par_hdr_next)
+	    || (recs[k].state != PAR_REC_SENT)
+	    || (recs[k].rec_id != info->sdr_rec))
+	{
+	    /* A read for a guess that has been thrown away. */
+	    ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	    goto out_next;
+	}
+
+	verified = ((k == sdrs->par_hdrs)
+		    && ((k == 0) || (recs[k-1].next_rec_id == info->sdr_rec)));
+	if ((rsp->data[0] != 0) && !verified) {
+	    /* Probably guessed a record that doesn't exist, we will
+	       find out when the previous header comes in. */
+	    recs[k].state = PAR_REC_FAILED;
+	    ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	    par_advance_chain(sdrs);
+	    goto out_next;
+	}
+
+	if ((k == 0)
+	    && ((rsp->data[0] == IPMI_UNKNOWN_ERR_CC)
+		|| (rsp->data[0] == IPMI_NOT_PRESENT_CC)))
+	{
+	    /* We got an error fetching the first SDR, so the
+	       repository is probably empty.  Just go on. */
+	    ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	    sdrs->par_chain_done = 1;
+	    sdrs->par_hdr_next = 0;
+	    goto out_next;
+	}
+    }
+
+    if (rsp->data[0] == 0x80) {
+	/* Data changed during fetch, re-read this record and the ones
+	   after it, like the sequential fetch does.  Only do this so
+	   many times before giving up. */
+	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	sdrs->sdr_retry_count++;
+	if (sdrs->sdr_retry_count > MAX_SDR_FETCH_RETRIES) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%ssdr.c(handle_par_sdr_data): "
+		     "To many retries trying to fetch SDRs", sdrs->name);
+	    par_fetch_fail(sdrs, EAGAIN);
+	    return;
+	}
+	par_refetch_from(sdrs, k);
+	goto out_next;
+    }
+
+    if ((rsp->data[0] == IPMI_CANNOT_RETURN_REQ_LENGTH_CC)
+	&& (info->offset != 0))
+    {
+	/* Too big for the target, redo it in smaller pieces. */
+	sdrs->fetch_size -= SDR_FETCH_BYTES_DECR;
+	if (sdrs->fetch_size < MIN_SDR_FETCH_BYTES) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "%ssdr.c(handle_par_sdr_data): "
+		     "SDR target chould not support the minimum fetch size",
+		     sdrs->name);
+	    ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	    par_fetch_fail(sdrs, IPMI_IPMI_ERR_VAL(rsp->data[0]));
+	    return;
+	}
+	ilist_add_tail(sdrs->process_fetch, info, &info->link);
+	goto out_next;
+    }
+
+    if (rsp->data[0] != 0) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssdr.c(handle_par_sdr_data): "
+		 "SDR fetch error getting sdr 0x%x: %x",
+		 sdrs->name, info->sdr_rec, rsp->data[0]);
+	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	par_fetch_fail(sdrs, IPMI_IPMI_ERR_VAL(rsp->data[0]));
+	return;
+    }
+
+    if (rsp->data_len < info->read_len+3) {
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssdr.c(handle_par_sdr_data): "
+		 "Got an invalid amount of SDR data: %d, expected %d",
+		 sdrs->name, rsp->data_len, info->read_len+3);
+	ilist_add_tail(sdrs->free_fetch, info, &info->link);
+	par_fetch_fail(sdrs, EINVAL);
+	return;
+    }
+
+    if (info->offset == 0) {
+	ipmi_sdr_t *sdr = &sdrs->working_sdrs[k];
+
+	recs[k].next_rec_id = ipmi_get_uint16(rsp->data+1);
+	recs[k].state = PAR_REC_HDR;
+	sdr->record_id = ipmi_get_uint16(rsp->data+3);
+	sdr->major_version = rsp->data[5] & 0xf;
+	sdr->minor_version = (rsp->data[5] >> 4) & 0xf;
+	sdr->type = rsp->data[6];
+	sdr->length = rsp->data[7];
+	par_advance_chain(sdrs);
+    } else {
+	memcpy(&sdrs->working_sdrs[k].data[info->offset-SDR_HEADER_SIZE],
+	       rsp->data+3, info->read_len);
+    }
+    ilist_add_tail(sdrs->free_fetch, info, &info->link);
+
+ out_next:
+    par_fetch_next(sdrs, mc);
+}
+
 static void
 handle_sdr_data(ipmi_mc_t  *mc,
 		ipmi_msg_t *rsp,
@@ -953,6 +1656,7 @@ handle_sdr_data(ipmi_mc_t  *mc,
 		 " outstanding operation list", sdrs->name);
 	goto out_unlock;
     }
+    sdrs->num_outstanding_fetch--;
 
     if (sdrs->destroyed) {
 	DEBUG_INFO(sdrs);
@@ -1023,6 +1727,12 @@ handle_sdr_data(ipmi_mc_t  *mc,
 	goto out_nextmsg;
     }
 
+    if (sdrs->par_recs && (rsp->data[0] != IPMI_INVALID_RESERVATION_CC)) {
+	DEBUG_INFO(sdrs);
+	handle_par_sdr_data(sdrs, info, mc, rsp);
+	goto out;
+    }
+
     if (rsp->data[0] == 0x80) {
 	/* Data changed during fetch, retry.  Only do this so many
            times before giving up. */
@@ -1259,6 +1969,11 @@ handle_sdr_data(ipmi_mc_t  *mc,
     }
 
  out_nextmsg:
+    if (sdrs->par_recs) {
+	par_fetch_next(sdrs, mc);
+	goto out;
+    }
+
     while (!ilist_empty(sdrs->free_fetch)) {
 	/* We have some free buffers, see what we can do with them. */
 
@@ -1380,8 +2095,16 @@ static int
 initial_sdr_fetch(ipmi_sdr_info_t *sdrs, ipmi_mc_t *mc)
 {
     fetch_info_t    *info;
+    int             rv;
 
     DEBUG_INFO(sdrs);
+    if (sdrs->par_recs) {
+	rv = par_fetch_send(sdrs, mc);
+	if (rv)
+	    fetch_complete(sdrs, rv);
+	return rv;
+    }
+
     info = ilist_remove_first(sdrs->free_fetch);
     if (!info) {
 	/* Technically this cannot fail, but just in case... */
@@ -1629,8 +2352,7 @@ handle_sdr_info(ipmi_mc_t  *mc,
 	/* No sdrs, so there's nothing to do. */
 	if (sdrs->sdrs) {
 	    DEBUG_INFO(sdrs);
-	    ipmi_mem_free(sdrs->sdrs);
-	    sdrs->sdrs = NULL;
+	    sdrs_free_array(sdrs);
 	}
 	DEBUG_INFO(sdrs);
 	sdrs->curr_read_idx = -1;
@@ -1651,6 +2373,18 @@ handle_sdr_info(ipmi_mc_t  *mc,
 	goto out;
     }
 
+    rv = par_fetch_init(sdrs, ipmi_domain_get_sdr_fetch_window
+			(ipmi_mc_get_domain(mc)));
+    if (rv) {
+	DEBUG_INFO(sdrs);
+	ipmi_log(IPMI_LOG_ERR_INFO,
+		 "%ssdr.c(handle_sdr_info): "
+		 "Could not allocate parallel fetch information",
+		 sdrs->name);
+	fetch_complete(sdrs, rv);
+	goto out;
+    }
+
     sdrs->curr_rec_id = 0;
     sdrs->read_offset = 0; /* First thing is to read the header. */
 
@@ -1997,11 +2731,31 @@ ipmi_get_sdr_by_recid(ipmi_sdr_info_t *sdrs,
 	return EINVAL;
     }
 
-    for (i=0; i<sdrs->num_sdrs; i++) {
-	if (sdrs->sdrs[i].record_id == recid) {
+    if (sdrs->map_index) {
+	/* Binary search the cache's index for the first match. */
+	const sdr_cache_idx_t *idx = sdrs->map_index;
+	unsigned int          lo = 0, hi = sdrs->num_sdrs, mid;
+
+	while (lo < hi) {
+	    mid = lo + ((hi - lo) / 2);
+	    if (idx[mid].record_id < (unsigned int) recid)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	if ((lo < sdrs->num_sdrs) && (idx[lo].record_id == recid)
+	    && (idx[lo].idx < sdrs->num_sdrs))
+	{
 	    rv = 0;
-	    *return_sdr = sdrs->sdrs[i];
-	    break;
+	    *return_sdr = sdrs->sdrs[idx[lo].idx];
+	}
+    } else {
+	for (i=0; i<sdrs->num_sdrs; i++) {
+	    if (sdrs->sdrs[i].record_id == recid) {
+		rv = 0;
+		*return_sdr = sdrs->sdrs[i];
+		break;
+	    }
 	}
     }
 
@@ -2072,8 +2826,11 @@ ipmi_set_sdr_by_index(ipmi_sdr_info_t *sdrs,
 
     if ((unsigned int)index >= sdrs->num_sdrs)
 	rv = ENOENT;
-    else
-	sdrs->sdrs[index] = *sdr;
+    else {
+	rv = sdrs_unshare(sdrs);
+	if (!rv)
+	    sdrs->sdrs[index] = *sdr;
+    }
 
     sdr_unlock(sdrs);
     return rv;
@@ -2268,6 +3025,9 @@ ipmi_sdr_add(ipmi_sdr_info_t *sdrs,
     int pos;
 
     sdr_lock(sdrs);
+    rv = sdrs_unshare(sdrs);
+    if (rv)
+	goto out_unlock;
     if (sdrs->num_sdrs >= sdrs->sdr_array_size) {
 	ipmi_sdr_t *new_array;
 	/* Allocate 9 extra bytes for the db info. */
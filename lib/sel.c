@@ -65,6 +65,9 @@ typedef struct sel_event_holder_s
     unsigned int cancelled : 1;
     unsigned int refcount;
     ipmi_event_t *event;
+
+    /* Link in the record ID index, see sel_index_add(). */
+    struct sel_event_holder_s *hash_next;
 } sel_event_holder_t;
 
 static sel_event_holder_t *
@@ -78,6 +81,7 @@ sel_event_holder_alloc(void)
     holder->cancelled = 0;
     holder->refcount = 1;
     holder->event = NULL;
+    holder->hash_next = NULL;
     return holder;
 }
 
@@ -105,6 +109,22 @@ typedef struct sel_clear_req_s
 
 #define SEL_NAME_LEN (IPMI_MC_NAME_LEN + 32)
 
+#define SEL_RECID_HASH_SIZE 256
+
+/* A Get SEL Entry sent ahead of the fetch, see "Pipelined fetch"
+   below. */
+#define SEL_PREFETCH_FREE	0
+#define SEL_PREFETCH_SENT	1
+#define SEL_PREFETCH_DONE	2
+#define SEL_PREFETCH_STALE	3
+typedef struct sel_prefetch_s
+{
+    unsigned int  state;
+    unsigned int  rec_id;
+    unsigned int  data_len;
+    unsigned char data[20];
+} sel_prefetch_t;
+
 struct ipmi_sel_info_s
 {
     ipmi_mcid_t mc;
@@ -165,6 +185,22 @@ struct ipmi_sel_info_s
     unsigned int           start_rec_id;
     unsigned char          start_rec_id_data[14];
 
+    /* Pipelined fetch state.  fetch_window is the number of prefetch
+       slots in use for this fetch, 0 for a plain sequential fetch.
+       Prefetch responses from an older gen are ignored. */
+    unsigned int           fetch_window;
+    unsigned int           prefetch_gen;
+    unsigned int           prefetch_stride;
+    unsigned int           prefetch_outstanding;
+    int                    prefetch_wait;
+    unsigned int           prefetch_misses;
+    sel_prefetch_t         prefetch[IPMI_MAX_SEL_FETCH_WINDOW];
+
+    /* A fetch_complete() held until the prefetches are back. */
+    unsigned int           complete_pending : 1;
+    int                    complete_err;
+    int                    complete_opq_done;
+
     /* A lock, primarily for handling race conditions fetching the data. */
     os_hnd_lock_t *sel_lock;
 
@@ -179,6 +215,9 @@ struct ipmi_sel_info_s
     unsigned int num_sels;
     unsigned int del_sels;
 
+    /* Index of the events by record ID. */
+    sel_event_holder_t *recid_hash[SEL_RECID_HASH_SIZE];
+
     /* We serialize operations through here, since we are dealing with
        a locked resource. */
     opq_t *opq;
@@ -237,10 +276,53 @@ recid_search_cmp(void *item, void *cb_data)
 
     return ipmi_event_get_record_id(holder->event) == recid;
 }
+
+/*
+ * Everything in the events list is also in a hash table by record
+ * ID, so looking up an event does not have to walk the list.  Holders
+ * must be added after their event is set and removed when they come
+ * out of the events list.  Record IDs are often spaced out evenly, so
+ * mix the bits a little.
+ */
+static unsigned int
+recid_hash(unsigned int recid)
+{
+    return ((recid * 40503) >> 8) % SEL_RECID_HASH_SIZE;
+}
+
+static void
+sel_index_add(ipmi_sel_info_t *sel, sel_event_holder_t *holder)
+{
+    unsigned int h = recid_hash(ipmi_event_get_record_id(holder->event));
+
+    holder->hash_next = sel->recid_hash[h];
+    sel->recid_hash[h] = holder;
+}
+
+static void
+sel_index_del(ipmi_sel_info_t *sel, sel_event_holder_t *holder)
+{
+    unsigned int       h = recid_hash(ipmi_event_get_record_id(holder->event));
+    sel_event_holder_t **p = &sel->recid_hash[h];
+
+    while (*p) {
+	if (*p == holder) {
+	    *p = holder->hash_next;
+	    break;
+	}
+	p = &(*p)->hash_next;
+    }
+    holder->hash_next = NULL;
+}
+
 static sel_event_holder_t *
-find_event(ilist_t *list, unsigned int recid)
+find_event(ipmi_sel_info_t *sel, unsigned int recid)
 {
-    return ilist_search(list, recid_search_cmp, &recid);
+    sel_event_holder_t *holder = sel->recid_hash[recid_hash(recid)];
+
+    while (holder && (ipmi_event_get_record_id(holder->event) != recid))
+	holder = holder->hash_next;
+    return holder;
 }
 
 static int
@@ -325,6 +407,7 @@ ipmi_sel_alloc(ipmi_mc_t       *mc,
     sel->lun = lun;
     sel->fetch_handlers = NULL;
     sel->new_event_handler = NULL;
+    sel->prefetch_wait = -1;
 
     sel->opq = opq_alloc(sel->os_hnd);
     if (!sel->opq) {
@@ -472,6 +555,19 @@ ipmi_sel_destroy(ipmi_sel_info_t      *sel,
     return 0;
 }
 
+/* Drop all the prefetches, called with the sel locked. */
+static void
+sel_prefetch_reset(ipmi_sel_info_t *sel)
+{
+    unsigned int i;
+
+    sel->prefetch_gen++;
+    sel->prefetch_stride = 0;
+    sel->prefetch_wait = -1;
+    for (i = 0; i < IPMI_MAX_SEL_FETCH_WINDOW; i++)
+	sel->prefetch[i].state = SEL_PREFETCH_FREE;
+}
+
 /* This should be called with the sel locked.  It will unlock the sel
    before returning. */
 static void
@@ -484,6 +580,16 @@ fetch_complete(ipmi_sel_info_t *sel, int err, int do_opq_done)
     if (sel->in_destroy)
 	goto out;
 
+    if (sel->prefetch_outstanding) {
+	/* Prefetches still refer to the fetch, finish when the last
+	   one comes back. */
+	sel_prefetch_reset(sel);
+	sel->complete_pending = 1;
+	sel->complete_err = err;
+	sel->complete_opq_done = do_opq_done;
+	goto out;
+    }
+
     sels_changed = sel->sels_changed;
     num_sels = sel->num_sels;
 
@@ -529,6 +635,7 @@ free_deleted_event(ilist_iter_t *iter, void *item, void *cb_data)
 
     if (holder->deleted) {
 	ilist_delete(iter);
+	sel_index_del(sel, holder);
 	holder->cancelled = 1;
 	sel->del_sels--;
 	sel_event_holder_put(holder);
@@ -611,6 +718,209 @@ send_sel_clear(sel_fetch_handler_t *elem, ipmi_mc_t *mc)
 
 static int start_fetch(void *cb_data, int shutdown);
 
+static void handle_sel_data(ipmi_mc_t  *mc,
+			    ipmi_msg_t *rsp,
+			    void       *rsp_data);
+
+/*
+ * Pipelined fetch.  Each Get SEL Entry response gives the ID of the
+ * next record, so a fetch walks a chain one round trip at a time.
+ * With a fetch window set on the domain, the IDs after the one being
+ * fetched are guessed from the spacing of the last two and requested
+ * ahead of time.  The responses are held in the prefetch slots until
+ * the walk gets to them.  If the walk reaches a record whose prefetch
+ * is still on the way, it waits for that instead of sending another
+ * request.  Wrong guesses are thrown away and the walk goes on with
+ * normal requests; prefetching stops for the fetch if the guesses
+ * keep missing.  Records are still only taken in chain order, so the
+ * result is the same as the sequential fetch.
+ */
+#define SEL_MAX_PREFETCH_MISSES 4
+
+typedef struct sel_prefetch_req_s
+{
+    sel_fetch_handler_t *elem;
+    unsigned int        gen;
+    unsigned int        slot;
+} sel_prefetch_req_t;
+
+static void
+handle_sel_prefetch(ipmi_mc_t  *mc,
+		    ipmi_msg_t *rsp,
+		    void       *rsp_data)
+{
+    sel_prefetch_req_t  *req = rsp_data;
+    sel_fetch_handler_t *elem = req->elem;
+    ipmi_sel_info_t     *sel = elem->sel;
+    unsigned int        slot = req->slot;
+    int                 current;
+    sel_prefetch_t      *pf;
+
+    sel_lock(sel);
+    current = (req->gen == sel->prefetch_gen);
+    ipmi_mem_free(req);
+    sel->prefetch_outstanding--;
+
+    if (current && (sel->prefetch_wait == (int) slot)) {
+	/* The fetch is waiting on this one, handle it like a normal
+	   response. */
+	sel->prefetch_wait = -1;
+	sel->prefetch[slot].state = SEL_PREFETCH_FREE;
+	sel_unlock(sel);
+	handle_sel_data(mc, rsp, elem);
+	return;
+    }
+
+    if (current) {
+	pf = &sel->prefetch[slot];
+	if ((pf->state == SEL_PREFETCH_SENT) && mc && (rsp->data[0] == 0)
+	    && (rsp->data_len >= 19) && (rsp->data_len <= sizeof(pf->data))
+	    && (ipmi_get_uint16(rsp->data+3) == pf->rec_id))
+	{
+	    memcpy(pf->data, rsp->data, rsp->data_len);
+	    pf->data_len = rsp->data_len;
+	    pf->state = SEL_PREFETCH_DONE;
+	} else {
+	    /* A bad guess or an error, the fetch will ask again if it
+	       needs it. */
+	    pf->state = SEL_PREFETCH_FREE;
+	}
+    }
+
+    if (sel->complete_pending && (sel->prefetch_outstanding == 0)) {
+	sel->complete_pending = 0;
+	/* This unlocks the sel. */
+	fetch_complete(sel, sel->complete_err, sel->complete_opq_done);
+	return;
+    }
+    sel_unlock(sel);
+}
+
+static int
+send_get_sel_entry(ipmi_sel_info_t            *sel,
+		   ipmi_mc_t                  *mc,
+		   unsigned int               rec_id,
+		   ipmi_mc_response_handler_t handler,
+		   void                       *cb_data)
+{
+    unsigned char cmd_data[MAX_IPMI_DATA_SIZE];
+    ipmi_msg_t    cmd_msg;
+
+    cmd_msg.data = cmd_data;
+    cmd_msg.netfn = IPMI_STORAGE_NETFN;
+    cmd_msg.cmd = IPMI_GET_SEL_ENTRY_CMD;
+    cmd_msg.data_len = 6;
+    ipmi_set_uint16(cmd_msg.data, sel->reservation);
+    ipmi_set_uint16(cmd_msg.data+2, rec_id);
+    cmd_msg.data[4] = 0;
+    cmd_msg.data[5] = 0xff;
+    return ipmi_mc_send_command(mc, sel->lun, &cmd_msg, handler, cb_data);
+}
+
+static int
+prefetch_slot_used(sel_prefetch_t *pf)
+{
+    return (pf->state == SEL_PREFETCH_SENT) || (pf->state == SEL_PREFETCH_DONE);
+}
+
+/* Get the entry at curr_rec_id, called with the sel locked.  If it
+   has already been prefetched, the response is copied into cached
+   and nothing is sent.  Prefetches are sent if there is room. */
+static int
+sel_fetch_entry(ipmi_sel_info_t     *sel,
+		sel_fetch_handler_t *elem,
+		ipmi_mc_t           *mc,
+		ipmi_msg_t          *cached)
+{
+    sel_prefetch_t     *pf;
+    sel_prefetch_req_t *req;
+    unsigned int       i, j, rec_id;
+    int                found = 0, guessed = 0;
+    int                rv;
+
+    cached->data_len = 0;
+    for (i = 0; i < sel->fetch_window; i++) {
+	pf = &sel->prefetch[i];
+	if (!prefetch_slot_used(pf))
+	    continue;
+	guessed = 1;
+	if (pf->rec_id != sel->curr_rec_id)
+	    continue;
+	found = 1;
+	if (pf->state == SEL_PREFETCH_DONE) {
+	    memcpy(cached->data, pf->data, pf->data_len);
+	    cached->data_len = pf->data_len;
+	    pf->state = SEL_PREFETCH_FREE;
+	} else {
+	    sel->prefetch_wait = i;
+	}
+	break;
+    }
+
+    if (!found) {
+	/* The guesses were wrong (or there weren't any), everything
+	   guessed from them is wrong too. */
+	if (guessed) {
+	    sel->prefetch_misses++;
+	    for (i = 0; i < sel->fetch_window; i++) {
+		pf = &sel->prefetch[i];
+		if (pf->state == SEL_PREFETCH_DONE)
+		    pf->state = SEL_PREFETCH_FREE;
+		else if (pf->state == SEL_PREFETCH_SENT)
+		    pf->state = SEL_PREFETCH_STALE;
+	    }
+	}
+	rv = send_get_sel_entry(sel, mc, sel->curr_rec_id,
+				handle_sel_data, elem);
+	if (rv)
+	    return rv;
+    }
+
+    if (!sel->prefetch_stride
+	|| (sel->prefetch_misses >= SEL_MAX_PREFETCH_MISSES))
+	return 0;
+
+    rec_id = sel->curr_rec_id;
+    for (j = 0; j < sel->fetch_window; j++) {
+	rec_id += sel->prefetch_stride;
+	if (rec_id >= 0xffff)
+	    break;
+	for (i = 0; i < sel->fetch_window; i++) {
+	    pf = &sel->prefetch[i];
+	    if (prefetch_slot_used(pf) && (pf->rec_id == rec_id))
+		break;
+	}
+	if (i < sel->fetch_window)
+	    /* Already on its way. */
+	    continue;
+	for (i = 0; i < sel->fetch_window; i++) {
+	    if (sel->prefetch[i].state == SEL_PREFETCH_FREE)
+		break;
+	}
+	if (i == sel->fetch_window)
+	    break;
+
+	/* Prefetches are only an optimization, don't fail on errors. */
+	req = ipmi_mem_alloc(sizeof(*req));
+	if (!req)
+	    break;
+	req->elem = elem;
+	req->gen = sel->prefetch_gen;
+	req->slot = i;
+	rv = send_get_sel_entry(sel, mc, rec_id, handle_sel_prefetch, req);
+	if (rv) {
+	    ipmi_mem_free(req);
+	    break;
+	}
+	pf = &sel->prefetch[i];
+	pf->state = SEL_PREFETCH_SENT;
+	pf->rec_id = rec_id;
+	sel->prefetch_outstanding++;
+    }
+
+    return 0;
+}
+
 static void
 handle_sel_data(ipmi_mc_t  *mc,
 		ipmi_msg_t *rsp,
@@ -618,8 +928,8 @@ handle_sel_data(ipmi_mc_t  *mc,
 {
     sel_fetch_handler_t *elem = rsp_data;
     ipmi_sel_info_t     *sel = elem->sel;
-    unsigned char       cmd_data[MAX_IPMI_DATA_SIZE];
-    ipmi_msg_t          cmd_msg;
+    ipmi_msg_t          cached_msg;
+    unsigned char       cached_data[20];
     int                 rv;
     int                 event_is_new = 0;
     ipmi_event_t        *del_event;
@@ -629,6 +939,7 @@ handle_sel_data(ipmi_mc_t  *mc,
 
 
     sel_lock(sel);
+ next_rsp:
     if (sel->destroyed) {
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "%ssel.c(handle_sel_data): "
@@ -697,6 +1008,7 @@ handle_sel_data(ipmi_mc_t  *mc,
 	       SEL. */
 	    sel->start_rec_id = 0;
 	    sel->curr_rec_id = 0;
+	    sel_prefetch_reset(sel);
 	    del_event = NULL;
 	    goto start_request_sel_data;
 	}
@@ -714,6 +1026,11 @@ handle_sel_data(ipmi_mc_t  *mc,
 
     record_id = ipmi_get_uint16(rsp->data+3);
 
+    /* Guess the spacing of the following record IDs from this one. */
+    if (sel->fetch_window && (sel->next_rec_id > record_id)
+	&& (sel->next_rec_id - record_id <= 0x100))
+	sel->prefetch_stride = sel->next_rec_id - record_id;
+
     if (rsp->data[5] < 0xe0)
 	timestamp = ipmi_seconds_to_time(ipmi_get_uint32(rsp->data+6));
     else
@@ -736,7 +1053,7 @@ handle_sel_data(ipmi_mc_t  *mc,
     if ((timestamp > 0) && (timestamp < ipmi_mc_get_startup_SEL_time(mc)))
 	ipmi_event_set_is_old(del_event, 1);
 
-    holder = find_event(sel->events, record_id);
+    holder = find_event(sel, record_id);
     if (!holder) {
 	holder = sel_event_holder_alloc();
 	if (!holder) {
@@ -758,6 +1075,7 @@ handle_sel_data(ipmi_mc_t  *mc,
 	}
 	holder->event = del_event;
 	holder->deleted = 0;
+	sel_index_add(sel, holder);
 	event_is_new = 1;
 	sel->num_sels++;
 	if (sel->sel_received_events)
@@ -781,6 +1099,9 @@ handle_sel_data(ipmi_mc_t  *mc,
     }
 
     if (sel->next_rec_id == 0xFFFF) {
+	/* Anything still prefetched is past the end. */
+	sel_prefetch_reset(sel);
+
 	/* Only set the timestamps if the SEL fetch completed
 	   successfully.  If we were unsuccessful, we want to redo the
 	   operation so don't set the timestamps. */
@@ -827,15 +1148,8 @@ handle_sel_data(ipmi_mc_t  *mc,
 
  start_request_sel_data:
     /* Request some more data. */
-    cmd_msg.data = cmd_data;
-    cmd_msg.netfn = IPMI_STORAGE_NETFN;
-    cmd_msg.cmd = IPMI_GET_SEL_ENTRY_CMD;
-    cmd_msg.data_len = 6;
-    ipmi_set_uint16(cmd_msg.data, sel->reservation);
-    ipmi_set_uint16(cmd_msg.data+2, sel->curr_rec_id);
-    cmd_msg.data[4] = 0;
-    cmd_msg.data[5] = 0xff;
-    rv = ipmi_mc_send_command(mc, sel->lun, &cmd_msg, handle_sel_data, elem);
+    cached_msg.data = cached_data;
+    rv = sel_fetch_entry(sel, elem, mc, &cached_msg);
     if (rv) {
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "%ssel.c(handle_sel_clear): "
@@ -851,6 +1165,13 @@ handle_sel_data(ipmi_mc_t  *mc,
 	handler(sel, mc, del_event, cb_data);
 	sel_lock(sel);
     }
+
+    if (cached_msg.data_len) {
+	/* The next one was already prefetched, handle it now. */
+	rsp = &cached_msg;
+	event_is_new = 0;
+	goto next_rsp;
+    }
  out_unlock:
     sel_unlock(sel);
  out:
@@ -878,8 +1199,8 @@ handle_sel_info(ipmi_mc_t  *mc,
 {
     sel_fetch_handler_t *elem = rsp_data;
     ipmi_sel_info_t     *sel = elem->sel;
-    unsigned char       cmd_data[MAX_IPMI_DATA_SIZE];
-    ipmi_msg_t          cmd_msg;
+    ipmi_msg_t          cached_msg;
+    unsigned char       cached_data[20];
     int                 rv;
     uint32_t            add_timestamp;
     uint32_t            erase_timestamp;
@@ -988,15 +1309,12 @@ handle_sel_info(ipmi_mc_t  *mc,
 
     /* Fetch the first SEL entry. */
     sel->curr_rec_id = sel->start_rec_id;
-    cmd_msg.data = cmd_data;
-    cmd_msg.netfn = IPMI_STORAGE_NETFN;
-    cmd_msg.cmd = IPMI_GET_SEL_ENTRY_CMD;
-    cmd_msg.data_len = 6;
-    ipmi_set_uint16(cmd_msg.data, sel->reservation);
-    ipmi_set_uint16(cmd_msg.data+2, sel->curr_rec_id);
-    cmd_msg.data[4] = 0;
-    cmd_msg.data[5] = 0xff;
-    rv = ipmi_mc_send_command(mc, sel->lun, &cmd_msg, handle_sel_data, elem);
+    sel->fetch_window = ipmi_domain_get_sel_fetch_window
+	(ipmi_mc_get_domain(mc));
+    sel_prefetch_reset(sel);
+    sel->prefetch_misses = 0;
+    cached_msg.data = cached_data;
+    rv = sel_fetch_entry(sel, elem, mc, &cached_msg);
     if (rv) {
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "%ssel.c(handle_sel_info): "
@@ -1338,6 +1656,7 @@ free_all_event(ilist_iter_t *iter, void *item, void *cb_data)
 	holder->cancelled = 1;
     }
     ilist_delete(iter);
+    sel_index_del(sel, holder);
     sel_event_holder_put(holder);
 }
 
@@ -1480,14 +1799,11 @@ handle_sel_delete(ipmi_mc_t  *mc,
     } else {	
 	/* We deleted the entry, so remove it from our database. */
 	sel_event_holder_t *real_holder;
-	ilist_iter_t       iter;
 
-	ilist_init_iter(&iter, sel->events);
-	ilist_unpositioned(&iter);
-	real_holder = ilist_search_iter(&iter, recid_search_cmp,
-					&(data->record_id));
+	real_holder = find_event(sel, data->record_id);
 	if (real_holder) {
-	    ilist_delete(&iter);
+	    ilist_remove_item_from_list(sel->events, real_holder);
+	    sel_index_del(sel, real_holder);
 	    sel_event_holder_put(real_holder);
 	    sel->del_sels--;
 	}
@@ -1836,7 +2152,6 @@ sel_del_event_cb(ipmi_mc_t *mc, void *cb_data)
     ipmi_event_t          *event = info->event;
     int                   cmp_event = info->cmp_event;
     sel_event_holder_t    *real_holder = NULL;
-    ilist_iter_t          iter;
     int                   start_fetch = 0;
 
     sel_lock(sel);
@@ -1846,10 +2161,7 @@ sel_del_event_cb(ipmi_mc_t *mc, void *cb_data)
     }
 
     if (event) {
-	ilist_init_iter(&iter, sel->events);
-	ilist_unpositioned(&iter);
-	real_holder = ilist_search_iter(&iter, recid_search_cmp,
-				    &info->record_id);
+	real_holder = find_event(sel, info->record_id);
 	if (!real_holder) {
 	    info->rv = EINVAL;
 	    goto out_unlock;
@@ -2157,7 +2469,7 @@ ipmi_sel_get_event_by_recid(ipmi_sel_info_t *sel,
 	return NULL;
     }
 
-    holder = find_event(sel->events, record_id);
+    holder = find_event(sel, record_id);
     if (!holder)
 	goto out_unlock;
 
@@ -2399,7 +2711,7 @@ ipmi_sel_event_add(ipmi_sel_info_t *sel,
     }
 
     record_id = ipmi_event_get_record_id(new_event);
-    holder = find_event(sel->events, record_id);
+    holder = find_event(sel, record_id);
     if (!holder) {
 	holder = sel_event_holder_alloc();
 	if (!holder) {
@@ -2411,6 +2723,7 @@ ipmi_sel_event_add(ipmi_sel_info_t *sel,
 	    goto out_unlock;
 	}
 	holder->event = ipmi_event_dup(new_event);
+	sel_index_add(sel, holder);
 	sel->num_sels++;
     } else if (event_cmp(holder->event, new_event) == 0) {
 	/* A duplicate event, just ignore it and return the right
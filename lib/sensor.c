@@ -168,6 +168,13 @@ struct ipmi_sensor_s
 	int b_exp : 4;
     } conv[256];
 
+    /* Raw to engineering value conversion table for standard
+       threshold sensors, built the first time a conversion is done.
+       Anything that changes the conversion factors clears
+       conv_table_valid so it gets rebuilt. */
+    double        *conv_table;
+    int           conv_table_valid;
+
     unsigned int  normal_min_specified : 1;
     unsigned int  normal_max_specified : 1;
     unsigned int  nominal_reading_specified : 1;
@@ -199,7 +206,10 @@ struct ipmi_sensor_s
        in. */
     locked_list_t *handler_list, *handler_list_cl;
 
-    opq_t *waitq;
+    /* Operations are serialized on the waitq, the lock for it is
+       shared by the whole domain. */
+    opq_sched_t *opq_sched;
+    opq_lite_t waitq;
     ipmi_event_state_t event_state;
 
     /* Polymorphic functions. */
@@ -257,8 +267,7 @@ i_ipmi_sensor_put(ipmi_sensor_t *sensor)
 	    i_ipmi_domain_entity_lock(sensor->domain);
 	}
 	if (sensor->destroyed
-	    && (!sensor->waitq
-		|| (!opq_stuff_in_progress(sensor->waitq))))
+	    && (!opq_lite_stuff_in_progress(&sensor->waitq)))
 	{
 	    i_ipmi_domain_entity_unlock(domain);
 	    sensor_final_destroy(sensor);
@@ -532,8 +541,8 @@ ipmi_sensor_add_opq(ipmi_sensor_t         *sensor,
     info->__sensor_id = ipmi_sensor_convert_to_id(sensor);
     info->__cb_data = cb_data;
     info->__handler = handler;
-    if (!opq_new_op(sensor->waitq, sensor_opq_ready, info, 0))
-	return ENOMEM;
+    opq_lite_new_op(sensor->opq_sched, &sensor->waitq, &info->__opq_op,
+		    sensor_opq_ready, info);
     return 0;
 }
 
@@ -543,8 +552,8 @@ sensor_id_add_opq_cb(ipmi_sensor_t *sensor, void *cb_data)
     ipmi_sensor_op_info_t *info = cb_data;
 
     info->__sensor = sensor;
-    if (!opq_new_op(sensor->waitq, sensor_opq_ready, info, 0))
-	info->__err = ENOMEM;
+    opq_lite_new_op(sensor->opq_sched, &sensor->waitq, &info->__opq_op,
+		    sensor_opq_ready, info);
 }
 
 int
@@ -576,17 +585,14 @@ ipmi_sensor_opq_done(ipmi_sensor_t *sensor)
     /* This gets called on ECANCELLED error cases, if the sensor is
        already destroyed we need to clear out the opq. */
     if (sensor->destroyed) {
-	if (sensor->waitq) {
-	    opq_destroy(sensor->waitq);
-	    sensor->waitq = NULL;
-	}
+	opq_lite_destroy(sensor->opq_sched, &sensor->waitq);
 	return;
     }
 
     /* No check for the sensor lock.  It will sometimes fail at
        destruction time. */
 
-    opq_op_done(sensor->waitq);
+    opq_lite_op_done(sensor->opq_sched, &sensor->waitq);
 }
 
 static void
@@ -897,15 +903,11 @@ ipmi_sensor_add_nonstandard(ipmi_mc_t              *mc,
 	sensors->idx_size[4] = new_size;
     }
 
-    sensor->waitq = opq_alloc(os_hnd);
-    if (! sensor->waitq) {
-	err = ENOMEM;
-	goto out_err;
-    }
+    sensor->opq_sched = i_ipmi_domain_get_opq_sched(domain);
+    opq_lite_init(&sensor->waitq);
 
-    sensor->handler_list = locked_list_alloc(os_hnd);
+    sensor->handler_list = locked_list_alloc_snapshot(os_hnd);
     if (! sensor->handler_list) {
-	opq_destroy(sensor->waitq);
 	err = ENOMEM;
 	goto out_err;
     }
@@ -913,15 +915,12 @@ ipmi_sensor_add_nonstandard(ipmi_mc_t              *mc,
     sensor->handler_list_cl = locked_list_alloc(os_hnd);
     if (! sensor->handler_list_cl) {
 	locked_list_destroy(sensor->handler_list);
-	opq_destroy(sensor->waitq);
 	err = ENOMEM;
 	goto out_err;
     }
 
     link = locked_list_alloc_entry();
     if (!link) {
-	opq_destroy(sensor->waitq);
-	sensor->waitq = NULL;
 	locked_list_destroy(sensor->handler_list);
 	locked_list_destroy(sensor->handler_list_cl);
 	sensor->handler_list = NULL;
@@ -1029,8 +1028,11 @@ sensor_final_destroy(ipmi_sensor_t *sensor)
     if (sensor->destroy_handler)
 	sensor->destroy_handler(sensor, sensor->destroy_handler_cb_data);
 
-    if (sensor->waitq)
-	opq_destroy(sensor->waitq);
+    if (sensor->opq_sched)
+	opq_lite_destroy(sensor->opq_sched, &sensor->waitq);
+
+    if (sensor->conv_table)
+	ipmi_mem_free(sensor->conv_table);
 
     if (sensor->handler_list) {
 	locked_list_iterate(sensor->handler_list, handler_list_cleanup,
@@ -1261,21 +1263,18 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 	s[p]->source_recid = sdr.record_id;
 	s[p]->hot_swap_requester = -1;
 
-	s[p]->waitq = opq_alloc(ipmi_domain_get_os_hnd(domain));
-	if (!s[p]->waitq)
-	    goto out_err_enomem;
+	s[p]->opq_sched = i_ipmi_domain_get_opq_sched(domain);
+	opq_lite_init(&s[p]->waitq);
 
 	s[p]->handler_list_cl
 	    = locked_list_alloc(ipmi_domain_get_os_hnd(domain));
-	if (! s[p]->handler_list_cl) {
-	    opq_destroy(s[p]->waitq);
+	if (! s[p]->handler_list_cl)
 	    goto out_err_enomem;
-	}
 
-	s[p]->handler_list = locked_list_alloc(ipmi_domain_get_os_hnd(domain));
+	s[p]->handler_list
+	    = locked_list_alloc_snapshot(ipmi_domain_get_os_hnd(domain));
 	if (! s[p]->handler_list) {
 	    locked_list_destroy(s[i]->handler_list_cl);
-	    opq_destroy(s[p]->waitq);
 	    goto out_err_enomem;
 	}
 
@@ -1466,17 +1465,15 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 							   s[p+j]->owner,
 							   &(s[p+j]->mc));
 
-		    s[p+j]->waitq = opq_alloc(ipmi_domain_get_os_hnd(domain));
-		    if (!s[p+j]->waitq)
-			goto out_err_enomem;
+		    opq_lite_init(&s[p+j]->waitq);
 
 		    s[p+j]->handler_list_cl
 			= locked_list_alloc(ipmi_domain_get_os_hnd(domain));
 		    if (! s[p+j]->handler_list_cl)
 			goto out_err_enomem;
 
-		    s[p+j]->handler_list
-			= locked_list_alloc(ipmi_domain_get_os_hnd(domain));
+		    s[p+j]->handler_list = locked_list_alloc_snapshot
+			(ipmi_domain_get_os_hnd(domain));
 		    if (! s[p+j]->handler_list)
 			goto out_err_enomem;
 
@@ -1544,8 +1541,6 @@ get_sensors_from_sdrs(ipmi_domain_t      *domain,
 	    if (s[i]) {
 		if (s[i]->mc)
 		    i_ipmi_mc_put(s[i]->mc);
-		if (s[i]->waitq)
-		    opq_destroy(s[i]->waitq);
 		if (s[i]->handler_list)
 		    locked_list_destroy(s[i]->handler_list);
 		if (s[i]->handler_list_cl)
@@ -1948,7 +1943,6 @@ ipmi_sensor_handle_sdrs(ipmi_domain_t   *domain,
 	case ENT_LIST_DUP:
 	    /* They compare, prefer to keep the old data. */
 	    i = nsensor->source_idx;
-	    opq_destroy(nsensor->waitq);
 	    locked_list_destroy(nsensor->handler_list);
 	    locked_list_destroy(nsensor->handler_list_cl);
 	    ipmi_mem_free(nsensor);
@@ -3057,6 +3051,7 @@ ipmi_sensor_set_event_reading_type(ipmi_sensor_t *sensor,
 				   int           event_reading_type)
 {
     sensor->event_reading_type = event_reading_type;
+    sensor->conv_table_valid = 0;
 }
 
 void
@@ -3078,6 +3073,7 @@ ipmi_sensor_set_analog_data_format(ipmi_sensor_t *sensor,
 				   int           analog_data_format)
 {
     sensor->analog_data_format = analog_data_format;
+    sensor->conv_table_valid = 0;
 }
 
 void
@@ -3114,12 +3110,14 @@ void
 ipmi_sensor_set_linearization(ipmi_sensor_t *sensor, int linearization)
 {
     sensor->linearization = linearization;
+    sensor->conv_table_valid = 0;
 }
 
 void
 ipmi_sensor_set_raw_m(ipmi_sensor_t *sensor, int idx, int val)
 {
     sensor->conv[idx].m = val;
+    sensor->conv_table_valid = 0;
 }
 
 void
@@ -3132,6 +3130,7 @@ void
 ipmi_sensor_set_raw_b(ipmi_sensor_t *sensor, int idx, int val)
 {
     sensor->conv[idx].b = val;
+    sensor->conv_table_valid = 0;
 }
 
 void
@@ -3150,12 +3149,14 @@ void
 ipmi_sensor_set_raw_r_exp(ipmi_sensor_t *sensor, int idx, int val)
 {
     sensor->conv[idx].r_exp = val;
+    sensor->conv_table_valid = 0;
 }
 
 void
 ipmi_sensor_set_raw_b_exp(ipmi_sensor_t *sensor, int idx, int val)
 {
     sensor->conv[idx].b_exp = val;
+    sensor->conv_table_valid = 0;
 }
 
 void
@@ -4759,6 +4760,7 @@ typedef struct reading_get_info_s
     enum ipmi_value_present_e  value_present;
     unsigned int               raw_val;
     double                     cooked_val;
+    int                        no_free; /* Owned by the caller. */
 } reading_get_info_t;
 
 static void reading_get_done_handler(ipmi_sensor_t *sensor,
@@ -4766,13 +4768,16 @@ static void reading_get_done_handler(ipmi_sensor_t *sensor,
 				     void          *sinfo)
 {
     reading_get_info_t *info = sinfo;
+    int                no_free = info->no_free;
 
+    /* The done handler may free the info if it's not ours. */
     if (info->done)
 	info->done(sensor, err, info->value_present,
 		   info->raw_val, info->cooked_val, &info->states,
 		   info->cb_data);
     ipmi_sensor_opq_done(sensor);
-    ipmi_mem_free(info);
+    if (!no_free)
+	ipmi_mem_free(info);
 }
 
 static void
@@ -4840,6 +4845,21 @@ reading_get_start(ipmi_sensor_t *sensor, int err, void *cb_data)
     }
 }
 
+static void
+reading_get_info_init(reading_get_info_t     *info,
+		      ipmi_sensor_reading_cb done,
+		      void                   *cb_data,
+		      int                    no_free)
+{
+    info->done = done;
+    info->cb_data = cb_data;
+    info->value_present = IPMI_NO_VALUES_PRESENT;
+    info->raw_val = 0;
+    info->cooked_val = 0.0;
+    info->no_free = no_free;
+    ipmi_init_states(&info->states);
+}
+
 static int
 stand_ipmi_sensor_get_reading(ipmi_sensor_t          *sensor,
 			      ipmi_sensor_reading_cb done,
@@ -4857,12 +4877,7 @@ stand_ipmi_sensor_get_reading(ipmi_sensor_t          *sensor,
     info = ipmi_mem_alloc(sizeof(*info));
     if (!info)
 	return ENOMEM;
-    info->done = done;
-    info->cb_data = cb_data;
-    info->value_present = IPMI_NO_VALUES_PRESENT;
-    info->raw_val = 0;
-    info->cooked_val = 0.0;
-    ipmi_init_states(&info->states);
+    reading_get_info_init(info, done, cb_data, 0);
     rv = ipmi_sensor_add_opq(sensor, reading_get_start, &(info->sdata), info);
     if (rv)
 	ipmi_mem_free(info);
@@ -4876,6 +4891,7 @@ typedef struct states_get_info_s
     ipmi_sensor_states_cb done;
     void                  *cb_data;
     ipmi_states_t         states;
+    int                   no_free; /* Owned by the caller. */
 } states_get_info_t;
 
 static void states_get_done_handler(ipmi_sensor_t *sensor,
@@ -4883,11 +4899,14 @@ static void states_get_done_handler(ipmi_sensor_t *sensor,
 				    void          *sinfo)
 {
     states_get_info_t *info = sinfo;
+    int               no_free = info->no_free;
 
+    /* The done handler may free the info if it's not ours. */
     if (info->done)
 	info->done(sensor, err, &info->states, info->cb_data);
     ipmi_sensor_opq_done(sensor);
-    ipmi_mem_free(info);
+    if (!no_free)
+	ipmi_mem_free(info);
 }
 
 static void
@@ -4963,6 +4982,7 @@ stand_ipmi_sensor_get_states(ipmi_sensor_t         *sensor,
 	return ENOMEM;
     info->done = done;
     info->cb_data = cb_data;
+    info->no_free = 0;
     ipmi_init_states(&info->states);
     rv = ipmi_sensor_add_opq(sensor, states_get_start, &(info->sdata), info);
     if (rv)
@@ -5042,24 +5062,22 @@ sign_extend(int m, int bits)
 	return m & (~(-1 << bits));
 }
 
-static int
-stand_ipmi_sensor_convert_from_raw(ipmi_sensor_t *sensor,
-				   int           val,
-				   double        *result)
+static linearizer
+sensor_linearizer(ipmi_sensor_t *sensor)
 {
-    double m, b, b_exp, r_exp, fval;
-    linearizer c_func;
-
-    if (sensor->event_reading_type != IPMI_EVENT_READING_TYPE_THRESHOLD)
-	/* Not a threshold sensor, it doesn't have readings. */
-	return ENOSYS;
-
     if (sensor->linearization == IPMI_LINEARIZATION_NONLINEAR)
-	c_func = c_linear;
+	return c_linear;
     else if (sensor->linearization <= 11)
-	c_func = linearize[sensor->linearization];
+	return linearize[sensor->linearization];
     else
-	return EINVAL;
+	return NULL;
+}
+
+/* Do the actual conversion math for a single raw value. */
+static double
+sensor_calc_from_raw(ipmi_sensor_t *sensor, linearizer c_func, int val)
+{
+    double m, b, b_exp, r_exp, fval;
 
     val &= 0xff;
 
@@ -5069,9 +5087,6 @@ stand_ipmi_sensor_convert_from_raw(ipmi_sensor_t *sensor,
     b_exp = sensor->conv[val].b_exp;
 
     switch(sensor->analog_data_format) {
-	case IPMI_ANALOG_DATA_FORMAT_UNSIGNED:
-	    fval = val;
-	    break;
 	case IPMI_ANALOG_DATA_FORMAT_1_COMPL:
 	    val = sign_extend(val, 8);
 	    if (val < 0)
@@ -5081,28 +5096,120 @@ stand_ipmi_sensor_convert_from_raw(ipmi_sensor_t *sensor,
 	case IPMI_ANALOG_DATA_FORMAT_2_COMPL:
 	    fval = sign_extend(val, 8);
 	    break;
+	default:
+	    fval = val;
+	    break;
+    }
+
+    return c_func(((m * fval) + (b * pow(10, b_exp))) * pow(10, r_exp));
+}
+
+/* Return the conversion table for the sensor, building it if
+   necessary.  Returns NULL if the table cannot be allocated, the
+   caller should fall back to calculating the value directly. */
+static double *
+sensor_get_conv_table(ipmi_sensor_t *sensor, linearizer c_func)
+{
+    ipmi_sensor_info_t *sensors;
+    int                i;
+
+    if (sensor->conv_table_valid)
+	return sensor->conv_table;
+
+    if (!sensor->mc)
+	return NULL;
+
+    sensors = i_ipmi_mc_get_sensors(sensor->mc);
+    ipmi_lock(sensors->idx_lock);
+    if (!sensor->conv_table_valid) {
+	if (!sensor->conv_table)
+	    sensor->conv_table = ipmi_mem_alloc(sizeof(double) * 256);
+	if (sensor->conv_table) {
+	    for (i=0; i<256; i++)
+		sensor->conv_table[i] = sensor_calc_from_raw(sensor, c_func, i);
+	    sensor->conv_table_valid = 1;
+	}
+    }
+    ipmi_unlock(sensors->idx_lock);
+
+    return sensor->conv_table;
+}
+
+static int
+stand_ipmi_sensor_check_conv(ipmi_sensor_t *sensor, linearizer *c_func)
+{
+    if (sensor->event_reading_type != IPMI_EVENT_READING_TYPE_THRESHOLD)
+	/* Not a threshold sensor, it doesn't have readings. */
+	return ENOSYS;
+
+    *c_func = sensor_linearizer(sensor);
+    if (!*c_func)
+	return EINVAL;
+
+    switch(sensor->analog_data_format) {
+	case IPMI_ANALOG_DATA_FORMAT_UNSIGNED:
+	case IPMI_ANALOG_DATA_FORMAT_1_COMPL:
+	case IPMI_ANALOG_DATA_FORMAT_2_COMPL:
+	    return 0;
 	default:
 	    return EINVAL;
     }
+}
+
+static int
+stand_ipmi_sensor_convert_from_raw(ipmi_sensor_t *sensor,
+				   int           val,
+				   double        *result)
+{
+    linearizer c_func;
+    double     *table;
+    int        rv;
+
+    rv = stand_ipmi_sensor_check_conv(sensor, &c_func);
+    if (rv)
+	return rv;
 
-    *result = c_func(((m * fval) + (b * pow(10, b_exp))) * pow(10, r_exp));
+    table = sensor_get_conv_table(sensor, c_func);
+    if (table)
+	*result = table[val & 0xff];
+    else
+	*result = sensor_calc_from_raw(sensor, c_func, val);
     return 0;
 }
 
+static int
+sensor_conv_lookup(ipmi_sensor_t *sensor, double *table, int raw, double *val)
+{
+    if (table) {
+	*val = table[raw & 0xff];
+	return 0;
+    }
+    return ipmi_sensor_convert_from_raw(sensor, raw, val);
+}
+
 static int
 stand_ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
 				 enum ipmi_round_e rounding,
 				 double            val,
 				 int               *result)
 {
-    double cval;
-    int    lowraw, highraw, raw, maxraw, minraw, next_raw;
-    int    rv;
+    double     cval;
+    int        lowraw, highraw, raw, maxraw, minraw, next_raw;
+    int        rv;
+    double     *table = NULL;
+    linearizer c_func;
 
     if (sensor->event_reading_type != IPMI_EVENT_READING_TYPE_THRESHOLD)
 	/* Not a threshold sensor, it doesn't have readings. */
 	return ENOSYS;
 
+    /* If the standard conversion is in use, search the table directly
+       instead of converting each probe. */
+    if ((sensor->cbs.ipmi_sensor_convert_from_raw
+	 == stand_ipmi_sensor_convert_from_raw)
+	&& (stand_ipmi_sensor_check_conv(sensor, &c_func) == 0))
+	table = sensor_get_conv_table(sensor, c_func);
+
     switch(sensor->analog_data_format) {
 	case IPMI_ANALOG_DATA_FORMAT_UNSIGNED:
 	    lowraw = 0;
@@ -5133,7 +5240,7 @@ stand_ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
        have a better plan that will work with non-linear sensors. */
     do {
 	raw = next_raw;
-	rv = ipmi_sensor_convert_from_raw(sensor, raw, &cval);
+	rv = sensor_conv_lookup(sensor, table, raw, &cval);
 	if (rv)
 	    return rv;
 
@@ -5154,7 +5261,7 @@ stand_ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
 	    if (val > cval) {
 		if (raw < maxraw) {
 		    double nval;
-		    rv = ipmi_sensor_convert_from_raw(sensor, raw+1, &nval);
+		    rv = sensor_conv_lookup(sensor, table, raw+1, &nval);
 		    if (rv)
 			return rv;
 		    nval = cval + ((nval - cval) / 2.0);
@@ -5164,7 +5271,7 @@ stand_ipmi_sensor_convert_to_raw(ipmi_sensor_t     *sensor,
 	    } else {
 		if (raw > minraw) {
 		    double pval;
-		    rv = ipmi_sensor_convert_from_raw(sensor, raw-1, &pval);
+		    rv = sensor_conv_lookup(sensor, table, raw-1, &pval);
 		    if (rv)
 			return rv;
 		    pval = pval + ((cval - pval) / 2.0);
@@ -5954,6 +6061,317 @@ ipmi_sensor_id_get_states(ipmi_sensor_id_t      sensor_id,
 }
 
 
+/***********************************************************************
+ *
+ * Reading a bunch of sensors at once.
+ *
+ **********************************************************************/
+
+/* The number of reads a bulk read keeps going at once.  The
+   connection queues anything past its own outstanding limit, this
+   just keeps a big bulk read from filling up the connection's queue
+   ahead of everything else. */
+#define SENSOR_BULK_WINDOW 32
+
+typedef struct sensor_bulk_s sensor_bulk_t;
+
+typedef struct sensor_bulk_item_s
+{
+    sensor_bulk_t *bulk;
+    unsigned int  idx;
+    int           start_err;
+
+    /* For standard sensors, the read uses these instead of allocating
+       its own. */
+    union {
+	reading_get_info_t reading;
+	states_get_info_t  states;
+    } u;
+} sensor_bulk_item_t;
+
+struct sensor_bulk_s
+{
+    ipmi_lock_t               *lock;
+
+    unsigned int              count;
+    unsigned int              next;
+    unsigned int              in_flight;
+
+    ipmi_sensor_bulk_result_t *results;
+    ipmi_states_t             *states;
+    sensor_bulk_item_t        *items;
+
+    ipmi_sensor_bulk_read_cb  done;
+    void                      *cb_data;
+};
+
+static void
+sensor_bulk_free(sensor_bulk_t *bulk)
+{
+    if (bulk->lock)
+	ipmi_destroy_lock(bulk->lock);
+    if (bulk->results)
+	ipmi_mem_free(bulk->results);
+    if (bulk->states)
+	ipmi_mem_free(bulk->states);
+    if (bulk->items)
+	ipmi_mem_free(bulk->items);
+    ipmi_mem_free(bulk);
+}
+
+static void sensor_bulk_item_done(sensor_bulk_item_t *item);
+
+static void
+sensor_bulk_reading_done(ipmi_sensor_t             *sensor,
+			 int                       err,
+			 enum ipmi_value_present_e value_present,
+			 unsigned int              raw_value,
+			 double                    val,
+			 ipmi_states_t             *states,
+			 void                      *cb_data)
+{
+    sensor_bulk_item_t        *item = cb_data;
+    ipmi_sensor_bulk_result_t *result = &item->bulk->results[item->idx];
+
+    result->err = err;
+    if (!err) {
+	result->value_present = value_present;
+	result->raw_value = raw_value;
+	result->val = val;
+	*result->states = *states;
+    }
+    sensor_bulk_item_done(item);
+}
+
+static void
+sensor_bulk_states_done(ipmi_sensor_t *sensor,
+			int           err,
+			ipmi_states_t *states,
+			void          *cb_data)
+{
+    sensor_bulk_item_t        *item = cb_data;
+    ipmi_sensor_bulk_result_t *result = &item->bulk->results[item->idx];
+
+    result->err = err;
+    if (!err)
+	*result->states = *states;
+    sensor_bulk_item_done(item);
+}
+
+static void
+sensor_bulk_start_cb(ipmi_sensor_t *sensor, void *cb_data)
+{
+    sensor_bulk_item_t *item = cb_data;
+    int                rv;
+
+    if (!sensor_ok_to_use(sensor)) {
+	rv = ECANCELED;
+    } else if (sensor->event_reading_type
+	       == IPMI_EVENT_READING_TYPE_THRESHOLD)
+    {
+	if (sensor->cbs.ipmi_sensor_get_reading
+	    == stand_ipmi_sensor_get_reading)
+	{
+	    reading_get_info_t *info = &item->u.reading;
+
+	    if (!sensor->readable) {
+		rv = ENOSYS;
+	    } else {
+		reading_get_info_init(info, sensor_bulk_reading_done, item, 1);
+		rv = ipmi_sensor_add_opq(sensor, reading_get_start,
+					 &info->sdata, info);
+	    }
+	} else {
+	    rv = ipmi_sensor_get_reading(sensor, sensor_bulk_reading_done,
+					 item);
+	}
+    } else {
+	if (sensor->cbs.ipmi_sensor_get_states
+	    == stand_ipmi_sensor_get_states)
+	{
+	    states_get_info_t *info = &item->u.states;
+
+	    if (!sensor->readable) {
+		rv = ENOSYS;
+	    } else {
+		info->done = sensor_bulk_states_done;
+		info->cb_data = item;
+		info->no_free = 1;
+		ipmi_init_states(&info->states);
+		rv = ipmi_sensor_add_opq(sensor, states_get_start,
+					 &info->sdata, info);
+	    }
+	} else {
+	    rv = ipmi_sensor_get_states(sensor, sensor_bulk_states_done,
+					item);
+	}
+    }
+
+    item->start_err = rv;
+}
+
+/* Start reads until the window is full.  Must be called with the bulk
+   lock held. */
+static void
+sensor_bulk_start_next(sensor_bulk_t *bulk)
+{
+    sensor_bulk_item_t        *item;
+    ipmi_sensor_bulk_result_t *result;
+    int                       rv;
+
+    while ((bulk->next < bulk->count)
+	   && (bulk->in_flight < SENSOR_BULK_WINDOW))
+    {
+	item = &bulk->items[bulk->next];
+	result = &bulk->results[bulk->next];
+	bulk->next++;
+	bulk->in_flight++;
+	ipmi_unlock(bulk->lock);
+
+	item->start_err = 0;
+	rv = ipmi_sensor_pointer_cb(result->sensor_id, sensor_bulk_start_cb,
+				    item);
+	if (!rv)
+	    rv = item->start_err;
+	if (rv) {
+	    /* The read never started, so there is no callback coming. */
+	    result->err = rv;
+	    ipmi_lock(bulk->lock);
+	    bulk->in_flight--;
+	} else {
+	    ipmi_lock(bulk->lock);
+	}
+    }
+}
+
+/* Called with the bulk lock held, releases it. */
+static void
+sensor_bulk_check_done(sensor_bulk_t *bulk)
+{
+    if (bulk->in_flight || (bulk->next < bulk->count)) {
+	ipmi_unlock(bulk->lock);
+	return;
+    }
+    ipmi_unlock(bulk->lock);
+
+    bulk->done(bulk->results, bulk->count, bulk->cb_data);
+    sensor_bulk_free(bulk);
+}
+
+static void
+sensor_bulk_item_done(sensor_bulk_item_t *item)
+{
+    sensor_bulk_t *bulk = item->bulk;
+
+    /* Keep counting this read until the next ones are started, so the
+       bulk read can't complete (from another thread) under us. */
+    ipmi_lock(bulk->lock);
+    sensor_bulk_start_next(bulk);
+    bulk->in_flight--;
+    sensor_bulk_check_done(bulk);
+}
+
+int
+ipmi_mc_read_sensors_bulk(ipmi_mc_t                *mc,
+			  ipmi_sensor_id_t         *sensor_ids,
+			  unsigned int             num_ids,
+			  ipmi_sensor_bulk_read_cb done,
+			  void                     *cb_data)
+{
+    ipmi_sensor_info_t *sensors = i_ipmi_mc_get_sensors(mc);
+    sensor_bulk_t      *bulk;
+    unsigned int       i, j, count;
+    int                rv;
+
+    CHECK_MC_LOCK(mc);
+
+    if (!done)
+	return EINVAL;
+
+    bulk = ipmi_mem_alloc(sizeof(*bulk));
+    if (!bulk)
+	return ENOMEM;
+    memset(bulk, 0, sizeof(*bulk));
+    bulk->done = done;
+    bulk->cb_data = cb_data;
+
+    rv = ipmi_create_lock(ipmi_mc_get_domain(mc), &bulk->lock);
+    if (rv)
+	goto out_err;
+
+    /* Figure out how many we have, when reading the whole MC the
+       sensors can come and go, so this is done under the lock. */
+    if (!sensor_ids) {
+	ipmi_lock(sensors->idx_lock);
+	count = 0;
+	for (i=0; i<5; i++) {
+	    for (j=0; j<sensors->idx_size[i]; j++) {
+		ipmi_sensor_t *sensor = sensors->sensors_by_idx[i][j];
+		if (sensor && sensor->readable && !sensor->destroyed)
+		    count++;
+	    }
+	}
+    } else {
+	count = num_ids;
+    }
+
+    if (count == 0) {
+	rv = EINVAL;
+	goto out_err_unlock;
+    }
+
+    bulk->results = ipmi_mem_alloc(sizeof(*bulk->results) * count);
+    bulk->states = ipmi_mem_alloc(sizeof(*bulk->states) * count);
+    bulk->items = ipmi_mem_alloc(sizeof(*bulk->items) * count);
+    if (!bulk->results || !bulk->states || !bulk->items) {
+	rv = ENOMEM;
+	goto out_err_unlock;
+    }
+    memset(bulk->results, 0, sizeof(*bulk->results) * count);
+    bulk->count = count;
+
+    for (i=0; i<count; i++) {
+	bulk->items[i].bulk = bulk;
+	bulk->items[i].idx = i;
+	bulk->results[i].value_present = IPMI_NO_VALUES_PRESENT;
+	bulk->results[i].states = &bulk->states[i];
+	ipmi_init_states(&bulk->states[i]);
+    }
+
+    if (!sensor_ids) {
+	count = 0;
+	for (i=0; i<5; i++) {
+	    for (j=0; j<sensors->idx_size[i]; j++) {
+		ipmi_sensor_t *sensor = sensors->sensors_by_idx[i][j];
+		if (sensor && sensor->readable && !sensor->destroyed)
+		    bulk->results[count++].sensor_id
+			= ipmi_sensor_convert_to_id(sensor);
+	    }
+	}
+	ipmi_unlock(sensors->idx_lock);
+    } else {
+	for (i=0; i<count; i++)
+	    bulk->results[i].sensor_id = sensor_ids[i];
+    }
+
+    /* Hold an extra in_flight so reads that finish right away don't
+       complete the whole thing while we are still starting them. */
+    ipmi_lock(bulk->lock);
+    bulk->in_flight = 1;
+    sensor_bulk_start_next(bulk);
+    bulk->in_flight--;
+    sensor_bulk_check_done(bulk);
+
+    return 0;
+
+ out_err_unlock:
+    if (!sensor_ids)
+	ipmi_unlock(sensors->idx_lock);
+ out_err:
+    sensor_bulk_free(bulk);
+    return rv;
+}
+
 #ifdef IPMI_CHECK_LOCKS
 void
 i__ipmi_check_sensor_lock(const ipmi_sensor_t *sensor)
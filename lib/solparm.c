@@ -466,6 +466,7 @@ typedef struct solparm_fetch_handler_s
     unsigned char       *data;
     unsigned int        data_len;
     int                 rv;
+    int                 queued; /* Went through the opq */
 } solparm_fetch_handler_t;
 
 /* This should be called with the solparm locked.  It will unlock the solparm
@@ -473,6 +474,8 @@ typedef struct solparm_fetch_handler_s
 static void
 fetch_complete(ipmi_solparm_t *solparm, int err, solparm_fetch_handler_t *elem)
 {
+    int queued = elem->queued;
+
     if (solparm->in_destroy)
 	goto out;
 
@@ -483,7 +486,7 @@ fetch_complete(ipmi_solparm_t *solparm, int err, solparm_fetch_handler_t *elem)
 
     ipmi_mem_free(elem);
 
-    if (!solparm->destroyed)
+    if (queued && !solparm->destroyed)
 	opq_op_done(solparm->opq);
 
     solparm_put(solparm);
@@ -586,13 +589,19 @@ start_config_fetch(void *cb_data, int shutdown)
     return OPQ_HANDLER_STARTED;
 }
 
-int
-ipmi_solparm_get_parm(ipmi_solparm_t      *solparm,
-		      unsigned int	  parm,
-		      unsigned int	  set,
-		      unsigned int	  block,
-		      ipmi_solparm_get_cb done,
-		      void                *cb_data)
+/*
+ * If queued is false, the fetch is started right away instead of
+ * waiting its turn in the opq, so more than one can be outstanding.
+ * That is only for the reads done by ipmi_sol_get_config().
+ */
+static int
+solparm_get_parm(ipmi_solparm_t      *solparm,
+		 unsigned int	     parm,
+		 unsigned int	     set,
+		 unsigned int	     block,
+		 ipmi_solparm_get_cb done,
+		 void                *cb_data,
+		 int                 queued)
 {
     solparm_fetch_handler_t *elem;
     int                 rv = 0;
@@ -615,6 +624,13 @@ ipmi_solparm_get_parm(ipmi_solparm_t      *solparm,
     elem->set = set;
     elem->block = block;
     elem->rv = 0;
+    elem->queued = queued;
+
+    if (!queued) {
+	solparm_get(solparm);
+	start_config_fetch(elem, 0);
+	return 0;
+    }
 
     if (!opq_new_op(solparm->opq, start_config_fetch, elem, 0))
 	rv = ENOMEM;
@@ -627,6 +643,17 @@ ipmi_solparm_get_parm(ipmi_solparm_t      *solparm,
     return rv;
 }
 
+int
+ipmi_solparm_get_parm(ipmi_solparm_t      *solparm,
+		      unsigned int	  parm,
+		      unsigned int	  set,
+		      unsigned int	  block,
+		      ipmi_solparm_get_cb done,
+		      void                *cb_data)
+{
+    return solparm_get_parm(solparm, parm, set, block, done, cb_data, 1);
+}
+
 typedef struct solparm_set_handler_s
 {
     ipmi_solparm_t 	 *solparm;
@@ -795,12 +822,33 @@ ipmi_solparm_set_parm(ipmi_solparm_t       *solparm,
     return rv;
 }
 
+/*
+ * A parameter to fetch for ipmi_sol_get_config().  These are sent
+ * SOLPARM_FETCH_WINDOW at a time.
+ */
+#define SOLPARM_FETCH_WINDOW 8
+typedef struct sol_fetch_s
+{
+    ipmi_sol_config_t  *solc;
+    unsigned char      parm;
+    struct sol_fetch_s *next;
+} sol_fetch_t;
+
 struct ipmi_sol_config_s
 {
     /* Stuff for getting/setting the values. */
     int curr_parm;
     int curr_sel;
 
+    /* Fetches not yet sent, and the number sent but not answered.
+       Protected by the solparm lock. */
+    sol_fetch_t *fetch_head, *fetch_tail;
+    int         fetch_outstanding;
+    int         fetch_running;
+    /* Set by whoever decides the fetch is over, only that caller may
+       touch the config after dropping the lock. */
+    int         fetch_done;
+
     /* Not used for access, just for checking validity. */
     ipmi_solparm_t *my_sol;
 
@@ -1026,6 +1074,134 @@ err_lock_cleared(ipmi_solparm_t *solparm,
     solparm_put(solparm);
 }
 
+static int
+solc_fetch_add(ipmi_sol_config_t *solc, unsigned int parm)
+{
+    sol_fetch_t *ent;
+
+    ent = ipmi_mem_alloc(sizeof(*ent));
+    if (!ent)
+	return ENOMEM;
+    ent->solc = solc;
+    ent->parm = parm;
+    ent->next = NULL;
+    if (solc->fetch_tail)
+	solc->fetch_tail->next = ent;
+    else
+	solc->fetch_head = ent;
+    solc->fetch_tail = ent;
+    return 0;
+}
+
+/* Called when nothing is outstanding any more. */
+static void
+solc_fetch_done(ipmi_solparm_t *solparm, ipmi_sol_config_t *solc)
+{
+    sol_fetch_t *ent;
+    int         err;
+
+    while ((ent = solc->fetch_head)) {
+	solc->fetch_head = ent->next;
+	ipmi_mem_free(ent);
+    }
+    solc->fetch_tail = NULL;
+
+    if (solc->err) {
+	unsigned char data[1];
+
+	/* Clear the lock */
+	data[0] = 0;
+	err = ipmi_solparm_set_parm(solparm, 0, data, 1,
+				    err_lock_cleared, solc);
+	if (err) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "solparm.c(solc_fetch_done): Error trying to clear lock:"
+		     " %x",
+		     err);
+	    solc->done(solparm, solc->err, NULL, solc->cb_data);
+	    ipmi_sol_free_config(solc);
+	    solparm->locked = 0;
+	    solparm_put(solparm);
+	}
+    } else {
+	solc->done(solparm, 0, solc, solc->cb_data);
+	solparm_put(solparm);
+    }
+}
+
+static void got_parm(ipmi_solparm_t *solparm, int err, unsigned char *data,
+		     unsigned int data_len, void *cb_data);
+
+/*
+ * Send fetches until the window is full.  Only one caller runs the
+ * loop at a time, a response that comes in while it is sending just
+ * updates the state and the loop picks that up.  Must be called with
+ * the solparm lock held, it is released.  Completion is decided once,
+ * under the lock, and the config must not be touched after this
+ * returns since whoever completed it may have freed it.
+ */
+static void
+solc_fetch_next(ipmi_solparm_t *solparm, ipmi_sol_config_t *solc)
+{
+    sol_fetch_t *ent;
+    int         rv;
+    int         finished;
+
+    if (solc->fetch_running || solc->fetch_done) {
+	solparm_unlock(solparm);
+	return;
+    }
+    solc->fetch_running = 1;
+    while (!solc->err && solc->fetch_head
+	   && (solc->fetch_outstanding < SOLPARM_FETCH_WINDOW))
+    {
+	ent = solc->fetch_head;
+	solc->fetch_head = ent->next;
+	if (!solc->fetch_head)
+	    solc->fetch_tail = NULL;
+	solc->fetch_outstanding++;
+	solparm_unlock(solparm);
+	rv = solparm_get_parm(solparm, ent->parm, 0, 0, got_parm, ent, 0);
+	solparm_lock(solparm);
+	if (rv) {
+	    ipmi_log(IPMI_LOG_ERR_INFO,
+		     "solparm.c(solc_fetch_next): Error trying to get parm"
+		     " %d: %x",
+		     ent->parm, rv);
+	    ipmi_mem_free(ent);
+	    solc->fetch_outstanding--;
+	    if (!solc->err)
+		solc->err = rv;
+	}
+    }
+    solc->fetch_running = 0;
+    finished = ((solc->fetch_outstanding == 0)
+		&& (solc->err || !solc->fetch_head));
+    if (finished)
+	solc->fetch_done = 1;
+    solparm_unlock(solparm);
+
+    if (finished)
+	solc_fetch_done(solparm, solc);
+}
+
+/* Errors are reported through the done handler. */
+static void
+solc_fetch_start(ipmi_solparm_t *solparm, ipmi_sol_config_t *solc)
+{
+    int i;
+
+    for (i=1; i<NUM_SOLPARMS; i++) {
+	if (!solparms[i].valid)
+	    continue;
+	solc->err = solc_fetch_add(solc, i);
+	if (solc->err)
+	    break;
+    }
+    solparm_lock(solparm);
+    solc_fetch_next(solparm, solc);
+}
+
 static void
 got_parm(ipmi_solparm_t    *solparm,
 	 int               err,
@@ -1033,8 +1209,19 @@ got_parm(ipmi_solparm_t    *solparm,
 	 unsigned int      data_len,
 	 void              *cb_data)
 {
-    ipmi_sol_config_t *solc = cb_data;
-    solparms_t        *lp = &(solparms[solc->curr_parm]);
+    sol_fetch_t       *ent = cb_data;
+    ipmi_sol_config_t *solc = ent->solc;
+    solparms_t        *lp = &(solparms[ent->parm]);
+
+    solparm_lock(solparm);
+    solc->fetch_outstanding--;
+    if (solc->err)
+	/* Already failed, just waiting for the rest to come back. */
+	goto out;
+
+    /* The get handlers and error logs use these. */
+    solc->curr_parm = ent->parm;
+    solc->curr_sel = 0;
 
     /* Check the length, and don't forget the revision byte must be added. */
     if ((!err) && (data_len < (unsigned int) (lp->length+1))) {
@@ -1042,14 +1229,14 @@ got_parm(ipmi_solparm_t    *solparm,
 	    /* Some systems return zero-length data for optional parms. */
 	    unsigned char *opt = ((unsigned char *)solc) + lp->optional_offset;
 	    *opt = 0;
-	    goto next_parm;
+	    goto out;
 	}
 	ipmi_log(IPMI_LOG_ERR_INFO,
 		 "solparm.c(got_parm): "
 		 " Invalid data length on parm %d was %d, should have been %d",
 		 solc->curr_parm, data_len, lp->length+1);
 	err = EINVAL;
-	goto done;
+	goto out_err;
     }
 
     err = lp->get_handler(solc, lp, err, data);
@@ -1058,54 +1245,22 @@ got_parm(ipmi_solparm_t    *solparm,
 		 "solparm.c(got_parm): "
 		 "Error fetching parm %d: %x",
 		 solc->curr_parm, err);
-	goto done;
-    }
-
- next_parm:
-    switch (solc->curr_parm) {
-    case IPMI_SOLPARM_PAYLOAD_PORT_NUMBER:
-	goto done;
-    default:
-	solc->curr_parm++;
+	goto out_err;
     }
 
-    lp = &(solparms[solc->curr_parm]);
-    if (!lp->valid)
-	goto next_parm;
-
-    err = ipmi_solparm_get_parm(solparm, solc->curr_parm, solc->curr_sel, 0,
-				got_parm, solc);
-    if (err)
-	goto done;
-
+ out:
+    /* Keep the lock, the outstanding count must not reach zero where
+       another thread can complete the fetch before we look at it. */
+    ipmi_mem_free(ent);
+    solc_fetch_next(solparm, solc);
     return;
 
- done:
-    if (err) {
-	unsigned char data[1];
-
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "solparm.c(got_parm): Error trying to get parm %d: %x",
-		 solc->curr_parm, err);
-	solc->err = err;
-	/* Clear the lock */
-	data[0] = 0;
-	err = ipmi_solparm_set_parm(solparm, 0, data, 1,
-				    err_lock_cleared, solc);
-	if (err) {
-	    ipmi_sol_free_config(solc);
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "solparm.c(got_parm): Error trying to clear lock: %x",
-		     err);
-	    solc->done(solparm, solc->err, NULL, solc->cb_data);
-	    ipmi_sol_free_config(solc);
-	    solparm->locked = 0;
-	    solparm_put(solparm);
-	}
-    } else {
-	solc->done(solparm, 0, solc, solc->cb_data);
-	solparm_put(solparm);
-    }
+ out_err:
+    ipmi_log(IPMI_LOG_ERR_INFO,
+	     "solparm.c(got_parm): Error trying to get parm %d: %x",
+	     solc->curr_parm, err);
+    solc->err = err;
+    goto out;
 }
 
 static void 
@@ -1114,7 +1269,6 @@ lock_done(ipmi_solparm_t *solparm,
 	  void           *cb_data)
 {
     ipmi_sol_config_t *solc = cb_data;
-    int               rv;
 
     if (err == IPMI_IPMI_ERR_VAL(0x80)) {
 	/* Lock is not supported, just mark it and go on. */
@@ -1139,29 +1293,7 @@ lock_done(ipmi_solparm_t *solparm,
 	solparm->locked = 1;
     }
 
-    rv = ipmi_solparm_get_parm(solparm, solc->curr_parm, solc->curr_sel, 0,
-			       got_parm, solc);
-    if (rv) {
-	unsigned char data[1];
-	ipmi_log(IPMI_LOG_ERR_INFO,
-		 "solparm.c(lock_done): Error trying to get parms: %x",
-		 err);
-
-	solc->err = rv;
-	/* Clear the lock */
-	data[0] = 0;
-	rv = ipmi_solparm_set_parm(solparm, 0, data, 1,
-				   err_lock_cleared, solc);
-	if (rv) {
-	    ipmi_log(IPMI_LOG_ERR_INFO,
-		     "solparm.c(lock_done): Error trying to clear lock: %x",
-		     err);
-	    solc->done(solparm, solc->err, NULL, solc->cb_data);
-	    ipmi_sol_free_config(solc);
-	    solparm->locked = 0;
-	    solparm_put(solparm);
-	}
-    }
+    solc_fetch_start(solparm, solc);
 }
 
 int ipmi_sol_get_config(ipmi_solparm_t         *solparm,
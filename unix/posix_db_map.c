@@ -0,0 +1,226 @@
+/*
+ * posix_db_map.c
+ *
+ * Mappable database entries for the POSIX OS handlers.
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2002 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "posix_db_map.h"
+
+/*
+ * Each entry is a plain file named by its key in a cache directory,
+ * $HOME/.OpenIPMI_db.d by default (or the database filename with
+ * ".d" added if one is set).  Entries are written to a temporary file
+ * and renamed into place, so anyone with the old file mapped keeps
+ * seeing the old data.  This is built into both OS handler libraries,
+ * the directory name is kept by the handler and passed in.
+ */
+
+#define DB_MAP_DIR ".OpenIPMI_db.d"
+
+typedef struct posix_db_map_s
+{
+    void   *addr;
+    size_t len;
+} posix_db_map_t;
+
+int
+posix_db_map_set_filename(char **map_dir, const char *name)
+{
+    char *nname;
+
+    nname = malloc(strlen(name) + 3);
+    if (!nname)
+	return ENOMEM;
+    strcpy(nname, name);
+    strcat(nname, ".d");
+    if (*map_dir)
+	free(*map_dir);
+    *map_dir = nname;
+    return 0;
+}
+
+/* Get the path for the key's file, returns NULL on error. */
+static char *
+posix_db_map_path(char **map_dir, const char *key, const char *suffix)
+{
+    const char *s;
+    char       *path;
+
+    /* Keys become file names, keep them to something safe. */
+    if (!*key)
+	return NULL;
+    for (s = key; *s; s++) {
+	if (!(((*s >= 'a') && (*s <= 'z')) || ((*s >= 'A') && (*s <= 'Z'))
+	      || ((*s >= '0') && (*s <= '9')) || (*s == '-') || (*s == '_')))
+	    return NULL;
+    }
+
+    if (!*map_dir) {
+	char *home = getenv("HOME");
+
+	if (!home)
+	    return NULL;
+	*map_dir = malloc(strlen(home) + strlen(DB_MAP_DIR) + 2);
+	if (!*map_dir)
+	    return NULL;
+	strcpy(*map_dir, home);
+	strcat(*map_dir, "/");
+	strcat(*map_dir, DB_MAP_DIR);
+    }
+
+    path = malloc(strlen(*map_dir) + strlen(key) + strlen(suffix) + 2);
+    if (!path)
+	return NULL;
+    sprintf(path, "%s/%s%s", *map_dir, key, suffix);
+    return path;
+}
+
+int
+posix_db_map_store(char          **map_dir,
+		   char          *key,
+		   unsigned char *data,
+		   unsigned int  data_len)
+{
+    char    *path, *tmppath;
+    int     fd;
+    ssize_t rv;
+    int     err = 0;
+
+    path = posix_db_map_path(map_dir, key, "");
+    if (!path)
+	return EINVAL;
+    tmppath = posix_db_map_path(map_dir, key, ".XXXXXX");
+    if (!tmppath) {
+	free(path);
+	return EINVAL;
+    }
+
+    /* It's fine if this already exists. */
+    mkdir(*map_dir, 0700);
+
+    fd = mkstemp(tmppath);
+    if (fd == -1) {
+	err = errno;
+	goto out;
+    }
+    while (data_len > 0) {
+	rv = write(fd, data, data_len);
+	if (rv == -1) {
+	    if (errno == EINTR)
+		continue;
+	    err = errno;
+	    break;
+	}
+	data += rv;
+	data_len -= rv;
+    }
+    close(fd);
+    if (!err && (rename(tmppath, path) == -1))
+	err = errno;
+    if (err)
+	unlink(tmppath);
+
+ out:
+    free(tmppath);
+    free(path);
+    return err;
+}
+
+int
+posix_db_map(char                **map_dir,
+	     char                *key,
+	     const unsigned char **data,
+	     unsigned int        *data_len,
+	     void                **map_id)
+{
+    char           *path;
+    int            fd;
+    struct stat    st;
+    posix_db_map_t *map;
+    int            err = 0;
+
+    path = posix_db_map_path(map_dir, key, "");
+    if (!path)
+	return EINVAL;
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd == -1)
+	return errno;
+
+    if (fstat(fd, &st) == -1) {
+	err = errno;
+	goto out;
+    }
+    if ((st.st_size == 0) || (st.st_size > 0x7fffffff)) {
+	err = EINVAL;
+	goto out;
+    }
+
+    map = malloc(sizeof(*map));
+    if (!map) {
+	err = ENOMEM;
+	goto out;
+    }
+    map->len = st.st_size;
+    map->addr = mmap(NULL, map->len, PROT_READ, MAP_SHARED, fd, 0);
+    if (map->addr == MAP_FAILED) {
+	err = errno;
+	free(map);
+	goto out;
+    }
+
+    *data = map->addr;
+    *data_len = map->len;
+    *map_id = map;
+ out:
+    close(fd);
+    return err;
+}
+
+void
+posix_db_unmap(void *map_id)
+{
+    posix_db_map_t *map = map_id;
+
+    munmap(map->addr, map->len);
+    free(map);
+}
@@ -0,0 +1,54 @@
+/*
+ * posix_db_map.h
+ *
+ * Mappable database entries for the POSIX OS handlers.
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2002 MontaVista Software Inc.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef OPENIPMI_POSIX_DB_MAP_H
+#define OPENIPMI_POSIX_DB_MAP_H
+
+/*
+ * Mappable database entries shared by the POSIX OS handlers.  The
+ * handler owns *map_dir and must serialize calls that share it.
+ */
+
+int posix_db_map_set_filename(char **map_dir, const char *name);
+int posix_db_map_store(char          **map_dir,
+		       char          *key,
+		       unsigned char *data,
+		       unsigned int  data_len);
+int posix_db_map(char                **map_dir,
+		 char                *key,
+		 const unsigned char **data,
+		 unsigned int        *data_len,
+		 void                **map_id);
+void posix_db_unmap(void *map_id);
+
+#endif /* OPENIPMI_POSIX_DB_MAP_H */
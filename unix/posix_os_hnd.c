@@ -50,6 +50,8 @@
 
 #include <OpenIPMI/ipmi_posix.h>
 
+#include "posix_db_map.h"
+
 typedef struct iposix_info_s
 {
     struct selector_s *sel;
@@ -58,6 +60,7 @@ typedef struct iposix_info_s
     char *gdbm_filename;
     GDBM_FILE gdbmf;
 #endif
+    char *db_map_dir;
 } iposix_info_t;
 
 struct os_hnd_fd_id_s
@@ -69,6 +72,7 @@ struct os_hnd_fd_id_s
     os_data_ready_t except_ready;
     os_handler_t    *handler;
     os_fd_data_freed_t freed;
+    os_dgram_ready_t dgram_ready;
 };
 
 static void
@@ -141,6 +145,58 @@ add_fd(os_handler_t       *handler,
     return 0;
 }
 
+static void
+fd_dgram_handler(int fd, void *data, unsigned char *buf, unsigned int len,
+		 void *addr, unsigned int addr_len)
+{
+    os_hnd_fd_id_t *fd_data = (os_hnd_fd_id_t *) data;
+
+    fd_data->dgram_ready(fd, fd_data->cb_data, fd_data, buf, len,
+			 addr, addr_len);
+}
+
+static int
+add_dgram_fd(os_handler_t       *handler,
+	     int                fd,
+	     os_dgram_ready_t   dgram_ready,
+	     void               *cb_data,
+	     os_fd_data_freed_t freed,
+	     os_hnd_fd_id_t     **id)
+{
+    os_hnd_fd_id_t   *fd_data;
+    int              rv;
+    iposix_info_t  *info = handler->internal_data;
+    struct selector_s *posix_sel = info->sel;
+
+    fd_data = malloc(sizeof(*fd_data));
+    if (!fd_data)
+	return ENOMEM;
+    memset(fd_data, 0, sizeof(*fd_data));
+
+    fd_data->fd = fd;
+    fd_data->cb_data = cb_data;
+    fd_data->dgram_ready = dgram_ready;
+    fd_data->handler = handler;
+    fd_data->freed = freed;
+    rv = sel_set_fd_handlers(posix_sel, fd, fd_data, NULL, NULL, NULL,
+			     free_fd_data);
+    if (rv) {
+	free(fd_data);
+	return rv;
+    }
+    rv = sel_set_fd_dgram_handler(posix_sel, fd, fd_dgram_handler);
+    if (rv) {
+	/* Nothing is enabled, so this won't call free_fd_data. */
+	sel_clear_fd_handlers_imm(posix_sel, fd);
+	free(fd_data);
+	return rv;
+    }
+    sel_set_fd_read_handler(posix_sel, fd, SEL_FD_HANDLER_ENABLED);
+
+    *id = fd_data;
+    return 0;
+}
+
 static int
 remove_fd(os_handler_t *handler, os_hnd_fd_id_t *fd_data)
 {
@@ -526,10 +582,14 @@ database_free(os_handler_t  *handler,
     free(data);
 }
 
+#endif
+
 static int
-set_gdbm_filename(os_handler_t *os_hnd, char *name)
+set_db_filename(os_handler_t *os_hnd, char *name)
 {
     iposix_info_t *info = os_hnd->internal_data;
+    int           rv;
+#ifdef HAVE_GDBM
     char          *nname;
 
     nname = strdup(name);
@@ -538,10 +598,41 @@ set_gdbm_filename(os_handler_t *os_hnd, char *name)
     if (info->gdbm_filename)
 	free(info->gdbm_filename);
     info->gdbm_filename = nname;
-    return 0;
-}
 #endif
 
+    rv = posix_db_map_set_filename(&info->db_map_dir, name);
+    return rv;
+}
+
+static int
+database_map_store(os_handler_t  *handler,
+		   char          *key,
+		   unsigned char *data,
+		   unsigned int  data_len)
+{
+    iposix_info_t *info = handler->internal_data;
+
+    return posix_db_map_store(&info->db_map_dir, key, data, data_len);
+}
+
+static int
+database_map(os_handler_t        *handler,
+	     char                *key,
+	     const unsigned char **data,
+	     unsigned int        *data_len,
+	     void                **map_id)
+{
+    iposix_info_t *info = handler->internal_data;
+
+    return posix_db_map(&info->db_map_dir, key, data, data_len, map_id);
+}
+
+static void
+database_unmap(os_handler_t *handler, void *map_id)
+{
+    posix_db_unmap(map_id);
+}
+
 static void sset_log_handler(os_handler_t *handler,
 			     os_vlog_t    log_handler)
 {
@@ -598,11 +689,15 @@ static os_handler_t ipmi_posix_os_handler =
     .database_store = database_store,
     .database_find = database_find,
     .database_free = database_free,
-    .database_set_filename = set_gdbm_filename,
 #endif
+    .database_set_filename = set_db_filename,
     .set_log_handler = sset_log_handler,
     .get_monotonic_time = get_monotonic_time,
-    .get_real_time = get_real_time
+    .get_real_time = get_real_time,
+    .database_map_store = database_map_store,
+    .database_map = database_map,
+    .database_unmap = database_unmap,
+    .add_dgram_fd_to_wait_for = add_dgram_fd
 };
 
 os_handler_t *
@@ -640,6 +735,8 @@ ipmi_posix_free_os_handler(os_handler_t *os_hnd)
     if (info->gdbmf)
 	gdbm_close(info->gdbmf);
 #endif
+    if (info->db_map_dir)
+	free(info->db_map_dir);
     free(info);
     free(os_hnd);
 }
@@ -660,6 +757,12 @@ ipmi_posix_os_handler_get_sel(os_handler_t *os_hnd)
 
 os_handler_t *
 ipmi_posix_setup_os_handler(void)
+{
+    return ipmi_posix_setup_os_handler_opts(0);
+}
+
+os_handler_t *
+ipmi_posix_setup_os_handler_opts(unsigned int sel_opts)
 {
     os_handler_t  *os_hnd;
     struct selector_s *sel;
@@ -670,7 +773,8 @@ ipmi_posix_setup_os_handler(void)
     if (!os_hnd)
 	return NULL;
 
-    rv = sel_alloc_selector_nothread(&sel);
+    rv = sel_alloc_selector_thread_opts(&sel, 0, NULL, NULL, NULL, NULL,
+					NULL, sel_opts);
     if (rv) {
 	ipmi_posix_free_os_handler(os_hnd);
 	os_hnd = NULL;
@@ -57,6 +57,8 @@
 
 #include <OpenIPMI/internal/ipmi_int.h>
 
+#include "posix_db_map.h"
+
 static void i_posix_lock(pthread_mutex_t *lock)
 {
     int rv = pthread_mutex_lock(lock);
@@ -78,14 +80,39 @@ typedef struct pt_os_hnd_data_s
     struct selector_s *sel;
     os_vlog_t        log_handler;
     int              wake_sig;
+    unsigned int     sel_opts;
     struct sigaction oldact;
 #ifdef HAVE_GDBM
     char *gdbm_filename;
     GDBM_FILE gdbmf;
     pthread_mutex_t gdbm_lock;
 #endif
+    char *db_map_dir;
+    pthread_mutex_t db_map_lock;
+
+    /* The data holding the logging and database state, this points
+       to itself except in shards. */
+    struct pt_os_hnd_data_s *root;
+
+    /* Shards, in the root only. */
+    unsigned int    num_shards;
+    unsigned int    next_shard;
+    os_handler_t    **shards;
+    pthread_mutex_t shard_lock;
+
+    /* The thread running a shard's selector. */
+    pthread_t       thread;
+    volatile int    stop;
 } pt_os_hnd_data_t;
 
+static pt_os_hnd_data_t *
+pt_root(os_handler_t *handler)
+{
+    pt_os_hnd_data_t *info = handler->internal_data;
+
+    return info->root;
+}
+
 
 struct os_hnd_fd_id_s
 {
@@ -94,6 +121,7 @@ struct os_hnd_fd_id_s
     os_data_ready_t data_ready;
     os_handler_t    *handler;
     os_fd_data_freed_t freed;
+    os_dgram_ready_t dgram_ready;
 };
 
 static void
@@ -152,6 +180,58 @@ add_fd(os_handler_t       *handler,
     return 0;
 }
 
+static void
+fd_dgram_handler(int fd, void *data, unsigned char *buf, unsigned int len,
+		 void *addr, unsigned int addr_len)
+{
+    os_hnd_fd_id_t *fd_data = (os_hnd_fd_id_t *) data;
+
+    fd_data->dgram_ready(fd, fd_data->cb_data, fd_data, buf, len,
+			 addr, addr_len);
+}
+
+static int
+add_dgram_fd(os_handler_t       *handler,
+	     int                fd,
+	     os_dgram_ready_t   dgram_ready,
+	     void               *cb_data,
+	     os_fd_data_freed_t freed,
+	     os_hnd_fd_id_t     **id)
+{
+    os_hnd_fd_id_t   *fd_data;
+    int              rv;
+    pt_os_hnd_data_t *info = handler->internal_data;
+    struct selector_s *posix_sel = info->sel;
+
+    fd_data = malloc(sizeof(*fd_data));
+    if (!fd_data)
+	return ENOMEM;
+    memset(fd_data, 0, sizeof(*fd_data));
+
+    fd_data->fd = fd;
+    fd_data->cb_data = cb_data;
+    fd_data->dgram_ready = dgram_ready;
+    fd_data->handler = handler;
+    fd_data->freed = freed;
+    rv = sel_set_fd_handlers(posix_sel, fd, fd_data, NULL, NULL, NULL,
+			     free_fd_data);
+    if (rv) {
+	free(fd_data);
+	return rv;
+    }
+    rv = sel_set_fd_dgram_handler(posix_sel, fd, fd_dgram_handler);
+    if (rv) {
+	/* Nothing is enabled, so this won't call free_fd_data. */
+	sel_clear_fd_handlers_imm(posix_sel, fd);
+	free(fd_data);
+	return rv;
+    }
+    sel_set_fd_read_handler(posix_sel, fd, SEL_FD_HANDLER_ENABLED);
+
+    *id = fd_data;
+    return 0;
+}
+
 static int
 remove_fd(os_handler_t *handler, os_hnd_fd_id_t *fd_data)
 {
@@ -372,7 +452,7 @@ sposix_vlog(os_handler_t         *handler,
 	    const char           *format,
 	    va_list              ap)
 {
-    pt_os_hnd_data_t *info = handler->internal_data;
+    pt_os_hnd_data_t *info = pt_root(handler);
     os_vlog_t        log_handler = info->log_handler;
 
     if (log_handler)
@@ -616,6 +696,9 @@ ipmi_posix_thread_free_os_handler(os_handler_t *os_hnd)
     if (info->gdbmf)
 	gdbm_close(info->gdbmf);
 #endif
+    pthread_mutex_destroy(&info->db_map_lock);
+    if (info->db_map_dir)
+	free(info->db_map_dir);
     free(info);
     free(os_hnd);
 }
@@ -678,11 +761,14 @@ operation_loop(os_handler_t *os_hnd)
     sel_select_loop(info->sel, posix_thread_send_sig, (long) &self, info);
 }
 
+static void free_shards(os_handler_t *os_hnd);
+
 static void
 free_os_handler(os_handler_t *os_hnd)
 {
     pt_os_hnd_data_t *info = os_hnd->internal_data;
 
+    free_shards(os_hnd);
     sigaction(info->wake_sig, &info->oldact, NULL);
     sel_free_selector(info->sel);
     ipmi_posix_thread_free_os_handler(os_hnd);
@@ -729,7 +815,7 @@ database_store(os_handler_t  *handler,
 	       unsigned char *data,
 	       unsigned int  data_len)
 {
-    pt_os_hnd_data_t *info = handler->internal_data;
+    pt_os_hnd_data_t *info = pt_root(handler);
     datum            gkey, gdata;
     int              rv;
 
@@ -766,7 +852,7 @@ database_find(os_handler_t  *handler,
 			       unsigned int  data_len),
 	      void *cb_data)
 {
-    pt_os_hnd_data_t *info = handler->internal_data;
+    pt_os_hnd_data_t *info = pt_root(handler);
     datum            gkey, gdata;
 
     i_posix_lock(&info->gdbm_lock);
@@ -797,26 +883,73 @@ database_free(os_handler_t  *handler,
     free(data);
 }
 
+#endif
+
 static int
-set_gdbm_filename(os_handler_t *os_hnd, char *name)
+set_db_filename(os_handler_t *os_hnd, char *name)
 {
-    pt_os_hnd_data_t *info = os_hnd->internal_data;
+    pt_os_hnd_data_t *info = pt_root(os_hnd);
+    int              rv;
+#ifdef HAVE_GDBM
     char             *nname;
 
     nname = strdup(name);
     if (!nname)
 	return ENOMEM;
+    i_posix_lock(&info->gdbm_lock);
     if (info->gdbm_filename)
 	free(info->gdbm_filename);
     info->gdbm_filename = nname;
-    return 0;
-}
+    i_posix_unlock(&info->gdbm_lock);
 #endif
 
+    i_posix_lock(&info->db_map_lock);
+    rv = posix_db_map_set_filename(&info->db_map_dir, name);
+    i_posix_unlock(&info->db_map_lock);
+    return rv;
+}
+
+static int
+database_map_store(os_handler_t  *handler,
+		   char          *key,
+		   unsigned char *data,
+		   unsigned int  data_len)
+{
+    pt_os_hnd_data_t *info = pt_root(handler);
+    int              rv;
+
+    i_posix_lock(&info->db_map_lock);
+    rv = posix_db_map_store(&info->db_map_dir, key, data, data_len);
+    i_posix_unlock(&info->db_map_lock);
+    return rv;
+}
+
+static int
+database_map(os_handler_t        *handler,
+	     char                *key,
+	     const unsigned char **data,
+	     unsigned int        *data_len,
+	     void                **map_id)
+{
+    pt_os_hnd_data_t *info = pt_root(handler);
+    int              rv;
+
+    i_posix_lock(&info->db_map_lock);
+    rv = posix_db_map(&info->db_map_dir, key, data, data_len, map_id);
+    i_posix_unlock(&info->db_map_lock);
+    return rv;
+}
+
+static void
+database_unmap(os_handler_t *handler, void *map_id)
+{
+    posix_db_unmap(map_id);
+}
+
 static void sset_log_handler(os_handler_t *handler,
 			     os_vlog_t    log_handler)
 {
-    pt_os_hnd_data_t *info = handler->internal_data;
+    pt_os_hnd_data_t *info = pt_root(handler);
 
     info->log_handler = log_handler;
 }
@@ -879,11 +1012,15 @@ static os_handler_t ipmi_posix_thread_os_handler =
     .database_store = database_store,
     .database_find = database_find,
     .database_free = database_free,
-    .database_set_filename = set_gdbm_filename,
 #endif
+    .database_set_filename = set_db_filename,
     .set_log_handler = sset_log_handler,
     .get_monotonic_time = get_monotonic_time,
-    .get_real_time = get_real_time
+    .get_real_time = get_real_time,
+    .database_map_store = database_map_store,
+    .database_map = database_map,
+    .database_unmap = database_unmap,
+    .add_dgram_fd_to_wait_for = add_dgram_fd
 };
 
 os_handler_t *
@@ -891,9 +1028,7 @@ ipmi_posix_thread_get_os_handler2(int wake_sig)
 {
     os_handler_t     *rv;
     pt_os_hnd_data_t *info;
-#ifdef HAVE_GDBM
     int              err;
-#endif
 
     rv = malloc(sizeof(*rv));
     if (!rv)
@@ -907,11 +1042,20 @@ ipmi_posix_thread_get_os_handler2(int wake_sig)
 	return NULL;
     }
     memset(info, 0, sizeof(*info));
+    info->root = info;
     rv->internal_data = info;
 
+    err = pthread_mutex_init(&info->db_map_lock, NULL);
+    if (err) {
+	free(info);
+	free(rv);
+	return NULL;
+    }
+
 #ifdef HAVE_GDBM
     err = pthread_mutex_init(&info->gdbm_lock, NULL);
     if (err) {
+	pthread_mutex_destroy(&info->db_map_lock);
 	free(info);
 	free(rv);
 	return NULL;
@@ -973,6 +1117,12 @@ slock_unlock(sel_lock_t *l)
 
 os_handler_t *
 ipmi_posix_thread_setup_os_handler(int wake_sig)
+{
+    return ipmi_posix_thread_setup_os_handler_opts(wake_sig, 0);
+}
+
+os_handler_t *
+ipmi_posix_thread_setup_os_handler_opts(int wake_sig, unsigned int sel_opts)
 {
     os_handler_t     *os_hnd;
     pt_os_hnd_data_t *info;
@@ -984,10 +1134,12 @@ ipmi_posix_thread_setup_os_handler(int wake_sig)
 	return NULL;
 
     info = os_hnd->internal_data;
+    info->sel_opts = sel_opts;
 
-    rv = sel_alloc_selector_thread(&info->sel, wake_sig,
-				   slock_alloc, slock_free,
-				   slock_lock, slock_unlock, os_hnd);
+    rv = sel_alloc_selector_thread_opts(&info->sel, wake_sig,
+					slock_alloc, slock_free,
+					slock_lock, slock_unlock, os_hnd,
+					sel_opts);
     if (rv) {
 	ipmi_posix_thread_free_os_handler(os_hnd);
 	os_hnd = NULL;
@@ -1008,6 +1160,188 @@ ipmi_posix_thread_setup_os_handler(int wake_sig)
     return os_hnd;
 }
 
+static void *
+shard_thread(void *data)
+{
+    os_handler_t     *shard = data;
+    pt_os_hnd_data_t *info = shard->internal_data;
+    pthread_t        self = pthread_self();
+
+    while (!info->stop)
+	sel_select(info->sel, posix_thread_send_sig, (long) &self, info,
+		   NULL);
+    return NULL;
+}
+
+static void
+free_shard_os_handler(os_handler_t *os_hnd)
+{
+    /* Shards go away with the OS handler they came from. */
+}
+
+static void
+free_shard(os_handler_t *shard)
+{
+    pt_os_hnd_data_t *info = shard->internal_data;
+
+    sel_free_selector(info->sel);
+    free(info);
+    free(shard);
+}
+
+static os_handler_t *
+alloc_shard(os_handler_t *os_hnd, unsigned int num)
+{
+    pt_os_hnd_data_t *root = os_hnd->internal_data;
+    os_handler_t     *shard;
+    pt_os_hnd_data_t *info;
+    int              rv;
+
+    shard = malloc(sizeof(*shard));
+    if (!shard)
+	return NULL;
+    memcpy(shard, os_hnd, sizeof(*shard));
+    shard->free_os_handler = free_shard_os_handler;
+
+    info = malloc(sizeof(*info));
+    if (!info) {
+	free(shard);
+	return NULL;
+    }
+    memset(info, 0, sizeof(*info));
+    info->root = root;
+    info->wake_sig = root->wake_sig;
+    info->sel_opts = root->sel_opts;
+    shard->internal_data = info;
+
+    rv = sel_alloc_selector_thread_opts(&info->sel, info->wake_sig,
+					slock_alloc, slock_free,
+					slock_lock, slock_unlock, shard,
+					info->sel_opts);
+    if (rv) {
+	free(info);
+	free(shard);
+	return NULL;
+    }
+
+    rv = pthread_create(&info->thread, NULL, shard_thread, shard);
+    if (rv) {
+	free_shard(shard);
+	return NULL;
+    }
+
+#ifdef CPU_SET
+    {
+	/* Keep each shard on its own CPU if we can, failure is fine. */
+	cpu_set_t cpus;
+	long      ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (ncpus > 0) {
+	    CPU_ZERO(&cpus);
+	    CPU_SET(num % ncpus, &cpus);
+	    pthread_setaffinity_np(info->thread, sizeof(cpus), &cpus);
+	}
+    }
+#endif
+
+    return shard;
+}
+
+static void
+free_shards(os_handler_t *os_hnd)
+{
+    pt_os_hnd_data_t *root = os_hnd->internal_data;
+    unsigned int     i;
+
+    if (!root->shards)
+	return;
+
+    for (i=0; i<root->num_shards; i++) {
+	pt_os_hnd_data_t *info = root->shards[i]->internal_data;
+
+	info->stop = 1;
+	pthread_kill(info->thread, info->wake_sig);
+	pthread_join(info->thread, NULL);
+	free_shard(root->shards[i]);
+    }
+    free(root->shards);
+    root->shards = NULL;
+    root->num_shards = 0;
+    pthread_mutex_destroy(&root->shard_lock);
+}
+
+os_handler_t *
+ipmi_posix_thread_setup_os_handler_sharded(int          wake_sig,
+					   unsigned int num_shards)
+{
+    os_handler_t     *os_hnd;
+    pt_os_hnd_data_t *info;
+    os_handler_t     *shard;
+
+    os_hnd = ipmi_posix_thread_setup_os_handler(wake_sig);
+    if (!os_hnd || (num_shards == 0))
+	return os_hnd;
+
+    info = os_hnd->internal_data;
+    if (pthread_mutex_init(&info->shard_lock, NULL))
+	goto out_err;
+    info->shards = malloc(sizeof(os_handler_t *) * num_shards);
+    if (!info->shards) {
+	pthread_mutex_destroy(&info->shard_lock);
+	goto out_err;
+    }
+
+    while (info->num_shards < num_shards) {
+	shard = alloc_shard(os_hnd, info->num_shards);
+	if (!shard)
+	    goto out_err;
+	info->shards[info->num_shards] = shard;
+	info->num_shards++;
+    }
+    return os_hnd;
+
+ out_err:
+    free_os_handler(os_hnd);
+    return NULL;
+}
+
+unsigned int
+ipmi_posix_thread_os_handler_num_shards(os_handler_t *os_hnd)
+{
+    pt_os_hnd_data_t *info = os_hnd->internal_data;
+
+    return info->num_shards;
+}
+
+os_handler_t *
+ipmi_posix_thread_os_handler_get_shard(os_handler_t *os_hnd,
+				       unsigned int num)
+{
+    pt_os_hnd_data_t *info = os_hnd->internal_data;
+
+    if (num >= info->num_shards)
+	return NULL;
+    return info->shards[num];
+}
+
+os_handler_t *
+ipmi_posix_thread_os_handler_next_shard(os_handler_t *os_hnd)
+{
+    pt_os_hnd_data_t *info = os_hnd->internal_data;
+    os_handler_t     *rv;
+
+    if (info->num_shards == 0)
+	return os_hnd;
+
+    i_posix_lock(&info->shard_lock);
+    rv = info->shards[info->next_shard];
+    info->next_shard++;
+    if (info->next_shard >= info->num_shards)
+	info->next_shard = 0;
+    i_posix_unlock(&info->shard_lock);
+    return rv;
+}
+
 /*
  * Cruft below, do not use these any more.
  */
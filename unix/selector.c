@@ -66,6 +66,22 @@ static void syslog(int level, char *format, ...) {}
 #define EPOLL_CTL_DEL 0
 #define EPOLL_CTL_MOD 0
 #endif
+#if defined(HAVE_EPOLL_PWAIT) && defined(HAVE_LINUX_IO_URING_H)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <stdint.h>
+#include <endian.h>
+#if defined(IORING_ENTER_EXT_ARG) && defined(__NR_io_uring_setup)
+#define SEL_USE_IO_URING
+/* Registered buffer rings came before multishot receives. */
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_register)
+#include <sys/socket.h>
+#define SEL_URING_RECV
+#endif
+#endif
+#endif
 
 struct sel_runner_s
 {
@@ -114,8 +130,100 @@ typedef struct fd_control_s
     /* See the comment in process_fds_epoll() on the use of this. */
     uint32_t saved_events;
 #endif
+#ifdef SEL_USE_IO_URING
+    /* The io_uring poll currently armed for this fd, if any.  The
+       user data has a generation count in the top so completions
+       from an old poll are ignored. */
+    char     uring_armed;
+    uint64_t uring_data;
+#endif
+#ifdef SEL_URING_RECV
+    /* If set, the selector receives datagrams for the fd and passes
+       them here instead of calling handle_read. */
+    sel_dgram_handler_t handle_dgram;
+
+    /* The multishot receive armed for the fd, like the poll above. */
+    char          uring_recv_armed;
+    uint64_t      uring_recv_data;
+    struct msghdr uring_msg;
+
+    /* Only one thread at a time is in handle_dgram, like the other
+       handlers.  Datagrams that arrive while one is in the handler
+       are queued here and handled by that thread. */
+    char         uring_in_dgram;
+    unsigned int uring_dgram_head;
+    unsigned int uring_dgram_count;
+    struct sel_uring_dgram_s *uring_dgrams;
+#endif
 } fd_control_t;
 
+#ifdef SEL_USE_IO_URING
+/*
+ * An io_uring used in place of epoll.  Each fd gets a one-shot
+ * IORING_OP_POLL_ADD, just like the EPOLLONESHOT events that epoll
+ * uses, and is rearmed after its handlers are called.  The
+ * submission side is only touched with the fd lock held.
+ */
+#define SEL_URING_ENTRIES	256
+#define SEL_URING_IGNORE	(~(uint64_t) 0)
+
+#ifdef SEL_URING_RECV
+/*
+ * Datagram fds get a multishot IORING_OP_RECVMSG instead of a poll
+ * for reading.  The kernel picks a buffer from a ring registered
+ * with it for each datagram, so once it is armed there are no
+ * system calls per datagram.  The buffer holds a struct
+ * io_uring_recvmsg_out, then the source address, then the data.
+ */
+#define SEL_URING_BGID		0
+#define SEL_URING_NBUFS		64 /* Must be a power of 2. */
+#define SEL_URING_NAME_LEN	sizeof(struct sockaddr_storage)
+#define SEL_URING_BUF_SIZE	(sizeof(struct io_uring_recvmsg_out) \
+				 + SEL_URING_NAME_LEN + SEL_DGRAM_MAX_LEN)
+
+/* A datagram waiting for a thread already in the handler. */
+struct sel_uring_dgram_s
+{
+    unsigned int bid;
+    unsigned int len;
+};
+#endif
+
+typedef struct sel_uring_s
+{
+    int                 fd;
+
+    /* Generation count for the user data of polls and receives.  This
+       is for the whole ring so a completion for an fd that was closed
+       can't match whatever gets that fd number next. */
+    uint32_t            gen;
+    void                *ring;
+    size_t              ring_size;
+    struct io_uring_sqe *sqes;
+    size_t              sqes_size;
+    unsigned int        sq_entries;
+    unsigned int        sqe_tail; /* Local tail, not yet submitted. */
+    unsigned int        *sq_head;
+    unsigned int        *sq_tail;
+    unsigned int        *sq_mask;
+    unsigned int        *sq_array;
+    unsigned int        *cq_head;
+    unsigned int        *cq_tail;
+    unsigned int        *cq_mask;
+    struct io_uring_cqe *cqes;
+#ifdef SEL_URING_RECV
+    /* The registered buffer ring, allocated on first use. */
+    struct io_uring_buf_ring *br;
+    size_t              br_size;
+    unsigned char       *bufs;
+
+    /* Set if the kernel can't do multishot receives, polls and
+       recvfrom() are used for datagram fds then. */
+    int                 no_recv;
+#endif
+} sel_uring_t;
+#endif
+
 typedef struct heap_val_s
 {
     /* Set this to the function to call when the timeout occurs. */
@@ -131,9 +239,14 @@ typedef struct heap_val_s
     /* Who owns me? */
     struct selector_s *sel;
 
-    /* Am I currently running? */
+    /* Am I currently running?  (In the heap or the wheel.) */
     int in_heap;
 
+    /* In the timing wheel, the links and slot. */
+    int in_wheel;
+    struct sel_timer_s *wheel_next, *wheel_prev;
+    unsigned int wheel_slot;
+
     /* Am I currently stopped? */
     int stopped;
 
@@ -181,6 +294,134 @@ heap_cmp_key(heap_val_t *v1, heap_val_t *v2)
 
 #include "heap.h"
 
+/*
+ * Optional timing wheel.  Timers that expire within SEL_WHEEL_SLOTS
+ * ticks of the wheel's current tick go onto the list for their tick
+ * instead of into the heap, so starting and stopping them is O(1).
+ * Longer timers still go into the heap.  A slot only ever holds
+ * timers for one tick, and a bitmap of the slots in use makes finding
+ * the next one quick.  The exact timeout is kept, the tick is only
+ * used to find the slot.  Each slot is kept sorted so its head is the
+ * earliest timer; adds walk back from the tail, which is immediate
+ * when timers are started in timeout order as they usually are.
+ */
+#define SEL_WHEEL_TICK_USEC	10000
+#define SEL_WHEEL_SLOTS		1024
+#define SEL_WHEEL_BITS		(sizeof(unsigned long) * 8)
+#define SEL_WHEEL_WORDS		(SEL_WHEEL_SLOTS / SEL_WHEEL_BITS)
+
+typedef struct sel_wheel_s
+{
+    /* The first tick that has not been processed yet. */
+    unsigned long long tick;
+    unsigned int       count;
+    sel_timer_t        *slots[SEL_WHEEL_SLOTS];
+    sel_timer_t        *tails[SEL_WHEEL_SLOTS];
+    unsigned long      used[SEL_WHEEL_WORDS];
+} sel_wheel_t;
+
+static unsigned long long
+wheel_tv_to_tick(const struct timeval *tv)
+{
+    return (((unsigned long long) tv->tv_sec
+	     * (1000000 / SEL_WHEEL_TICK_USEC))
+	    + (tv->tv_usec / SEL_WHEEL_TICK_USEC));
+}
+
+static void
+wheel_add(sel_wheel_t *w, sel_timer_t *timer, unsigned int slot)
+{
+    sel_timer_t *prev = w->tails[slot];
+
+    /* Equal timeouts stay in the order they were added. */
+    while (prev
+	   && (cmp_timeval(&prev->val.timeout, &timer->val.timeout) > 0))
+	prev = prev->val.wheel_prev;
+
+    timer->val.wheel_slot = slot;
+    timer->val.wheel_prev = prev;
+    if (prev) {
+	timer->val.wheel_next = prev->val.wheel_next;
+	prev->val.wheel_next = timer;
+    } else {
+	timer->val.wheel_next = w->slots[slot];
+	w->slots[slot] = timer;
+    }
+    if (timer->val.wheel_next)
+	timer->val.wheel_next->val.wheel_prev = timer;
+    else
+	w->tails[slot] = timer;
+    w->used[slot / SEL_WHEEL_BITS] |= 1UL << (slot % SEL_WHEEL_BITS);
+    w->count++;
+}
+
+static void
+wheel_remove(sel_wheel_t *w, sel_timer_t *timer)
+{
+    unsigned int slot = timer->val.wheel_slot;
+
+    if (timer->val.wheel_prev)
+	timer->val.wheel_prev->val.wheel_next = timer->val.wheel_next;
+    else
+	w->slots[slot] = timer->val.wheel_next;
+    if (timer->val.wheel_next)
+	timer->val.wheel_next->val.wheel_prev = timer->val.wheel_prev;
+    else
+	w->tails[slot] = timer->val.wheel_prev;
+    if (!w->slots[slot])
+	w->used[slot / SEL_WHEEL_BITS] &= ~(1UL << (slot % SEL_WHEEL_BITS));
+    w->count--;
+}
+
+/* Move the wheel's tick up to now_tick, stopping at a slot that
+   still has timers in it. */
+static void
+wheel_advance(sel_wheel_t *w, unsigned long long now_tick)
+{
+    if (w->count == 0) {
+	if (now_tick > w->tick)
+	    w->tick = now_tick;
+	return;
+    }
+    while ((w->tick < now_tick) && !w->slots[w->tick % SEL_WHEEL_SLOTS])
+	w->tick++;
+}
+
+/* Return the timer in the wheel with the earliest timeout. */
+static sel_timer_t *
+wheel_first(sel_wheel_t *w)
+{
+    unsigned int start = w->tick % SEL_WHEEL_SLOTS;
+    unsigned int i, word, slot;
+    unsigned long bits;
+
+    if (w->count == 0)
+	return NULL;
+
+    /* Search the bitmap from the current slot, wrapping around to
+       the bits before it in the starting word last. */
+    for (i=0; i<=SEL_WHEEL_WORDS; i++) {
+	word = ((start / SEL_WHEEL_BITS) + i) % SEL_WHEEL_WORDS;
+	bits = w->used[word];
+	if (i == 0)
+	    bits &= ~0UL << (start % SEL_WHEEL_BITS);
+	else if (i == SEL_WHEEL_WORDS)
+	    bits &= ~(~0UL << (start % SEL_WHEEL_BITS));
+	if (bits)
+	    break;
+    }
+    if (!bits)
+	return NULL;
+
+    slot = word * SEL_WHEEL_BITS;
+    while (!(bits & 1)) {
+	bits >>= 1;
+	slot++;
+    }
+
+    return w->slots[slot];
+}
+
 /* Used to build a list of threads that may need to be woken if a
    timer on the top of the heap changes, or an FD is added/removed.
    See i_wake_sel_thread() for more info. */
@@ -211,6 +452,9 @@ struct selector_s
     /* The timer heap. */
     theap_t timer_heap;
 
+    /* The timing wheel, if SEL_OPT_TIMER_WHEEL was given. */
+    sel_wheel_t *wheel;
+
     /* This is a list of items waiting to be woken up because they are
        sitting in a select.  See i_wake_sel_thread() for more info. */
     sel_wait_list_t wait_list;
@@ -224,6 +468,10 @@ struct selector_s
 
 #ifdef HAVE_EPOLL_PWAIT
     int epollfd;
+#endif
+#ifdef SEL_USE_IO_URING
+    /* If set, this is used instead of epoll. */
+    sel_uring_t *uring;
 #endif
     sel_lock_t *(*sel_lock_alloc)(void *cb_data);
     void (*sel_lock_free)(sel_lock_t *);
@@ -303,10 +551,58 @@ sel_wake_all(struct selector_s *sel)
     sel_timer_unlock(sel);
 }
 
+/* Timer queue handling, these must be called with the timer lock
+   held. */
+static sel_timer_t *
+sel_timer_first(struct selector_s *sel)
+{
+    sel_timer_t *top = theap_get_top(&sel->timer_heap);
+    sel_timer_t *wtop;
+
+    if (!sel->wheel)
+	return top;
+    wtop = wheel_first(sel->wheel);
+    if (!top || (wtop && (cmp_timeval(&wtop->val.timeout,
+				      &top->val.timeout) < 0)))
+	return wtop;
+    return top;
+}
+
+static void
+sel_timer_add(struct selector_s *sel, sel_timer_t *timer)
+{
+    timer->val.in_heap = 1;
+    if (sel->wheel) {
+	sel_wheel_t        *w = sel->wheel;
+	unsigned long long tick = wheel_tv_to_tick(&timer->val.timeout);
+
+	if (tick < w->tick)
+	    tick = w->tick;
+	if ((tick - w->tick) < SEL_WHEEL_SLOTS) {
+	    timer->val.in_wheel = 1;
+	    wheel_add(w, timer, tick % SEL_WHEEL_SLOTS);
+	    return;
+	}
+    }
+    theap_add(&sel->timer_heap, timer);
+}
+
+static void
+sel_timer_remove(struct selector_s *sel, sel_timer_t *timer)
+{
+    if (timer->val.in_wheel) {
+	wheel_remove(sel->wheel, timer);
+	timer->val.in_wheel = 0;
+    } else {
+	theap_remove(&sel->timer_heap, timer);
+    }
+    timer->val.in_heap = 0;
+}
+
 static void
 wake_timer_sel_thread(struct selector_s *sel, volatile sel_timer_t *old_top)
 {
-    if (old_top != theap_get_top(&sel->timer_heap))
+    if (old_top != sel_timer_first(sel))
 	/* If the top value changed, restart the waiting thread. */
 	i_wake_sel_thread(sel);
 }
@@ -347,8 +643,294 @@ init_fd(fd_control_t *fd)
     fd->read_enabled = 0;
     fd->write_enabled = 0;
     fd->except_enabled = 0;
+#ifdef SEL_URING_RECV
+    fd->handle_dgram = NULL;
+#endif
+}
+
+#ifdef SEL_USE_IO_URING
+static void
+sel_uring_free(sel_uring_t *u)
+{
+    if (u->sqes)
+	munmap(u->sqes, u->sqes_size);
+    if (u->ring)
+	munmap(u->ring, u->ring_size);
+    close(u->fd);
+#ifdef SEL_URING_RECV
+    /* The kernel lets go of the buffers when the ring goes away. */
+    if (u->br)
+	munmap(u->br, u->br_size);
+    if (u->bufs)
+	free(u->bufs);
+#endif
+    free(u);
 }
 
+static int
+sel_uring_alloc(sel_uring_t **ru)
+{
+    sel_uring_t            *u;
+    struct io_uring_params p;
+    size_t                 cq_size;
+    char                   *ring;
+    int                    rv;
+
+    u = malloc(sizeof(*u));
+    if (!u)
+	return ENOMEM;
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+    u->fd = syscall(__NR_io_uring_setup, SEL_URING_ENTRIES, &p);
+    if (u->fd < 0) {
+	rv = errno;
+	free(u);
+	return rv;
+    }
+
+    /* We need the timeout and signal mask together in the wait, and
+       a single mapping keeps things simple. */
+    if (!(p.features & IORING_FEAT_EXT_ARG)
+	|| !(p.features & IORING_FEAT_SINGLE_MMAP)
+	|| !(p.features & IORING_FEAT_NODROP)) {
+	rv = ENOSYS;
+	goto out_err;
+    }
+
+    u->ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > u->ring_size)
+	u->ring_size = cq_size;
+    ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+	rv = errno;
+	goto out_err;
+    }
+    u->ring = ring;
+
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+	rv = errno;
+	u->sqes = NULL;
+	goto out_err;
+    }
+
+    u->sq_entries = p.sq_entries;
+    u->sq_head = (unsigned int *) (ring + p.sq_off.head);
+    u->sq_tail = (unsigned int *) (ring + p.sq_off.tail);
+    u->sq_mask = (unsigned int *) (ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned int *) (ring + p.sq_off.array);
+    u->cq_head = (unsigned int *) (ring + p.cq_off.head);
+    u->cq_tail = (unsigned int *) (ring + p.cq_off.tail);
+    u->cq_mask = (unsigned int *) (ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (ring + p.cq_off.cqes);
+    u->sqe_tail = *u->sq_tail;
+
+    *ru = u;
+    return 0;
+
+ out_err:
+    sel_uring_free(u);
+    return rv;
+}
+
+/* Must be called with the fd lock held. */
+static struct io_uring_sqe *
+sel_uring_get_sqe(sel_uring_t *u)
+{
+    unsigned int idx;
+    struct io_uring_sqe *sqe;
+
+    if (u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE)
+	>= u->sq_entries)
+	return NULL;
+    idx = u->sqe_tail & *u->sq_mask;
+    u->sqe_tail++;
+    sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    return sqe;
+}
+
+/* Must be called with the fd lock held. */
+static void
+sel_uring_submit(sel_uring_t *u, unsigned int count)
+{
+    int rv;
+
+    __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+    do {
+	rv = syscall(__NR_io_uring_enter, u->fd, count, 0, 0, NULL, 0);
+    } while (rv < 0 && errno == EINTR);
+    /* Like epoll_ctl, this should only fail due to system problems. */
+    if (rv < 0) {
+	perror("io_uring_enter");
+	assert(0);
+    }
+}
+
+#ifdef SEL_URING_RECV
+/* Give a buffer back to the kernel.  Must be called with the fd lock
+   held. */
+static void
+sel_uring_put_buf(sel_uring_t *u, unsigned int bid)
+{
+    unsigned short      tail = u->br->tail;
+    struct io_uring_buf *buf;
+
+    buf = &u->br->bufs[tail & (SEL_URING_NBUFS - 1)];
+    buf->addr = (uintptr_t) (u->bufs + bid * SEL_URING_BUF_SIZE);
+    buf->len = SEL_URING_BUF_SIZE;
+    buf->bid = bid;
+    __atomic_store_n(&u->br->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Must be called with the fd lock held. */
+static int
+sel_uring_setup_bufs(sel_uring_t *u)
+{
+    struct io_uring_buf_reg reg;
+    unsigned int            i;
+    int                     rv;
+
+    if (u->no_recv)
+	return ENOSYS;
+    if (u->br)
+	return 0;
+
+    u->bufs = malloc(SEL_URING_NBUFS * SEL_URING_BUF_SIZE);
+    if (!u->bufs)
+	return ENOMEM;
+    u->br_size = SEL_URING_NBUFS * sizeof(struct io_uring_buf);
+    u->br = mmap(NULL, u->br_size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED) {
+	rv = errno;
+	u->br = NULL;
+	goto out_err;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t) u->br;
+    reg.ring_entries = SEL_URING_NBUFS;
+    reg.bgid = SEL_URING_BGID;
+    rv = syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING,
+		 &reg, 1);
+    if (rv < 0) {
+	rv = errno;
+	goto out_err;
+    }
+
+    for (i = 0; i < SEL_URING_NBUFS; i++)
+	sel_uring_put_buf(u, i);
+    return 0;
+
+ out_err:
+    if (u->br)
+	munmap(u->br, u->br_size);
+    u->br = NULL;
+    free(u->bufs);
+    u->bufs = NULL;
+    /* Don't keep trying this. */
+    u->no_recv = 1;
+    return rv;
+}
+
+static void
+sel_uring_update_recv(sel_uring_t *u, fd_control_t *fdc, int recv,
+		      unsigned int *count)
+{
+    struct io_uring_sqe *sqe;
+
+    if (fdc->uring_recv_armed && !recv) {
+	sqe = sel_uring_get_sqe(u);
+	assert(sqe != NULL);
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = fdc->uring_recv_data;
+	sqe->user_data = SEL_URING_IGNORE;
+	(*count)++;
+	fdc->uring_recv_armed = 0;
+    } else if (!fdc->uring_recv_armed && recv) {
+	sqe = sel_uring_get_sqe(u);
+	assert(sqe != NULL);
+	u->gen++;
+	fdc->uring_recv_data = (((uint64_t) u->gen << 32)
+				| (unsigned int) fdc->fd);
+	memset(&fdc->uring_msg, 0, sizeof(fdc->uring_msg));
+	fdc->uring_msg.msg_namelen = SEL_URING_NAME_LEN;
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fdc->fd;
+	sqe->addr = (uintptr_t) &fdc->uring_msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = SEL_URING_BGID;
+	sqe->user_data = fdc->uring_recv_data;
+	(*count)++;
+	fdc->uring_recv_armed = 1;
+    }
+}
+#endif
+
+static void
+sel_uring_update(struct selector_s *sel, fd_control_t *fdc, int op,
+		 uint32_t events)
+{
+    sel_uring_t         *u = sel->uring;
+    struct io_uring_sqe *sqe;
+    unsigned int        count = 0;
+
+#ifdef SEL_URING_RECV
+    if (fdc->handle_dgram || fdc->uring_recv_armed) {
+	int recv = (fdc->handle_dgram && (op != EPOLL_CTL_DEL)
+		    && (events & POLLIN));
+
+	if (recv && sel_uring_setup_bufs(u))
+	    /* Fall back to a poll and recvfrom(). */
+	    recv = 0;
+	if (recv)
+	    events &= ~(POLLIN | POLLHUP);
+	sel_uring_update_recv(u, fdc, recv, &count);
+    }
+#endif
+
+    if (fdc->uring_armed) {
+	sqe = sel_uring_get_sqe(u);
+	assert(sqe != NULL);
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = fdc->uring_data;
+	sqe->user_data = SEL_URING_IGNORE;
+	count++;
+	fdc->uring_armed = 0;
+    }
+
+    if (op != EPOLL_CTL_DEL && events) {
+	sqe = sel_uring_get_sqe(u);
+	assert(sqe != NULL);
+	u->gen++;
+	fdc->uring_data = (((uint64_t) u->gen << 32)
+			   | (unsigned int) fdc->fd);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fdc->fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = (events << 16) | (events >> 16);
+#endif
+	sqe->poll32_events = events;
+	sqe->user_data = fdc->uring_data;
+	count++;
+	fdc->uring_armed = 1;
+    }
+
+    if (count)
+	sel_uring_submit(u, count);
+}
+#endif
+
 #ifdef HAVE_EPOLL_PWAIT
 static int
 sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
@@ -381,6 +963,13 @@ sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
 	if (fdc->except_enabled)
 	    event.events |= EPOLLERR | EPOLLPRI;
     }
+#ifdef SEL_USE_IO_URING
+    if (sel->uring) {
+	/* The poll(2) event bits are the same as the epoll ones. */
+	sel_uring_update(sel, fdc, op, event.events & ~EPOLLONESHOT);
+	return 0;
+    }
+#endif
     /* This should only fail due to system problems, and if that's the case,
        well, we should probably terminate. */
     rv = epoll_ctl(sel->epollfd, op, fdc->fd, &event);
@@ -488,6 +1077,9 @@ sel_set_fd_handlers(struct selector_s *sel,
     fdc->handle_read = read_handler;
     fdc->handle_write = write_handler;
     fdc->handle_except = except_handler;
+#ifdef SEL_URING_RECV
+    fdc->handle_dgram = NULL;
+#endif
 
     if (added) {
 	/* Move maxfd up if necessary. */
@@ -695,6 +1287,46 @@ sel_set_fd_except_handler(struct selector_s *sel, int fd, int state)
     sel_fd_unlock(sel);
 }
 
+int
+sel_set_fd_dgram_handler(struct selector_s   *sel,
+			 int                 fd,
+			 sel_dgram_handler_t handler)
+{
+#ifdef SEL_URING_RECV
+    fd_control_t *fdc;
+    int          rv = 0;
+
+    sel_fd_lock(sel);
+    valid_fd(sel, fd, &fdc);
+    if (!fdc->state) {
+	rv = EINVAL;
+	goto out;
+    }
+    if (!sel->uring) {
+	rv = ENOSYS;
+	goto out;
+    }
+    rv = sel_uring_setup_bufs(sel->uring);
+    if (rv)
+	goto out;
+    if (!fdc->uring_dgrams) {
+	fdc->uring_dgrams = malloc(SEL_URING_NBUFS
+				   * sizeof(*fdc->uring_dgrams));
+	if (!fdc->uring_dgrams) {
+	    rv = ENOMEM;
+	    goto out;
+	}
+    }
+    fdc->handle_dgram = handler;
+    sel_update_fd(sel, fdc, EPOLL_CTL_MOD);
+ out:
+    sel_fd_unlock(sel);
+    return rv;
+#else
+    return ENOSYS;
+#endif
+}
+
 static void
 diff_timeval(struct timeval *dest,
 	     struct timeval *left,
@@ -761,10 +1393,9 @@ sel_stop_timer_i(struct selector_s *sel, sel_timer_t *timer)
 	return ETIMEDOUT;
 
     if (timer->val.in_heap) {
-	volatile sel_timer_t *old_top = theap_get_top(&sel->timer_heap);
+	volatile sel_timer_t *old_top = sel_timer_first(sel);
 
-	theap_remove(&sel->timer_heap, timer);
-	timer->val.in_heap = 0;
+	sel_timer_remove(sel, timer);
 	wake_timer_sel_thread(sel, old_top);
     }
     timer->val.stopped = 1;
@@ -804,15 +1435,13 @@ sel_start_timer(sel_timer_t    *timer,
 	return EBUSY;
     }
 
-    old_top = theap_get_top(&sel->timer_heap);
+    old_top = sel_timer_first(sel);
 
     timer->val.timeout = *timeout;
 
-    if (!timer->val.in_handler) {
+    if (!timer->val.in_handler)
 	/* Wait until the handler returns to start the timer. */
-	theap_add(&sel->timer_heap, timer);
-	timer->val.in_heap = 1;
-    }
+	sel_timer_add(sel, timer);
     timer->val.stopped = 0;
 
     wake_timer_sel_thread(sel, old_top);
@@ -862,12 +1491,10 @@ sel_stop_timer_with_done(sel_timer_t *timer,
      * heap with an immediate timeout so it will be processed now.
      */
     timer->val.in_handler = 1;
-    if (timer->val.in_heap) {
-	theap_remove(&sel->timer_heap, timer);
-	timer->val.in_heap = 0;
-    }
+    if (timer->val.in_heap)
+	sel_timer_remove(sel, timer);
     sel_get_monotonic_time(&timer->val.timeout);
-    theap_add(&sel->timer_heap, timer);
+    sel_timer_add(sel, timer);
     wake_timer_sel_thread(sel, NULL);
 
  out_unlock:
@@ -899,11 +1526,12 @@ process_timers(struct selector_s       *sel,
     struct timeval now;
     sel_timer_t    *timer;
 
-    timer = theap_get_top(&sel->timer_heap);
     sel_get_monotonic_time(&now);
+    if (sel->wheel)
+	wheel_advance(sel->wheel, wheel_tv_to_tick(&now));
+    timer = sel_timer_first(sel);
     while (timer && cmp_timeval(&now, &timer->val.timeout) >= 0) {
-	theap_remove(&(sel->timer_heap), timer);
-	timer->val.in_heap = 0;
+	sel_timer_remove(sel, timer);
 	timer->val.stopped = 1;
 
 	/*
@@ -933,11 +1561,12 @@ process_timers(struct selector_s       *sel,
 	    free(timer);
 	else if (!timer->val.stopped) {
 	    /* We were restarted while in the handler. */
-	    theap_add(&sel->timer_heap, timer);
-	    timer->val.in_heap = 1;
+	    sel_timer_add(sel, timer);
 	}
 
-	timer = theap_get_top(&sel->timer_heap);
+	if (sel->wheel)
+	    wheel_advance(sel->wheel, wheel_tv_to_tick(&now));
+	timer = sel_timer_first(sel);
     }
 
     if (*count) {
@@ -1037,6 +1666,23 @@ process_runners(struct selector_s *sel)
     return count;
 }
 
+/* Drop a use of the fd's state, finishing its removal if it was
+   deleted while in use.  Called with the fd lock held. */
+static void
+fd_state_put(struct selector_s *sel, fd_control_t *fdc, fd_state_t *state,
+	     void *data)
+{
+    state->use_count--;
+    if (state->deleted && state->use_count == 0) {
+	if (state->done) {
+	    sel_fd_unlock(sel);
+	    state->done(fdc->fd, data);
+	    sel_fd_lock(sel);
+	}
+	free(state);
+    }
+}
+
 static void
 handle_selector_call(struct selector_s *sel, fd_control_t *fdc,
 		     volatile fd_set *fdset, int enabled,
@@ -1063,17 +1709,54 @@ handle_selector_call(struct selector_s *sel, fd_control_t *fdc,
     sel_fd_unlock(sel);
     handler(fdc->fd, data);
     sel_fd_lock(sel);
-    state->use_count--;
-    if (state->deleted && state->use_count == 0) {
-	if (state->done) {
-	    sel_fd_unlock(sel);
-	    state->done(fdc->fd, data);
-	    sel_fd_lock(sel);
-	}
-	free(state);
-    }
+    fd_state_put(sel, fdc, state, data);
 }
 
+#ifdef SEL_URING_RECV
+/*
+ * Receive a datagram with recvfrom() for a datagram fd, used when
+ * the multishot receive is not available.
+ */
+static void
+handle_dgram_call(struct selector_s *sel, fd_control_t *fdc)
+{
+    unsigned char           buf[SEL_DGRAM_MAX_LEN];
+    struct sockaddr_storage addr;
+    socklen_t               addrlen = sizeof(addr);
+    sel_dgram_handler_t     handler = fdc->handle_dgram;
+    void                    *data;
+    fd_state_t              *state;
+    int                     len;
+
+    if (!fdc->read_enabled)
+	return;
+
+    data = fdc->data;
+    state = fdc->state;
+    state->use_count++;
+    sel_fd_unlock(sel);
+    len = recvfrom(fdc->fd, buf, sizeof(buf), MSG_DONTWAIT,
+		   (struct sockaddr *) &addr, &addrlen);
+    if (len >= 0)
+	handler(fdc->fd, data, buf, len, &addr, addrlen);
+    sel_fd_lock(sel);
+    fd_state_put(sel, fdc, state, data);
+}
+
+static void
+handle_read_call(struct selector_s *sel, fd_control_t *fdc)
+{
+    if (fdc->handle_dgram)
+	handle_dgram_call(sel, fdc);
+    else
+	handle_selector_call(sel, fdc, NULL, fdc->read_enabled,
+			     fdc->handle_read);
+}
+#else
+#define handle_read_call(sel, fdc) \
+    handle_selector_call(sel, fdc, NULL, fdc->read_enabled, fdc->handle_read)
+#endif
+
 static void
 setup_my_sigmask(sigset_t *sigmask, sigset_t *isigmask)
 {
@@ -1215,8 +1898,7 @@ process_fds_epoll(struct selector_s *sel, struct timeval *tvtimeout,
 	event.events |= EPOLLIN;
     }
     if (event.events & (EPOLLIN | EPOLLHUP))
-	handle_selector_call(sel, fdc, NULL, fdc->read_enabled,
-			     fdc->handle_read);
+	handle_read_call(sel, fdc);
     if (event.events & EPOLLOUT)
 	handle_selector_call(sel, fdc, NULL, fdc->write_enabled,
 			     fdc->handle_write);
@@ -1233,6 +1915,219 @@ process_fds_epoll(struct selector_s *sel, struct timeval *tvtimeout,
     return rv;
 }
 
+#ifdef SEL_URING_RECV
+/*
+ * Pass a datagram the kernel put in buffer bid to the fd's handler
+ * and give the buffer back.  Called with the fd lock held.
+ */
+static void
+sel_uring_dgram(struct selector_s *sel, fd_control_t *fdc,
+		unsigned int bid, unsigned int res)
+{
+    sel_uring_t                 *u = sel->uring;
+    struct io_uring_recvmsg_out *out;
+    sel_dgram_handler_t         handler;
+    unsigned char               *buf;
+    unsigned int                len, namelen;
+    fd_state_t                  *state;
+    void                        *data;
+
+    if (fdc->uring_in_dgram) {
+	/* Another thread is in the handler, it will do this one. */
+	fdc->uring_dgrams[(fdc->uring_dgram_head + fdc->uring_dgram_count)
+			  % SEL_URING_NBUFS].bid = bid;
+	fdc->uring_dgrams[(fdc->uring_dgram_head + fdc->uring_dgram_count)
+			  % SEL_URING_NBUFS].len = res;
+	fdc->uring_dgram_count++;
+	return;
+    }
+
+    fdc->uring_in_dgram = 1;
+    for (;;) {
+	handler = fdc->handle_dgram;
+	if (fdc->state && handler && fdc->read_enabled
+	    && res >= sizeof(*out) + SEL_URING_NAME_LEN)
+	{
+	    buf = u->bufs + bid * SEL_URING_BUF_SIZE;
+	    out = (struct io_uring_recvmsg_out *) buf;
+	    len = res - sizeof(*out) - SEL_URING_NAME_LEN;
+	    if (out->payloadlen < len)
+		len = out->payloadlen;
+	    namelen = out->namelen;
+	    if (namelen > SEL_URING_NAME_LEN)
+		namelen = SEL_URING_NAME_LEN;
+
+	    data = fdc->data;
+	    state = fdc->state;
+	    state->use_count++;
+	    sel_fd_unlock(sel);
+	    handler(fdc->fd, data, buf + sizeof(*out) + SEL_URING_NAME_LEN,
+		    len, buf + sizeof(*out), namelen);
+	    sel_fd_lock(sel);
+	    fd_state_put(sel, fdc, state, data);
+	}
+	sel_uring_put_buf(u, bid);
+
+	if (!fdc->uring_dgram_count)
+	    break;
+	bid = fdc->uring_dgrams[fdc->uring_dgram_head].bid;
+	res = fdc->uring_dgrams[fdc->uring_dgram_head].len;
+	fdc->uring_dgram_head = (fdc->uring_dgram_head + 1) % SEL_URING_NBUFS;
+	fdc->uring_dgram_count--;
+    }
+    fdc->uring_in_dgram = 0;
+}
+#endif
+
+#ifdef SEL_USE_IO_URING
+static int
+process_fds_uring(struct selector_s *sel, struct timeval *tvtimeout,
+		  sigset_t *isigmask)
+{
+    sel_uring_t *u = sel->uring;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    struct io_uring_cqe *cqe;
+    struct timeval end, now, left;
+    unsigned int head, tail;
+    uint64_t data;
+    uint32_t events = 0;
+#ifdef SEL_URING_RECV
+    uint32_t flags;
+#endif
+    sigset_t sigmask;
+    fd_control_t *fdc = NULL;
+    unsigned long entry_fd_del_count = sel->fd_del_count;
+    int rv;
+
+    setup_my_sigmask(&sigmask, isigmask);
+    sigdelset(&sigmask, sel->wake_sig);
+
+    left = *tvtimeout;
+    if (left.tv_sec > 600)
+	/* Match the epoll limit. */
+	left.tv_sec = 600;
+    sel_get_monotonic_time(&now);
+    add_timeval(&end, &now, &left);
+
+ retry:
+    sel_fd_lock(sel);
+    head = *u->cq_head;
+    tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+	cqe = &u->cqes[head & *u->cq_mask];
+	data = cqe->user_data;
+	rv = cqe->res;
+#ifdef SEL_URING_RECV
+	flags = cqe->flags;
+#endif
+	head++;
+	__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+	/* Completions for removes and replaced polls are ignored. */
+	if (data == SEL_URING_IGNORE)
+	    continue;
+	fdc = get_fd(sel, (int) (data & 0xffffffff));
+#ifdef SEL_URING_RECV
+	if (fdc && fdc->uring_recv_armed && fdc->uring_recv_data == data)
+	    goto got_recv;
+	/* A receive that was cancelled may still have used a buffer. */
+	if (flags & IORING_CQE_F_BUFFER)
+	    sel_uring_put_buf(u, flags >> IORING_CQE_BUFFER_SHIFT);
+#endif
+	if (!fdc || !fdc->uring_armed || fdc->uring_data != data)
+	    continue;
+	fdc->uring_armed = 0;
+	if (rv > 0) {
+	    events = rv;
+	    goto got_event;
+	}
+	/* The poll failed somehow, just try it again. */
+	if (fdc->state)
+	    sel_update_fd(sel, fdc, EPOLL_CTL_MOD);
+    }
+    sel_fd_unlock(sel);
+
+    /*
+     * Nothing there for us, wait for something.  If another thread
+     * took what woke us up, we come back here with whatever time is
+     * left.
+     */
+    sel_get_monotonic_time(&now);
+    diff_timeval(&left, &end, &now);
+    ts.tv_sec = left.tv_sec;
+    ts.tv_nsec = left.tv_usec * 1000;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask = (uintptr_t) &sigmask;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uintptr_t) &ts;
+    rv = syscall(__NR_io_uring_enter, u->fd, 0, 1,
+		 IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		 &arg, sizeof(arg));
+    if (rv < 0) {
+	if (errno == ETIME)
+	    return 0;
+	return rv;
+    }
+    goto retry;
+
+#ifdef SEL_URING_RECV
+ got_recv:
+    if (!(flags & IORING_CQE_F_MORE)) {
+	/*
+	 * The receive is done, most likely because the kernel ran out
+	 * of buffers.  If the kernel can't do multishot receives at
+	 * all, use a poll and recvfrom() from now on.
+	 */
+	fdc->uring_recv_armed = 0;
+	if (rv == -EINVAL)
+	    u->no_recv = 1;
+    }
+    if (flags & IORING_CQE_F_BUFFER) {
+	if (rv >= 0)
+	    sel_uring_dgram(sel, fdc, flags >> IORING_CQE_BUFFER_SHIFT, rv);
+	else
+	    sel_uring_put_buf(u, flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+    if (!fdc->uring_recv_armed && fdc->state)
+	sel_update_fd(sel, fdc, EPOLL_CTL_MOD);
+    sel_fd_unlock(sel);
+
+    return 1;
+#endif
+
+ got_event:
+    if (entry_fd_del_count != sel->fd_del_count)
+	/* Something was deleted from the FD set, don't process this as it
+	   may be from the old fd wakeup. */
+	goto rearm;
+    if (events & (POLLHUP | POLLERR)) {
+	/*
+	 * Same as epoll, don't keep polling for these, they will just
+	 * come back immediately.  The poll is already gone.
+	 */
+	fdc->saved_events = events & (POLLHUP | POLLERR);
+	events |= POLLIN;
+    }
+    if (events & (POLLIN | POLLHUP))
+	handle_read_call(sel, fdc);
+    if (events & POLLOUT)
+	handle_selector_call(sel, fdc, NULL, fdc->write_enabled,
+			     fdc->handle_write);
+    if (events & (POLLPRI | POLLERR))
+	handle_selector_call(sel, fdc, NULL, fdc->except_enabled,
+			     fdc->handle_except);
+
+ rearm:
+    /* Rearm the poll.  Remember it could have been deleted in the handler. */
+    if (fdc->state)
+	sel_update_fd(sel, fdc, EPOLL_CTL_MOD);
+    sel_fd_unlock(sel);
+
+    return 1;
+}
+#endif
+
 int
 sel_setup_forked_process(struct selector_s *sel)
 {
@@ -1251,10 +2146,29 @@ sel_setup_forked_process(struct selector_s *sel)
 	return errno;
     }
 
+#ifdef SEL_USE_IO_URING
+    /* The same goes for an io_uring, the polls are shared. */
+    if (sel->uring) {
+	sel_uring_free(sel->uring);
+	sel->uring = NULL;
+	if (sel_uring_alloc(&sel->uring))
+	    sel->uring = NULL;
+    }
+#endif
+
     for (i = 0; i <= sel->maxfd; i++) {
 	fd_control_t *fdc = sel->fds[i];
-	if (fdc && fdc->state)
+	if (fdc && fdc->state) {
+#ifdef SEL_USE_IO_URING
+	    fdc->uring_armed = 0;
+#endif
+#ifdef SEL_URING_RECV
+	    fdc->uring_recv_armed = 0;
+	    fdc->uring_in_dgram = 0;
+	    fdc->uring_dgram_count = 0;
+#endif
 	    sel_update_fd(sel, fdc, EPOLL_CTL_ADD);
+	}
     }
     return 0;
 }
@@ -1299,6 +2213,11 @@ sel_select_intr_sigmask(struct selector_s *sel,
     add_sel_wait_list(sel, &wait_entry, send_sig, cb_data, thread_id);
     sel_timer_unlock(sel);
 
+#ifdef SEL_USE_IO_URING
+    if (sel->uring)
+	err = process_fds_uring(sel, &loc_timeout, sigmask);
+    else
+#endif
 #ifdef HAVE_EPOLL_PWAIT
     if (sel->epollfd >= 0)
 	err = process_fds_epoll(sel, &loc_timeout, sigmask);
@@ -1389,22 +2308,35 @@ sel_select_loop(struct selector_s *sel,
 
 /* Initialize the select code. */
 int
-sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
-			  sel_lock_t *(*sel_lock_alloc)(void *cb_data),
-			  void (*sel_lock_free)(sel_lock_t *),
-			  void (*sel_lock)(sel_lock_t *),
-			  void (*sel_unlock)(sel_lock_t *),
-			  void *cb_data)
+sel_alloc_selector_thread_opts(struct selector_s **new_selector, int wake_sig,
+			       sel_lock_t *(*sel_lock_alloc)(void *cb_data),
+			       void (*sel_lock_free)(sel_lock_t *),
+			       void (*sel_lock)(sel_lock_t *),
+			       void (*sel_unlock)(sel_lock_t *),
+			       void *cb_data,
+			       unsigned int opts)
 {
     struct selector_s *sel;
     int rv;
     sigset_t sigset;
+    struct timeval now;
 
     sel = malloc(sizeof(*sel));
     if (!sel)
 	return ENOMEM;
     memset(sel, 0, sizeof(*sel));
 
+    if (opts & SEL_OPT_TIMER_WHEEL) {
+	sel->wheel = malloc(sizeof(*sel->wheel));
+	if (!sel->wheel) {
+	    free(sel);
+	    return ENOMEM;
+	}
+	memset(sel->wheel, 0, sizeof(*sel->wheel));
+	sel_get_monotonic_time(&now);
+	sel->wheel->tick = wheel_tv_to_tick(&now);
+    }
+
     sel->sel_lock_alloc = sel_lock_alloc;
     sel->sel_lock_free = sel_lock_free;
     sel->sel_lock = sel_lock;
@@ -1427,12 +2359,16 @@ sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
     if (sel->sel_lock_alloc) {
 	sel->timer_lock = sel->sel_lock_alloc(cb_data);
 	if (!sel->timer_lock) {
+	    if (sel->wheel)
+		free(sel->wheel);
 	    free(sel);
 	    return ENOMEM;
 	}
 	sel->fd_lock = sel->sel_lock_alloc(cb_data);
 	if (!sel->fd_lock) {
-	    sel->sel_lock_free(sel->fd_lock);
+	    sel->sel_lock_free(sel->timer_lock);
+	    if (sel->wheel)
+		free(sel->wheel);
 	    free(sel);
 	    return ENOMEM;
 	}
@@ -1447,6 +2383,8 @@ sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
 	    sel->sel_lock_free(sel->fd_lock);
 		sel->sel_lock_free(sel->timer_lock);
 	}
+	if (sel->wheel)
+	    free(sel->wheel);
 	free(sel);
 	return rv;
     }
@@ -1456,12 +2394,43 @@ sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
     if (sel->epollfd == -1)
 	syslog(LOG_ERR, "Unable to set up epoll, falling back to select: %m");
 #endif
+#ifdef SEL_USE_IO_URING
+    if ((opts & SEL_OPT_IO_URING) && sel->epollfd >= 0) {
+	rv = sel_uring_alloc(&sel->uring);
+	if (rv)
+	    syslog(LOG_INFO, "Unable to set up io_uring, using epoll: %s",
+		   strerror(rv));
+    }
+#endif
 
     *new_selector = sel;
 
     return 0;
 }
 
+int
+sel_uses_io_uring(struct selector_s *sel)
+{
+#ifdef SEL_USE_IO_URING
+    return sel->uring != NULL;
+#else
+    return 0;
+#endif
+}
+
+int
+sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
+			  sel_lock_t *(*sel_lock_alloc)(void *cb_data),
+			  void (*sel_lock_free)(sel_lock_t *),
+			  void (*sel_lock)(sel_lock_t *),
+			  void (*sel_unlock)(sel_lock_t *),
+			  void *cb_data)
+{
+    return sel_alloc_selector_thread_opts(new_selector, wake_sig,
+					  sel_lock_alloc, sel_lock_free,
+					  sel_lock, sel_unlock, cb_data, 0);
+}
+
 int
 sel_alloc_selector_nothread(struct selector_s **new_selector)
 {
@@ -1481,6 +2450,20 @@ sel_free_selector(struct selector_s *sel)
 	free(elem);
 	elem = theap_get_top(&(sel->timer_heap));
     }
+    if (sel->wheel) {
+	for (i = 0; i < SEL_WHEEL_SLOTS; i++) {
+	    while (sel->wheel->slots[i]) {
+		elem = sel->wheel->slots[i];
+		sel->wheel->slots[i] = elem->val.wheel_next;
+		free(elem);
+	    }
+	}
+	free(sel->wheel);
+    }
+#ifdef SEL_USE_IO_URING
+    if (sel->uring)
+	sel_uring_free(sel->uring);
+#endif
 #ifdef HAVE_EPOLL_PWAIT
     if (sel->epollfd >= 0)
 	close(sel->epollfd);
@@ -1492,6 +2475,10 @@ sel_free_selector(struct selector_s *sel)
 	    sel->fds[i] = fdc->next;
 	    if (fdc->state)
 		free(fdc->state);
+#ifdef SEL_URING_RECV
+	    if (fdc->uring_dgrams)
+		free(fdc->uring_dgrams);
+#endif
 	    free(fdc);
 	}
     }
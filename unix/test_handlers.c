@@ -222,10 +222,15 @@ main(int argc, char *argv[])
     os_handler_waiter_factory_t *factory;
     os_handler_t *os_hnd;
     int          rv;
+    unsigned int sel_opts = 0;
+
+    /* -u runs everything with the selectors on io_uring. */
+    if (argc > 1 && strcmp(argv[1], "-u") == 0)
+	sel_opts |= SEL_OPT_IO_URING;
 
     fprintf(stderr, "*** Testing POSIX OS handler\n");
     reset_tests();
-    os_hnd = ipmi_posix_setup_os_handler();
+    os_hnd = ipmi_posix_setup_os_handler_opts(sel_opts);
     if (!os_hnd) {
 	fprintf(stderr, "ipmi_smi_setup_con: Unable to allocate os handler\n");
 	exit(1);
@@ -241,7 +246,7 @@ main(int argc, char *argv[])
 
     fprintf(stderr, "*** Testing POSIX Threaded OS handler (singlethread)\n");
     reset_tests();
-    os_hnd = ipmi_posix_thread_setup_os_handler(SIGUSR1);
+    os_hnd = ipmi_posix_thread_setup_os_handler_opts(SIGUSR1, sel_opts);
     if (!os_hnd) {
 	fprintf(stderr, "ipmi_smi_setup_con: Unable to allocate os handler\n");
 	exit(1);
@@ -253,7 +258,7 @@ main(int argc, char *argv[])
     test_os_handler(os_hnd, factory);
     fprintf(stderr, "*** Testing POSIX Threaded OS handler (multithread)\n");
     reset_tests();
-    os_hnd = ipmi_posix_thread_setup_os_handler(SIGUSR1);
+    os_hnd = ipmi_posix_thread_setup_os_handler_opts(SIGUSR1, sel_opts);
     if (!os_hnd) {
 	fprintf(stderr, "ipmi_smi_setup_con: Unable to allocate os handler\n");
 	exit(1);
@@ -0,0 +1,4 @@
+#!/bin/sh
+# Run the OS handler tests with the selectors on io_uring.  They quietly
+# use epoll if io_uring is not available.
+exec ./test_handlers -u
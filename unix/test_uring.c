@@ -0,0 +1,359 @@
+/*
+ * test_uring.c
+ *
+ * Tests for the selector io_uring backend.
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2006 MontaVista Software Inc.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * Lesser General Public License (GPL) Version 2 or the modified BSD
+ * license below.  The following disclamer applies to both licenses:
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * GNU Lesser General Public Licence
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Modified BSD Licence
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *   3. The name of the author may not be used to endorse or promote
+ *      products derived from this software without specific prior
+ *      written permission.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <OpenIPMI/selector.h>
+
+/* Returned to automake to say the test was skipped. */
+#define TEST_SKIPPED	77
+
+static struct selector_s *sel;
+static int pfd[2];
+static unsigned int reads, writes, cleared, got_eof, fired;
+static unsigned int dgrams, dgram_len, dgram_port;
+
+static void
+err_leave(int err, char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    if (err)
+	fprintf(stderr, "error: %s (%d)\n", strerror(err), err);
+    va_end(ap);
+    exit(1);
+}
+
+static void
+read_handler(int fd, void *data)
+{
+    char    c;
+    ssize_t rv;
+
+    rv = read(fd, &c, 1);
+    if (rv == 0)
+	got_eof = 1;
+    else if (rv < 0)
+	err_leave(errno, "read failed\n");
+    reads++;
+}
+
+static void
+write_handler(int fd, void *data)
+{
+    writes++;
+    sel_set_fd_write_handler(sel, fd, SEL_FD_HANDLER_DISABLED);
+}
+
+static void
+dgram_handler(int fd, void *data, unsigned char *buf, unsigned int len,
+	      void *addr, unsigned int addr_len)
+{
+    struct sockaddr_in *sin = addr;
+    char               expect[20];
+
+    if (addr_len != sizeof(*sin) || sin->sin_family != AF_INET)
+	err_leave(0, "Bad datagram source address\n");
+    dgram_port = ntohs(sin->sin_port);
+    dgram_len = len;
+    if (len < 100) {
+	/* The small ones are numbered, make sure they are in order. */
+	sprintf(expect, "dgram %u", dgrams);
+	if (len != strlen(expect) || memcmp(buf, expect, len) != 0)
+	    err_leave(0, "Datagram %u is wrong\n", dgrams);
+    }
+    dgrams++;
+}
+
+static void
+send_dgrams(int fd, struct sockaddr_in *to, unsigned int count)
+{
+    char         buf[20];
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+	sprintf(buf, "dgram %u", dgrams + i);
+	if (sendto(fd, buf, strlen(buf), 0, (struct sockaddr *) to,
+		   sizeof(*to)) == -1)
+	    err_leave(errno, "sendto failed\n");
+    }
+}
+
+static void
+fd_cleared(int fd, void *data)
+{
+    cleared++;
+}
+
+static void
+timeout(struct selector_s *sel, sel_timer_t *timer, void *data)
+{
+    unsigned int n = (unsigned long) data;
+
+    if (n != fired)
+	err_leave(0, "Timer %u fired out of order\n", n);
+    fired++;
+}
+
+/* Run the selector until *count reaches want, or fail after a while. */
+static void
+wait_for(unsigned int *count, unsigned int want, char *what)
+{
+    struct timeval start, now, tv;
+
+    sel_get_monotonic_time(&start);
+    while (*count < want) {
+	sel_get_monotonic_time(&now);
+	if (now.tv_sec > start.tv_sec + 5)
+	    err_leave(0, "Timed out waiting for %s\n", what);
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	sel_select(sel, NULL, 0, NULL, &tv);
+    }
+}
+
+/* Run the selector for a bit and make sure *count doesn't change. */
+static void
+wait_none(unsigned int *count, char *what)
+{
+    unsigned int   old = *count;
+    struct timeval tv;
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    sel_select(sel, NULL, 0, NULL, &tv);
+    if (*count != old)
+	err_leave(0, "Unexpected %s\n", what);
+}
+
+int
+main(int argc, char *argv[])
+{
+    sel_timer_t        *timers[10];
+    struct timeval     now, tv;
+    struct sockaddr_in raddr, saddr;
+    socklen_t          len;
+    char               big[SEL_DGRAM_MAX_LEN + 100];
+    unsigned int       i;
+    int                rv, rfd, sfd;
+
+    rv = sel_alloc_selector_thread_opts(&sel, 0, NULL, NULL, NULL, NULL,
+					NULL, SEL_OPT_IO_URING);
+    if (rv)
+	err_leave(rv, "Unable to allocate selector\n");
+    if (!sel_uses_io_uring(sel)) {
+	printf("io_uring not available, skipping\n");
+	sel_free_selector(sel);
+	return TEST_SKIPPED;
+    }
+
+    if (pipe(pfd) == -1)
+	err_leave(errno, "Unable to create pipe\n");
+
+    rv = sel_set_fd_handlers(sel, pfd[0], NULL, read_handler, NULL, NULL,
+			     fd_cleared);
+    if (rv)
+	err_leave(rv, "Unable to set read fd handlers\n");
+    rv = sel_set_fd_handlers(sel, pfd[1], NULL, NULL, write_handler, NULL,
+			     fd_cleared);
+    if (rv)
+	err_leave(rv, "Unable to set write fd handlers\n");
+
+    /* Nothing enabled, nothing should happen. */
+    if (write(pfd[1], "a", 1) != 1)
+	err_leave(errno, "write failed\n");
+    wait_none(&reads, "read with the handler disabled");
+
+    /* Enabling the read handler picks up the waiting data. */
+    sel_set_fd_read_handler(sel, pfd[0], SEL_FD_HANDLER_ENABLED);
+    wait_for(&reads, 1, "first read");
+
+    /* The poll is rearmed after each event. */
+    for (i = 2; i < 100; i++) {
+	if (write(pfd[1], "b", 1) != 1)
+	    err_leave(errno, "write failed\n");
+	wait_for(&reads, i, "repeated read");
+    }
+
+    /* Disabling stops it again, even with data waiting. */
+    sel_set_fd_read_handler(sel, pfd[0], SEL_FD_HANDLER_DISABLED);
+    if (write(pfd[1], "c", 1) != 1)
+	err_leave(errno, "write failed\n");
+    wait_none(&reads, "read after disabling");
+    sel_set_fd_read_handler(sel, pfd[0], SEL_FD_HANDLER_ENABLED);
+    wait_for(&reads, 100, "read after reenabling");
+
+    /* A pipe with room in it is writable. */
+    sel_set_fd_write_handler(sel, pfd[1], SEL_FD_HANDLER_ENABLED);
+    wait_for(&writes, 1, "write ready");
+    wait_none(&writes, "write after disabling");
+
+    /* Timers still work while polls are armed. */
+    sel_get_monotonic_time(&now);
+    for (i = 0; i < 10; i++) {
+	rv = sel_alloc_timer(sel, timeout, (void *) (unsigned long) i,
+			     &timers[i]);
+	if (rv)
+	    err_leave(rv, "Unable to allocate timer\n");
+	tv = now;
+	tv.tv_usec += (i + 1) * 10000;
+	tv.tv_sec += tv.tv_usec / 1000000;
+	tv.tv_usec %= 1000000;
+	rv = sel_start_timer(timers[i], &tv);
+	if (rv)
+	    err_leave(rv, "Unable to start timer\n");
+    }
+    wait_for(&fired, 10, "timers");
+    for (i = 0; i < 10; i++)
+	sel_free_timer(timers[i]);
+
+    /* Closing the write end gives a hangup on the read end. */
+    sel_clear_fd_handlers(sel, pfd[1]);
+    wait_for(&cleared, 1, "write fd to be cleared");
+    close(pfd[1]);
+    wait_for(&got_eof, 1, "hangup");
+
+    sel_clear_fd_handlers(sel, pfd[0]);
+    wait_for(&cleared, 2, "read fd to be cleared");
+    close(pfd[0]);
+
+    /* Datagrams through the multishot receive. */
+    rfd = socket(AF_INET, SOCK_DGRAM, 0);
+    sfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (rfd == -1 || sfd == -1)
+	err_leave(errno, "Unable to create sockets\n");
+    memset(&raddr, 0, sizeof(raddr));
+    raddr.sin_family = AF_INET;
+    raddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    saddr = raddr;
+    len = sizeof(raddr);
+    if (bind(rfd, (struct sockaddr *) &raddr, sizeof(raddr)) == -1
+	|| getsockname(rfd, (struct sockaddr *) &raddr, &len) == -1
+	|| bind(sfd, (struct sockaddr *) &saddr, sizeof(saddr)) == -1
+	|| getsockname(sfd, (struct sockaddr *) &saddr, &len) == -1)
+	err_leave(errno, "Unable to bind sockets\n");
+
+    rv = sel_set_fd_handlers(sel, rfd, NULL, read_handler, NULL, NULL,
+			     fd_cleared);
+    if (rv)
+	err_leave(rv, "Unable to set datagram fd handlers\n");
+    rv = sel_set_fd_dgram_handler(sel, rfd, dgram_handler);
+    if (rv == ENOSYS) {
+	printf("multishot receive not available, skipping datagrams\n");
+	goto out;
+    }
+    if (rv)
+	err_leave(rv, "Unable to set datagram handler\n");
+
+    /* Nothing until reading is enabled, then it all comes in order. */
+    send_dgrams(sfd, &raddr, 10);
+    wait_none(&dgrams, "datagram with reading disabled");
+    sel_set_fd_read_handler(sel, rfd, SEL_FD_HANDLER_ENABLED);
+    wait_for(&dgrams, 10, "datagrams");
+    if (dgram_port != ntohs(saddr.sin_port))
+	err_leave(0, "Wrong datagram source port\n");
+
+    /* More than there are buffers, so the receive has to be rearmed. */
+    send_dgrams(sfd, &raddr, 150);
+    wait_for(&dgrams, 160, "datagram burst");
+
+    /* Too big ones are cut down to size. */
+    memset(big, 'x', sizeof(big));
+    if (sendto(sfd, big, sizeof(big), 0, (struct sockaddr *) &raddr,
+	       sizeof(raddr)) == -1)
+	err_leave(errno, "sendto failed\n");
+    wait_for(&dgrams, 161, "big datagram");
+    if (dgram_len != SEL_DGRAM_MAX_LEN)
+	err_leave(0, "Big datagram was %u bytes\n", dgram_len);
+    dgrams = 160;
+
+    /* Disabling cancels the receive, enabling starts it again. */
+    sel_set_fd_read_handler(sel, rfd, SEL_FD_HANDLER_DISABLED);
+    wait_none(&dgrams, "datagram after disabling");
+    sel_set_fd_read_handler(sel, rfd, SEL_FD_HANDLER_ENABLED);
+    send_dgrams(sfd, &raddr, 5);
+    wait_for(&dgrams, 165, "datagrams after reenabling");
+
+    /* Setting the handlers again goes back to the read handler. */
+    rv = sel_set_fd_handlers(sel, rfd, NULL, read_handler, NULL, NULL,
+			     fd_cleared);
+    if (rv)
+	err_leave(rv, "Unable to reset datagram fd handlers\n");
+    wait_for(&cleared, 3, "datagram fd handlers to be replaced");
+    sel_set_fd_read_handler(sel, rfd, SEL_FD_HANDLER_ENABLED);
+    reads = 0;
+    send_dgrams(sfd, &raddr, 1);
+    wait_for(&reads, 1, "read on a datagram fd");
+    if (dgrams != 165)
+	err_leave(0, "Datagram handler called after it was replaced\n");
+
+ out:
+    sel_clear_fd_handlers(sel, rfd);
+    close(rfd);
+    close(sfd);
+
+    sel_free_selector(sel);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * test_wheel.c
+ *
+ * Tests for the selector timing wheel.
+ *
+ * Author: MontaVista Software, Inc.
+ *         Corey Minyard <minyard@mvista.com>
+ *         source@mvista.com
+ *
+ * Copyright 2006 MontaVista Software Inc.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * Lesser General Public License (GPL) Version 2 or the modified BSD
+ * license below.  The following disclamer applies to both licenses:
+ *
+ *  THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ *  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ *  USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * GNU Lesser General Public Licence
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2 of
+ *  the License, or (at your option) any later version.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Modified BSD Licence
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *   3. The name of the author may not be used to endorse or promote
+ *      products derived from this software without specific prior
+ *      written permission.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/time.h>
+#include <OpenIPMI/selector.h>
+
+#define NUM_TIMERS	2000
+#define NUM_LONG	100
+
+struct wtimer {
+    sel_timer_t    *timer;
+    struct timeval timeout;
+    int            running;
+};
+
+static struct wtimer timers[NUM_TIMERS];
+static struct wtimer long_timers[NUM_LONG];
+static unsigned int fired;
+static struct timeval last;
+
+static void
+err_leave(int err, char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    if (err)
+	fprintf(stderr, "error: %s (%d)\n", strerror(err), err);
+    va_end(ap);
+    exit(1);
+}
+
+static int
+cmp_tv(struct timeval *a, struct timeval *b)
+{
+    if (a->tv_sec < b->tv_sec)
+	return -1;
+    if (a->tv_sec > b->tv_sec)
+	return 1;
+    if (a->tv_usec < b->tv_usec)
+	return -1;
+    if (a->tv_usec > b->tv_usec)
+	return 1;
+    return 0;
+}
+
+static void
+add_usec(struct timeval *tv, long usec)
+{
+    tv->tv_usec += usec;
+    tv->tv_sec += tv->tv_usec / 1000000;
+    tv->tv_usec %= 1000000;
+}
+
+static void
+timeout(struct selector_s *sel, sel_timer_t *timer, void *data)
+{
+    struct wtimer  *t = data;
+    struct timeval now;
+
+    sel_get_monotonic_time(&now);
+    if (!t->running)
+	err_leave(0, "Stopped timer fired\n");
+    if (cmp_tv(&now, &t->timeout) < 0)
+	err_leave(0, "Timer fired early\n");
+    if (cmp_tv(&t->timeout, &last) < 0)
+	err_leave(0, "Timer fired out of order\n");
+    last = t->timeout;
+    t->running = 0;
+    fired++;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct selector_s *sel;
+    struct timeval    now, tv;
+    unsigned int      i, expected = 0;
+    int               rv;
+
+    rv = sel_alloc_selector_thread_opts(&sel, 0, NULL, NULL, NULL, NULL,
+					NULL, SEL_OPT_TIMER_WHEEL);
+    if (rv)
+	err_leave(rv, "Unable to allocate selector\n");
+
+    srand(1);
+    sel_get_monotonic_time(&now);
+    for (i = 0; i < NUM_TIMERS; i++) {
+	rv = sel_alloc_timer(sel, timeout, &timers[i], &timers[i].timer);
+	if (rv)
+	    err_leave(rv, "Unable to allocate timer\n");
+	timers[i].timeout = now;
+	add_usec(&timers[i].timeout, rand() % 250000);
+	rv = sel_start_timer(timers[i].timer, &timers[i].timeout);
+	if (rv)
+	    err_leave(rv, "Unable to start timer\n");
+	timers[i].running = 1;
+    }
+
+    /* These are too long for the wheel, they go into the heap. */
+    for (i = 0; i < NUM_LONG; i++) {
+	rv = sel_alloc_timer(sel, timeout, &long_timers[i],
+			     &long_timers[i].timer);
+	if (rv)
+	    err_leave(rv, "Unable to allocate timer\n");
+	long_timers[i].timeout = now;
+	long_timers[i].timeout.tv_sec += 30;
+	add_usec(&long_timers[i].timeout, rand() % 1000000);
+	rv = sel_start_timer(long_timers[i].timer, &long_timers[i].timeout);
+	if (rv)
+	    err_leave(rv, "Unable to start timer\n");
+	long_timers[i].running = 1;
+    }
+
+    /* Stop every third short timer. */
+    for (i = 0; i < NUM_TIMERS; i++) {
+	if (i % 3 == 0) {
+	    rv = sel_stop_timer(timers[i].timer);
+	    if (rv)
+		err_leave(rv, "Unable to stop timer\n");
+	    timers[i].running = 0;
+	} else {
+	    expected++;
+	}
+    }
+
+    for (i = 0; i < NUM_LONG; i++) {
+	rv = sel_stop_timer(long_timers[i].timer);
+	if (rv)
+	    err_leave(rv, "Unable to stop long timer\n");
+	long_timers[i].running = 0;
+    }
+
+    /* Restart one long timer as a short one, it moves to the wheel. */
+    long_timers[0].timeout = now;
+    add_usec(&long_timers[0].timeout, 100000);
+    rv = sel_start_timer(long_timers[0].timer, &long_timers[0].timeout);
+    if (rv)
+	err_leave(rv, "Unable to restart timer\n");
+    long_timers[0].running = 1;
+    expected++;
+
+    while (fired < expected) {
+	sel_get_monotonic_time(&tv);
+	if (tv.tv_sec > now.tv_sec + 5)
+	    err_leave(0, "Timers did not fire, %u of %u\n", fired, expected);
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	sel_select(sel, NULL, 0, NULL, &tv);
+    }
+
+    for (i = 0; i < NUM_TIMERS; i++) {
+	if (timers[i].running)
+	    err_leave(0, "Timer %u did not fire\n", i);
+	sel_free_timer(timers[i].timer);
+    }
+    for (i = 0; i < NUM_LONG; i++)
+	sel_free_timer(long_timers[i].timer);
+
+    sel_free_selector(sel);
+    return 0;
+}
@@ -61,6 +61,19 @@
 
 #define LOCKED_LIST_ENTRIES_INCREMENT 5
 
+/* Snapshot lists need the compiler's atomic builtins.  Without them a
+   snapshot list is just a normal locked list. */
+#ifdef __ATOMIC_SEQ_CST
+#define LL_HAVE_SNAPSHOT 1
+#define ll_atomic_load(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define ll_atomic_store(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define ll_atomic_inc(p) __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST)
+#define ll_atomic_dec(p) __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST)
+#else
+#define ll_atomic_load(p) (*(p))
+#define ll_atomic_store(p, v) (*(p) = (v))
+#endif
+
 struct locked_list_entry_s
 {
     unsigned int destroyed;
@@ -69,6 +82,16 @@ struct locked_list_entry_s
     locked_list_entry_t *dlist_next;
 };
 
+/* An immutable copy of the entries on a snapshot list, iterated
+   without the list lock. */
+typedef struct locked_list_snap_s locked_list_snap_t;
+struct locked_list_snap_s
+{
+    unsigned int        count;
+    locked_list_entry_t **entries;
+    locked_list_snap_t  *retired_next;
+};
+
 struct locked_list_s
 {
     unsigned int        destroyed;
@@ -78,6 +101,21 @@ struct locked_list_s
     unsigned int        count;
     locked_list_entry_t head;
     locked_list_entry_t *destroy_list;
+
+    /* Snapshot list handling.  The linked list above is still the
+       real list and is only touched with the lock held; every change
+       to it publishes a new snapshot in "snap".  Lockless iterators
+       bump "readers" while they use a snapshot.  Replaced snapshots
+       and removed entries go on the retired lists and are freed once
+       "readers" has been seen to be zero after they were retired.
+       If a snapshot cannot be allocated, "snap" is NULL and
+       iterators fall back to the locked walk. */
+    int                 snapshot;
+    locked_list_snap_t  *snap;
+    unsigned int        readers;
+    unsigned int        retired;
+    locked_list_snap_t  *retired_snaps;
+    locked_list_entry_t *retired_entries;
 };
 
 static void
@@ -152,6 +190,97 @@ locked_list_alloc_my_lock(locked_list_lock_cb lock_func,
     return ll;
 }
 
+static void
+ll_free_retired(locked_list_t *ll)
+{
+    locked_list_snap_t  *snap;
+    locked_list_entry_t *entry;
+
+    while (ll->retired_snaps) {
+	snap = ll->retired_snaps;
+	ll->retired_snaps = snap->retired_next;
+	ipmi_mem_free(snap);
+    }
+    while (ll->retired_entries) {
+	entry = ll->retired_entries;
+	ll->retired_entries = entry->dlist_next;
+	ipmi_mem_free(entry);
+    }
+    ll_atomic_store(&ll->retired, 0);
+}
+
+/* Called with the lock held.  Anything retired before the reader
+   count is seen as zero cannot be in use, new readers only see the
+   current snapshot. */
+static void
+ll_reclaim(locked_list_t *ll)
+{
+    if (ll_atomic_load(&ll->retired) && (ll_atomic_load(&ll->readers) == 0))
+	ll_free_retired(ll);
+}
+
+/* Build a new snapshot of the list and publish it.  Called with the
+   lock held after every change to a snapshot list. */
+static void
+ll_publish(locked_list_t *ll)
+{
+    locked_list_snap_t  *snap, *old;
+    locked_list_entry_t *entry;
+    unsigned int        i = 0;
+
+    snap = ipmi_mem_alloc(sizeof(*snap)
+			  + (ll->count * sizeof(locked_list_entry_t *)));
+    if (snap) {
+	snap->entries = (locked_list_entry_t **) (snap + 1);
+	entry = ll->head.next;
+	while (entry != &ll->head) {
+	    if (!entry->destroyed)
+		snap->entries[i++] = entry;
+	    entry = entry->next;
+	}
+	snap->count = i;
+    }
+
+    old = ll->snap;
+    ll_atomic_store(&ll->snap, snap);
+    if (old) {
+	old->retired_next = ll->retired_snaps;
+	ll->retired_snaps = old;
+	ll_atomic_store(&ll->retired, 1);
+    }
+    ll_reclaim(ll);
+}
+
+/* Free an entry that has been unlinked from the list.  Called with
+   the lock held. */
+static void
+ll_free_entry(locked_list_t *ll, locked_list_entry_t *entry)
+{
+    if (!ll->snapshot) {
+	ipmi_mem_free(entry);
+	return;
+    }
+    entry->dlist_next = ll->retired_entries;
+    ll->retired_entries = entry;
+    ll_atomic_store(&ll->retired, 1);
+    ll_reclaim(ll);
+}
+
+locked_list_t *
+locked_list_alloc_snapshot(os_handler_t *os_hnd)
+{
+    locked_list_t *ll;
+
+    ll = locked_list_alloc(os_hnd);
+    if (!ll)
+	return NULL;
+#ifdef LL_HAVE_SNAPSHOT
+    ll->snapshot = 1;
+    ll_publish(ll);
+#endif
+    return ll;
+}
+
 void
 locked_list_destroy(locked_list_t *ll)
 {
@@ -163,6 +292,9 @@ locked_list_destroy(locked_list_t *ll)
 	ipmi_mem_free(entry);
 	entry = next;
     }
+    if (ll->snap)
+	ipmi_mem_free(ll->snap);
+    ll_free_retired(ll);
     if (ll->lock == ll_std_lock)
 	ipmi_destroy_lock(ll->lock_cb_data);
     ipmi_mem_free(ll);
@@ -214,6 +346,8 @@ locked_list_add_entry(locked_list_t *ll, void *item1, void *item2,
     entry->prev->next = entry;
     entry->next->prev = entry;
     ll->count++;
+    if (ll->snapshot)
+	ll_publish(ll);
 
  out_unlock:
     ll->unlock(ll->lock_cb_data);
@@ -251,6 +385,8 @@ locked_list_add_entry_nolock(locked_list_t *ll, void *item1, void *item2,
     entry->prev->next = entry;
     entry->next->prev = entry;
     ll->count++;
+    if (ll->snapshot)
+	ll_publish(ll);
 
  out:
     return rv;
@@ -274,16 +410,21 @@ locked_list_remove_nolock(locked_list_t *ll, void *item1, void *item2)
     } else {
 	rv = 1;
 	ll->count--;
+	ll_atomic_store(&entry->destroyed, 1);
+	if (ll->snapshot) {
+	    /* Take it out of the published snapshot before it can be
+	       retired. */
+	    ll_publish(ll);
+	}
 	if (ll->cb_count) {
 	    /* We are in callbacks, just mark it destroyed and let the
 	       last call back exit clear it up. */
-	    entry->destroyed = 1;
 	    entry->dlist_next = ll->destroy_list;
 	    ll->destroy_list = entry;
 	} else {
 	    entry->next->prev = entry->prev;
 	    entry->prev->next = entry->next;
-	    ipmi_mem_free(entry);
+	    ll_free_entry(ll, entry);
 	}
     }
     return rv;
@@ -345,17 +486,60 @@ locked_list_iterate_prefunc_nolock(locked_list_t          *ll,
 	    ll->destroy_list = entry->dlist_next;
 	    entry->next->prev = entry->prev;
 	    entry->prev->next = entry->next;
-	    ipmi_mem_free(entry);
+	    ll_free_entry(ll, entry);
 	}
     }
 }
 
+#ifdef LL_HAVE_SNAPSHOT
+/* Iterate a snapshot list without taking the lock.  Returns false if
+   there is no snapshot and the caller must do a locked walk. */
+static int
+ll_iterate_snapshot(locked_list_t          *ll,
+		    locked_list_handler_cb handler,
+		    void                   *cb_data)
+{
+    locked_list_snap_t  *snap;
+    locked_list_entry_t *entry;
+    unsigned int        i;
+
+    ll_atomic_inc(&ll->readers);
+    snap = ll_atomic_load(&ll->snap);
+    if (!snap) {
+	ll_atomic_dec(&ll->readers);
+	return 0;
+    }
+
+    for (i=0; i<snap->count; i++) {
+	entry = snap->entries[i];
+	if (ll_atomic_load(&entry->destroyed))
+	    continue;
+	if (handler(cb_data, entry->item1, entry->item2))
+	    break;
+    }
+
+    if ((ll_atomic_dec(&ll->readers) == 0) && ll_atomic_load(&ll->retired)) {
+	ll->lock(ll->lock_cb_data);
+	ll_reclaim(ll);
+	ll->unlock(ll->lock_cb_data);
+    }
+    return 1;
+}
+#endif
+
 void
 locked_list_iterate_prefunc(locked_list_t          *ll,
 			    locked_list_handler_cb prefunc,
 			    locked_list_handler_cb handler,
 			    void                   *cb_data)
 {
+#ifdef LL_HAVE_SNAPSHOT
+    /* The prefunc is documented as running with the lock held, so
+       only a plain iteration can use the snapshot. */
+    if (ll->snapshot && !prefunc && handler
+	&& ll_iterate_snapshot(ll, handler, cb_data))
+	return;
+#endif
     ll->lock(ll->lock_cb_data);
     locked_list_iterate_prefunc_nolock(ll, prefunc, handler, cb_data);
     ll->unlock(ll->lock_cb_data);
@@ -366,6 +550,10 @@ locked_list_iterate(locked_list_t          *ll,
 		    locked_list_handler_cb handler,
 		    void                   *cb_data)
 {
+#ifdef LL_HAVE_SNAPSHOT
+    if (ll->snapshot && handler && ll_iterate_snapshot(ll, handler, cb_data))
+	return;
+#endif
     ll->lock(ll->lock_cb_data);
     locked_list_iterate_prefunc_nolock(ll, NULL, handler, cb_data);
     ll->unlock(ll->lock_cb_data);